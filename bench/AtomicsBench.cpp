@@ -0,0 +1,110 @@
+#include "Atomics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace RISCV;
+
+// Host threads stand in for harts and increment guest words through the A
+// extension layer: AMOADD.W on one shared word, an LR/SC retry loop on one
+// shared word, and AMOADD.W on a word of each hart's own. The total number of
+// increments is fixed, so a flat rate as threads go from 1 to 64 means no
+// serialization beyond the shared cache line itself. Each count is checked
+// at the end. Prints the best rate of several runs, since a shared host is
+// noisy; on a host with fewer cores than threads, this measures
+// oversubscription as well.
+
+constexpr unsigned int MaxHarts = 64;
+constexpr __uint64_t GuestBase = 0x80000000;
+
+using table_t = reservationTable<MaxHarts>;
+
+enum class workload { SharedAMO, SharedLRSC, PrivateAMO };
+
+struct machine {
+    table_t reservations;
+    // A cache line per hart, so private words never share one
+    alignas(64) __uint32_t words[MaxHarts * 16];
+};
+
+void Hart(machine& m, workload kind, unsigned int hart, __uint64_t increments, const std::atomic<bool>& go) {
+    while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    unsigned int index = kind == workload::PrivateAMO ? hart * 16 : 0;
+    __uint64_t physicalAddress = GuestBase + index * sizeof(__uint32_t);
+    __uint32_t* address = &m.words[index];
+    for (__uint64_t i = 0; i < increments; i++) {
+        if (kind == workload::SharedLRSC) {
+            __uint32_t value;
+            do {
+                value = m.reservations.LoadReserved<__uint32_t>(hart, physicalAddress, address, true, false);
+            } while (!m.reservations.StoreConditional<__uint32_t>(hart, physicalAddress, address, value + 1, false, true));
+        } else {
+            m.reservations.AMO<MinorOpcode::AMOADD, __uint32_t>(physicalAddress, address, 1, true, true);
+        }
+    }
+}
+
+// Returns the best time of several runs, or a negative time if a count was off
+double Measure(workload kind, unsigned int harts, __uint64_t total) {
+    constexpr unsigned int runs = 5;
+    double best = 0;
+    for (unsigned int run = 0; run < runs; run++) {
+        auto m = std::make_unique<machine>();
+        m->reservations.Reset();
+        for (__uint32_t& word : m->words)
+            word = 0;
+
+        std::atomic<bool> go(false);
+        std::vector<std::thread> threads;
+        for (unsigned int hart = 0; hart < harts; hart++)
+            threads.emplace_back(Hart, std::ref(*m), kind, hart, total / harts, std::cref(go));
+        auto start = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for (std::thread& thread : threads)
+            thread.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        __uint64_t sum = 0;
+        for (__uint32_t word : m->words)
+            sum += word;
+        if (sum != total / harts * harts)
+            return -1;
+        if (run == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+int main() {
+    constexpr __uint64_t total = 1 << 22;
+    const struct {
+        workload kind;
+        const char* name;
+    } workloads[] = {
+        { workload::SharedAMO, "amoadd.w shared" },
+        { workload::SharedLRSC, "lr/sc shared" },
+        { workload::PrivateAMO, "amoadd.w private" },
+    };
+
+    std::printf("%u host threads available, %llu increments per test\n",
+                std::thread::hardware_concurrency(), (unsigned long long)total);
+    bool ok = true;
+    for (const auto& w : workloads) {
+        std::printf("%s:\n", w.name);
+        for (unsigned int harts = 1; harts <= MaxHarts; harts *= 2) {
+            double seconds = Measure(w.kind, harts, total);
+            if (seconds < 0) {
+                std::printf("  %2u harts: wrong count\n", harts);
+                ok = false;
+                continue;
+            }
+            std::printf("  %2u harts: %.1fM increments/s\n", harts, total / seconds / 1e6);
+        }
+    }
+    return ok ? 0 : 1;
+}
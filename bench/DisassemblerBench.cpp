@@ -0,0 +1,58 @@
+#include "Disassembler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace RISCV;
+
+// Disassembles random valid RV64 instructions, half of them compressed,
+// into a 64 KiB buffer that is drained whenever it fills. Prints the best
+// rate of several runs, since a shared host is noisy.
+
+int main() {
+    constexpr std::size_t count = 1 << 16;
+    constexpr unsigned int repeats = 200;
+    constexpr unsigned int runs = 5;
+
+    std::mt19937 random(1);
+    std::vector<__uint64_t> pcs(count);
+    std::vector<__uint32_t> words(count);
+    __uint64_t pc = 0x80000000;
+    for (std::size_t i = 0; i < count; i++) {
+        __uint32_t word;
+        bool compressed = random() % 2;
+        do {
+            word = compressed ? (random() & 0xffff) : (random() | 0b11);
+        } while ((word & 0b11) == (compressed ? 0b11u : 0) ||
+                 decode<__uint64_t>(compressed ? expandCompressed<__uint64_t>(word) : word).id == InstructionID::INVALID);
+        pcs[i] = pc;
+        words[i] = word;
+        pc += compressed ? 2 : 4;
+    }
+
+    std::vector<char> buffer(1 << 16);
+    double best = 0;
+    std::size_t characters = 0;
+    for (unsigned int run = 0; run < runs; run++) {
+        characters = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int r = 0; r < repeats; r++) {
+            for (std::size_t done = 0; done < count;) {
+                disassemblyResult result = disassemble<__uint64_t>(pcs.data() + done, words.data() + done, count - done,
+                                                                   buffer.data(), buffer.data() + buffer.size());
+                done += result.count;
+                characters += result.end - buffer.data();
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || seconds < best)
+            best = seconds;
+    }
+
+    double instructions = (double)count * repeats;
+    std::printf("disassemble: %.0f instructions, %.1f characters each\n", instructions, characters / instructions);
+    std::printf("  %.1fM instructions/s\n", instructions / best / 1e6);
+    return 0;
+}
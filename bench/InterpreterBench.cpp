@@ -0,0 +1,126 @@
+#include "Interpreter.hpp"
+
+#include "GuestProgram.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+using namespace RISCV;
+
+// Runs small integer kernels in M-mode on RV32 and RV64: a dependent ALU
+// chain, a load-add-store pass over an array, a multiply-heavy hash, and
+// calls to a leaf function. Each kernel loops forever, so Run() decides how
+// long it goes. Prints the best rate of several runs, since a shared host is
+// noisy. Build with -DRISCV_SWITCH_DISPATCH to compare the switch fallback.
+
+namespace kernels {
+
+using namespace encode;
+
+constexpr __uint32_t xor_(unsigned int rd, unsigned int rs1, unsigned int rs2) { return encodeR(MajorOpcode::OP, rd, 4, rs1, rs2, 0); }
+constexpr __uint32_t mul(unsigned int rd, unsigned int rs1, unsigned int rs2) { return encodeR(MajorOpcode::OP, rd, 0, rs1, rs2, 1); }
+constexpr __uint32_t slli(unsigned int rd, unsigned int rs1, unsigned int shamt) { return encodeI(MajorOpcode::OP_IMM, rd, 1, rs1, (__int32_t)shamt); }
+constexpr __uint32_t jalr(unsigned int rd, unsigned int rs1, __int32_t imm) { return encodeI(MajorOpcode::JALR, rd, 0, rs1, imm); }
+
+guestProgram alu() {
+    guestProgram program;
+    program << addi(10, 0, 1000)
+            << addi(5, 0, 0)            // +4
+            << addi(5, 5, 1)            // +8: loop
+            << add(6, 6, 5)
+            << xor_(7, 7, 6)
+            << slli(8, 7, 3)
+            << add(7, 7, 8)
+            << branch(1, 5, 10, -20)    // bne loop
+            << jal(0, -28);             // to +4
+    return program;
+}
+
+guestProgram memory() {
+    guestProgram program;
+    program << auipc(10, 0x1000)        // x10 = 500 words of data
+            << addi(11, 10, 0)          // +4
+            << addi(12, 10, 2000)
+            << load(2, 13, 11, 0)       // +12: loop, lw
+            << add(14, 14, 13)
+            << store(2, 11, 14, 0)      // sw
+            << addi(11, 11, 4)
+            << branch(1, 11, 12, -16)   // bne loop
+            << jal(0, -28);             // to +4
+    return program;
+}
+
+guestProgram multiply() {
+    guestProgram program;
+    program << addi(10, 0, 1103)
+            << addi(5, 0, 0)            // +4
+            << addi(6, 0, 1000)
+            << mul(7, 7, 10)            // +12: loop
+            << addi(7, 7, 1234)
+            << addi(5, 5, 1)
+            << branch(1, 5, 6, -12)     // bne loop
+            << jal(0, -24);             // to +4
+    return program;
+}
+
+guestProgram calls() {
+    guestProgram program;
+    program << addi(5, 0, 0)
+            << addi(6, 0, 1000)
+            << jal(1, 16)               // +8: loop, call +24
+            << addi(5, 5, 1)
+            << branch(1, 5, 6, -8)      // bne loop
+            << jal(0, -20)              // to +0
+            << add(7, 7, 5)             // +24: leaf
+            << jalr(0, 1, 0);           // ret
+    return program;
+}
+
+} // namespace kernels
+
+template<typename XLEN_t>
+void Measure(const char* name, const guestProgram& program) {
+    constexpr __uint64_t steps = 20000000;
+    constexpr unsigned int runs = 5;
+
+    double best = 0;
+    __uint64_t retired = 0;
+    __uint64_t traps = 0;
+    for (unsigned int run = 0; run < runs; run++) {
+        flatMemory memory;
+        program.Load(memory);
+        auto hart = std::make_unique<HartState<XLEN_t>>(isaFeatures("rv64imacsu") & 0x3ffffff);
+        hart->Reset((XLEN_t)GuestBase);
+        auto cpu = std::make_unique<interpreter<XLEN_t, flatMemory>>(*hart, memory);
+        cpu->Reset();
+
+        auto start = std::chrono::steady_clock::now();
+        retired = cpu->Run(steps);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        traps = cpu->trapsTaken;
+        if (run == 0 || seconds < best)
+            best = seconds;
+    }
+
+    std::printf("%s rv%u: %llu instructions, %llu traps\n", name, (unsigned int)sizeof(XLEN_t) * 8,
+                (unsigned long long)retired, (unsigned long long)traps);
+    std::printf("  %.1f MIPS\n", retired / best / 1e6);
+}
+
+int main() {
+    const struct {
+        const char* name;
+        guestProgram program;
+    } workloads[] = {
+        { "alu", kernels::alu() },
+        { "memory", kernels::memory() },
+        { "multiply", kernels::multiply() },
+        { "calls", kernels::calls() },
+    };
+    for (const auto& workload : workloads) {
+        Measure<__uint32_t>(workload.name, workload.program);
+        Measure<__uint64_t>(workload.name, workload.program);
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "NameLookup.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string_view>
+#include <vector>
+
+using namespace RISCV;
+
+// Looks up every trap, register and CSR name, in shuffled order, through the
+// perfect hash tables and through a linear scan of the same names. The sets
+// grow from tens to hundreds of names; the hash should cost the same for
+// each while the scan grows with the set. Hashing reads the whole name, so
+// the long trap names cost more per lookup than the short register names.
+// Prints the best time of several runs, since a shared host is noisy.
+
+constexpr unsigned int lookups = 1 << 22;
+constexpr unsigned int runs = 5;
+
+template<typename Lookup>
+double Measure(const std::vector<std::string_view>& queries, Lookup lookup, unsigned int& checksum) {
+    double best = 0;
+    for (unsigned int run = 0; run < runs; run++) {
+        checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < lookups; i++)
+            checksum += lookup(queries[i % queries.size()]);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+// key() folds a looked up value into the checksum that both methods must agree on
+template<typename Value, std::size_t N, typename Lookup, typename Key>
+bool Compare(const char* name, const std::array<detail::nameEntry<Value>, N>& entries, Lookup lookup, Key key) {
+    std::vector<std::string_view> queries;
+    std::size_t characters = 0;
+    for (const detail::nameEntry<Value>& entry : entries) {
+        queries.push_back(entry.name);
+        characters += queries.back().size();
+    }
+    std::shuffle(queries.begin(), queries.end(), std::mt19937(1));
+
+    unsigned int hashed;
+    double hashSeconds = Measure(queries, [&](std::string_view query) { return key(lookup(query)); }, hashed);
+    unsigned int scanned;
+    double scanSeconds = Measure(queries, [&](std::string_view query) {
+        for (const detail::nameEntry<Value>& entry : entries)
+            if (entry.name == query)
+                return key(entry.value);
+        return 0u;
+    }, scanned);
+
+    std::printf("%s: %zu names, %.1f characters each\n", name, N, (double)characters / N);
+    std::printf("  perfect hash %.1f ns, linear scan %.1f ns per lookup\n",
+                hashSeconds / lookups * 1e9, scanSeconds / lookups * 1e9);
+    return hashed == scanned;
+}
+
+int main() {
+    bool ok = true;
+    ok = Compare("traps", detail::getTrapNameEntries(), trapFromName,
+                 [](trapIdentity trap) { return (unsigned int)trap.cause * 2 + trap.interrupt; }) && ok;
+    ok = Compare("registers", detail::getRegisterNameEntries(), regNumFromName,
+                 [](unsigned int reg) { return reg; }) && ok;
+    ok = Compare("CSRs", detail::getCSRNameEntries(), csrAddressFromName,
+                 [](CSRAddress address) { return (unsigned int)address; }) && ok;
+    return ok ? 0 : 1;
+}
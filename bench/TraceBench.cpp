@@ -0,0 +1,74 @@
+#include "Trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace RISCV;
+
+// Encodes a synthetic RV64 trace: every instruction writes back a register,
+// one in eight jumps somewhere else, and one in 4096 traps. Prints the rate
+// at which trace bytes are produced. The output goes to /dev/null unless a
+// path is given, so by default this measures encoding rather than the disk.
+
+struct step {
+    __uint64_t pc;
+    __uint32_t word;
+    unsigned int reg;
+    __uint64_t value;
+};
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "/dev/null";
+    constexpr unsigned int steps = 1 << 16;
+    constexpr unsigned int repeats = 200;
+
+    std::mt19937_64 random(1);
+    std::vector<step> program(steps);
+    __uint64_t pc = 0x80000000;
+    for (step& s : program) {
+        if (random() % 8 == 0)
+            pc += ((__int64_t)(random() % 4096) - 2048) & ~1ull;
+        bool compressed = random() % 2;
+        s.pc = pc;
+        s.word = compressed ? 0x4501 : 0x00a50513;
+        pc += compressed ? 2 : 4;
+        s.reg = 1 + random() % 31;
+        // Mostly small values, some addresses and some full-width ones
+        unsigned int kind = random() % 4;
+        s.value = kind < 2 ? random() % 256 : kind == 2 ? 0x80000000 + random() % 0x100000 : random();
+    }
+
+    // The best of several runs, since a shared host is noisy
+    constexpr unsigned int runs = 5;
+    double best = 0;
+    __uint64_t bytes = 0;
+    bool ok = true;
+    for (unsigned int run = 0; run < runs; run++) {
+        traceWriter<__uint64_t> writer;
+        if (!writer.Open(path)) {
+            std::printf("Can't open %s\n", path);
+            return 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int r = 0; r < repeats; r++) {
+            for (unsigned int i = 0; i < steps; i++) {
+                const step& s = program[i];
+                writer.Instruction(s.pc, s.word);
+                writer.Writeback(s.reg, s.value);
+                if (i % 4096 == 4095)
+                    writer.Trap(false, TrapCause::ECALL_FROM_U_MODE, PrivilegeMode::User, PrivilegeMode::Machine);
+            }
+        }
+        bytes = writer.fileOffset + (writer.out - writer.blockStart);
+        ok = writer.Close() && ok;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || seconds < best)
+            best = seconds;
+    }
+
+    double instructions = (double)steps * repeats;
+    std::printf("traceWriter: %.0f instructions, %.2f bytes each\n", instructions, bytes / instructions);
+    std::printf("  %.2f GB/s, %.1fM instructions/s\n", bytes / best / 1e9, instructions / best / 1e6);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+#include <cstddef>
+#include <thread>
+
+namespace RISCV {
+
+// -- Host atomics for the A extension --
+
+// For harts that run on their own host threads and share guest memory
+// through host pointers. Each AMO becomes one lock-free host atomic RMW of
+// the same width. The aq and rl bits become its memory order. MIN and MAX
+// have no host instruction and are a compare-and-swap loop.
+//
+// LR/SC uses a reservationTable: a version number per guest cache line,
+// hashed into a fixed number of slots, plus one reservation per hart.
+//  - Every store to guest memory, from any hart, bumps its line's version by
+//    two after writing (OnStore()). AMOs do this themselves.
+//  - LR records the line's version and the value it loaded.
+//  - SC claims the line by swapping its version from the recorded one to the
+//    next odd number. It then swaps the stored value in against the one LR
+//    loaded, and releases the line with another increment.
+// SC fails if the line was written, or claimed by another SC, at any point
+// since the LR. No lock is held beyond the few instructions of a successful
+// SC. An LR that finds its line claimed spins briefly, then yields the host
+// thread, since the claiming hart may have been preempted. A hash collision or an unrelated store to the same line only causes
+// a spurious failure, which the ISA allows.
+
+// aq and rl together are sequentially consistent under RVWMO
+constexpr int amoMemoryOrder(bool aq, bool rl) {
+    return aq && rl ? __ATOMIC_SEQ_CST : aq ? __ATOMIC_ACQUIRE : rl ? __ATOMIC_RELEASE : __ATOMIC_RELAXED;
+}
+
+// Host loads and stores cannot take every order. LR.rl and SC.aq are
+// promoted to sequentially consistent, which is stronger than asked.
+constexpr int amoLoadOrder(bool aq, bool rl) {
+    return rl ? __ATOMIC_SEQ_CST : aq ? __ATOMIC_ACQUIRE : __ATOMIC_RELAXED;
+}
+
+constexpr int amoStoreOrder(bool aq, bool rl) {
+    return aq ? __ATOMIC_SEQ_CST : rl ? __ATOMIC_RELEASE : __ATOMIC_RELAXED;
+}
+
+// The failure order of a compare-and-swap may not release
+constexpr int amoFailureOrder(int order) {
+    return order == __ATOMIC_RELEASE ? __ATOMIC_RELAXED : order == __ATOMIC_ACQ_REL ? __ATOMIC_ACQUIRE : order;
+}
+
+template<AmoWidth width>
+using amoType = std::conditional_t<width == AmoWidth::AMO_W, __uint32_t, __uint64_t>;
+
+namespace detail {
+
+inline void spinPause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+constexpr unsigned int SpinsBeforeYield = 64;
+
+// Spins briefly, then gives up the host CPU, in case whoever holds what is
+// being waited for has been preempted
+inline void spinWait(unsigned int& spins) {
+    if (spins < SpinsBeforeYield) {
+        spins++;
+        spinPause();
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+template<typename T, bool maximum, bool isSigned>
+T amoMinMax(T* address, T operand, int order) {
+    using C = std::conditional_t<isSigned, std::make_signed_t<T>, T>;
+    T old = __atomic_load_n(address, __ATOMIC_RELAXED);
+    while (true) {
+        T result = maximum ? ((C)old > (C)operand ? old : operand) : ((C)old < (C)operand ? old : operand);
+        // Written back even when memory already holds the result. A load and
+        // a fence would let earlier stores pass the load, which the release
+        // half of the AMO forbids.
+        if (__atomic_compare_exchange_n(address, &old, result, true, order, amoFailureOrder(order)))
+            return old;
+    }
+}
+
+} // namespace detail
+
+// Performs an AMO on host memory and returns the old value, not sign
+// extended. LR and SC are not AMOs here; see reservationTable.
+template<MinorOpcode op, typename T>
+T atomicMemoryOperation(T* address, T operand, int order) {
+    static_assert(__atomic_always_lock_free(sizeof(T), 0), "AMOs of this width are not lock-free on the host");
+    if constexpr (op == MinorOpcode::AMOSWAP)
+        return __atomic_exchange_n(address, operand, order);
+    else if constexpr (op == MinorOpcode::AMOADD)
+        return __atomic_fetch_add(address, operand, order);
+    else if constexpr (op == MinorOpcode::AMOXOR)
+        return __atomic_fetch_xor(address, operand, order);
+    else if constexpr (op == MinorOpcode::AMOAND)
+        return __atomic_fetch_and(address, operand, order);
+    else if constexpr (op == MinorOpcode::AMOOR)
+        return __atomic_fetch_or(address, operand, order);
+    else if constexpr (op == MinorOpcode::AMOMIN)
+        return detail::amoMinMax<T, false, true>(address, operand, order);
+    else if constexpr (op == MinorOpcode::AMOMAX)
+        return detail::amoMinMax<T, true, true>(address, operand, order);
+    else if constexpr (op == MinorOpcode::AMOMINU)
+        return detail::amoMinMax<T, false, false>(address, operand, order);
+    else if constexpr (op == MinorOpcode::AMOMAXU)
+        return detail::amoMinMax<T, true, false>(address, operand, order);
+    else
+        static_assert(op == MinorOpcode::AMOSWAP, "Not an AMO");
+}
+
+// The same, for an op taken from funct5 at run time. Returns false for
+// funct5 values that are not AMOs, including LR and SC.
+template<typename T>
+bool atomicMemoryOperation(unsigned int funct5, T* address, T operand, int order, T& old) {
+    switch (funct5) {
+    case MinorOpcode::AMOSWAP: old = atomicMemoryOperation<MinorOpcode::AMOSWAP>(address, operand, order); return true;
+    case MinorOpcode::AMOADD:  old = atomicMemoryOperation<MinorOpcode::AMOADD>(address, operand, order); return true;
+    case MinorOpcode::AMOXOR:  old = atomicMemoryOperation<MinorOpcode::AMOXOR>(address, operand, order); return true;
+    case MinorOpcode::AMOAND:  old = atomicMemoryOperation<MinorOpcode::AMOAND>(address, operand, order); return true;
+    case MinorOpcode::AMOOR:   old = atomicMemoryOperation<MinorOpcode::AMOOR>(address, operand, order); return true;
+    case MinorOpcode::AMOMIN:  old = atomicMemoryOperation<MinorOpcode::AMOMIN>(address, operand, order); return true;
+    case MinorOpcode::AMOMAX:  old = atomicMemoryOperation<MinorOpcode::AMOMAX>(address, operand, order); return true;
+    case MinorOpcode::AMOMINU: old = atomicMemoryOperation<MinorOpcode::AMOMINU>(address, operand, order); return true;
+    case MinorOpcode::AMOMAXU: old = atomicMemoryOperation<MinorOpcode::AMOMAXU>(address, operand, order); return true;
+    default: return false;
+    }
+}
+
+// -- LR/SC reservations --
+
+constexpr unsigned int ReservationLineShift = 6;
+
+// One hart's reservation, on its own cache line so harts never share one
+struct alignas(64) hartReservation {
+    bool valid;
+    unsigned int width;         // bytes
+    __uint64_t address;         // guest physical
+    __uint64_t version;         // of the line at LR time, always even
+    __uint64_t value;           // what LR loaded, zero extended
+};
+
+template<unsigned int Harts, unsigned int Slots = 1024>
+struct reservationTable {
+
+    static_assert((Slots & (Slots - 1)) == 0, "Slot count must be a power of two");
+
+    // Padded so stores to lines in different slots never contend
+    struct alignas(64) lineVersion {
+        __uint64_t version;
+    };
+
+    std::array<lineVersion, Slots> lines;
+    std::array<hartReservation, Harts> reservations;
+
+    // Not thread safe; call before any hart runs
+    void Reset() {
+        for (lineVersion& line : lines)
+            line.version = 0;
+        for (hartReservation& reservation : reservations)
+            reservation.valid = false;
+    }
+
+    static unsigned int Slot(__uint64_t physicalAddress) {
+        __uint64_t line = physicalAddress >> ReservationLineShift;
+        return (line ^ (line >> 16)) & (Slots - 1);
+    }
+
+    // Call after every guest store, from any hart, to break reservations on
+    // the lines it wrote. AMO() does this itself.
+    void OnStore(__uint64_t physicalAddress, unsigned int size) {
+        unsigned int first = Slot(physicalAddress);
+        unsigned int last = Slot(physicalAddress + size - 1);
+        __atomic_fetch_add(&lines[first].version, 2, __ATOMIC_RELEASE);
+        if (last != first)
+            __atomic_fetch_add(&lines[last].version, 2, __ATOMIC_RELEASE);
+    }
+
+    // Drops a hart's reservation, as trap entry and xRET may
+    void Clear(unsigned int hart) {
+        reservations[hart].valid = false;
+    }
+
+    template<typename T>
+    T LoadReserved(unsigned int hart, __uint64_t physicalAddress, T* address, bool aq, bool rl) {
+        __uint64_t* version = &lines[Slot(physicalAddress)].version;
+        __uint64_t seen;
+        unsigned int spins = 0;
+        // An odd version is an SC midway through its write
+        while ((seen = __atomic_load_n(version, __ATOMIC_ACQUIRE)) & 1)
+            detail::spinWait(spins);
+        T value = __atomic_load_n(address, amoLoadOrder(aq, rl));
+        reservations[hart] = { true, sizeof(T), physicalAddress, seen, value };
+        return value;
+    }
+
+    // Returns whether the store happened. The reservation is gone either way.
+    template<typename T>
+    bool StoreConditional(unsigned int hart, __uint64_t physicalAddress, T* address, T value, bool aq, bool rl) {
+        hartReservation& reservation = reservations[hart];
+        bool valid = reservation.valid;
+        reservation.valid = false;
+        if (!valid || reservation.address != physicalAddress || reservation.width != sizeof(T))
+            return false;
+
+        __uint64_t* version = &lines[Slot(physicalAddress)].version;
+        __uint64_t expected = reservation.version;
+        if (!__atomic_compare_exchange_n(version, &expected, expected + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return false;
+
+        // A store can land before its version bump, so the value is checked
+        // as well. Only a store of the very value LR saw can slip past both.
+        T loaded = (T)reservation.value;
+        int order = amoStoreOrder(aq, rl);
+        bool stored = __atomic_compare_exchange_n(address, &loaded, value, false,
+                                                  order == __ATOMIC_RELAXED ? __ATOMIC_RELAXED : __ATOMIC_SEQ_CST,
+                                                  __ATOMIC_RELAXED);
+        __atomic_fetch_add(version, 1, __ATOMIC_RELEASE);
+        return stored;
+    }
+
+    template<MinorOpcode op, typename T>
+    T AMO(__uint64_t physicalAddress, T* address, T operand, bool aq, bool rl) {
+        T old = atomicMemoryOperation<op>(address, operand, amoMemoryOrder(aq, rl));
+        OnStore(physicalAddress, sizeof(T));
+        return old;
+    }
+};
+
+} // namespace RISCV
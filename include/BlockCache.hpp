@@ -0,0 +1,313 @@
+#pragma once
+
+#include "RiscV.hpp"
+#include "Decoder.hpp"
+#include "Compressed.hpp"
+#include "PageTableWalker.hpp"
+
+namespace RISCV {
+
+// -- Predecoded basic blocks --
+
+// A block is a run of instructions decoded once into predecodedOps. Each op
+// carries the handler index (its InstructionID) and its operands already
+// pulled out of the encoding, so the interpreter's inner loop never looks at
+// instruction bits. Compressed instructions are expanded first and differ
+// from their 32-bit forms only in length.
+//
+// A block ends after the first BRANCH, JAL, JALR, SYSTEM or MISC_MEM
+// instruction, after an instruction that does not decode, at the end of its
+// page, or at MaxBlockInstructions. Blocks never cross a page, so every
+// block lives on exactly one physical code page. An instruction that
+// straddles a page boundary is never part of a block, and the caller has to
+// step it on its slow path.
+//
+// Instruction memory is read through an accessor providing
+//
+//     bool Read(__uint64_t physicalAddress, __uint16_t& value);
+//
+// in the style of the page table walker's memory accessor.
+//
+// The cache is direct mapped on the block's tag pc and mode. Blocks can be
+// tagged by physical pc or, where the caller prefers to skip translation on
+// a hit, by virtual pc. Invalidation:
+//  - FENCE.I drops every block, by bumping an epoch.
+//  - OnSatpWrite() drops every virtually tagged block, by bumping a second
+//    epoch.
+//  - OnStore() drops the blocks on a written code page. Blocks are chained
+//    into a list per hashed code page, so a store to a page with no cached
+//    code costs one load, and one to a code page visits only the blocks
+//    sharing its list.
+
+struct predecodedOp {
+    InstructionID id;
+    __uint8_t rd;
+    __uint8_t rs1;          // also the uimm of CSR immediate forms
+    __uint8_t rs2;
+    __uint8_t length;       // 2 or 4
+    __int32_t imm;          // immediate, shift amount, CSR address, fence sets or aq/rl
+};
+
+struct blockCacheStats {
+    __uint64_t hits;
+    __uint64_t misses;
+    __uint64_t evictions;
+    __uint64_t invalidations;   // blocks dropped by stores to code pages
+    __uint64_t fences;          // FENCE.I flushes
+    __uint64_t satpFlushes;
+};
+
+// Mode a block was decoded for. Different privileges see different code on
+// virtually tagged blocks, and UXL/SXL changes change the decoding.
+constexpr __uint8_t blockMode(PrivilegeMode privilege, XlenMode xlen) {
+    return (__uint8_t)(privilege | (xlen << 2));
+}
+
+// Whether a (32-bit or expanded) instruction ends a block
+constexpr bool endsBlock(__uint32_t encodedInstruction) {
+    switch ((encodedInstruction >> 2) & 0x1f) {
+    case MajorOpcode::BRANCH:
+    case MajorOpcode::JAL:
+    case MajorOpcode::JALR:
+    case MajorOpcode::SYSTEM:
+    case MajorOpcode::MISC_MEM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+template<typename XLEN_t, isaFeatureSet features = allFeatures>
+constexpr predecodedOp predecode(__uint32_t encodedInstruction, unsigned int length) {
+    constexpr unsigned int shamtMask = std::is_same<XLEN_t, __uint32_t>() ? 0x1f : 0x3f;
+    DecodedInstruction decoded = decode<XLEN_t, features>(encodedInstruction);
+    predecodedOp op = {
+        decoded.id,
+        (__uint8_t)rdField(encodedInstruction),
+        (__uint8_t)rs1Field(encodedInstruction),
+        (__uint8_t)rs2Field(encodedInstruction),
+        (__uint8_t)length,
+        0
+    };
+    switch (decoded.format) {
+    case OperandFormat::I:
+    case OperandFormat::IMem:
+        op.imm = immI(encodedInstruction);
+        break;
+    case OperandFormat::IShift:
+        op.imm = rs2Field(encodedInstruction) | (((encodedInstruction >> 25) & 1) << 5);
+        op.imm &= shamtMask;
+        break;
+    case OperandFormat::S:
+        op.imm = immS(encodedInstruction);
+        break;
+    case OperandFormat::B:
+        op.imm = immB(encodedInstruction);
+        break;
+    case OperandFormat::U:
+        op.imm = immU(encodedInstruction);
+        break;
+    case OperandFormat::J:
+        op.imm = immJ(encodedInstruction);
+        break;
+    case OperandFormat::CSR:
+    case OperandFormat::CSRImm:
+        op.imm = csrField(encodedInstruction);
+        break;
+    case OperandFormat::Fence:
+        op.imm = (encodedInstruction >> 20) & 0xff;
+        break;
+    case OperandFormat::Atomic:
+    case OperandFormat::LoadReserved:
+        op.imm = (encodedInstruction >> 25) & 0b11;
+        break;
+    default:
+        break;
+    }
+    return op;
+}
+
+template<unsigned int MaxBlockInstructions>
+struct predecodedBlock {
+    __uint64_t pc;              // tag: physical or virtual pc of the first instruction
+    __uint64_t page;            // physical page number the code lives on
+    __uint32_t epoch;
+    __uint32_t virtualEpoch;    // only checked for virtually tagged blocks
+    __uint8_t mode;
+    bool virtuallyTagged;
+    __uint16_t count;
+    __uint16_t bytes;
+    __uint32_t nextOnPage;      // links in the cache's per-page block lists
+    __uint32_t previousOnPage;
+    std::array<predecodedOp, MaxBlockInstructions> ops;
+};
+
+template<typename XLEN_t, isaFeatureSet features = allFeatures,
+         unsigned int Entries = 1024, unsigned int MaxBlockInstructions = 32, unsigned int FilterSlots = 4096>
+struct blockCache {
+
+    static_assert((Entries & (Entries - 1)) == 0, "Entry count must be a power of two");
+    static_assert((FilterSlots & (FilterSlots - 1)) == 0, "Filter slot count must be a power of two");
+
+    using block = predecodedBlock<MaxBlockInstructions>;
+
+    constexpr static __uint32_t NoBlock = ~(__uint32_t)0;
+
+    std::array<block, Entries> blocks;
+    std::array<__uint32_t, FilterSlots> codePageBlocks;     // first valid block per hashed code page
+    __uint32_t epoch;
+    __uint32_t virtualEpoch;
+    blockCacheStats stats;
+
+    void Reset() {
+        // Epoch 0 marks empty slots and is never current
+        for (block& b : blocks)
+            b.epoch = 0;
+        epoch = 1;
+        virtualEpoch = 1;
+        codePageBlocks.fill(NoBlock);
+        stats = {};
+    }
+
+    static unsigned int Index(__uint64_t pc) {
+        return (pc >> 1) & (Entries - 1);
+    }
+
+    static unsigned int FilterSlot(__uint64_t page) {
+        return (page ^ (page >> 12)) & (FilterSlots - 1);
+    }
+
+    bool Valid(const block& b) const {
+        return b.epoch == epoch && (!b.virtuallyTagged || b.virtualEpoch == virtualEpoch);
+    }
+
+    const block* Lookup(__uint64_t pc, __uint8_t mode) {
+        const block& b = blocks[Index(pc)];
+        if (b.pc == pc && b.mode == mode && Valid(b)) {
+            stats.hits++;
+            return &b;
+        }
+        stats.misses++;
+        return nullptr;
+    }
+
+    // Decodes and caches the block starting at physicalPc. pc is the tag,
+    // equal to physicalPc unless virtuallyTagged. Returns nullptr if not
+    // even the first instruction could be fetched whole from the page.
+    template<typename Memory>
+    const block* Build(Memory& memory, __uint64_t pc, __uint64_t physicalPc, __uint8_t mode, bool virtuallyTagged) {
+
+        const unsigned int index = Index(pc);
+        block& b = blocks[index];
+        if (b.epoch == epoch) {
+            stats.evictions++;
+            Forget(index);
+            b.epoch = 0;
+        }
+
+        const __uint64_t pageEnd = (physicalPc | (PageSize - 1)) + 1;
+        __uint64_t address = physicalPc;
+        unsigned int count = 0;
+        while (count < MaxBlockInstructions && address + 2 <= pageEnd) {
+            __uint16_t low;
+            if (!memory.Read(address, low))
+                break;
+            __uint32_t encoded = low;
+            unsigned int length = 2;
+            if (isCompressed(low)) {
+                encoded = featureSetHas(features, 'C') ? expandCompressed<XLEN_t>(low) : IllegalExpansion;
+            } else {
+                __uint16_t high;
+                if (address + 4 > pageEnd || !memory.Read(address + 2, high))
+                    break;
+                encoded |= (__uint32_t)high << 16;
+                length = 4;
+            }
+            b.ops[count++] = predecode<XLEN_t, features>(encoded, length);
+            address += length;
+            if (endsBlock(encoded) || b.ops[count - 1].id == InstructionID::INVALID)
+                break;
+        }
+
+        if (count == 0)
+            return nullptr;
+        b.count = count;
+        b.pc = pc;
+        b.page = physicalPc >> PageShift;
+        b.epoch = epoch;
+        b.virtualEpoch = virtualEpoch;
+        b.mode = mode;
+        b.virtuallyTagged = virtuallyTagged;
+        b.bytes = (__uint16_t)(address - physicalPc);
+        Link(index);
+        return &b;
+    }
+
+    // -- Invalidation hooks --
+
+    void OnFenceI() {
+        stats.fences++;
+        epoch++;
+        codePageBlocks.fill(NoBlock);
+    }
+
+    // Virtually tagged blocks dropped here stay on their page lists until
+    // they are evicted or the next FENCE.I. That only lengthens a few walks.
+    void OnSatpWrite() {
+        stats.satpFlushes++;
+        virtualEpoch++;
+    }
+
+    // Call for every store, with its physical address. Stores to pages with
+    // no cached code cost one load and compare.
+    void OnStore(__uint64_t physicalAddress, unsigned int size) {
+        __uint64_t firstPage = physicalAddress >> PageShift;
+        __uint64_t lastPage = (physicalAddress + size - 1) >> PageShift;
+        if (__builtin_expect(codePageBlocks[FilterSlot(firstPage)] == NoBlock &&
+                             codePageBlocks[FilterSlot(lastPage)] == NoBlock, 1))
+            return;
+        DropPage(firstPage);
+        if (lastPage != firstPage)
+            DropPage(lastPage);
+    }
+
+private:
+
+    // Every block on a list has the current epoch: FENCE.I empties the
+    // lists, and eviction and invalidation unlink before clearing the epoch.
+    void Link(unsigned int index) {
+        block& b = blocks[index];
+        __uint32_t& head = codePageBlocks[FilterSlot(b.page)];
+        b.previousOnPage = NoBlock;
+        b.nextOnPage = head;
+        if (head != NoBlock)
+            blocks[head].previousOnPage = index;
+        head = index;
+    }
+
+    void Forget(unsigned int index) {
+        block& b = blocks[index];
+        if (b.previousOnPage != NoBlock)
+            blocks[b.previousOnPage].nextOnPage = b.nextOnPage;
+        else
+            codePageBlocks[FilterSlot(b.page)] = b.nextOnPage;
+        if (b.nextOnPage != NoBlock)
+            blocks[b.nextOnPage].previousOnPage = b.previousOnPage;
+    }
+
+    void DropPage(__uint64_t page) {
+        __uint32_t index = codePageBlocks[FilterSlot(page)];
+        while (index != NoBlock) {
+            block& b = blocks[index];
+            __uint32_t next = b.nextOnPage;
+            if (b.page == page) {
+                Forget(index);
+                b.epoch = 0;
+                stats.invalidations++;
+            }
+            index = next;
+        }
+    }
+};
+
+} // namespace RISCV
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace RISCV {
+
+// -- Bulk instruction-boundary scanning --
+
+// Finding instruction starts is inherently serial: where one instruction
+// starts depends on the length of the one before it. The scanner splits the
+// work so the serial part is cheap. First, 32 parcels at a time are
+// classified in parallel into "wide" (not compressed) and "extended" (48 bits
+// or longer) masks. Then, for chunks with no extended parcels, the serial
+// walk runs eight parcels per table lookup. Chunks that contain an extended
+// parcel (possibly just immediate bits that look like one) fall back to
+// walking instructionLength() parcel by parcel.
+
+namespace detail {
+
+struct BoundaryStep {
+    __uint8_t starts;   // parcels within the byte that begin an instruction
+    __uint8_t carry;    // parcels the last instruction spills into the next byte
+};
+
+constexpr std::array<BoundaryStep, 512> buildBoundaryStepTable() {
+    std::array<BoundaryStep, 512> table = {};
+    for (unsigned int carry = 0; carry < 2; carry++) {
+        for (unsigned int wide = 0; wide < 256; wide++) {
+            unsigned int parcel = carry;
+            unsigned int starts = 0;
+            while (parcel < 8) {
+                starts |= 1 << parcel;
+                parcel += ((wide >> parcel) & 1) ? 2 : 1;
+            }
+            table[(carry << 8) | wide] = { (__uint8_t)starts, (__uint8_t)(parcel - 8) };
+        }
+    }
+    return table;
+}
+
+constexpr std::array<BoundaryStep, 512> boundaryStepTable = buildBoundaryStepTable();
+
+constexpr unsigned int ParcelsPerChunk = 32;
+
+inline __uint16_t loadParcel(const __uint8_t* code) {
+    return code[0] | (code[1] << 8);
+}
+
+inline void classifyParcels(const __uint8_t* code, std::size_t parcels, __uint32_t& wide, __uint32_t& extended) {
+    wide = 0;
+    extended = 0;
+    for (std::size_t i = 0; i < parcels; i++) {
+        __uint16_t parcel = loadParcel(code + (2 * i));
+        wide |= (__uint32_t)((parcel & 0x03) == 0x03) << i;
+        extended |= (__uint32_t)((parcel & 0x1f) == 0x1f) << i;
+    }
+}
+
+#if defined(__AVX2__)
+
+inline __uint32_t parcelMask32(__m256i lo, __m256i hi, __m256i fieldMask) {
+    __m256i matchLo = _mm256_cmpeq_epi16(_mm256_and_si256(lo, fieldMask), fieldMask);
+    __m256i matchHi = _mm256_cmpeq_epi16(_mm256_and_si256(hi, fieldMask), fieldMask);
+    // Packing interleaves the 128-bit lanes; the permute puts parcels back in order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(matchLo, matchHi), 0xd8);
+    return (__uint32_t)_mm256_movemask_epi8(packed);
+}
+
+inline void classifyChunk(const __uint8_t* code, __uint32_t& wide, __uint32_t& extended) {
+    __m256i lo = _mm256_loadu_si256((const __m256i*)code);
+    __m256i hi = _mm256_loadu_si256((const __m256i*)(code + 32));
+    wide = parcelMask32(lo, hi, _mm256_set1_epi16(0x03));
+    extended = parcelMask32(lo, hi, _mm256_set1_epi16(0x1f));
+}
+
+#else
+
+inline void classifyChunk(const __uint8_t* code, __uint32_t& wide, __uint32_t& extended) {
+    classifyParcels(code, ParcelsPerChunk, wide, extended);
+}
+
+#endif
+
+} // namespace detail
+
+// Writes the byte offset of every instruction that begins in code[0, size) to
+// offsets, which needs room for size/2 entries, and returns how many were
+// written. The buffer is assumed to begin on an instruction boundary. Parcels
+// with a reserved (192-bit or longer) length encoding are stepped over one at
+// a time.
+inline std::size_t findInstructionStarts(const __uint8_t* code, std::size_t size, std::size_t* offsets) {
+
+    const std::size_t parcels = size / 2;
+    std::size_t count = 0;
+    std::size_t spill = 0;
+
+    for (std::size_t base = 0; base < parcels; base += detail::ParcelsPerChunk) {
+
+        const __uint8_t* chunk = code + (2 * base);
+        std::size_t chunkParcels = parcels - base;
+        __uint32_t wide, extended;
+        if (chunkParcels >= detail::ParcelsPerChunk) {
+            chunkParcels = detail::ParcelsPerChunk;
+            detail::classifyChunk(chunk, wide, extended);
+        } else {
+            detail::classifyParcels(chunk, chunkParcels, wide, extended);
+        }
+
+        if (extended == 0 && spill <= 1) {
+            __uint32_t starts = 0;
+            unsigned int carry = spill;
+            for (unsigned int byte = 0; byte < 4; byte++) {
+                detail::BoundaryStep step = detail::boundaryStepTable[(carry << 8) | ((wide >> (8 * byte)) & 0xff)];
+                starts |= (__uint32_t)step.starts << (8 * byte);
+                carry = step.carry;
+            }
+            if (chunkParcels < detail::ParcelsPerChunk)
+                starts &= (1u << chunkParcels) - 1;
+            while (starts) {
+                offsets[count++] = 2 * (base + __builtin_ctz(starts));
+                starts &= starts - 1;
+            }
+            spill = carry;
+            continue;
+        }
+
+        std::size_t parcel = spill;
+        while (parcel < chunkParcels) {
+            offsets[count++] = 2 * (base + parcel);
+            unsigned int length = instructionLength(detail::loadParcel(chunk + (2 * parcel)));
+            parcel += length ? length / 2 : 1;
+        }
+        spill = parcel - chunkParcels;
+    }
+
+    return count;
+}
+
+} // namespace RISCV
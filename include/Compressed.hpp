@@ -0,0 +1,318 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+namespace RISCV {
+
+// -- Expansion of the C extension into 32-bit encodings --
+
+// The all-zeroes word is not a legal 32-bit instruction, so it doubles as the
+// marker for reserved and illegal compressed encodings.
+constexpr __uint32_t IllegalExpansion = 0;
+
+constexpr unsigned int NumHalfwords = 1 << 16;
+
+namespace detail {
+
+constexpr __uint32_t opcodeBits(MajorOpcode op) {
+    return ((__uint32_t)op << 2) | OpcodeQuadrant::UNCOMPRESSED;
+}
+
+constexpr __uint32_t encodeR(MajorOpcode op, unsigned int rd, unsigned int funct3, unsigned int rs1, unsigned int rs2, unsigned int funct7) {
+    return opcodeBits(op) | (rd << 7) | (funct3 << 12) | (rs1 << 15) | (rs2 << 20) | (funct7 << 25);
+}
+
+constexpr __uint32_t encodeI(MajorOpcode op, unsigned int rd, unsigned int funct3, unsigned int rs1, __int32_t imm) {
+    return opcodeBits(op) | (rd << 7) | (funct3 << 12) | (rs1 << 15) | ((__uint32_t)imm << 20);
+}
+
+constexpr __uint32_t encodeS(MajorOpcode op, unsigned int funct3, unsigned int rs1, unsigned int rs2, __int32_t imm) {
+    __uint32_t uimm = (__uint32_t)imm;
+    return opcodeBits(op) | ((uimm & 0x1f) << 7) | (funct3 << 12) | (rs1 << 15) | (rs2 << 20) | ((uimm >> 5) << 25);
+}
+
+constexpr __uint32_t encodeB(unsigned int funct3, unsigned int rs1, unsigned int rs2, __int32_t imm) {
+    __uint32_t uimm = (__uint32_t)imm;
+    return opcodeBits(MajorOpcode::BRANCH) |
+           (((uimm >> 11) & 0x1) << 7) | (((uimm >> 1) & 0xf) << 8) |
+           (funct3 << 12) | (rs1 << 15) | (rs2 << 20) |
+           (((uimm >> 5) & 0x3f) << 25) | (((uimm >> 12) & 0x1) << 31);
+}
+
+constexpr __uint32_t encodeU(MajorOpcode op, unsigned int rd, __int32_t imm) {
+    return opcodeBits(op) | (rd << 7) | ((__uint32_t)imm & 0xfffff000);
+}
+
+constexpr __uint32_t encodeJ(unsigned int rd, __int32_t imm) {
+    __uint32_t uimm = (__uint32_t)imm;
+    return opcodeBits(MajorOpcode::JAL) | (rd << 7) |
+           (((uimm >> 12) & 0xff) << 12) | (((uimm >> 11) & 0x1) << 20) |
+           (((uimm >> 1) & 0x3ff) << 21) | (((uimm >> 20) & 0x1) << 31);
+}
+
+constexpr unsigned int bit(__uint32_t value, unsigned int index) {
+    return (value >> index) & 1;
+}
+
+constexpr unsigned int bits(__uint32_t value, unsigned int hi, unsigned int lo) {
+    return (value >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+constexpr __int32_t signExtend(__uint32_t value, unsigned int width) {
+    return (__int32_t)(value << (32 - width)) >> (32 - width);
+}
+
+// Compressed register fields name x8-x15
+constexpr unsigned int cReg(unsigned int field) {
+    return field + 8;
+}
+
+constexpr unsigned int cRdPrime(__uint32_t c) {
+    return cReg(bits(c, 4, 2));
+}
+
+constexpr unsigned int cRs1Prime(__uint32_t c) {
+    return cReg(bits(c, 9, 7));
+}
+
+constexpr unsigned int cRs2(__uint32_t c) {
+    return bits(c, 6, 2);
+}
+
+// Immediates and offsets shared by several compressed encodings
+
+constexpr __int32_t cImm6(__uint32_t c) {
+    return signExtend((bit(c, 12) << 5) | bits(c, 6, 2), 6);
+}
+
+constexpr unsigned int cShamt(__uint32_t c) {
+    return (bit(c, 12) << 5) | bits(c, 6, 2);
+}
+
+constexpr unsigned int cLwOffset(__uint32_t c) {
+    return (bits(c, 12, 10) << 3) | (bit(c, 6) << 2) | (bit(c, 5) << 6);
+}
+
+constexpr unsigned int cLdOffset(__uint32_t c) {
+    return (bits(c, 12, 10) << 3) | (bits(c, 6, 5) << 6);
+}
+
+constexpr unsigned int cLwspOffset(__uint32_t c) {
+    return (bit(c, 12) << 5) | (bits(c, 6, 4) << 2) | (bits(c, 3, 2) << 6);
+}
+
+constexpr unsigned int cLdspOffset(__uint32_t c) {
+    return (bit(c, 12) << 5) | (bits(c, 6, 5) << 3) | (bits(c, 4, 2) << 6);
+}
+
+constexpr unsigned int cSwspOffset(__uint32_t c) {
+    return (bits(c, 12, 9) << 2) | (bits(c, 8, 7) << 6);
+}
+
+constexpr unsigned int cSdspOffset(__uint32_t c) {
+    return (bits(c, 12, 10) << 3) | (bits(c, 9, 7) << 6);
+}
+
+constexpr __int32_t cJOffset(__uint32_t c) {
+    return signExtend(
+        (bit(c, 12) << 11) | (bit(c, 11) << 4) | (bits(c, 10, 9) << 8) | (bit(c, 8) << 10) |
+        (bit(c, 7) << 6) | (bit(c, 6) << 7) | (bits(c, 5, 3) << 1) | (bit(c, 2) << 5), 12);
+}
+
+constexpr __int32_t cBOffset(__uint32_t c) {
+    return signExtend(
+        (bit(c, 12) << 8) | (bits(c, 11, 10) << 3) | (bits(c, 6, 5) << 6) |
+        (bits(c, 4, 3) << 1) | (bit(c, 2) << 5), 9);
+}
+
+} // namespace detail
+
+template<typename XLEN_t>
+constexpr __uint32_t expandCompressedInstruction(__uint16_t c) {
+
+    static_assert(std::is_same<XLEN_t, __uint32_t>() || std::is_same<XLEN_t, __uint64_t>(),
+                  "Compressed expansion exists for RV32C and RV64C only");
+    constexpr bool rv64 = std::is_same<XLEN_t, __uint64_t>();
+
+    using namespace detail;
+
+    const unsigned int quadrant = c & 0b11;
+    const unsigned int funct3 = bits(c, 15, 13);
+    const unsigned int rdFull = bits(c, 11, 7);
+
+    switch (quadrant) {
+    case OpcodeQuadrant::Q0:
+        switch (funct3) {
+        case 0b000: { // C.ADDI4SPN
+            unsigned int nzuimm = (bits(c, 12, 11) << 4) | (bits(c, 10, 7) << 6) | (bit(c, 6) << 2) | (bit(c, 5) << 3);
+            if (nzuimm == 0)
+                return IllegalExpansion;
+            return encodeI(MajorOpcode::OP_IMM, cRdPrime(c), MinorOpcode::ADDI, 2, nzuimm);
+        }
+        case 0b001: // C.FLD
+            return encodeI(MajorOpcode::LOAD_FP, cRdPrime(c), 0b011, cRs1Prime(c), cLdOffset(c));
+        case 0b010: // C.LW
+            return encodeI(MajorOpcode::LOAD, cRdPrime(c), MinorOpcode::LW, cRs1Prime(c), cLwOffset(c));
+        case 0b011:
+            if constexpr (rv64) // C.LD
+                return encodeI(MajorOpcode::LOAD, cRdPrime(c), MinorOpcode::LD, cRs1Prime(c), cLdOffset(c));
+            else // C.FLW
+                return encodeI(MajorOpcode::LOAD_FP, cRdPrime(c), 0b010, cRs1Prime(c), cLwOffset(c));
+        case 0b101: // C.FSD
+            return encodeS(MajorOpcode::STORE_FP, 0b011, cRs1Prime(c), cRdPrime(c), cLdOffset(c));
+        case 0b110: // C.SW
+            return encodeS(MajorOpcode::STORE, MinorOpcode::SW, cRs1Prime(c), cRdPrime(c), cLwOffset(c));
+        case 0b111:
+            if constexpr (rv64) // C.SD
+                return encodeS(MajorOpcode::STORE, MinorOpcode::SD, cRs1Prime(c), cRdPrime(c), cLdOffset(c));
+            else // C.FSW
+                return encodeS(MajorOpcode::STORE_FP, 0b010, cRs1Prime(c), cRdPrime(c), cLwOffset(c));
+        default:
+            return IllegalExpansion;
+        }
+
+    case OpcodeQuadrant::Q1:
+        switch (funct3) {
+        case 0b000: // C.ADDI, C.NOP and hints
+            return encodeI(MajorOpcode::OP_IMM, rdFull, MinorOpcode::ADDI, rdFull, cImm6(c));
+        case 0b001:
+            if constexpr (rv64) { // C.ADDIW
+                if (rdFull == 0)
+                    return IllegalExpansion;
+                return encodeI(MajorOpcode::OP_IMM_32, rdFull, MinorOpcode::ADDIW, rdFull, cImm6(c));
+            } else { // C.JAL
+                return encodeJ(1, cJOffset(c));
+            }
+        case 0b010: // C.LI
+            return encodeI(MajorOpcode::OP_IMM, rdFull, MinorOpcode::ADDI, 0, cImm6(c));
+        case 0b011:
+            if (rdFull == 2) { // C.ADDI16SP
+                __int32_t nzimm = signExtend(
+                    (bit(c, 12) << 9) | (bit(c, 6) << 4) | (bit(c, 5) << 6) |
+                    (bits(c, 4, 3) << 7) | (bit(c, 2) << 5), 10);
+                if (nzimm == 0)
+                    return IllegalExpansion;
+                return encodeI(MajorOpcode::OP_IMM, 2, MinorOpcode::ADDI, 2, nzimm);
+            } else { // C.LUI
+                if (cImm6(c) == 0)
+                    return IllegalExpansion;
+                return encodeU(MajorOpcode::LUI, rdFull, (__int32_t)((__uint32_t)cImm6(c) << 12));
+            }
+        case 0b100: {
+            unsigned int rd = cRs1Prime(c);
+            switch (bits(c, 11, 10)) {
+            case 0b00: // C.SRLI
+                if (!rv64 && bit(c, 12))
+                    return IllegalExpansion;
+                return encodeI(MajorOpcode::OP_IMM, rd, MinorOpcode::SRI, rd, cShamt(c) | (SubMinorOpcode::SRLI << 5));
+            case 0b01: // C.SRAI
+                if (!rv64 && bit(c, 12))
+                    return IllegalExpansion;
+                return encodeI(MajorOpcode::OP_IMM, rd, MinorOpcode::SRI, rd, cShamt(c) | (SubMinorOpcode::SRAI << 5));
+            case 0b10: // C.ANDI
+                return encodeI(MajorOpcode::OP_IMM, rd, MinorOpcode::ANDI, rd, cImm6(c));
+            default: {
+                unsigned int rs2 = cRdPrime(c);
+                unsigned int op = (bit(c, 12) << 2) | bits(c, 6, 5);
+                switch (op) {
+                case 0b000: // C.SUB
+                    return encodeR(MajorOpcode::OP, rd, MinorOpcode::SUB & 7, rd, rs2, MinorOpcode::SUB >> 3);
+                case 0b001: // C.XOR
+                    return encodeR(MajorOpcode::OP, rd, MinorOpcode::XOR, rd, rs2, 0);
+                case 0b010: // C.OR
+                    return encodeR(MajorOpcode::OP, rd, MinorOpcode::OR, rd, rs2, 0);
+                case 0b011: // C.AND
+                    return encodeR(MajorOpcode::OP, rd, MinorOpcode::AND, rd, rs2, 0);
+                case 0b100: // C.SUBW
+                    if (!rv64)
+                        return IllegalExpansion;
+                    return encodeR(MajorOpcode::OP_32, rd, MinorOpcode::SUBW & 7, rd, rs2, MinorOpcode::SUBW >> 3);
+                case 0b101: // C.ADDW
+                    if (!rv64)
+                        return IllegalExpansion;
+                    return encodeR(MajorOpcode::OP_32, rd, MinorOpcode::ADDW, rd, rs2, 0);
+                default:
+                    return IllegalExpansion;
+                }
+            }
+            }
+        }
+        case 0b101: // C.J
+            return encodeJ(0, cJOffset(c));
+        case 0b110: // C.BEQZ
+            return encodeB(MinorOpcode::BEQ, cRs1Prime(c), 0, cBOffset(c));
+        default: // C.BNEZ
+            return encodeB(MinorOpcode::BNE, cRs1Prime(c), 0, cBOffset(c));
+        }
+
+    case OpcodeQuadrant::Q2:
+        switch (funct3) {
+        case 0b000: // C.SLLI
+            if (!rv64 && bit(c, 12))
+                return IllegalExpansion;
+            return encodeI(MajorOpcode::OP_IMM, rdFull, MinorOpcode::SLLI, rdFull, cShamt(c));
+        case 0b001: // C.FLDSP
+            return encodeI(MajorOpcode::LOAD_FP, rdFull, 0b011, 2, cLdspOffset(c));
+        case 0b010: // C.LWSP
+            if (rdFull == 0)
+                return IllegalExpansion;
+            return encodeI(MajorOpcode::LOAD, rdFull, MinorOpcode::LW, 2, cLwspOffset(c));
+        case 0b011:
+            if constexpr (rv64) { // C.LDSP
+                if (rdFull == 0)
+                    return IllegalExpansion;
+                return encodeI(MajorOpcode::LOAD, rdFull, MinorOpcode::LD, 2, cLdspOffset(c));
+            } else { // C.FLWSP
+                return encodeI(MajorOpcode::LOAD_FP, rdFull, 0b010, 2, cLwspOffset(c));
+            }
+        case 0b100:
+            if (!bit(c, 12)) {
+                if (cRs2(c) == 0) { // C.JR
+                    if (rdFull == 0)
+                        return IllegalExpansion;
+                    return encodeI(MajorOpcode::JALR, 0, 0, rdFull, 0);
+                } // C.MV
+                return encodeR(MajorOpcode::OP, rdFull, MinorOpcode::ADD, 0, cRs2(c), 0);
+            }
+            if (cRs2(c) == 0) {
+                if (rdFull == 0) // C.EBREAK
+                    return encodeI(MajorOpcode::SYSTEM, 0, MinorOpcode::PRIV, 0, SubSubMinorOpcode::EBREAK);
+                // C.JALR
+                return encodeI(MajorOpcode::JALR, 1, 0, rdFull, 0);
+            } // C.ADD
+            return encodeR(MajorOpcode::OP, rdFull, MinorOpcode::ADD, rdFull, cRs2(c), 0);
+        case 0b101: // C.FSDSP
+            return encodeS(MajorOpcode::STORE_FP, 0b011, 2, cRs2(c), cSdspOffset(c));
+        case 0b110: // C.SWSP
+            return encodeS(MajorOpcode::STORE, MinorOpcode::SW, 2, cRs2(c), cSwspOffset(c));
+        default:
+            if constexpr (rv64) // C.SDSP
+                return encodeS(MajorOpcode::STORE, MinorOpcode::SD, 2, cRs2(c), cSdspOffset(c));
+            else // C.FSWSP
+                return encodeS(MajorOpcode::STORE_FP, 0b010, 2, cRs2(c), cSwspOffset(c));
+        }
+
+    default:
+        return IllegalExpansion;
+    }
+}
+
+template<typename XLEN_t>
+constexpr std::array<__uint32_t, NumHalfwords> buildCompressedExpansionTable() {
+    std::array<__uint32_t, NumHalfwords> table = {0};
+    for (unsigned int halfword = 0; halfword < NumHalfwords; halfword++)
+        table[halfword] = expandCompressedInstruction<XLEN_t>(halfword);
+    return table;
+}
+
+// One table per XLEN, only instantiated for the XLENs a consumer uses. Indices
+// whose low bits mark an uncompressed parcel hold IllegalExpansion.
+template<typename XLEN_t>
+constexpr std::array<__uint32_t, NumHalfwords> compressedExpansionTable = buildCompressedExpansionTable<XLEN_t>();
+
+template<typename XLEN_t>
+inline __uint32_t expandCompressed(__uint16_t encodedInstruction) {
+    return compressedExpansionTable<XLEN_t>[encodedInstruction];
+}
+
+} // namespace RISCV
@@ -0,0 +1,373 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+namespace RISCV {
+
+// -- Decoded instruction identities --
+
+enum class InstructionID : __uint8_t {
+    INVALID,
+
+    // RV32I / RV64I
+    LUI, AUIPC, JAL, JALR,
+    BEQ, BNE, BLT, BGE, BLTU, BGEU,
+    LB, LH, LW, LD, LBU, LHU, LWU,
+    SB, SH, SW, SD,
+    ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI,
+    ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND,
+    ADDIW, SLLIW, SRLIW, SRAIW,
+    ADDW, SUBW, SLLW, SRLW, SRAW,
+    FENCE,
+
+    // SYSTEM / PRIV
+    ECALL, EBREAK, URET, SRET, MRET, WFI, SFENCE_VMA,
+
+    // Zifencei
+    FENCE_I,
+
+    // Zicsr
+    CSRRW, CSRRS, CSRRC, CSRRWI, CSRRSI, CSRRCI,
+
+    // M
+    MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU,
+    MULW, DIVW, DIVUW, REMW, REMUW,
+
+    // A
+    LR_W, SC_W, AMOSWAP_W, AMOADD_W, AMOXOR_W, AMOAND_W, AMOOR_W,
+    AMOMIN_W, AMOMAX_W, AMOMINU_W, AMOMAXU_W,
+    LR_D, SC_D, AMOSWAP_D, AMOADD_D, AMOXOR_D, AMOAND_D, AMOOR_D,
+    AMOMIN_D, AMOMAX_D, AMOMINU_D, AMOMAXU_D,
+
+    NUM_INSTRUCTION_IDS
+};
+
+constexpr unsigned int NumInstructionIDs = (unsigned int)InstructionID::NUM_INSTRUCTION_IDS;
+
+constexpr std::array<const char*, NumInstructionIDs> instructionMnemonics = {
+    "(invalid)",
+    "lui", "auipc", "jal", "jalr",
+    "beq", "bne", "blt", "bge", "bltu", "bgeu",
+    "lb", "lh", "lw", "ld", "lbu", "lhu", "lwu",
+    "sb", "sh", "sw", "sd",
+    "addi", "slti", "sltiu", "xori", "ori", "andi", "slli", "srli", "srai",
+    "add", "sub", "sll", "slt", "sltu", "xor", "srl", "sra", "or", "and",
+    "addiw", "slliw", "srliw", "sraiw",
+    "addw", "subw", "sllw", "srlw", "sraw",
+    "fence",
+    "ecall", "ebreak", "uret", "sret", "mret", "wfi", "sfence.vma",
+    "fence.i",
+    "csrrw", "csrrs", "csrrc", "csrrwi", "csrrsi", "csrrci",
+    "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu",
+    "mulw", "divw", "divuw", "remw", "remuw",
+    "lr.w", "sc.w", "amoswap.w", "amoadd.w", "amoxor.w", "amoand.w", "amoor.w",
+    "amomin.w", "amomax.w", "amominu.w", "amomaxu.w",
+    "lr.d", "sc.d", "amoswap.d", "amoadd.d", "amoxor.d", "amoand.d", "amoor.d",
+    "amomin.d", "amomax.d", "amominu.d", "amomaxu.d"
+};
+
+// How the operand fields of an instruction are laid out and should be read
+enum class OperandFormat : __uint8_t {
+    None,           // no operands (ECALL, MRET, ...)
+    R,              // rd, rs1, rs2
+    I,              // rd, rs1, imm[11:0]
+    IShift,         // rd, rs1, shamt
+    IMem,           // rd, imm[11:0](rs1) - loads and JALR
+    S,              // rs2, imm[11:0](rs1)
+    B,              // rs1, rs2, pc-relative imm[12:1]
+    U,              // rd, imm[31:12]
+    J,              // rd, pc-relative imm[20:1]
+    CSR,            // rd, csr, rs1
+    CSRImm,         // rd, csr, uimm[4:0] in the rs1 field
+    Fence,          // pred, succ
+    Atomic,         // rd, rs2, (rs1) with aq/rl
+    LoadReserved,   // rd, (rs1) with aq/rl
+    SFence          // rs1, rs2
+};
+
+struct DecodedInstruction {
+    InstructionID id;
+    OperandFormat format;
+};
+
+// -- Instruction field extraction --
+
+constexpr unsigned int opcodeField(__uint32_t inst) { return inst & 0x7f; }
+constexpr unsigned int rdField(__uint32_t inst)     { return (inst >> 7) & 0x1f; }
+constexpr unsigned int funct3Field(__uint32_t inst) { return (inst >> 12) & 0x7; }
+constexpr unsigned int rs1Field(__uint32_t inst)    { return (inst >> 15) & 0x1f; }
+constexpr unsigned int rs2Field(__uint32_t inst)    { return (inst >> 20) & 0x1f; }
+constexpr unsigned int funct7Field(__uint32_t inst) { return inst >> 25; }
+constexpr unsigned int csrField(__uint32_t inst)    { return inst >> 20; }
+
+constexpr __int32_t immI(__uint32_t inst) {
+    return (__int32_t)inst >> 20;
+}
+
+constexpr __int32_t immS(__uint32_t inst) {
+    return (((__int32_t)inst >> 20) & ~0x1f) | ((inst >> 7) & 0x1f);
+}
+
+constexpr __int32_t immB(__uint32_t inst) {
+    return (((__int32_t)inst >> 19) & ~0xfff) |
+           ((inst << 4) & 0x800) |
+           ((inst >> 20) & 0x7e0) |
+           ((inst >> 7) & 0x1e);
+}
+
+constexpr __int32_t immU(__uint32_t inst) {
+    return (__int32_t)(inst & 0xfffff000);
+}
+
+constexpr __int32_t immJ(__uint32_t inst) {
+    return (((__int32_t)inst >> 11) & ~0xfffff) |
+           (inst & 0xff000) |
+           ((inst >> 9) & 0x800) |
+           ((inst >> 20) & 0x7fe);
+}
+
+// -- Table-driven decoding --
+
+// Decoding is two dependent loads with no branches. The primary table is
+// indexed by the full 7-bit opcode and funct3, and says which further bits of
+// the instruction (if any) select among the leaves in the secondary table.
+// Primary entries that need no further bits point at a single leaf with a
+// zero mask, so every decode takes the same path.
+//
+// Tables are built per XLEN and isaFeatureSet. Instructions from extensions
+// the feature set lacks are left out and decode as INVALID, so a decoder
+// built for a fixed configuration such as RV64GC needs no extension checks.
+// SRET and SFENCE.VMA are gated on the privilege modes the hart implements
+// instead, since ISA strings such as "rv64gc" do not name them.
+
+constexpr unsigned int DecodePrimaryEntries = 1 << 10;
+constexpr unsigned int DecodeSecondaryEntries = 8192;
+
+struct DecodePrimaryEntry {
+    __uint16_t base;
+    __uint16_t mask;
+    __uint8_t shift;
+};
+
+struct DecodeTable {
+    std::array<DecodePrimaryEntry, DecodePrimaryEntries> primary;
+    std::array<DecodedInstruction, DecodeSecondaryEntries> secondary;
+};
+
+constexpr unsigned int decodePrimaryIndex(__uint32_t inst) {
+    return (inst & 0x7f) | ((inst >> 5) & 0x380);
+}
+
+namespace detail {
+
+struct DecodeTableBuilder {
+
+    DecodeTable table;
+    unsigned int used;
+
+    constexpr DecodeTableBuilder() : table(), used(1) {
+        // Secondary slot 0 is the shared INVALID leaf everything defaults to
+        for (unsigned int i = 0; i < DecodePrimaryEntries; i++)
+            table.primary[i] = { 0, 0, 0 };
+        for (unsigned int i = 0; i < DecodeSecondaryEntries; i++)
+            table.secondary[i] = { InstructionID::INVALID, OperandFormat::None };
+    }
+
+    static constexpr unsigned int Index(MajorOpcode op, unsigned int funct3) {
+        return (((unsigned int)op << 2) | 0b11) | (funct3 << 7);
+    }
+
+    constexpr void Leaf(MajorOpcode op, unsigned int funct3, InstructionID id, OperandFormat format) {
+        table.primary[Index(op, funct3)] = { (__uint16_t)used, 0, 0 };
+        table.secondary[used++] = { id, format };
+    }
+
+    constexpr void LeafAllFunct3(MajorOpcode op, InstructionID id, OperandFormat format) {
+        table.secondary[used] = { id, format };
+        for (unsigned int funct3 = 0; funct3 < 8; funct3++)
+            table.primary[Index(op, funct3)] = { (__uint16_t)used, 0, 0 };
+        used++;
+    }
+
+    // Reserve a secondary range selected by (inst >> shift) & mask
+    constexpr unsigned int Split(MajorOpcode op, unsigned int funct3, unsigned int shift, unsigned int mask) {
+        unsigned int base = used;
+        table.primary[Index(op, funct3)] = { (__uint16_t)base, (__uint16_t)mask, (__uint8_t)shift };
+        used += mask + 1;
+        return base;
+    }
+
+    constexpr void SubLeaf(unsigned int base, unsigned int selector, InstructionID id, OperandFormat format) {
+        table.secondary[base + selector] = { id, format };
+    }
+};
+
+} // namespace detail
+
+template<typename XLEN_t, isaFeatureSet features = allFeatures, privilegeModeSet modes = allPrivilegeModes>
+constexpr DecodeTable buildDecodeTable() {
+
+    static_assert(std::is_same<XLEN_t, __uint32_t>() || std::is_same<XLEN_t, __uint64_t>(),
+                  "Decode tables exist for RV32 and RV64 only");
+    constexpr bool rv64 = std::is_same<XLEN_t, __uint64_t>();
+    constexpr bool hasM = featureSetHas(features, 'M');
+    constexpr bool hasMul = featureSetHas(features, MultiLetterExtension::Zmmul);
+    constexpr bool hasA = featureSetHas(features, 'A');
+    constexpr bool hasCSR = featureSetHas(features, MultiLetterExtension::Zicsr);
+
+    using ID = InstructionID;
+    using F = OperandFormat;
+    detail::DecodeTableBuilder b;
+
+    b.LeafAllFunct3(MajorOpcode::LUI, ID::LUI, F::U);
+    b.LeafAllFunct3(MajorOpcode::AUIPC, ID::AUIPC, F::U);
+    b.LeafAllFunct3(MajorOpcode::JAL, ID::JAL, F::J);
+    b.Leaf(MajorOpcode::JALR, 0, ID::JALR, F::IMem);
+
+    b.Leaf(MajorOpcode::BRANCH, MinorOpcode::BEQ, ID::BEQ, F::B);
+    b.Leaf(MajorOpcode::BRANCH, MinorOpcode::BNE, ID::BNE, F::B);
+    b.Leaf(MajorOpcode::BRANCH, MinorOpcode::BLT, ID::BLT, F::B);
+    b.Leaf(MajorOpcode::BRANCH, MinorOpcode::BGE, ID::BGE, F::B);
+    b.Leaf(MajorOpcode::BRANCH, MinorOpcode::BLTU, ID::BLTU, F::B);
+    b.Leaf(MajorOpcode::BRANCH, MinorOpcode::BGEU, ID::BGEU, F::B);
+
+    b.Leaf(MajorOpcode::LOAD, MinorOpcode::LB, ID::LB, F::IMem);
+    b.Leaf(MajorOpcode::LOAD, MinorOpcode::LH, ID::LH, F::IMem);
+    b.Leaf(MajorOpcode::LOAD, MinorOpcode::LW, ID::LW, F::IMem);
+    b.Leaf(MajorOpcode::LOAD, MinorOpcode::LBU, ID::LBU, F::IMem);
+    b.Leaf(MajorOpcode::LOAD, MinorOpcode::LHU, ID::LHU, F::IMem);
+    b.Leaf(MajorOpcode::STORE, MinorOpcode::SB, ID::SB, F::S);
+    b.Leaf(MajorOpcode::STORE, MinorOpcode::SH, ID::SH, F::S);
+    b.Leaf(MajorOpcode::STORE, MinorOpcode::SW, ID::SW, F::S);
+    if constexpr (rv64) {
+        b.Leaf(MajorOpcode::LOAD, MinorOpcode::LD, ID::LD, F::IMem);
+        b.Leaf(MajorOpcode::LOAD, MinorOpcode::LWU, ID::LWU, F::IMem);
+        b.Leaf(MajorOpcode::STORE, MinorOpcode::SD, ID::SD, F::S);
+    }
+
+    b.Leaf(MajorOpcode::OP_IMM, MinorOpcode::ADDI, ID::ADDI, F::I);
+    b.Leaf(MajorOpcode::OP_IMM, MinorOpcode::SLTI, ID::SLTI, F::I);
+    b.Leaf(MajorOpcode::OP_IMM, MinorOpcode::SLTIU, ID::SLTIU, F::I);
+    b.Leaf(MajorOpcode::OP_IMM, MinorOpcode::XORI, ID::XORI, F::I);
+    b.Leaf(MajorOpcode::OP_IMM, MinorOpcode::ORI, ID::ORI, F::I);
+    b.Leaf(MajorOpcode::OP_IMM, MinorOpcode::ANDI, ID::ANDI, F::I);
+
+    // RV64 shift amounts are six bits wide, leaving funct6 to select the op
+    constexpr unsigned int shiftSelectShift = rv64 ? 26 : 25;
+    constexpr unsigned int shiftSelectMask = rv64 ? 0x3f : 0x7f;
+    constexpr unsigned int shiftSelectAdjust = rv64 ? 1 : 0;
+    unsigned int slli = b.Split(MajorOpcode::OP_IMM, MinorOpcode::SLLI, shiftSelectShift, shiftSelectMask);
+    b.SubLeaf(slli, 0, ID::SLLI, F::IShift);
+    unsigned int sri = b.Split(MajorOpcode::OP_IMM, MinorOpcode::SRI, shiftSelectShift, shiftSelectMask);
+    b.SubLeaf(sri, SubMinorOpcode::SRLI >> shiftSelectAdjust, ID::SRLI, F::IShift);
+    b.SubLeaf(sri, SubMinorOpcode::SRAI >> shiftSelectAdjust, ID::SRAI, F::IShift);
+
+    // OP selects on funct7, which also distinguishes the M extension
+    unsigned int op[8] = {};
+    for (unsigned int funct3 = 0; funct3 < 8; funct3++) {
+        op[funct3] = b.Split(MajorOpcode::OP, funct3, 25, 0x7f);
+    }
+    constexpr ID opBase[8] = { ID::ADD, ID::SLL, ID::SLT, ID::SLTU, ID::XOR, ID::SRL, ID::OR, ID::AND };
+    constexpr ID opMulDiv[8] = { ID::MUL, ID::MULH, ID::MULHSU, ID::MULHU, ID::DIV, ID::DIVU, ID::REM, ID::REMU };
+    for (unsigned int funct3 = 0; funct3 < 8; funct3++) {
+        b.SubLeaf(op[funct3], 0b0000000, opBase[funct3], F::R);
+        // Zmmul is the multiplies of M without the divides
+        if (hasM || (hasMul && funct3 < 4))
+            b.SubLeaf(op[funct3], 0b0000001, opMulDiv[funct3], F::R);
+    }
+    b.SubLeaf(op[MinorOpcode::SUB & 7], MinorOpcode::SUB >> 3, ID::SUB, F::R);
+    b.SubLeaf(op[MinorOpcode::SRA & 7], MinorOpcode::SRA >> 3, ID::SRA, F::R);
+
+    if constexpr (rv64) {
+        b.Leaf(MajorOpcode::OP_IMM_32, MinorOpcode::ADDIW, ID::ADDIW, F::I);
+        unsigned int slliw = b.Split(MajorOpcode::OP_IMM_32, MinorOpcode::SLLIW, 25, 0x7f);
+        b.SubLeaf(slliw, 0, ID::SLLIW, F::IShift);
+        unsigned int sriw = b.Split(MajorOpcode::OP_IMM_32, MinorOpcode::SRIW, 25, 0x7f);
+        b.SubLeaf(sriw, SubMinorOpcode::SRLIW, ID::SRLIW, F::IShift);
+        b.SubLeaf(sriw, SubMinorOpcode::SRAIW, ID::SRAIW, F::IShift);
+
+        unsigned int addw = b.Split(MajorOpcode::OP_32, MinorOpcode::ADDW, 25, 0x7f);
+        b.SubLeaf(addw, 0b0000000, ID::ADDW, F::R);
+        b.SubLeaf(addw, MinorOpcode::SUBW >> 3, ID::SUBW, F::R);
+        if constexpr (hasMul)
+            b.SubLeaf(addw, 0b0000001, ID::MULW, F::R);
+        unsigned int sllw = b.Split(MajorOpcode::OP_32, MinorOpcode::SLLW, 25, 0x7f);
+        b.SubLeaf(sllw, 0b0000000, ID::SLLW, F::R);
+        unsigned int srlw = b.Split(MajorOpcode::OP_32, MinorOpcode::SRLW, 25, 0x7f);
+        b.SubLeaf(srlw, 0b0000000, ID::SRLW, F::R);
+        b.SubLeaf(srlw, MinorOpcode::SRAW >> 3, ID::SRAW, F::R);
+        if constexpr (hasM) {
+            b.SubLeaf(srlw, 0b0000001, ID::DIVUW, F::R);
+            unsigned int divw = b.Split(MajorOpcode::OP_32, MinorOpcode::DIV & 7, 25, 0x7f);
+            b.SubLeaf(divw, 0b0000001, ID::DIVW, F::R);
+            unsigned int remw = b.Split(MajorOpcode::OP_32, MinorOpcode::REM & 7, 25, 0x7f);
+            b.SubLeaf(remw, 0b0000001, ID::REMW, F::R);
+            unsigned int remuw = b.Split(MajorOpcode::OP_32, MinorOpcode::REMU & 7, 25, 0x7f);
+            b.SubLeaf(remuw, 0b0000001, ID::REMUW, F::R);
+        }
+    }
+
+    b.Leaf(MajorOpcode::MISC_MEM, MinorOpcode::FENCE, ID::FENCE, F::Fence);
+    if constexpr (featureSetHas(features, MultiLetterExtension::Zifencei))
+        b.Leaf(MajorOpcode::MISC_MEM, MinorOpcode::FENCE_I, ID::FENCE_I, F::None);
+
+    if constexpr (hasCSR) {
+        b.Leaf(MajorOpcode::SYSTEM, MinorOpcode::CSRRW, ID::CSRRW, F::CSR);
+        b.Leaf(MajorOpcode::SYSTEM, MinorOpcode::CSRRS, ID::CSRRS, F::CSR);
+        b.Leaf(MajorOpcode::SYSTEM, MinorOpcode::CSRRC, ID::CSRRC, F::CSR);
+        b.Leaf(MajorOpcode::SYSTEM, MinorOpcode::CSRRWI, ID::CSRRWI, F::CSRImm);
+        b.Leaf(MajorOpcode::SYSTEM, MinorOpcode::CSRRSI, ID::CSRRSI, F::CSRImm);
+        b.Leaf(MajorOpcode::SYSTEM, MinorOpcode::CSRRCI, ID::CSRRCI, F::CSRImm);
+    }
+
+    // PRIV selects on the whole funct7:rs2 field. The rd and rs1 fields are
+    // not checked for zero here.
+    unsigned int priv = b.Split(MajorOpcode::SYSTEM, MinorOpcode::PRIV, 20, 0xfff);
+    b.SubLeaf(priv, (SubMinorOpcode::ECALL_EBREAK_URET << 5) | SubSubMinorOpcode::ECALL, ID::ECALL, F::None);
+    b.SubLeaf(priv, (SubMinorOpcode::ECALL_EBREAK_URET << 5) | SubSubMinorOpcode::EBREAK, ID::EBREAK, F::None);
+    if constexpr (featureSetHas(features, 'N'))
+        b.SubLeaf(priv, (SubMinorOpcode::ECALL_EBREAK_URET << 5) | SubSubMinorOpcode::URET, ID::URET, F::None);
+    b.SubLeaf(priv, (SubMinorOpcode::SRET_WFI << 5) | SubSubMinorOpcode::WFI, ID::WFI, F::None);
+    // MRET shares its rs2 encoding with SRET
+    b.SubLeaf(priv, (SubMinorOpcode::MRET << 5) | SubSubMinorOpcode::SRET, ID::MRET, F::None);
+    if constexpr (privilegeModeSetHas(modes, PrivilegeMode::Supervisor)) {
+        b.SubLeaf(priv, (SubMinorOpcode::SRET_WFI << 5) | SubSubMinorOpcode::SRET, ID::SRET, F::None);
+        for (unsigned int rs2 = 0; rs2 < NumRegs; rs2++)
+            b.SubLeaf(priv, (SubMinorOpcode::SFENCE_VMA << 5) | rs2, ID::SFENCE_VMA, F::SFence);
+    }
+
+    // AMO selects on funct5; aq/rl in the low funct7 bits are operands
+    constexpr ID amoW[32] = {
+        ID::AMOADD_W, ID::AMOSWAP_W, ID::LR_W, ID::SC_W, ID::AMOXOR_W, ID::INVALID, ID::INVALID, ID::INVALID,
+        ID::AMOOR_W, ID::INVALID, ID::INVALID, ID::INVALID, ID::AMOAND_W, ID::INVALID, ID::INVALID, ID::INVALID,
+        ID::AMOMIN_W, ID::INVALID, ID::INVALID, ID::INVALID, ID::AMOMAX_W, ID::INVALID, ID::INVALID, ID::INVALID,
+        ID::AMOMINU_W, ID::INVALID, ID::INVALID, ID::INVALID, ID::AMOMAXU_W, ID::INVALID, ID::INVALID, ID::INVALID
+    };
+    constexpr unsigned int wToD = (unsigned int)ID::LR_D - (unsigned int)ID::LR_W;
+    if constexpr (!hasA)
+        return b.table;
+    unsigned int amo32 = b.Split(MajorOpcode::AMO, AmoWidth::AMO_W, 27, 0x1f);
+    unsigned int amo64 = rv64 ? b.Split(MajorOpcode::AMO, AmoWidth::AMO_D, 27, 0x1f) : 0;
+    for (unsigned int funct5 = 0; funct5 < 32; funct5++) {
+        if (amoW[funct5] == ID::INVALID)
+            continue;
+        OperandFormat format = funct5 == MinorOpcode::LR ? F::LoadReserved : F::Atomic;
+        b.SubLeaf(amo32, funct5, amoW[funct5], format);
+        if (rv64)
+            b.SubLeaf(amo64, funct5, (ID)((unsigned int)amoW[funct5] + wToD), format);
+    }
+
+    return b.table;
+}
+
+template<typename XLEN_t, isaFeatureSet features = allFeatures, privilegeModeSet modes = allPrivilegeModes>
+constexpr DecodeTable decodeTable = buildDecodeTable<XLEN_t, features, modes>();
+
+template<typename XLEN_t, isaFeatureSet features = allFeatures, privilegeModeSet modes = allPrivilegeModes>
+constexpr DecodedInstruction decode(__uint32_t encodedInstruction) {
+    const DecodeTable& table = decodeTable<XLEN_t, features, modes>;
+    const DecodePrimaryEntry& entry = table.primary[decodePrimaryIndex(encodedInstruction)];
+    return table.secondary[entry.base + ((encodedInstruction >> entry.shift) & entry.mask)];
+}
+
+} // namespace RISCV
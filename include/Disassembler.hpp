@@ -0,0 +1,464 @@
+#pragma once
+
+#include "RiscV.hpp"
+#include "Decoder.hpp"
+#include "Compressed.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace RISCV {
+
+// -- Batch disassembly --
+
+// Disassembles into a caller-owned buffer with no allocation. Compressed
+// instructions are expanded and printed as the base instruction they stand
+// for. Every name the disassembler prints comes from a fixed-width padded
+// table, so each name is copied with one 16-byte memcpy no matter how long it
+// is. The buffer is checked once per block of instructions against
+// MaxDisassemblyLength for each of them, not once per character.
+
+constexpr std::size_t MaxDisassemblyLength = 80;
+
+namespace detail {
+
+struct paddedName {
+    char text[16];
+    __uint8_t length;
+};
+
+constexpr paddedName padName(std::string_view name) {
+    paddedName padded = {};
+    for (std::size_t i = 0; i < name.size() && i < sizeof(padded.text); i++)
+        padded.text[i] = name[i];
+    padded.length = (__uint8_t)name.size();
+    return padded;
+}
+
+template<std::size_t N>
+constexpr std::array<paddedName, N> padNames(const std::array<const char*, N>& names) {
+    std::array<paddedName, N> padded = {};
+    for (std::size_t i = 0; i < N; i++)
+        padded[i] = padName(names[i]);
+    return padded;
+}
+
+constexpr std::array<paddedName, NumInstructionIDs> paddedMnemonics = padNames(instructionMnemonics);
+constexpr std::array<paddedName, NumRegs> paddedAbiNames = padNames(registerAbiNames);
+constexpr std::array<paddedName, NumRegs> paddedFlatNames = padNames(registerFlatNames);
+
+// Indexed by the aq/rl bits of an AMO
+constexpr std::array<paddedName, 4> paddedOrderingSuffixes = {
+    padName(""), padName(".rl"), padName(".aq"), padName(".aqrl")
+};
+
+constexpr std::array<paddedName, 16> buildFenceSetNames() {
+    std::array<paddedName, 16> table = {};
+    for (unsigned int set = 0; set < 16; set++) {
+        paddedName& name = table[set];
+        if (set & 0b1000) name.text[name.length++] = 'i';
+        if (set & 0b0100) name.text[name.length++] = 'o';
+        if (set & 0b0010) name.text[name.length++] = 'r';
+        if (set & 0b0001) name.text[name.length++] = 'w';
+        if (set == 0)     name.text[name.length++] = '0';
+    }
+    return table;
+}
+
+constexpr std::array<paddedName, 16> paddedFenceSets = buildFenceSetNames();
+
+// The writers below assume the caller has already reserved space
+
+inline char* putName(char* out, const paddedName& name) {
+    std::memcpy(out, name.text, sizeof(name.text));
+    return out + name.length;
+}
+
+inline char* putSeparator(char* out) {
+    out[0] = ',';
+    out[1] = ' ';
+    return out + 2;
+}
+
+// Numbers are converted a word at a time and stored with their leading
+// zeros shifted out, rather than a digit at a time: digit counts vary from
+// one instruction to the next, so a loop over them mispredicts.
+
+// "00" to "99", the first digit in the low byte
+constexpr std::array<__uint16_t, 100> buildDecimalPairs() {
+    std::array<__uint16_t, 100> pairs = {};
+    for (unsigned int i = 0; i < 100; i++)
+        pairs[i] = (__uint16_t)(('0' + i / 10) | ('0' + i % 10) << 8);
+    return pairs;
+}
+
+constexpr std::array<__uint16_t, 100> decimalPairs = buildDecimalPairs();
+
+// Immediates are at most 13 bits, so decimal output needs at most 4 digits
+inline char* putDecimal(char* out, __int32_t value) {
+    *out = '-';
+    out += value < 0;
+    unsigned int magnitude = value < 0 ? -value : value;
+    if (magnitude >= 10000)
+        return std::to_chars(out, out + 10, magnitude).ptr;
+    unsigned int digits = 1 + (magnitude >= 10) + (magnitude >= 100) + (magnitude >= 1000);
+    // Most significant digit in the lowest byte, which is first in memory
+    __uint32_t text = (__uint32_t)decimalPairs[magnitude / 100] | (__uint32_t)decimalPairs[magnitude % 100] << 16;
+    text >>= 8 * (4 - digits);
+    std::memcpy(out, &text, sizeof(text));
+    return out + digits;
+}
+
+// The eight hex digits of value, most significant first in memory
+inline __uint64_t hexText(__uint32_t value) {
+    __uint64_t nibbles = value;
+    nibbles = (nibbles | nibbles << 16) & 0x0000ffff0000ffffull;
+    nibbles = (nibbles | nibbles << 8) & 0x00ff00ff00ff00ffull;
+    nibbles = (nibbles | nibbles << 4) & 0x0f0f0f0f0f0f0f0full;
+    __uint64_t letters = ((nibbles + 0x0606060606060606ull) >> 4) & 0x0101010101010101ull;
+    return __builtin_bswap64(nibbles + 0x3030303030303030ull + letters * ('a' - '0' - 10));
+}
+
+inline char* putHex(char* out, __uint64_t value) {
+    unsigned int digits = (67 - __builtin_clzll(value | 1)) / 4;
+    out[0] = '0';
+    out[1] = 'x';
+    // Immediates and most addresses fit in 32 bits, which is half the work
+    if (value >> 32 == 0) {
+        __uint64_t text = hexText((__uint32_t)value) >> (8 * (8 - digits));
+        std::memcpy(out + 2, &text, sizeof(text));
+        return out + 2 + digits;
+    }
+    __uint128_t text = hexText((__uint32_t)(value >> 32)) | (__uint128_t)hexText((__uint32_t)value) << 64;
+    text >>= 8 * (16 - digits);
+    std::memcpy(out + 2, &text, sizeof(text));
+    return out + 2 + digits;
+}
+
+inline char* putCSR(char* out, unsigned int address) {
+    std::string_view name = csrNameView(address);
+    if (name.empty())
+        return putHex(out, address);
+    std::memcpy(out, name.data(), name.size());
+    return out + name.size();
+}
+
+template<typename XLEN_t, OperandFormat format>
+inline char* putOperands(char* out, XLEN_t pc, __uint32_t inst, const paddedName* regs) {
+
+    const paddedName& rd = regs[rdField(inst)];
+    const paddedName& rs1 = regs[rs1Field(inst)];
+    const paddedName& rs2 = regs[rs2Field(inst)];
+
+    if constexpr (format == OperandFormat::None) {
+        return out;
+    } else if constexpr (format == OperandFormat::R) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        out = putSeparator(putName(out, rs1));
+        return putName(out, rs2);
+    } else if constexpr (format == OperandFormat::I) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        out = putSeparator(putName(out, rs1));
+        return putDecimal(out, immI(inst));
+    } else if constexpr (format == OperandFormat::IShift) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        out = putSeparator(putName(out, rs1));
+        return putDecimal(out, (inst >> 20) & (sizeof(XLEN_t) == 4 ? 0x1f : 0x3f));
+    } else if constexpr (format == OperandFormat::IMem) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        out = putDecimal(out, immI(inst));
+        *out++ = '(';
+        out = putName(out, rs1);
+        *out++ = ')';
+        return out;
+    } else if constexpr (format == OperandFormat::S) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rs2));
+        out = putDecimal(out, immS(inst));
+        *out++ = '(';
+        out = putName(out, rs1);
+        *out++ = ')';
+        return out;
+    } else if constexpr (format == OperandFormat::B) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rs1));
+        out = putSeparator(putName(out, rs2));
+        return putHex(out, (XLEN_t)(pc + (XLEN_t)(__int64_t)immB(inst)));
+    } else if constexpr (format == OperandFormat::U) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        return putHex(out, inst >> 12);
+    } else if constexpr (format == OperandFormat::J) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        return putHex(out, (XLEN_t)(pc + (XLEN_t)(__int64_t)immJ(inst)));
+    } else if constexpr (format == OperandFormat::CSR) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        out = putSeparator(putCSR(out, csrField(inst)));
+        return putName(out, rs1);
+    } else if constexpr (format == OperandFormat::CSRImm) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        out = putSeparator(putCSR(out, csrField(inst)));
+        return putDecimal(out, rs1Field(inst));
+    } else if constexpr (format == OperandFormat::Fence) {
+        *out++ = ' ';
+        out = putSeparator(putName(out, paddedFenceSets[(inst >> 24) & 0xf]));
+        return putName(out, paddedFenceSets[(inst >> 20) & 0xf]);
+    } else if constexpr (format == OperandFormat::Atomic) {
+        out = putName(out, paddedOrderingSuffixes[(inst >> 25) & 0b11]);
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        out = putSeparator(putName(out, rs2));
+        *out++ = '(';
+        out = putName(out, rs1);
+        *out++ = ')';
+        return out;
+    } else if constexpr (format == OperandFormat::LoadReserved) {
+        out = putName(out, paddedOrderingSuffixes[(inst >> 25) & 0b11]);
+        *out++ = ' ';
+        out = putSeparator(putName(out, rd));
+        *out++ = '(';
+        out = putName(out, rs1);
+        *out++ = ')';
+        return out;
+    } else {
+        static_assert(format == OperandFormat::SFence, "Every OperandFormat needs operands");
+        *out++ = ' ';
+        out = putSeparator(putName(out, rs1));
+        return putName(out, rs2);
+    }
+}
+
+constexpr unsigned int NumOperandFormats = (unsigned int)OperandFormat::SFence + 1;
+
+// Calls handler.template Operands<format>() for a format known only at run time
+template<typename Handler>
+inline auto visitOperandFormat(OperandFormat format, Handler&& handler) {
+    using F = OperandFormat;
+    switch (format) {
+    case F::None:         return handler.template Operands<F::None>();
+    case F::R:            return handler.template Operands<F::R>();
+    case F::I:            return handler.template Operands<F::I>();
+    case F::IShift:       return handler.template Operands<F::IShift>();
+    case F::IMem:         return handler.template Operands<F::IMem>();
+    case F::S:            return handler.template Operands<F::S>();
+    case F::B:            return handler.template Operands<F::B>();
+    case F::U:            return handler.template Operands<F::U>();
+    case F::J:            return handler.template Operands<F::J>();
+    case F::CSR:          return handler.template Operands<F::CSR>();
+    case F::CSRImm:       return handler.template Operands<F::CSRImm>();
+    case F::Fence:        return handler.template Operands<F::Fence>();
+    case F::Atomic:       return handler.template Operands<F::Atomic>();
+    case F::LoadReserved: return handler.template Operands<F::LoadReserved>();
+    case F::SFence:       return handler.template Operands<F::SFence>();
+    }
+    return handler.template Operands<F::None>();
+}
+
+// An instruction decoded ahead of printing. inst is the expanded
+// instruction, or the encoding as written if it is invalid.
+struct decodedLine {
+    __uint32_t inst;
+    DecodedInstruction decoded;
+};
+
+template<typename XLEN_t>
+inline decodedLine decodeLine(__uint32_t encoded) {
+    // Masked rather than a conditional, which compilers turn into a branch
+    // that a mix of compressed and full-width instructions mispredicts
+    __uint32_t compressedMask = -(__uint32_t)((encoded & 0b11) != 0b11);
+    __uint32_t expanded = expandCompressed<XLEN_t>((__uint16_t)encoded);
+    __uint32_t inst = (expanded & compressedMask) | (encoded & ~compressedMask);
+    DecodedInstruction decoded = decode<XLEN_t>(inst);
+    if (decoded.id == InstructionID::INVALID)
+        inst = encoded & (~compressedMask | 0xffff);
+    return { inst, decoded };
+}
+
+inline char* putInvalid(char* out, __uint32_t encoding) {
+    out = putName(out, paddedMnemonics[(unsigned int)InstructionID::INVALID]);
+    *out++ = ' ';
+    return putHex(out, encoding);
+}
+
+template<typename XLEN_t>
+struct lineOperandPrinter {
+    char* out;
+    XLEN_t pc;
+    __uint32_t inst;
+    const paddedName* regs;
+
+    template<OperandFormat format>
+    char* Operands() {
+        return putOperands<XLEN_t, format>(out, pc, inst, regs);
+    }
+};
+
+template<typename XLEN_t>
+inline char* disassembleInto(char* out, XLEN_t pc, __uint32_t encoded, const paddedName* regs) {
+    decodedLine line = decodeLine<XLEN_t>(encoded);
+    if (line.decoded.id == InstructionID::INVALID)
+        return putInvalid(out, line.inst);
+    out = putName(out, paddedMnemonics[(unsigned int)line.decoded.id]);
+    lineOperandPrinter<XLEN_t> printer = { out, pc, line.inst, regs };
+    return visitOperandFormat(line.decoded.format, printer);
+}
+
+// A random mix of instructions switches to a different operand format
+// nearly every time, and the switch mispredicts just as often. So batches
+// are printed a block at a time: the block is decoded, grouped by format,
+// and each group printed by a loop specialized for its format into rows of
+// its own, which are then copied out in order.
+
+constexpr std::size_t DisassemblyBlockSize = 64;
+
+// Lines group by operand format, with invalid instructions last
+constexpr unsigned int InvalidLineGroup = NumOperandFormats;
+
+inline unsigned int lineGroup(const decodedLine& line) {
+    return line.decoded.id == InstructionID::INVALID ? InvalidLineGroup : (unsigned int)line.decoded.format;
+}
+
+template<typename XLEN_t>
+struct disassemblyBlock {
+    decodedLine lines[DisassemblyBlockSize];
+    // Line indices grouped by lineGroup()
+    __uint8_t order[DisassemblyBlockSize];
+    std::size_t groupEnd[InvalidLineGroup + 1];
+    char rows[DisassemblyBlockSize][MaxDisassemblyLength];
+    __uint8_t rowLength[DisassemblyBlockSize];
+};
+
+template<typename XLEN_t>
+struct blockGroupPrinter {
+    disassemblyBlock<XLEN_t>& block;
+    const XLEN_t* pcs;
+    const paddedName* regs;
+    std::size_t first;
+    std::size_t last;
+
+    template<OperandFormat format>
+    void Operands() {
+        for (std::size_t k = first; k < last; k++) {
+            unsigned int i = block.order[k];
+            const decodedLine& line = block.lines[i];
+            char* out = putName(block.rows[i], paddedMnemonics[(unsigned int)line.decoded.id]);
+            out = putOperands<XLEN_t, format>(out, pcs[i], line.inst, regs);
+            *out++ = '\n';
+            block.rowLength[i] = (__uint8_t)(out - block.rows[i]);
+        }
+    }
+};
+
+// Prints count <= DisassemblyBlockSize lines at out, which has room for
+// MaxDisassemblyLength per line
+template<typename XLEN_t>
+inline char* disassembleBlock(disassemblyBlock<XLEN_t>& block, const XLEN_t* pcs, const __uint32_t* words,
+                              std::size_t count, char* out, const paddedName* regs) {
+
+    std::size_t groupSize[InvalidLineGroup + 1] = {};
+    for (std::size_t i = 0; i < count; i++) {
+        block.lines[i] = decodeLine<XLEN_t>(words[i]);
+        groupSize[lineGroup(block.lines[i])]++;
+    }
+    std::size_t next[InvalidLineGroup + 1];
+    std::size_t end = 0;
+    for (unsigned int group = 0; group <= InvalidLineGroup; group++) {
+        next[group] = end;
+        end += groupSize[group];
+        block.groupEnd[group] = end;
+    }
+    for (std::size_t i = 0; i < count; i++)
+        block.order[next[lineGroup(block.lines[i])]++] = (__uint8_t)i;
+
+    std::size_t groupStart = 0;
+    for (unsigned int format = 0; format < NumOperandFormats; format++) {
+        if (block.groupEnd[format] != groupStart) {
+            blockGroupPrinter<XLEN_t> printer = { block, pcs, regs, groupStart, block.groupEnd[format] };
+            visitOperandFormat((OperandFormat)format, printer);
+        }
+        groupStart = block.groupEnd[format];
+    }
+    for (std::size_t k = groupStart; k < count; k++) {
+        unsigned int i = block.order[k];
+        char* row = putInvalid(block.rows[i], block.lines[i].inst);
+        *row++ = '\n';
+        block.rowLength[i] = (__uint8_t)(row - block.rows[i]);
+    }
+
+    // Most lines fit in 32 bytes, and are copied as whole 32- or 80-byte rows
+    // whose tails the following lines overwrite. The last lines, within
+    // MaxDisassemblyLength of the end, go through a staging buffer the same
+    // way and are then copied out exactly, so nothing past the returned end
+    // is written.
+    std::size_t staged = count;
+    for (std::size_t length = 0; staged > 0 && length < MaxDisassemblyLength; )
+        length += block.rowLength[--staged];
+    for (std::size_t i = 0; i < staged; i++) {
+        std::memcpy(out, block.rows[i], 32);
+        if (block.rowLength[i] > 32)
+            std::memcpy(out + 32, block.rows[i] + 32, MaxDisassemblyLength - 32);
+        out += block.rowLength[i];
+    }
+    // Staged lines total under 2 * MaxDisassemblyLength, plus one row of overrun
+    char stage[3 * MaxDisassemblyLength];
+    char* stageEnd = stage;
+    for (std::size_t i = staged; i < count; i++) {
+        std::memcpy(stageEnd, block.rows[i], 32);
+        if (block.rowLength[i] > 32)
+            std::memcpy(stageEnd + 32, block.rows[i] + 32, MaxDisassemblyLength - 32);
+        stageEnd += block.rowLength[i];
+    }
+    std::memcpy(out, stage, stageEnd - stage);
+    return out + (stageEnd - stage);
+}
+
+} // namespace detail
+
+struct disassemblyResult {
+    std::size_t count;  // instructions fully written
+    char* end;          // one past the last character written
+};
+
+// Disassembles count instructions, one per line, each ending in '\n'. Entry i
+// is the instruction at pcs[i] whose first 32 bits are words[i]. For compressed
+// instructions only the low 16 bits of the word are read. Stops early when
+// [first, last) has less than MaxDisassemblyLength left, so a caller filling
+// a ring buffer can drain it and resume from pcs + count. Nothing in
+// [end, last) is written.
+template<typename XLEN_t>
+inline disassemblyResult disassemble(const XLEN_t* pcs, const __uint32_t* words, std::size_t count,
+                                     char* first, char* last, bool flatRegisterNames=false) {
+    const detail::paddedName* regs = flatRegisterNames ? detail::paddedFlatNames.data() : detail::paddedAbiNames.data();
+    detail::disassemblyBlock<XLEN_t> block;
+    std::size_t i = 0;
+    while (i < count) {
+        // Every line of the block fits even at MaxDisassemblyLength
+        std::size_t lines = std::min({ count - i, detail::DisassemblyBlockSize,
+                                       (std::size_t)(last - first) / MaxDisassemblyLength });
+        if (lines == 0)
+            break;
+        first = detail::disassembleBlock<XLEN_t>(block, pcs + i, words + i, lines, first, regs);
+        i += lines;
+    }
+    return { i, first };
+}
+
+// Single-instruction form in the style of std::to_chars, without a newline
+template<typename XLEN_t>
+inline std::to_chars_result disassembleToChars(char* first, char* last, XLEN_t pc, __uint32_t word,
+                                               bool flatRegisterNames=false) {
+    char line[MaxDisassemblyLength];
+    const detail::paddedName* regs = flatRegisterNames ? detail::paddedFlatNames.data() : detail::paddedAbiNames.data();
+    char* end = detail::disassembleInto<XLEN_t>(line, pc, word, regs);
+    return nameToChars(first, last, std::string_view(line, end - line));
+}
+
+} // namespace RISCV
@@ -0,0 +1,563 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+#include <algorithm>
+#include <cfenv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace RISCV {
+
+// -- Rounding-mode-specialized floating-point kernels --
+
+// Every F and D arithmetic, fused multiply-add and conversion kernel is a
+// template over fpRoundingMode. This file assumes the host FPU is left in
+// round-to-nearest-even:
+//  - RNE kernels are the host operation, with NaN results canonicalized.
+//  - RTZ, RDN and RUP kernels also compute the RNE result. They then get the
+//    sign of its rounding error from an exact error term (TwoSum for add, an
+//    FMA residual for multiply, the remainder for divide and square root)
+//    and step one ulp if that rounding went the wrong way.
+//  - RMM differs from RNE only on exact ties, which that same error term
+//    detects. Quotients and square roots can never be exact ties.
+//  - The error terms stop being exact once values reach the bottom of the
+//    normal range. Results that small are recomputed under the host's own
+//    rounding mode with fesetround. RMM has no host mode. For it, the
+//    operands are rescaled so the exact result becomes a short sum of
+//    doubles (or floats) well inside the normal range. Ties are then found
+//    exactly, with TwoSum, against the midpoint of the RNE result and its
+//    neighbour. Below the normal range a quotient can tie too, so RMM
+//    division takes this path for subnormal results.
+// Exceptions are raised on the host FPU, so fcsrReg::accumulateHostFlags
+// collects them without per-op work. The FMA-based error terms want a host
+// with hardware fused multiply-add (e.g. -mfma); otherwise std::fma is a
+// slow software routine.
+
+template<typename T>
+struct fpTraits;
+
+template<>
+struct fpTraits<float> {
+    using bits_t = __uint32_t;
+    constexpr static bits_t canonicalNaN = 0x7fc00000;
+};
+
+template<>
+struct fpTraits<double> {
+    using bits_t = __uint64_t;
+    constexpr static bits_t canonicalNaN = 0x7ff8000000000000;
+};
+
+// Resolves an instruction's rm field, going through frm for DYN. Values above
+// RMM (a reserved rm, or an frm holding one) are illegal instructions; the
+// kernel tables hold nullptr there.
+constexpr unsigned int effectiveRoundingMode(unsigned int rmField, fpRoundingMode frm) {
+    return rmField == fpRoundingMode::DYN ? (unsigned int)frm : rmField;
+}
+
+namespace detail {
+
+template<typename T>
+inline T fromBits(typename fpTraits<T>::bits_t bits) {
+    T value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+template<typename T>
+inline typename fpTraits<T>::bits_t toBits(T value) {
+    typename fpTraits<T>::bits_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+template<typename T>
+inline T canonicalize(T value) {
+    return value != value ? fromBits<T>(fpTraits<T>::canonicalNaN) : value;
+}
+
+// The adjacent representable value above or below a finite value
+template<typename T>
+inline T nextRepresentable(T value, bool up) {
+    if (value == 0)
+        return up ? std::numeric_limits<T>::denorm_min() : -std::numeric_limits<T>::denorm_min();
+    typename fpTraits<T>::bits_t bits = toBits(value);
+    bits += ((value > 0) == up) ? 1 : -1;
+    return fromBits<T>(bits);
+}
+
+// Below this magnitude an FMA residual can underflow and lose its sign
+template<typename T>
+constexpr T exactErrorThreshold() {
+    return std::numeric_limits<T>::min() * (T)((__uint64_t)1 << std::numeric_limits<T>::digits);
+}
+
+constexpr int hostRoundingMode(fpRoundingMode rm) {
+    switch (rm) {
+    case fpRoundingMode::RTZ:
+        return FE_TOWARDZERO;
+    case fpRoundingMode::RDN:
+        return FE_DOWNWARD;
+    case fpRoundingMode::RUP:
+        return FE_UPWARD;
+    default:
+        return FE_TONEAREST;
+    }
+}
+
+// Runs op under the host equivalent of rm. op must keep its operands in
+// volatiles so the compiler can't move the arithmetic across fesetround.
+template<fpRoundingMode rm, typename Op>
+inline auto withHostRounding(Op op) {
+    if constexpr (rm == fpRoundingMode::RNE || rm == fpRoundingMode::RMM) {
+        return op();
+    } else {
+        int saved = std::fegetround();
+        std::fesetround(hostRoundingMode(rm));
+        auto result = op();
+        std::fesetround(saved);
+        return result;
+    }
+}
+
+// Corrects the RNE-rounded r to mode rm, given err = exact - r. err only
+// needs the right sign, except for RMM, which also needs it exact at ties.
+template<fpRoundingMode rm, typename T, typename E>
+inline T roundFromNearest(T r, E err) {
+    if constexpr (rm == fpRoundingMode::RNE) {
+        return r;
+    } else {
+        if (err == 0 || err != err)
+            return r;
+        bool up = err > 0;
+        if constexpr (rm == fpRoundingMode::RTZ) {
+            // Only step when RNE rounded away from zero
+            if (r == 0 || (r > 0) == up)
+                return r;
+        } else if constexpr (rm == fpRoundingMode::RDN) {
+            if (up)
+                return r;
+        } else if constexpr (rm == fpRoundingMode::RUP) {
+            if (!up)
+                return r;
+        } else {
+            // A tie RNE broke toward zero goes away from zero instead
+            T neighbour = nextRepresentable(r, up);
+            if (2 * err != (E)neighbour - (E)r || !(r == 0 || (r > 0) == up))
+                return r;
+            return neighbour;
+        }
+        T result = nextRepresentable(r, up);
+        if (std::isinf(result))
+            std::feraiseexcept(FE_OVERFLOW | FE_INEXACT);
+        return result;
+    }
+}
+
+// RNE overflowed to r = +-inf from finite operands
+template<fpRoundingMode rm, typename T>
+inline T roundOverflow(T r) {
+    constexpr T max = std::numeric_limits<T>::max();
+    if constexpr (rm == fpRoundingMode::RTZ) {
+        return r > 0 ? max : -max;
+    } else if constexpr (rm == fpRoundingMode::RDN) {
+        return r > 0 ? max : r;
+    } else if constexpr (rm == fpRoundingMode::RUP) {
+        return r < 0 ? -max : r;
+    } else {
+        return r;
+    }
+}
+
+// Exact a + b == sum + error, for finite operands whose sum doesn't overflow
+template<typename T>
+inline T twoSumError(T a, T b, T sum) {
+    T bVirtual = sum - a;
+    return (a - (sum - bVirtual)) + (b - bVirtual);
+}
+
+// Sign of the exact sum of some terms: -1, 0 or 1. The terms are grown into
+// a nonoverlapping expansion with TwoSum (Shewchuk's Grow-Expansion), whose
+// largest nonzero component has the sign of the sum. Nothing may overflow.
+template<typename T, std::size_t N>
+inline int exactSumSign(const std::array<T, N>& terms) {
+    std::array<T, N> expansion = {};
+    std::size_t used = 0;
+    for (T term : terms) {
+        for (std::size_t i = 0; i < used; i++) {
+            T sum = term + expansion[i];
+            expansion[i] = twoSumError(term, expansion[i], sum);
+            term = sum;
+        }
+        expansion[used++] = term;
+    }
+    for (std::size_t i = used; i-- > 0;)
+        if (expansion[i] != 0)
+            return expansion[i] > 0 ? 1 : -1;
+    return 0;
+}
+
+// log2 of 1 / denorm_min: scaling by this turns the smallest subnormal into 1
+template<typename T>
+constexpr int subnormalScale() {
+    return std::numeric_limits<T>::digits - std::numeric_limits<T>::min_exponent;
+}
+
+// ldexp, or false if that loses bits
+template<typename T>
+inline bool exactScale(T value, int scale, T& scaled) {
+    scaled = std::ldexp(value, scale);
+    return std::ldexp(scaled, -scale) == value;
+}
+
+// RMM from the RNE result r of a tiny or otherwise hard case, given the
+// exact result as a sum of terms scaled by 2^scale. Moves r away from zero
+// only if the exact result is the midpoint of |r| and the next value up.
+// If the scaled terms lost bits the exact result has bits finer than any
+// midpoint, so exact says whether they were all scaled exactly.
+template<typename T, std::size_t N>
+inline T roundTiesAwayScaled(T r, const std::array<T, N>& terms, int scale, bool exact) {
+    int sign = exactSumSign(terms);
+    if (!exact || sign == 0)
+        return r;
+    T magnitude = std::fabs(r);
+    T away = nextRepresentable(magnitude, true);
+    if (std::isinf(away))
+        return r;
+    // 2 |exact| - |r| - away == 0
+    std::array<T, N + 2> midpoint;
+    for (std::size_t i = 0; i < N; i++)
+        midpoint[i] = 2 * (sign > 0 ? terms[i] : -terms[i]);
+    midpoint[N] = -std::ldexp(magnitude, scale);
+    midpoint[N + 1] = -std::ldexp(away, scale);
+    if (exactSumSign(midpoint) != 0)
+        return r;
+    return sign > 0 ? away : -away;
+}
+
+// RMM product for results below exactErrorThreshold
+template<typename T>
+inline T mulTiesAway(T a, T b, T r) {
+    int ea, eb;
+    T ma = std::frexp(a, &ea);
+    T mb = std::frexp(b, &eb);
+    T hi = ma * mb;
+    T lo = std::fma(ma, mb, -hi);
+    constexpr int scale = subnormalScale<T>();
+    std::array<T, 2> terms;
+    bool exact = exactScale(hi, ea + eb + scale, terms[0]) & exactScale(lo, ea + eb + scale, terms[1]);
+    return roundTiesAwayScaled(r, terms, scale, exact);
+}
+
+// RMM fused multiply-add for results the error expansion can't handle:
+// tiny results, tiny products and products that overflow on their own
+template<typename T>
+inline T mulAddTiesAway(T a, T b, T c, T r) {
+    int ea, eb;
+    T ma = std::frexp(a, &ea);
+    T mb = std::frexp(b, &eb);
+    T hi = ma * mb;
+    T lo = std::fma(ma, mb, -hi);
+    // Scale the smallest subnormal to 1, or less if the largest term would
+    // then come near overflow
+    int top = ea + eb;
+    if (c != 0)
+        top = std::max(top, std::ilogb(c) + 1);
+    if (r != 0)
+        top = std::max(top, std::ilogb(r) + 1);
+    int scale = std::min(subnormalScale<T>(), std::numeric_limits<T>::max_exponent - 8 - top);
+    std::array<T, 3> terms;
+    bool exact = exactScale(hi, ea + eb + scale, terms[0]) & exactScale(lo, ea + eb + scale, terms[1]) &
+                 exactScale(c, scale, terms[2]);
+    return roundTiesAwayScaled(r, terms, scale, exact);
+}
+
+// RMM quotient for subnormal results. |a / b| is the midpoint m of |r| and
+// the next value up when |a| == |b| m, checked with both sides scaled.
+template<typename T>
+inline T divTiesAway(T a, T b, T r) {
+    int ea, eb;
+    T ma = std::fabs(std::frexp(a, &ea));
+    T mb = std::fabs(std::frexp(b, &eb));
+    T magnitude = std::fabs(r);
+    T away = nextRepresentable(magnitude, true);
+    constexpr int scale = subnormalScale<T>();
+    // |a / b| = ma / mb 2^(ea - eb), and 2 m 2^scale = R + A
+    int shift = ea - eb + scale + 1;
+    if (shift < std::numeric_limits<T>::min_exponent)
+        return r;
+    T R = std::ldexp(magnitude, scale);
+    T A = std::ldexp(away, scale);
+    T productR = mb * R;
+    T productA = mb * A;
+    std::array<T, 5> terms = {
+        std::ldexp(ma, shift),
+        -productR, -std::fma(mb, R, -productR),
+        -productA, -std::fma(mb, A, -productA)
+    };
+    if (exactSumSign(terms) != 0)
+        return r;
+    return std::signbit(a) != std::signbit(b) ? -away : away;
+}
+
+} // namespace detail
+
+template<fpRoundingMode rm, typename T>
+inline T fpAdd(T a, T b) {
+    T r = a + b;
+    if constexpr (rm != fpRoundingMode::RNE) {
+        if (std::isinf(r) && std::isfinite(a) && std::isfinite(b))
+            return detail::roundOverflow<rm>(r);
+        // An exact zero sum is -0 when rounding down, unless both are +0
+        if constexpr (rm == fpRoundingMode::RDN) {
+            if (r == 0 && (a != 0 || std::signbit(a) || std::signbit(b)))
+                return -(T)0;
+        }
+        r = detail::roundFromNearest<rm>(r, detail::twoSumError(a, b, r));
+    }
+    return detail::canonicalize(r);
+}
+
+template<fpRoundingMode rm, typename T>
+inline T fpSub(T a, T b) {
+    return fpAdd<rm, T>(a, -b);
+}
+
+template<fpRoundingMode rm, typename T>
+inline T fpMul(T a, T b) {
+    T r = a * b;
+    if constexpr (rm != fpRoundingMode::RNE) {
+        if (std::isinf(r) && std::isfinite(a) && std::isfinite(b))
+            return detail::roundOverflow<rm>(r);
+        if (std::fabs(r) < detail::exactErrorThreshold<T>() && a != 0 && b != 0) {
+            if constexpr (rm == fpRoundingMode::RMM)
+                return detail::canonicalize(detail::mulTiesAway(a, b, r));
+            return detail::canonicalize(detail::withHostRounding<rm>([a, b]() {
+                volatile T x = a, y = b;
+                volatile T product = x * y;
+                return (T)product;
+            }));
+        }
+        r = detail::roundFromNearest<rm>(r, std::fma(a, b, -r));
+    }
+    return detail::canonicalize(r);
+}
+
+template<fpRoundingMode rm, typename T>
+inline T fpDiv(T a, T b) {
+    T r = a / b;
+    if constexpr (rm == fpRoundingMode::RMM) {
+        if (std::fabs(r) < std::numeric_limits<T>::min() && a != 0 && std::isfinite(a) && std::isfinite(b))
+            r = detail::divTiesAway(a, b, r);
+    } else if constexpr (rm != fpRoundingMode::RNE) {
+        bool finiteOperands = std::isfinite(a) && std::isfinite(b) && b != 0;
+        if (std::isinf(r) && finiteOperands)
+            return detail::roundOverflow<rm>(r);
+        const T threshold = detail::exactErrorThreshold<T>();
+        if (finiteOperands && a != 0 && (std::fabs(r) < threshold || std::fabs(a) < threshold)) {
+            return detail::canonicalize(detail::withHostRounding<rm>([a, b]() {
+                volatile T x = a, y = b;
+                volatile T quotient = x / y;
+                return (T)quotient;
+            }));
+        }
+        // a - r*b has the sign of a/b - r when b is positive
+        T remainder = std::fma(-r, b, a);
+        r = detail::roundFromNearest<rm>(r, std::signbit(b) ? -remainder : remainder);
+    }
+    return detail::canonicalize(r);
+}
+
+template<fpRoundingMode rm, typename T>
+inline T fpSqrt(T a) {
+    T r = std::sqrt(a);
+    if constexpr (rm != fpRoundingMode::RNE && rm != fpRoundingMode::RMM) {
+        if (a > 0 && a < detail::exactErrorThreshold<T>()) {
+            return detail::canonicalize(detail::withHostRounding<rm>([a]() {
+                volatile T x = a;
+                volatile T root = std::sqrt((T)x);
+                return (T)root;
+            }));
+        }
+        r = detail::roundFromNearest<rm>(r, std::fma(-r, r, a));
+    }
+    return detail::canonicalize(r);
+}
+
+// a * b + c with a single rounding. The error of the fused result is summed
+// from error-free parts into a leading term and a tail. Its sign can only
+// come out wrong under cancellation far beyond anything that separates
+// adjacent results.
+template<fpRoundingMode rm, typename T>
+inline T fpMulAdd(T a, T b, T c) {
+    T r = std::fma(a, b, c);
+    if constexpr (rm != fpRoundingMode::RNE) {
+        if (!std::isfinite(a) || !std::isfinite(b) || !std::isfinite(c))
+            return detail::canonicalize(r);
+        if (std::isinf(r))
+            return detail::roundOverflow<rm>(r);
+        const T threshold = detail::exactErrorThreshold<T>();
+        T p = a * b;
+        bool productTiny = a != 0 && b != 0 && std::fabs(p) < threshold;
+        if (std::fabs(r) < threshold || productTiny || std::isinf(p)) {
+            if constexpr (rm == fpRoundingMode::RMM)
+                return detail::canonicalize(detail::mulAddTiesAway(a, b, c, r));
+            return detail::canonicalize(detail::withHostRounding<rm>([a, b, c]() {
+                volatile T x = a, y = b, z = c;
+                volatile T fused = std::fma((T)x, (T)y, (T)z);
+                return (T)fused;
+            }));
+        }
+        T ep = std::fma(a, b, -p);
+        T s = p + c;
+        T es = detail::twoSumError(p, c, s);
+        T t = s - r;
+        T et = detail::twoSumError(s, -r, t);
+        T u = es + ep;
+        T eu = detail::twoSumError(es, ep, u);
+        T v = t + u;
+        T ev = detail::twoSumError(t, u, v);
+        // The error is v + tail; a nonzero tail means it can't be an exact tie
+        T tail = ev + et + eu;
+        if constexpr (rm == fpRoundingMode::RMM) {
+            if (tail != 0)
+                return detail::canonicalize(r);
+        }
+        r = detail::roundFromNearest<rm>(r, v != 0 ? v : tail);
+    }
+    return detail::canonicalize(r);
+}
+
+template<fpRoundingMode rm, typename T>
+inline T fpMulSub(T a, T b, T c) {
+    return fpMulAdd<rm, T>(a, b, -c);
+}
+
+template<fpRoundingMode rm, typename T>
+inline T fpNegMulSub(T a, T b, T c) {
+    return fpMulAdd<rm, T>(-a, b, c);
+}
+
+template<fpRoundingMode rm, typename T>
+inline T fpNegMulAdd(T a, T b, T c) {
+    return fpMulAdd<rm, T>(-a, b, -c);
+}
+
+// FCVT to an integer: rounds with an exact libm rounding function, then
+// saturates out-of-range values and NaN as RISC-V specifies.
+template<fpRoundingMode rm, typename I, typename T>
+inline I fpToInt(T value) {
+    T rounded;
+    if constexpr (rm == fpRoundingMode::RTZ) {
+        rounded = std::trunc(value);
+    } else if constexpr (rm == fpRoundingMode::RDN) {
+        rounded = std::floor(value);
+    } else if constexpr (rm == fpRoundingMode::RUP) {
+        rounded = std::ceil(value);
+    } else if constexpr (rm == fpRoundingMode::RMM) {
+        rounded = std::round(value);
+    } else {
+        rounded = std::nearbyint(value);
+    }
+    // limit is the first value past the top of the range, a power of two
+    constexpr T limit = (T)((__uint64_t)1 << (std::numeric_limits<I>::digits - 1)) * 2;
+    constexpr T bottom = std::numeric_limits<I>::is_signed ? -limit : 0;
+    if (value != value || rounded >= limit) {
+        std::feraiseexcept(FE_INVALID);
+        return std::numeric_limits<I>::max();
+    }
+    if (rounded < bottom) {
+        std::feraiseexcept(FE_INVALID);
+        return std::numeric_limits<I>::min();
+    }
+    if (rounded != value)
+        std::feraiseexcept(FE_INEXACT);
+    return (I)rounded;
+}
+
+// FCVT from an integer. Only 64-bit sources (and 32-bit ones into single
+// precision) can be inexact; the error is computed in 128-bit integers.
+template<fpRoundingMode rm, typename T, typename I>
+inline T fpFromInt(I value) {
+    T r = (T)value;
+    if constexpr (rm != fpRoundingMode::RNE) {
+        __int128 err = (__int128)value - (__int128)r;
+        r = detail::roundFromNearest<rm>(r, err);
+    }
+    return r;
+}
+
+// FCVT.S.D. Widening is always exact, so it needs no kernel.
+template<fpRoundingMode rm>
+inline float fpNarrow(double value) {
+    float r = (float)value;
+    if constexpr (rm != fpRoundingMode::RNE) {
+        if (std::isinf(r) && std::isfinite(value))
+            return detail::roundOverflow<rm>(r);
+        if (value != 0 && std::fabs(r) < detail::exactErrorThreshold<float>()) {
+            // The midpoint of two floats is exact in double
+            if constexpr (rm == fpRoundingMode::RMM) {
+                float away = detail::nextRepresentable(std::fabs(r), true);
+                if (std::fabs(value) == ((double)std::fabs(r) + (double)away) / 2)
+                    return std::copysign(away, (float)value);
+                return r;
+            }
+            return detail::canonicalize(detail::withHostRounding<rm>([value]() {
+                volatile double x = value;
+                volatile float narrowed = (float)x;
+                return (float)narrowed;
+            }));
+        }
+        r = detail::roundFromNearest<rm>(r, value - (double)r);
+    }
+    return detail::canonicalize(r);
+}
+
+// -- Kernel dispatch --
+
+// Indexed by effectiveRoundingMode(); reserved encodings hold nullptr
+template<typename T>
+struct fpKernelTable {
+
+    template<typename R, typename... Args>
+    using table = std::array<R (*)(Args...), 8>;
+
+    constexpr static fpRoundingMode RNE = fpRoundingMode::RNE;
+    constexpr static fpRoundingMode RTZ = fpRoundingMode::RTZ;
+    constexpr static fpRoundingMode RDN = fpRoundingMode::RDN;
+    constexpr static fpRoundingMode RUP = fpRoundingMode::RUP;
+    constexpr static fpRoundingMode RMM = fpRoundingMode::RMM;
+
+    table<T, T, T> add = {{ fpAdd<RNE, T>, fpAdd<RTZ, T>, fpAdd<RDN, T>, fpAdd<RUP, T>, fpAdd<RMM, T> }};
+    table<T, T, T> sub = {{ fpSub<RNE, T>, fpSub<RTZ, T>, fpSub<RDN, T>, fpSub<RUP, T>, fpSub<RMM, T> }};
+    table<T, T, T> mul = {{ fpMul<RNE, T>, fpMul<RTZ, T>, fpMul<RDN, T>, fpMul<RUP, T>, fpMul<RMM, T> }};
+    table<T, T, T> div = {{ fpDiv<RNE, T>, fpDiv<RTZ, T>, fpDiv<RDN, T>, fpDiv<RUP, T>, fpDiv<RMM, T> }};
+    table<T, T> sqrt = {{ fpSqrt<RNE, T>, fpSqrt<RTZ, T>, fpSqrt<RDN, T>, fpSqrt<RUP, T>, fpSqrt<RMM, T> }};
+
+    table<T, T, T, T> madd = {{ fpMulAdd<RNE, T>, fpMulAdd<RTZ, T>, fpMulAdd<RDN, T>, fpMulAdd<RUP, T>, fpMulAdd<RMM, T> }};
+    table<T, T, T, T> msub = {{ fpMulSub<RNE, T>, fpMulSub<RTZ, T>, fpMulSub<RDN, T>, fpMulSub<RUP, T>, fpMulSub<RMM, T> }};
+    table<T, T, T, T> nmsub = {{ fpNegMulSub<RNE, T>, fpNegMulSub<RTZ, T>, fpNegMulSub<RDN, T>, fpNegMulSub<RUP, T>, fpNegMulSub<RMM, T> }};
+    table<T, T, T, T> nmadd = {{ fpNegMulAdd<RNE, T>, fpNegMulAdd<RTZ, T>, fpNegMulAdd<RDN, T>, fpNegMulAdd<RUP, T>, fpNegMulAdd<RMM, T> }};
+
+    table<__int32_t, T> toW = {{ fpToInt<RNE, __int32_t, T>, fpToInt<RTZ, __int32_t, T>, fpToInt<RDN, __int32_t, T>, fpToInt<RUP, __int32_t, T>, fpToInt<RMM, __int32_t, T> }};
+    table<__uint32_t, T> toWU = {{ fpToInt<RNE, __uint32_t, T>, fpToInt<RTZ, __uint32_t, T>, fpToInt<RDN, __uint32_t, T>, fpToInt<RUP, __uint32_t, T>, fpToInt<RMM, __uint32_t, T> }};
+    table<__int64_t, T> toL = {{ fpToInt<RNE, __int64_t, T>, fpToInt<RTZ, __int64_t, T>, fpToInt<RDN, __int64_t, T>, fpToInt<RUP, __int64_t, T>, fpToInt<RMM, __int64_t, T> }};
+    table<__uint64_t, T> toLU = {{ fpToInt<RNE, __uint64_t, T>, fpToInt<RTZ, __uint64_t, T>, fpToInt<RDN, __uint64_t, T>, fpToInt<RUP, __uint64_t, T>, fpToInt<RMM, __uint64_t, T> }};
+
+    table<T, __int32_t> fromW = {{ fpFromInt<RNE, T, __int32_t>, fpFromInt<RTZ, T, __int32_t>, fpFromInt<RDN, T, __int32_t>, fpFromInt<RUP, T, __int32_t>, fpFromInt<RMM, T, __int32_t> }};
+    table<T, __uint32_t> fromWU = {{ fpFromInt<RNE, T, __uint32_t>, fpFromInt<RTZ, T, __uint32_t>, fpFromInt<RDN, T, __uint32_t>, fpFromInt<RUP, T, __uint32_t>, fpFromInt<RMM, T, __uint32_t> }};
+    table<T, __int64_t> fromL = {{ fpFromInt<RNE, T, __int64_t>, fpFromInt<RTZ, T, __int64_t>, fpFromInt<RDN, T, __int64_t>, fpFromInt<RUP, T, __int64_t>, fpFromInt<RMM, T, __int64_t> }};
+    table<T, __uint64_t> fromLU = {{ fpFromInt<RNE, T, __uint64_t>, fpFromInt<RTZ, T, __uint64_t>, fpFromInt<RDN, T, __uint64_t>, fpFromInt<RUP, T, __uint64_t>, fpFromInt<RMM, T, __uint64_t> }};
+};
+
+template<typename T>
+constexpr fpKernelTable<T> fpKernels = {};
+
+constexpr std::array<float (*)(double), 8> fpNarrowKernels = {{
+    fpNarrow<fpRoundingMode::RNE>, fpNarrow<fpRoundingMode::RTZ>, fpNarrow<fpRoundingMode::RDN>,
+    fpNarrow<fpRoundingMode::RUP>, fpNarrow<fpRoundingMode::RMM>
+}};
+
+} // namespace RISCV
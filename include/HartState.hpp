@@ -0,0 +1,176 @@
+#pragma once
+
+#include "RiscV.hpp"
+#include "Trap.hpp"
+
+#include <cstddef>
+#include <utility>
+
+namespace RISCV {
+
+// -- Aggregate hart state --
+
+// HartState keeps what nearly every step touches at the front: pc, the
+// takeable-interrupt summary, privilege and the integer registers. The CSRs
+// follow in a hartControlState starting on its own cache line. Both are
+// cache-line aligned, so an array of harts stepped from different threads
+// never shares a line between two of them.
+//
+// HartArray is the structure-of-arrays form for stepping many small harts
+// from one thread: each hot field, and each register, is an array over harts,
+// so the same register of consecutive harts is contiguous.
+
+constexpr std::size_t HartStateAlignment = 64;
+
+template<typename XLEN_t>
+struct alignas(HartStateAlignment) hartControlState {
+
+    // Warm: read by translation and FP instructions
+    mstatusReg mstatus;
+    fcsrReg fcsr;
+    satpReg<XLEN_t> satp;
+
+    // Cold: only read by CSR instructions and traps
+    interruptPendingReg mip;
+    interruptEnableReg mie;
+    XLEN_t medeleg, mideleg, sedeleg, sideleg;
+    trapDelegationResolver<XLEN_t> delegation;
+    trapState<XLEN_t> traps;
+    XLEN_t mscratch, sscratch, uscratch;
+    __uint32_t mcounteren, scounteren;
+    misaReg misa;
+
+    explicit hartControlState(__uint32_t maximalExtensions) :
+        misa(maximalExtensions) { }
+
+    void Reset() {
+        mstatus.Reset<XLEN_t>();
+        fcsr.Reset();
+        satp.Reset();
+        mip.Reset();
+        mie.Reset();
+        medeleg = mideleg = sedeleg = sideleg = 0;
+        traps.Reset();
+        mscratch = sscratch = uscratch = 0;
+        mcounteren = scounteren = 0;
+        misa.Reset<XLEN_t>();
+        UpdateDelegation();
+    }
+
+    // Call after any write to a delegation register or misa
+    void UpdateDelegation() {
+        delegation.Update(medeleg, mideleg, sedeleg, sideleg, misa.extensions);
+    }
+
+    // Interrupts that are pending, enabled, and would be taken right now at
+    // the given privilege. Interrupts bound for a more privileged mode are
+    // always taken; ones for the current mode only if its xIE is set.
+    XLEN_t TakeableInterrupts(PrivilegeMode privilege) const {
+        XLEN_t pending = (XLEN_t)(mip.bits & mie.bits);
+        XLEN_t takeable = 0;
+        for (XLEN_t remaining = pending; remaining; remaining &= remaining - 1) {
+            unsigned int cause = __builtin_ctzll(remaining);
+            PrivilegeMode destination = delegation.Resolve(true, (TrapCause)cause);
+            bool enabled = destination > privilege ||
+                (destination == privilege &&
+                 (destination == PrivilegeMode::Machine ? mstatus.MIE() :
+                  destination == PrivilegeMode::Supervisor ? mstatus.SIE() : mstatus.UIE()));
+            if (enabled)
+                takeable |= (XLEN_t)1 << cause;
+        }
+        return takeable;
+    }
+};
+
+template<typename XLEN_t>
+struct alignas(HartStateAlignment) HartState {
+
+    // Hot
+    XLEN_t pc;
+    XLEN_t interruptsPending;   // TakeableInterrupts(); nonzero sends the step loop to the trap path
+    PrivilegeMode privilege;
+    std::array<XLEN_t, NumRegs> regs;
+
+    // Cold, starting on its own cache line
+    hartControlState<XLEN_t> control;
+
+    explicit HartState(__uint32_t maximalExtensions) :
+        control(maximalExtensions) { }
+
+    void Reset(XLEN_t resetVector) {
+        pc = resetVector;
+        privilege = PrivilegeMode::Machine;
+        regs = {};
+        control.Reset();
+        UpdateInterruptsPending();
+    }
+
+    // Call after any change to mip, mie, mstatus, delegation or privilege
+    void UpdateInterruptsPending() {
+        interruptsPending = control.TakeableInterrupts(privilege);
+    }
+};
+
+template<typename XLEN_t, unsigned int Harts>
+struct HartArray {
+
+    alignas(HartStateAlignment) std::array<XLEN_t, Harts> pc;
+    alignas(HartStateAlignment) std::array<XLEN_t, Harts> interruptsPending;
+    alignas(HartStateAlignment) std::array<PrivilegeMode, Harts> privilege;
+    alignas(HartStateAlignment) std::array<std::array<XLEN_t, Harts>, NumRegs> regs;   // regs[reg][hart]
+    std::array<hartControlState<XLEN_t>, Harts> control;
+
+    explicit HartArray(__uint32_t maximalExtensions) :
+        control(MakeControl(maximalExtensions, std::make_index_sequence<Harts>())) { }
+
+    void Reset(XLEN_t resetVector) {
+        pc.fill(resetVector);
+        privilege.fill(PrivilegeMode::Machine);
+        for (auto& reg : regs)
+            reg.fill(0);
+        for (unsigned int hart = 0; hart < Harts; hart++) {
+            control[hart].Reset();
+            UpdateInterruptsPending(hart);
+        }
+    }
+
+    void UpdateInterruptsPending(unsigned int hart) {
+        interruptsPending[hart] = control[hart].TakeableInterrupts(privilege[hart]);
+    }
+
+    // Whether any hart has an interrupt to take, so a batch step can skip
+    // the per-hart check
+    bool AnyInterruptsPending() const {
+        XLEN_t any = 0;
+        for (unsigned int hart = 0; hart < Harts; hart++)
+            any |= interruptsPending[hart];
+        return any;
+    }
+
+    // Gather and scatter the hot fields of one hart, for slow paths written
+    // against HartState. The CSRs are not copied; use control[hart] directly.
+    void Load(unsigned int hart, HartState<XLEN_t>& state) const {
+        state.pc = pc[hart];
+        state.interruptsPending = interruptsPending[hart];
+        state.privilege = privilege[hart];
+        for (unsigned int reg = 0; reg < NumRegs; reg++)
+            state.regs[reg] = regs[reg][hart];
+    }
+
+    void Store(unsigned int hart, const HartState<XLEN_t>& state) {
+        pc[hart] = state.pc;
+        interruptsPending[hart] = state.interruptsPending;
+        privilege[hart] = state.privilege;
+        for (unsigned int reg = 0; reg < NumRegs; reg++)
+            regs[reg][hart] = state.regs[reg];
+    }
+
+private:
+
+    template<std::size_t... hart>
+    static std::array<hartControlState<XLEN_t>, Harts> MakeControl(__uint32_t maximalExtensions, std::index_sequence<hart...>) {
+        return {{ ((void)hart, hartControlState<XLEN_t>(maximalExtensions))... }};
+    }
+};
+
+} // namespace RISCV
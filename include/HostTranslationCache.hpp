@@ -0,0 +1,170 @@
+#pragma once
+
+#include "RiscV.hpp"
+#include "PageTableWalker.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace RISCV {
+
+// -- Guest virtual page to host pointer cache --
+
+// A direct-mapped cache from guest virtual pages to host memory, with one
+// table per AccessType. A hit skips translation, permission checks, PMP and
+// the physical memory map entirely: a load or store is a tag compare and a
+// host memory access. Entries are tagged with the paging mode, ASID and
+// effective privilege they were filled under, plus an epoch. Flushing bumps
+// the epoch, which invalidates every entry in O(1) without touching the
+// tables. A satp write that only switches ASID keeps the other address
+// space's entries, as the TLB does; one that moves the root or mode under
+// the same ASID flushes.
+//
+// The cache only stays correct if the caller keeps these rules:
+//  - Insert only after the access fully succeeded (translation, PMP, PMA)
+//    for that access type and privilege, and only when PMP allows the whole
+//    page (pmpUnit::Check on the page base with size PageSize) and the whole
+//    page is contiguous host memory.
+//  - Report satp writes, SFENCE.VMA, mstatus writes and PMP writes through
+//    the On... hooks.
+//  - A Store() hit writes host memory directly, so it bypasses
+//    blockCache::OnStore and reservationTable::OnStore. Call those after
+//    every successful Store() too, or never insert Store entries for pages
+//    that may hold code or reserved lines.
+// Store entries are refused unless the leaf PTE's D bit is set. The first
+// store to a clean page therefore always takes the slow path, where the
+// walker sets D or faults.
+
+struct hostTranslationEntry {
+    __uint64_t page;            // guest virtual address >> PageShift
+    __uint64_t context;         // epoch, paging mode, ASID and privilege it was filled under
+    std::uintptr_t addend;      // host address minus guest virtual address
+};
+
+template<typename XLEN_t, unsigned int Entries = 256>
+struct hostTranslationCache {
+
+    static_assert((Entries & (Entries - 1)) == 0, "Entry count must be a power of two");
+
+    constexpr static unsigned int asidShift = 2;
+    constexpr static unsigned int modeShift = 18;
+    constexpr static unsigned int epochShift = 22;
+
+    std::array<std::array<hostTranslationEntry, Entries>, 3> tables;
+    std::array<__uint64_t, 4> contexts;     // current context per privilege
+    __uint64_t epoch;
+    __uint16_t asid;
+    PagingMode pagingMode;
+    __uint64_t rootPpn;
+
+    void Reset() {
+        for (auto& table : tables)
+            for (hostTranslationEntry& entry : table)
+                entry = { 0, 0, 0 };
+        asid = 0;
+        pagingMode = PagingMode::Bare;
+        rootPpn = 0;
+        // Epoch 0 belongs to the zeroed entries, so start past it
+        epoch = 0;
+        Flush();
+    }
+
+    void Flush() {
+        epoch++;
+        Retag();
+    }
+
+    void Retag() {
+        for (unsigned int privilege = 0; privilege < 4; privilege++)
+            contexts[privilege] = (epoch << epochShift) | ((__uint64_t)pagingMode << modeShift) |
+                                  ((__uint64_t)asid << asidShift) | privilege;
+    }
+
+    static unsigned int Index(XLEN_t virtualAddress) {
+        return (virtualAddress >> PageShift) & (Entries - 1);
+    }
+
+    // privilege is the effective privilege, i.e. after MPRV for data accesses
+    template<AccessType type>
+    void* Lookup(XLEN_t virtualAddress, unsigned int size, PrivilegeMode privilege) const {
+        const hostTranslationEntry& entry = tables[type][Index(virtualAddress)];
+        __uint64_t firstPage = virtualAddress >> PageShift;
+        __uint64_t lastPage = (virtualAddress + size - 1) >> PageShift;
+        if (entry.page != firstPage || lastPage != firstPage || entry.context != contexts[privilege])
+            return nullptr;
+        return (void*)((std::uintptr_t)virtualAddress + entry.addend);
+    }
+
+    template<typename T>
+    bool Load(XLEN_t virtualAddress, PrivilegeMode privilege, T& value) const {
+        void* host = Lookup<AccessType::Load>(virtualAddress, sizeof(T), privilege);
+        if (host == nullptr)
+            return false;
+        std::memcpy(&value, host, sizeof(T));
+        return true;
+    }
+
+    template<typename T>
+    bool Store(XLEN_t virtualAddress, PrivilegeMode privilege, T value) {
+        void* host = Lookup<AccessType::Store>(virtualAddress, sizeof(T), privilege);
+        if (host == nullptr)
+            return false;
+        std::memcpy(host, &value, sizeof(T));
+        return true;
+    }
+
+    // hostPage is the host address backing the first byte of the guest page
+    void Insert(XLEN_t virtualAddress, AccessType type, PrivilegeMode privilege, __uint8_t pteBits, void* hostPage) {
+        if (type == AccessType::Store && !(pteBits & PTEBit::D))
+            return;
+        __uint64_t pageBase = (__uint64_t)virtualAddress & ~(PageSize - 1);
+        tables[type][Index(virtualAddress)] = {
+            pageBase >> PageShift,
+            contexts[privilege],
+            (std::uintptr_t)hostPage - (std::uintptr_t)pageBase
+        };
+    }
+
+    // -- Invalidation hooks --
+
+    // Software has to fence before it reuses an ASID for different tables,
+    // so only a new root or mode under the same ASID needs a flush
+    void OnSatpWrite(const satpReg<XLEN_t>& satp) {
+        bool sameAsid = satp.asid == asid;
+        bool moved = satp.pagingMode != pagingMode || satp.ppn != rootPpn;
+        asid = satp.asid;
+        pagingMode = satp.pagingMode;
+        rootPpn = satp.ppn;
+        if (sameAsid && moved)
+            Flush();
+        else
+            Retag();
+    }
+
+    // An address-specific fence only needs the three entries that could hold
+    // the page. Fences by ASID alone are rare enough to just flush.
+    void OnFence(bool hasAddress, XLEN_t virtualAddress) {
+        if (!hasAddress) {
+            Flush();
+            return;
+        }
+        for (auto& table : tables) {
+            hostTranslationEntry& entry = table[Index(virtualAddress)];
+            if (entry.page == (virtualAddress >> PageShift))
+                entry.context = 0;
+        }
+    }
+
+    void OnMstatusWrite(const mstatusReg& before, const mstatusReg& after) {
+        if (before.SUM() != after.SUM() || before.MXR() != after.MXR() ||
+            before.MPRV() != after.MPRV() || before.MPP() != after.MPP())
+            Flush();
+    }
+
+    void OnPmpWrite() {
+        Flush();
+    }
+
+};
+
+} // namespace RISCV
@@ -0,0 +1,748 @@
+#pragma once
+
+#include "RiscV.hpp"
+#include "BlockCache.hpp"
+#include "HartState.hpp"
+#include "PerformanceCounters.hpp"
+#include "TLB.hpp"
+#include "Trap.hpp"
+
+namespace RISCV {
+
+// -- Reference interpreter --
+
+// Executes RV32/RV64 IMAC with Zicsr and Zifencei, in M, S and U modes, on a
+// HartState. Code runs out of a blockCache of predecoded blocks. Each
+// block's ops are dispatched direct-threaded: every handler ends by jumping
+// straight to the next op's handler through a table of label addresses. The
+// compiler then gives each handler its own indirect branch, which predicts
+// far better than the single shared jump of a switch loop. Compilers without
+// labels-as-values get a switch instead, as does anything that defines
+// RISCV_SWITCH_DISPATCH.
+//
+// Memory is reached through an accessor providing, for T each of __uint8_t,
+// __uint16_t, __uint32_t and __uint64_t,
+//
+//     bool Read(__uint64_t physicalAddress, T& value);
+//     bool Write(__uint64_t physicalAddress, T value);
+//
+// with false reporting an access fault. This is the same accessor the page
+// table walker and block cache use. Data accesses are translated through a
+// TLB. PMP is not checked, and misaligned accesses trap.
+//
+// Interrupts are taken between blocks, when HartState::interruptsPending is
+// nonzero. Code that changes mip from outside has to call
+// UpdateInterruptsPending() on the hart.
+//
+// Performance events are counted as the instruction causing them retires,
+// so mhpmevent can select any of them. The TLB counts its own misses and
+// fences. FloatingPointRetired stays at zero, since there is no F or D.
+
+#if !defined(__GNUC__) && !defined(RISCV_SWITCH_DISPATCH)
+#define RISCV_SWITCH_DISPATCH
+#endif
+
+// Every InstructionID, in enum order, for building the handler table
+#define RISCV_INSTRUCTION_IDS(X) \
+    X(INVALID) \
+    X(LUI) X(AUIPC) X(JAL) X(JALR) \
+    X(BEQ) X(BNE) X(BLT) X(BGE) X(BLTU) X(BGEU) \
+    X(LB) X(LH) X(LW) X(LD) X(LBU) X(LHU) X(LWU) \
+    X(SB) X(SH) X(SW) X(SD) \
+    X(ADDI) X(SLTI) X(SLTIU) X(XORI) X(ORI) X(ANDI) X(SLLI) X(SRLI) X(SRAI) \
+    X(ADD) X(SUB) X(SLL) X(SLT) X(SLTU) X(XOR) X(SRL) X(SRA) X(OR) X(AND) \
+    X(ADDIW) X(SLLIW) X(SRLIW) X(SRAIW) \
+    X(ADDW) X(SUBW) X(SLLW) X(SRLW) X(SRAW) \
+    X(FENCE) \
+    X(ECALL) X(EBREAK) X(URET) X(SRET) X(MRET) X(WFI) X(SFENCE_VMA) \
+    X(FENCE_I) \
+    X(CSRRW) X(CSRRS) X(CSRRC) X(CSRRWI) X(CSRRSI) X(CSRRCI) \
+    X(MUL) X(MULH) X(MULHSU) X(MULHU) X(DIV) X(DIVU) X(REM) X(REMU) \
+    X(MULW) X(DIVW) X(DIVUW) X(REMW) X(REMUW) \
+    X(LR_W) X(SC_W) X(AMOSWAP_W) X(AMOADD_W) X(AMOXOR_W) X(AMOAND_W) X(AMOOR_W) \
+    X(AMOMIN_W) X(AMOMAX_W) X(AMOMINU_W) X(AMOMAXU_W) \
+    X(LR_D) X(SC_D) X(AMOSWAP_D) X(AMOADD_D) X(AMOXOR_D) X(AMOAND_D) X(AMOOR_D) \
+    X(AMOMIN_D) X(AMOMAX_D) X(AMOMINU_D) X(AMOMAXU_D)
+
+constexpr isaFeatureSet interpreterFeatures = isaFeatures("rv64imacsu_zicsr_zifencei");
+
+template<typename XLEN_t, typename Memory, isaFeatureSet features = interpreterFeatures>
+struct interpreter {
+
+    using SXLEN_t = std::make_signed_t<XLEN_t>;
+    using cache_t = blockCache<XLEN_t, features>;
+    using block_t = typename cache_t::block;
+
+    constexpr static bool rv32 = std::is_same<XLEN_t, __uint32_t>();
+    constexpr static unsigned int xlenBits = sizeof(XLEN_t) * 8;
+
+    HartState<XLEN_t>& hart;
+    Memory& memory;
+    cache_t cache;
+    tlb<XLEN_t> translationBuffer;
+    performanceCounters counters;
+    XLEN_t hartId;
+    bool reservationValid;
+    XLEN_t reservationAddress;
+    __uint64_t trapsTaken;
+
+    // Holds the one instruction that straddles a page, which never goes in the cache
+    block_t straddler;
+
+    interpreter(HartState<XLEN_t>& hart, Memory& memory, XLEN_t hartId = 0) :
+        hart(hart), memory(memory), hartId(hartId) {
+        translationBuffer.counters = &counters;
+    }
+
+    void Reset() {
+        cache.Reset();
+        translationBuffer.Reset();
+        counters.Reset();
+        reservationValid = false;
+        reservationAddress = 0;
+        trapsTaken = 0;
+    }
+
+    // Runs until at least the given number of steps have passed, stopping at
+    // the first block boundary after that. A step is a retired instruction or
+    // a trap entry, so a hart stuck in a trap loop still returns. Returns the
+    // number of instructions retired.
+    __uint64_t Run(__uint64_t steps) {
+        __uint64_t retired = 0;
+        const __uint64_t trapsBefore = trapsTaken;
+        while (retired + (trapsTaken - trapsBefore) < steps) {
+            if (hart.interruptsPending) {
+                counters.Count<PerformanceEvent::Interrupts>();
+                Trap(true, highestPriorityInterrupt(hart.interruptsPending), 0);
+                continue;
+            }
+            TrapCause cause = TrapCause::NONE;
+            XLEN_t tval = 0;
+            const block_t* b = FetchBlock(cause, tval);
+            if (b == nullptr) {
+                Trap(false, cause, tval);
+                continue;
+            }
+            retired += Execute(*b);
+        }
+        return retired;
+    }
+
+private:
+
+    // -- Fetch --
+
+    // On failure, sets the cause and the faulting address to report in tval
+    const block_t* FetchBlock(TrapCause& cause, XLEN_t& tval) {
+        XLEN_t pc = hart.pc;
+        __uint8_t mode = blockMode(hart.privilege, xlenTypeToMode<XLEN_t>());
+        translationResult translated = translationBuffer.Translate(
+            memory, hart.control.satp, hart.control.mstatus, hart.privilege, pc, AccessType::Fetch);
+        if (translated.cause != TrapCause::NONE) {
+            cause = translated.cause;
+            tval = pc;
+            return nullptr;
+        }
+        const block_t* b = cache.Lookup(translated.physicalAddress, mode);
+        if (b != nullptr)
+            return b;
+        b = cache.Build(memory, translated.physicalAddress, translated.physicalAddress, mode, false);
+        if (b != nullptr)
+            return b;
+        return FetchStraddler(translated.physicalAddress, cause, tval);
+    }
+
+    // An instruction whose two halves sit on different pages. A fault on the
+    // second half reports the address of that half, not the pc.
+    const block_t* FetchStraddler(__uint64_t physicalAddress, TrapCause& cause, XLEN_t& tval) {
+        __uint16_t low, high;
+        if (!memory.Read(physicalAddress, low)) {
+            cause = TrapCause::INSTRUCTION_ACCESS_FAULT;
+            tval = hart.pc;
+            return nullptr;
+        }
+        __uint32_t encoded = low;
+        unsigned int length = 2;
+        if (!isCompressed(low)) {
+            XLEN_t upper = hart.pc + 2;
+            translationResult translated = translationBuffer.Translate(
+                memory, hart.control.satp, hart.control.mstatus, hart.privilege, upper, AccessType::Fetch);
+            if (translated.cause != TrapCause::NONE) {
+                cause = translated.cause;
+                tval = upper;
+                return nullptr;
+            }
+            if (!memory.Read(translated.physicalAddress, high)) {
+                cause = TrapCause::INSTRUCTION_ACCESS_FAULT;
+                tval = upper;
+                return nullptr;
+            }
+            encoded |= (__uint32_t)high << 16;
+            length = 4;
+        } else {
+            encoded = featureSetHas(features, 'C') ? expandCompressed<XLEN_t>(low) : IllegalExpansion;
+        }
+        straddler.ops[0] = predecode<XLEN_t, features>(encoded, length);
+        straddler.count = 1;
+        return &straddler;
+    }
+
+    // -- Traps --
+
+    void Trap(bool interrupt, TrapCause cause, XLEN_t tval) {
+        trapsTaken++;
+        if (!interrupt)
+            counters.Count<PerformanceEvent::Exceptions>();
+        // A handler that saves FP state has to see what the host FPU collected
+        hart.control.fcsr.SyncHostFlags();
+        hart.pc = TakeTrap(hart.control.traps, hart.control.delegation, hart.control.mstatus,
+                           hart.privilege, interrupt, cause, hart.pc, tval);
+        hart.UpdateInterruptsPending();
+    }
+
+    // -- Data memory --
+
+    template<typename T, AccessType type>
+    bool Translate(XLEN_t address, __uint64_t& physicalAddress, TrapCause& cause) {
+        if (address & (sizeof(T) - 1)) {
+            cause = misalignedCause(type);
+            return false;
+        }
+        translationResult translated = translationBuffer.Translate(
+            memory, hart.control.satp, hart.control.mstatus, hart.privilege, address, type);
+        cause = translated.cause;
+        physicalAddress = translated.physicalAddress;
+        return cause == TrapCause::NONE;
+    }
+
+    template<typename T>
+    bool Load(XLEN_t address, T& value, TrapCause& cause) {
+        __uint64_t physicalAddress;
+        if (!Translate<T, AccessType::Load>(address, physicalAddress, cause))
+            return false;
+        if (!memory.Read(physicalAddress, value)) {
+            cause = TrapCause::LOAD_ACCESS_FAULT;
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    bool Store(XLEN_t address, T value, TrapCause& cause) {
+        __uint64_t physicalAddress;
+        if (!Translate<T, AccessType::Store>(address, physicalAddress, cause))
+            return false;
+        if (!memory.Write(physicalAddress, value)) {
+            cause = TrapCause::STORE_AMO_ACCESS_FAULT;
+            return false;
+        }
+        cache.OnStore(physicalAddress, sizeof(T));
+        if (reservationValid && (physicalAddress >> 3) == ((__uint64_t)reservationAddress >> 3))
+            reservationValid = false;
+        return true;
+    }
+
+    // Read-modify-write for AMOs, which fault as stores
+    template<typename T, typename Op>
+    bool Atomic(XLEN_t address, T& old, TrapCause& cause, Op op) {
+        __uint64_t physicalAddress;
+        if (!Translate<T, AccessType::Store>(address, physicalAddress, cause))
+            return false;
+        if (!memory.Read(physicalAddress, old) || !memory.Write(physicalAddress, (T)op(old))) {
+            cause = TrapCause::STORE_AMO_ACCESS_FAULT;
+            return false;
+        }
+        cache.OnStore(physicalAddress, sizeof(T));
+        return true;
+    }
+
+    // -- CSRs --
+
+    bool ReadCSR(unsigned int address, XLEN_t& value) {
+        hartControlState<XLEN_t>& c = hart.control;
+        PrivilegeMode view = csrRequiredPrivilege((CSRAddress)address);
+        trapContext<XLEN_t>& context = c.traps.contexts[view];
+        switch (csrMetadataTable[address].handler) {
+        case CSRHandlerClass::Status:
+            value = view == PrivilegeMode::Machine ? c.mstatus.template Read<XLEN_t, PrivilegeMode::Machine>() :
+                    view == PrivilegeMode::Supervisor ? c.mstatus.template Read<XLEN_t, PrivilegeMode::Supervisor>() :
+                    c.mstatus.template Read<XLEN_t, PrivilegeMode::User>();
+            return true;
+        case CSRHandlerClass::ISA:
+            value = c.misa.template Read<XLEN_t>();
+            return true;
+        case CSRHandlerClass::Delegation:
+            value = address == CSRAddress::MEDELEG ? c.medeleg : address == CSRAddress::MIDELEG ? c.mideleg :
+                    address == CSRAddress::SEDELEG ? c.sedeleg : c.sideleg;
+            return true;
+        case CSRHandlerClass::InterruptEnable:
+            value = ReadInterruptReg(c.mie, view);
+            return true;
+        case CSRHandlerClass::InterruptPending:
+            value = ReadInterruptReg(c.mip, view);
+            return true;
+        case CSRHandlerClass::TrapVector:
+            value = context.tvec.Read();
+            return true;
+        case CSRHandlerClass::CounterEnable:
+            value = address == CSRAddress::MCOUNTEREN ? c.mcounteren : c.scounteren;
+            return true;
+        case CSRHandlerClass::Scratch:
+            value = view == PrivilegeMode::Machine ? c.mscratch : view == PrivilegeMode::Supervisor ? c.sscratch : c.uscratch;
+            return true;
+        case CSRHandlerClass::ExceptionPC:
+            value = context.epc;
+            return true;
+        case CSRHandlerClass::Cause:
+            value = context.cause.Read();
+            return true;
+        case CSRHandlerClass::TrapValue:
+            value = context.tval;
+            return true;
+        case CSRHandlerClass::AddressTranslation:
+            value = c.satp.Read();
+            return true;
+        case CSRHandlerClass::FloatingPoint:
+            value = address == CSRAddress::FFLAGS ? c.fcsr.template Read<XLEN_t, CSRAddress::FFLAGS>() :
+                    address == CSRAddress::FRM ? c.fcsr.template Read<XLEN_t, CSRAddress::FRM>() :
+                    c.fcsr.template Read<XLEN_t, CSRAddress::FCSR>();
+            return true;
+        case CSRHandlerClass::Counter:
+        case CSRHandlerClass::CounterHigh:
+        case CSRHandlerClass::EventSelector:
+        case CSRHandlerClass::CounterInhibit:
+            value = counters.Read<XLEN_t>(address);
+            return true;
+        case CSRHandlerClass::MachineInformation:
+            value = address == CSRAddress::MHARTID ? hartId : 0;
+            return true;
+        case CSRHandlerClass::None:
+            return false;
+        default:
+            // PMP, triggers and debug are not modelled and read as zero
+            value = 0;
+            return true;
+        }
+    }
+
+    void WriteCSR(unsigned int address, XLEN_t value) {
+        hartControlState<XLEN_t>& c = hart.control;
+        PrivilegeMode view = csrRequiredPrivilege((CSRAddress)address);
+        trapContext<XLEN_t>& context = c.traps.contexts[view];
+        // IALIGN is 16 with C and 32 without
+        constexpr XLEN_t epcMask = featureSetHas(features, 'C') ? ~(XLEN_t)1 : ~(XLEN_t)3;
+        switch (csrMetadataTable[address].handler) {
+        case CSRHandlerClass::Status:
+            if (view == PrivilegeMode::Machine)
+                c.mstatus.template Write<XLEN_t, PrivilegeMode::Machine>(value);
+            else if (view == PrivilegeMode::Supervisor)
+                c.mstatus.template Write<XLEN_t, PrivilegeMode::Supervisor>(value);
+            else
+                c.mstatus.template Write<XLEN_t, PrivilegeMode::User>(value);
+            break;
+        case CSRHandlerClass::ISA:
+            c.misa.template Write<XLEN_t>(value);
+            c.UpdateDelegation();
+            break;
+        case CSRHandlerClass::Delegation:
+            (address == CSRAddress::MEDELEG ? c.medeleg : address == CSRAddress::MIDELEG ? c.mideleg :
+             address == CSRAddress::SEDELEG ? c.sedeleg : c.sideleg) = value;
+            c.UpdateDelegation();
+            break;
+        case CSRHandlerClass::InterruptEnable:
+            WriteInterruptReg(c.mie, view, value);
+            break;
+        case CSRHandlerClass::InterruptPending:
+            WriteInterruptReg(c.mip, view, value);
+            break;
+        case CSRHandlerClass::TrapVector:
+            context.tvec.Write(value);
+            break;
+        case CSRHandlerClass::CounterEnable:
+            (address == CSRAddress::MCOUNTEREN ? c.mcounteren : c.scounteren) = (__uint32_t)value;
+            break;
+        case CSRHandlerClass::Scratch:
+            (view == PrivilegeMode::Machine ? c.mscratch : view == PrivilegeMode::Supervisor ? c.sscratch : c.uscratch) = value;
+            break;
+        case CSRHandlerClass::ExceptionPC:
+            context.epc = value & epcMask;
+            break;
+        case CSRHandlerClass::Cause:
+            context.cause.Write(value);
+            break;
+        case CSRHandlerClass::TrapValue:
+            context.tval = value;
+            break;
+        case CSRHandlerClass::AddressTranslation: {
+            // Writes selecting an unsupported mode have no effect at all
+            PagingMode mode = rv32 ? (PagingMode)(value >> 31) : (PagingMode)((__uint64_t)value >> 60);
+            bool supported = rv32 ? (mode == PagingMode::Bare || mode == PagingMode::Sv32) :
+                (mode == PagingMode::Bare || mode == PagingMode::Sv39 || mode == PagingMode::Sv48 || mode == PagingMode::Sv57);
+            if (supported)
+                c.satp.Write(value);
+            break;
+        }
+        case CSRHandlerClass::FloatingPoint:
+            if (address == CSRAddress::FFLAGS)
+                c.fcsr.template Write<XLEN_t, CSRAddress::FFLAGS>(value);
+            else if (address == CSRAddress::FRM)
+                c.fcsr.template Write<XLEN_t, CSRAddress::FRM>(value);
+            else
+                c.fcsr.template Write<XLEN_t, CSRAddress::FCSR>(value);
+            break;
+        case CSRHandlerClass::Counter:
+        case CSRHandlerClass::CounterHigh:
+        case CSRHandlerClass::EventSelector:
+        case CSRHandlerClass::CounterInhibit:
+            counters.Write<XLEN_t>(address, value);
+            break;
+        default:
+            break;
+        }
+        hart.UpdateInterruptsPending();
+    }
+
+    template<typename Reg>
+    static XLEN_t ReadInterruptReg(Reg& reg, PrivilegeMode view) {
+        if (view == PrivilegeMode::Machine)
+            return reg.template Read<XLEN_t, PrivilegeMode::Machine>();
+        if (view == PrivilegeMode::Supervisor)
+            return reg.template Read<XLEN_t, PrivilegeMode::Supervisor>();
+        return reg.template Read<XLEN_t, PrivilegeMode::User>();
+    }
+
+    template<typename Reg>
+    static void WriteInterruptReg(Reg& reg, PrivilegeMode view, XLEN_t value) {
+        if (view == PrivilegeMode::Machine)
+            reg.template Write<XLEN_t, PrivilegeMode::Machine>(value);
+        else if (view == PrivilegeMode::Supervisor)
+            reg.template Write<XLEN_t, PrivilegeMode::Supervisor>(value);
+        else
+            reg.template Write<XLEN_t, PrivilegeMode::User>(value);
+    }
+
+    // Performs a whole CSR instruction; false if it is illegal. Only writes
+    // when the instruction would: always for CSRRW(I), and for the set and
+    // clear forms only with a nonzero rs1 or uimm.
+    bool CSRInstruction(const predecodedOp& op, XLEN_t source, bool write, int kind) {
+        unsigned int address = (unsigned int)op.imm;
+        hartControlState<XLEN_t>& c = hart.control;
+        __uint32_t counterEnable = effectiveCounterEnable(hart.privilege, c.mcounteren, c.scounteren, c.misa.extensions);
+        if (!csrAccessLegal<XLEN_t>(address, hart.privilege, write, c.misa.extensions, counterEnable))
+            return false;
+        if (address == CSRAddress::SATP && hart.privilege == PrivilegeMode::Supervisor && c.mstatus.TVM())
+            return false;
+        XLEN_t old = 0;
+        if ((kind != 0 || op.rd != 0) && !ReadCSR(address, old))
+            return false;
+        if (write)
+            WriteCSR(address, kind == 0 ? source : kind == 1 ? (old | source) : (old & ~source));
+        hart.regs[op.rd] = old;
+        return true;
+    }
+
+    // -- Execution --
+
+    // Runs one block and returns how many of its instructions retired
+    unsigned int Execute(const block_t& b) {
+
+        const predecodedOp* const first = b.ops.data();
+        const predecodedOp* const end = first + b.count;
+        const predecodedOp* op = first;
+        XLEN_t pc = hart.pc;
+        XLEN_t* x = hart.regs.data();
+        TrapCause cause = TrapCause::NONE;
+        XLEN_t tval = 0;
+        unsigned int counted = 0;   // retirements already passed to counters
+
+#if defined(RISCV_SWITCH_DISPATCH)
+#define RISCV_HANDLER_CASE(name) case InstructionID::name: goto handle_##name;
+#define DISPATCH() goto dispatch
+#else
+#define RISCV_HANDLER_ADDRESS(name) &&handle_##name,
+        static const void* const handlers[] = { RISCV_INSTRUCTION_IDS(RISCV_HANDLER_ADDRESS) };
+        static_assert(sizeof(handlers) / sizeof(handlers[0]) == NumInstructionIDs, "Handler table out of step with InstructionID");
+#undef RISCV_HANDLER_ADDRESS
+#define DISPATCH() goto *handlers[(unsigned int)op->id]
+#endif
+
+// x0 is written like any register and cleared again before the next op
+#define NEXT() do { pc += op->length; x[0] = 0; if (++op == end) goto done; DISPATCH(); } while (0)
+#define JUMP(target) do { pc = (target); x[0] = 0; op++; goto done; } while (0)
+#define RAISE(trapCause, trapValue) do { cause = (trapCause); tval = (trapValue); goto exception; } while (0)
+#define HANDLER(name) handle_##name:
+#define RS1 x[op->rs1]
+#define RS2 x[op->rs2]
+#define RD x[op->rd]
+#define IMM ((XLEN_t)(SXLEN_t)op->imm)
+#define SEXT32(value) ((XLEN_t)(SXLEN_t)(__int32_t)(value))
+
+        DISPATCH();
+
+#if defined(RISCV_SWITCH_DISPATCH)
+    dispatch:
+        switch (op->id) {
+        RISCV_INSTRUCTION_IDS(RISCV_HANDLER_CASE)
+        default:
+            goto handle_INVALID;
+        }
+#undef RISCV_HANDLER_CASE
+#endif
+
+    HANDLER(INVALID) RAISE(TrapCause::ILLEGAL_INSTRUCTION, 0);
+
+    HANDLER(LUI) RD = IMM; NEXT();
+    HANDLER(AUIPC) RD = pc + IMM; NEXT();
+    HANDLER(JAL) {
+        XLEN_t link = pc + op->length; XLEN_t target = pc + IMM; RD = link;
+        counters.Count<PerformanceEvent::JumpsRetired>(); JUMP(target); }
+    HANDLER(JALR) {
+        XLEN_t link = pc + op->length; XLEN_t target = (RS1 + IMM) & ~(XLEN_t)1; RD = link;
+        counters.Count<PerformanceEvent::JumpsRetired>(); JUMP(target); }
+
+#define BRANCH_HANDLER(name, condition) \
+    HANDLER(name) { \
+        bool taken = (condition); \
+        counters.Count<PerformanceEvent::BranchesRetired>(); \
+        counters.Count<PerformanceEvent::BranchesTaken>(taken); \
+        JUMP(taken ? pc + IMM : pc + op->length); }
+    BRANCH_HANDLER(BEQ, RS1 == RS2)
+    BRANCH_HANDLER(BNE, RS1 != RS2)
+    BRANCH_HANDLER(BLT, (SXLEN_t)RS1 < (SXLEN_t)RS2)
+    BRANCH_HANDLER(BGE, (SXLEN_t)RS1 >= (SXLEN_t)RS2)
+    BRANCH_HANDLER(BLTU, RS1 < RS2)
+    BRANCH_HANDLER(BGEU, RS1 >= RS2)
+#undef BRANCH_HANDLER
+
+#define LOAD_HANDLER(name, T, signExtend) \
+    HANDLER(name) { \
+        T value; if (!Load<T>(RS1 + IMM, value, cause)) RAISE(cause, RS1 + IMM); \
+        RD = signExtend ? (XLEN_t)(SXLEN_t)(std::make_signed_t<T>)value : (XLEN_t)value; \
+        counters.Count<PerformanceEvent::LoadsRetired>(); NEXT(); }
+    LOAD_HANDLER(LB, __uint8_t, true)
+    LOAD_HANDLER(LH, __uint16_t, true)
+    LOAD_HANDLER(LW, __uint32_t, true)
+    LOAD_HANDLER(LD, __uint64_t, false)
+    LOAD_HANDLER(LBU, __uint8_t, false)
+    LOAD_HANDLER(LHU, __uint16_t, false)
+    LOAD_HANDLER(LWU, __uint32_t, false)
+#undef LOAD_HANDLER
+
+#define STORE_HANDLER(name, T) \
+    HANDLER(name) { \
+        if (!Store<T>(RS1 + IMM, (T)RS2, cause)) RAISE(cause, RS1 + IMM); \
+        counters.Count<PerformanceEvent::StoresRetired>(); NEXT(); }
+    STORE_HANDLER(SB, __uint8_t)
+    STORE_HANDLER(SH, __uint16_t)
+    STORE_HANDLER(SW, __uint32_t)
+    STORE_HANDLER(SD, __uint64_t)
+#undef STORE_HANDLER
+
+    HANDLER(ADDI) RD = RS1 + IMM; NEXT();
+    HANDLER(SLTI) RD = (SXLEN_t)RS1 < (SXLEN_t)IMM; NEXT();
+    HANDLER(SLTIU) RD = RS1 < IMM; NEXT();
+    HANDLER(XORI) RD = RS1 ^ IMM; NEXT();
+    HANDLER(ORI) RD = RS1 | IMM; NEXT();
+    HANDLER(ANDI) RD = RS1 & IMM; NEXT();
+    HANDLER(SLLI) RD = RS1 << op->imm; NEXT();
+    HANDLER(SRLI) RD = RS1 >> op->imm; NEXT();
+    HANDLER(SRAI) RD = (XLEN_t)((SXLEN_t)RS1 >> op->imm); NEXT();
+
+    HANDLER(ADD) RD = RS1 + RS2; NEXT();
+    HANDLER(SUB) RD = RS1 - RS2; NEXT();
+    HANDLER(SLL) RD = RS1 << (RS2 & (xlenBits - 1)); NEXT();
+    HANDLER(SLT) RD = (SXLEN_t)RS1 < (SXLEN_t)RS2; NEXT();
+    HANDLER(SLTU) RD = RS1 < RS2; NEXT();
+    HANDLER(XOR) RD = RS1 ^ RS2; NEXT();
+    HANDLER(SRL) RD = RS1 >> (RS2 & (xlenBits - 1)); NEXT();
+    HANDLER(SRA) RD = (XLEN_t)((SXLEN_t)RS1 >> (RS2 & (xlenBits - 1))); NEXT();
+    HANDLER(OR) RD = RS1 | RS2; NEXT();
+    HANDLER(AND) RD = RS1 & RS2; NEXT();
+
+    HANDLER(ADDIW) RD = SEXT32(RS1 + IMM); NEXT();
+    HANDLER(SLLIW) RD = SEXT32((__uint32_t)RS1 << op->imm); NEXT();
+    HANDLER(SRLIW) RD = SEXT32((__uint32_t)RS1 >> op->imm); NEXT();
+    HANDLER(SRAIW) RD = SEXT32((__int32_t)RS1 >> op->imm); NEXT();
+    HANDLER(ADDW) RD = SEXT32(RS1 + RS2); NEXT();
+    HANDLER(SUBW) RD = SEXT32(RS1 - RS2); NEXT();
+    HANDLER(SLLW) RD = SEXT32((__uint32_t)RS1 << (RS2 & 31)); NEXT();
+    HANDLER(SRLW) RD = SEXT32((__uint32_t)RS1 >> (RS2 & 31)); NEXT();
+    HANDLER(SRAW) RD = SEXT32((__int32_t)RS1 >> (RS2 & 31)); NEXT();
+
+    HANDLER(FENCE) NEXT();
+    HANDLER(FENCE_I) cache.OnFenceI(); JUMP(pc + op->length);
+
+    HANDLER(ECALL) RAISE((TrapCause)((int)TrapCause::ECALL_FROM_U_MODE + (int)hart.privilege), 0);
+    HANDLER(EBREAK) RAISE(TrapCause::BREAKPOINT, pc);
+    // xRET changes privilege and xIE, so what is takeable has to be redone
+    HANDLER(URET) {
+        XLEN_t target = URet(hart.control.traps, hart.control.mstatus, hart.privilege);
+        hart.UpdateInterruptsPending();
+        JUMP(target);
+    }
+    HANDLER(SRET) {
+        if (hart.privilege < PrivilegeMode::Supervisor ||
+            (hart.privilege == PrivilegeMode::Supervisor && hart.control.mstatus.TSR()))
+            RAISE(TrapCause::ILLEGAL_INSTRUCTION, 0);
+        XLEN_t target = SRet(hart.control.traps, hart.control.mstatus, hart.privilege);
+        hart.UpdateInterruptsPending();
+        JUMP(target);
+    }
+    HANDLER(MRET) {
+        if (hart.privilege != PrivilegeMode::Machine)
+            RAISE(TrapCause::ILLEGAL_INSTRUCTION, 0);
+        XLEN_t target = MRet(hart.control.traps, hart.control.mstatus, hart.privilege);
+        hart.UpdateInterruptsPending();
+        JUMP(target);
+    }
+    HANDLER(WFI) {
+        // Waiting is allowed to be a no-op; interrupts are checked after the block
+        if (hart.privilege != PrivilegeMode::Machine && hart.control.mstatus.TW())
+            RAISE(TrapCause::ILLEGAL_INSTRUCTION, 0);
+        JUMP(pc + op->length);
+    }
+    HANDLER(SFENCE_VMA) {
+        if (hart.privilege == PrivilegeMode::User ||
+            (hart.privilege == PrivilegeMode::Supervisor && hart.control.mstatus.TVM()))
+            RAISE(TrapCause::ILLEGAL_INSTRUCTION, 0);
+        translationBuffer.Fence(op->rs1 != 0, RS1, op->rs2 != 0, (__uint16_t)RS2);
+        JUMP(pc + op->length);
+    }
+
+    // Reads of minstret have to see every instruction before the CSR one,
+    // so the block's retirements so far are counted first
+#define CSR_HANDLER(name, source, write, kind) \
+    HANDLER(name) { \
+        counted = op - first; \
+        counters.Count<PerformanceEvent::InstructionsRetired>(counted); \
+        if (!CSRInstruction(*op, source, write, kind)) RAISE(TrapCause::ILLEGAL_INSTRUCTION, 0); \
+        counters.Count<PerformanceEvent::CSRAccesses>(); JUMP(pc + op->length); }
+    CSR_HANDLER(CSRRW, RS1, true, 0)
+    CSR_HANDLER(CSRRS, RS1, op->rs1 != 0, 1)
+    CSR_HANDLER(CSRRC, RS1, op->rs1 != 0, 2)
+    CSR_HANDLER(CSRRWI, op->rs1, true, 0)
+    CSR_HANDLER(CSRRSI, op->rs1, op->rs1 != 0, 1)
+    CSR_HANDLER(CSRRCI, op->rs1, op->rs1 != 0, 2)
+#undef CSR_HANDLER
+
+    HANDLER(MUL) RD = RS1 * RS2; NEXT();
+    HANDLER(MULH) RD = MulHigh((SXLEN_t)RS1, (SXLEN_t)RS2); NEXT();
+    HANDLER(MULHSU) RD = MulHigh((SXLEN_t)RS1, RS2); NEXT();
+    HANDLER(MULHU) RD = MulHigh(RS1, RS2); NEXT();
+    HANDLER(DIV) RD = Divide<SXLEN_t>(RS1, RS2); NEXT();
+    HANDLER(DIVU) RD = Divide<XLEN_t>(RS1, RS2); NEXT();
+    HANDLER(REM) RD = Remainder<SXLEN_t>(RS1, RS2); NEXT();
+    HANDLER(REMU) RD = Remainder<XLEN_t>(RS1, RS2); NEXT();
+    HANDLER(MULW) RD = SEXT32((__uint32_t)RS1 * (__uint32_t)RS2); NEXT();
+    HANDLER(DIVW) RD = SEXT32(Divide<__int32_t>((__uint32_t)RS1, (__uint32_t)RS2)); NEXT();
+    HANDLER(DIVUW) RD = SEXT32(Divide<__uint32_t>((__uint32_t)RS1, (__uint32_t)RS2)); NEXT();
+    HANDLER(REMW) RD = SEXT32(Remainder<__int32_t>((__uint32_t)RS1, (__uint32_t)RS2)); NEXT();
+    HANDLER(REMUW) RD = SEXT32(Remainder<__uint32_t>((__uint32_t)RS1, (__uint32_t)RS2)); NEXT();
+
+#define LR_HANDLER(name, T) \
+    HANDLER(name) { \
+        T value; XLEN_t address = RS1; __uint64_t physicalAddress; \
+        if (!Translate<T, AccessType::Load>(address, physicalAddress, cause)) RAISE(cause, address); \
+        if (!memory.Read(physicalAddress, value)) RAISE(TrapCause::LOAD_ACCESS_FAULT, address); \
+        reservationValid = true; reservationAddress = physicalAddress; \
+        RD = (XLEN_t)(SXLEN_t)(std::make_signed_t<T>)value; \
+        counters.Count<PerformanceEvent::AtomicsRetired>(); NEXT(); }
+#define SC_HANDLER(name, T) \
+    HANDLER(name) { \
+        XLEN_t address = RS1; __uint64_t physicalAddress; \
+        if (!Translate<T, AccessType::Store>(address, physicalAddress, cause)) RAISE(cause, address); \
+        bool success = reservationValid && reservationAddress == physicalAddress; \
+        reservationValid = false; \
+        if (success) { \
+            if (!memory.Write(physicalAddress, (T)RS2)) RAISE(TrapCause::STORE_AMO_ACCESS_FAULT, address); \
+            cache.OnStore(physicalAddress, sizeof(T)); \
+        } \
+        RD = !success; counters.Count<PerformanceEvent::AtomicsRetired>(); NEXT(); }
+#define AMO_HANDLER(name, T, expression) \
+    HANDLER(name) { \
+        using S = std::make_signed_t<T>; T b = (T)RS2; T old; XLEN_t address = RS1; \
+        if (!Atomic<T>(address, old, cause, [b](T a) { return (expression); })) RAISE(cause, address); \
+        RD = (XLEN_t)(SXLEN_t)(S)old; counters.Count<PerformanceEvent::AtomicsRetired>(); NEXT(); }
+#define AMO_HANDLERS(suffix, T) \
+    LR_HANDLER(LR_##suffix, T) \
+    SC_HANDLER(SC_##suffix, T) \
+    AMO_HANDLER(AMOSWAP_##suffix, T, ((void)a, b)) \
+    AMO_HANDLER(AMOADD_##suffix, T, (T)(a + b)) \
+    AMO_HANDLER(AMOXOR_##suffix, T, (T)(a ^ b)) \
+    AMO_HANDLER(AMOAND_##suffix, T, (T)(a & b)) \
+    AMO_HANDLER(AMOOR_##suffix, T, (T)(a | b)) \
+    AMO_HANDLER(AMOMIN_##suffix, T, (S)a < (S)b ? a : b) \
+    AMO_HANDLER(AMOMAX_##suffix, T, (S)a > (S)b ? a : b) \
+    AMO_HANDLER(AMOMINU_##suffix, T, a < b ? a : b) \
+    AMO_HANDLER(AMOMAXU_##suffix, T, a > b ? a : b)
+    AMO_HANDLERS(W, __uint32_t)
+    AMO_HANDLERS(D, __uint64_t)
+#undef AMO_HANDLERS
+#undef AMO_HANDLER
+#undef SC_HANDLER
+#undef LR_HANDLER
+
+    exception:
+        hart.pc = pc;
+        counters.Count<PerformanceEvent::InstructionsRetired>((op - first) - counted);
+        Trap(false, cause, tval);
+        return op - first;
+
+    done:
+        hart.pc = pc;
+        counters.Count<PerformanceEvent::InstructionsRetired>((op - first) - counted);
+        return op - first;
+
+#undef SEXT32
+#undef IMM
+#undef RD
+#undef RS2
+#undef RS1
+#undef HANDLER
+#undef RAISE
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+    }
+
+    // -- M extension arithmetic, with the spec's division corner cases --
+
+    template<typename A, typename B>
+    static XLEN_t MulHigh(A a, B b) {
+        if constexpr (rv32) {
+            using wide = std::conditional_t<std::is_signed<A>() || std::is_signed<B>(), __int64_t, __uint64_t>;
+            return (XLEN_t)(((wide)a * (wide)b) >> 32);
+        } else {
+            using wide = std::conditional_t<std::is_signed<A>() || std::is_signed<B>(), __int128_t, __uint128_t>;
+            return (XLEN_t)(((wide)a * (wide)b) >> 64);
+        }
+    }
+
+    template<typename T, typename U>
+    static XLEN_t Divide(U a, U b) {
+        T dividend = (T)a;
+        T divisor = (T)b;
+        if (divisor == 0)
+            return ~(XLEN_t)0;
+        if constexpr (std::is_signed<T>()) {
+            if (divisor == -1 && dividend == std::numeric_limits<T>::min())
+                return (XLEN_t)(SXLEN_t)dividend;
+        }
+        return (XLEN_t)(SXLEN_t)(dividend / divisor);
+    }
+
+    template<typename T, typename U>
+    static XLEN_t Remainder(U a, U b) {
+        T dividend = (T)a;
+        T divisor = (T)b;
+        if (divisor == 0)
+            return (XLEN_t)(SXLEN_t)dividend;
+        if constexpr (std::is_signed<T>()) {
+            if (divisor == -1)
+                return 0;
+        }
+        return (XLEN_t)(SXLEN_t)(dividend % divisor);
+    }
+};
+
+} // namespace RISCV
@@ -0,0 +1,250 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+#include <string_view>
+
+namespace RISCV {
+
+// -- Name to value lookups --
+
+// The name tables in RiscV.hpp map numbers to names. These go the other way
+// using perfect hash tables built at compile time. The tables use
+// hash-and-displace: one hash of the name picks a bucket from its high half,
+// and each bucket stores a seed. Remixing the hash with that seed sends every
+// name in the bucket to its own slot. A lookup is one pass over the name, a
+// seed load, a remix and one string compare, with no allocation. Lookups are
+// exact and case-sensitive.
+
+namespace detail {
+
+// Little-endian bytes [i, i + n) of the name, n at most 8. With n fixed at 8
+// the compiler turns this into a single load.
+constexpr __uint64_t nameWord(std::string_view name, std::size_t i, std::size_t n) {
+    __uint64_t word = 0;
+    for (std::size_t k = 0; k < n; k++)
+        word |= (__uint64_t)(__uint8_t)name[i + k] << (8 * k);
+    return word;
+}
+
+// Eight bytes at a time. The last word overlaps the one before it rather
+// than being read byte by byte. The length is mixed in first, so neither
+// that overlap nor the zero padding of short names can make two names read
+// the same.
+constexpr __uint64_t nameHash(std::string_view name) {
+    constexpr __uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+    const std::size_t size = name.size();
+    __uint64_t hash = (size + 1) * multiplier;
+    if (size < 8) {
+        hash = (hash ^ nameWord(name, 0, size)) * multiplier;
+    } else {
+        for (std::size_t i = 0; i + 8 < size; i += 8) {
+            hash = (hash ^ nameWord(name, i, 8)) * multiplier;
+            hash ^= hash >> 29;
+        }
+        hash = (hash ^ nameWord(name, size - 8, 8)) * multiplier;
+    }
+    return hash ^ (hash >> 32);
+}
+
+constexpr __uint32_t nameBucket(__uint64_t hash) {
+    return (__uint32_t)(hash >> 32);
+}
+
+constexpr __uint32_t nameSlot(__uint64_t hash, __uint32_t seed) {
+    hash ^= seed * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    return (__uint32_t)(hash ^ (hash >> 33));
+}
+
+template<typename Value>
+struct nameEntry {
+    const char* name;
+    Value value;
+};
+
+} // namespace detail
+
+template<typename Value, unsigned int Slots, unsigned int Buckets>
+struct perfectHashTable {
+
+    static_assert((Slots & (Slots - 1)) == 0, "Slot count must be a power of two");
+    static_assert((Buckets & (Buckets - 1)) == 0, "Bucket count must be a power of two");
+
+    std::array<__uint32_t, Buckets> seeds = {};
+    std::array<std::string_view, Slots> names = {};
+    std::array<Value, Slots> values = {};
+    bool complete = false;
+
+    constexpr unsigned int Slot(std::string_view name) const {
+        __uint64_t hash = detail::nameHash(name);
+        return detail::nameSlot(hash, seeds[detail::nameBucket(hash) & (Buckets - 1)]) & (Slots - 1);
+    }
+
+    // Empty slots hold an empty name, which no table contains
+    constexpr bool Find(std::string_view name, Value& value) const {
+        unsigned int slot = Slot(name);
+        if (names[slot].empty() || name != names[slot])
+            return false;
+        value = values[slot];
+        return true;
+    }
+
+};
+
+namespace detail {
+
+// Buckets are placed largest first, so the crowded ones get the most free
+// slots to choose from. If any bucket can't be placed, complete stays false
+// and the static_asserts below catch it.
+template<typename Value, unsigned int Slots, unsigned int Buckets, std::size_t N>
+constexpr perfectHashTable<Value, Slots, Buckets> buildPerfectHashTable(const std::array<nameEntry<Value>, N>& entries) {
+
+    perfectHashTable<Value, Slots, Buckets> table = {};
+    std::array<__uint64_t, N> hashes = {};
+    std::array<__uint32_t, N> bucketOf = {};
+    std::array<unsigned int, Buckets> bucketSize = {};
+    unsigned int largest = 0;
+    for (std::size_t i = 0; i < N; i++) {
+        hashes[i] = nameHash(entries[i].name);
+        bucketOf[i] = nameBucket(hashes[i]) & (Buckets - 1);
+        if (++bucketSize[bucketOf[i]] > largest)
+            largest = bucketSize[bucketOf[i]];
+    }
+
+    for (unsigned int size = largest; size > 0; size--) {
+        for (unsigned int bucket = 0; bucket < Buckets; bucket++) {
+            if (bucketSize[bucket] != size)
+                continue;
+            bool placed = false;
+            for (__uint32_t seed = 1; seed < 0x10000 && !placed; seed++) {
+                std::array<unsigned int, N> slots = {};
+                unsigned int count = 0;
+                placed = true;
+                for (std::size_t i = 0; i < N && placed; i++) {
+                    if (bucketOf[i] != bucket)
+                        continue;
+                    unsigned int slot = nameSlot(hashes[i], seed) & (Slots - 1);
+                    placed = table.names[slot].empty();
+                    for (unsigned int j = 0; j < count && placed; j++)
+                        placed = slots[j] != slot;
+                    slots[count++] = slot;
+                }
+                if (!placed)
+                    continue;
+                table.seeds[bucket] = seed;
+                count = 0;
+                for (std::size_t i = 0; i < N; i++) {
+                    if (bucketOf[i] != bucket)
+                        continue;
+                    table.names[slots[count]] = entries[i].name;
+                    table.values[slots[count]] = entries[i].value;
+                    count++;
+                }
+            }
+            if (!placed)
+                return table;
+        }
+    }
+
+    table.complete = true;
+    return table;
+}
+
+constexpr unsigned int countNamedCSRs() {
+    unsigned int count = 0;
+    for (unsigned int address = 0; address < NumCSRs; address++)
+        if (csrNames[address] != nullptr)
+            count++;
+    return count;
+}
+
+constexpr unsigned int NumNamedCSRs = countNamedCSRs();
+
+constexpr std::array<nameEntry<CSRAddress>, NumNamedCSRs> getCSRNameEntries() {
+    std::array<nameEntry<CSRAddress>, NumNamedCSRs> entries = {};
+    unsigned int count = 0;
+    for (unsigned int address = 0; address < NumCSRs; address++)
+        if (csrNames[address] != nullptr)
+            entries[count++] = { csrNames[address], (CSRAddress)address };
+    return entries;
+}
+
+// Both ABI and flat names, plus "fp" as the ABI alias for s0
+constexpr std::array<nameEntry<unsigned int>, 2 * NumRegs + 1> getRegisterNameEntries() {
+    std::array<nameEntry<unsigned int>, 2 * NumRegs + 1> entries = {};
+    for (unsigned int reg = 0; reg < NumRegs; reg++) {
+        entries[2 * reg] = { registerAbiNames[reg], reg };
+        entries[2 * reg + 1] = { registerFlatNames[reg], reg };
+    }
+    entries[2 * NumRegs] = { "fp", 8 };
+    return entries;
+}
+
+} // namespace detail
+
+struct trapIdentity {
+    bool interrupt;
+    TrapCause cause;
+};
+
+namespace detail {
+
+constexpr unsigned int countNamedTraps() {
+    unsigned int count = 0;
+    for (unsigned int cause = 0; cause < NumStandardCauses; cause++)
+        count += (interruptNames[cause] != nullptr) + (exceptionNames[cause] != nullptr);
+    return count;
+}
+
+constexpr unsigned int NumNamedTraps = countNamedTraps();
+
+constexpr std::array<nameEntry<trapIdentity>, NumNamedTraps> getTrapNameEntries() {
+    std::array<nameEntry<trapIdentity>, NumNamedTraps> entries = {};
+    unsigned int count = 0;
+    for (unsigned int cause = 0; cause < NumStandardCauses; cause++) {
+        if (interruptNames[cause] != nullptr)
+            entries[count++] = { interruptNames[cause], { true, (TrapCause)cause } };
+        if (exceptionNames[cause] != nullptr)
+            entries[count++] = { exceptionNames[cause], { false, (TrapCause)cause } };
+    }
+    return entries;
+}
+
+} // namespace detail
+
+constexpr perfectHashTable<CSRAddress, 512, 256> csrNameTable =
+    detail::buildPerfectHashTable<CSRAddress, 512, 256>(detail::getCSRNameEntries());
+static_assert(csrNameTable.complete, "CSR names do not fit their perfect hash table");
+
+constexpr perfectHashTable<unsigned int, 128, 64> registerNameTable =
+    detail::buildPerfectHashTable<unsigned int, 128, 64>(detail::getRegisterNameEntries());
+static_assert(registerNameTable.complete, "Register names do not fit their perfect hash table");
+
+constexpr perfectHashTable<trapIdentity, 64, 32> trapNameTable =
+    detail::buildPerfectHashTable<trapIdentity, 64, 32>(detail::getTrapNameEntries());
+static_assert(trapNameTable.complete, "Trap names do not fit their perfect hash table");
+
+// Returns INVALID_CSR if no CSR has this name
+constexpr CSRAddress csrAddressFromName(std::string_view name) {
+    CSRAddress address = CSRAddress::INVALID_CSR;
+    csrNameTable.Find(name, address);
+    return address;
+}
+
+// Accepts ABI names ("a0", "fp") and flat names ("x10"); returns NumRegs on a miss
+constexpr unsigned int regNumFromName(std::string_view name) {
+    unsigned int reg = NumRegs;
+    registerNameTable.Find(name, reg);
+    return reg;
+}
+
+// Accepts the names produced by trapName(); returns a cause of NONE on a miss
+constexpr trapIdentity trapFromName(std::string_view name) {
+    trapIdentity trap = { false, TrapCause::NONE };
+    trapNameTable.Find(name, trap);
+    return trap;
+}
+
+} // namespace RISCV
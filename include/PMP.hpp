@@ -0,0 +1,229 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+namespace RISCV {
+
+// -- Physical memory protection --
+
+// Each hart owns a pmpUnit. Whenever a pmpcfg or pmpaddr write lands, the
+// unit recompiles its sixteen entries into a sorted list of disjoint regions
+// covering the whole physical address space, including the gaps no entry
+// matches. Each region records what the lowest-numbered entry covering it
+// allows. Checking an access is then a comparison against the last region
+// hit, with a binary search over at most 33 regions on a miss. Adjacent
+// regions never come from the same entry, so an access that crosses a region
+// boundary always partially matches some entry and fails, as the spec
+// requires.
+
+constexpr unsigned int NumPMPEntries = 16;
+
+constexpr __uint8_t pmpReadMask = 0b00000001;
+constexpr __uint8_t pmpWriteMask = 0b00000010;
+constexpr __uint8_t pmpExecuteMask = 0b00000100;
+constexpr __uint8_t pmpAddressModeMask = 0b00011000;
+constexpr __uint8_t pmpLockedMask = 0b10000000;
+constexpr unsigned int pmpAddressModeShift = 3;
+
+struct pmpRegion {
+    __uint64_t first;           // inclusive
+    __uint64_t last;            // inclusive
+    __uint8_t entry;            // the deciding entry, or NumPMPEntries for none
+    __uint8_t machineAllowed;   // one bit per AccessType
+    __uint8_t otherAllowed;
+};
+
+template<typename XLEN_t>
+struct pmpUnit {
+
+    // pmpaddr holds bits [33:2] of the address on RV32 and [55:2] on RV64
+    constexpr static __uint64_t addressRegisterMask =
+        std::is_same<XLEN_t, __uint32_t>() ? 0xffffffffull : 0x003fffffffffffffull;
+    constexpr static unsigned int entriesPerConfig = sizeof(XLEN_t);
+    constexpr static __uint8_t allAccesses = (1 << Fetch) | (1 << Load) | (1 << Store);
+
+    std::array<pmpEntry, NumPMPEntries> entries;
+    std::array<pmpRegion, 2 * NumPMPEntries + 1> regions;
+    unsigned int numRegions;
+    unsigned int lastHit;
+
+    void Reset() {
+        for (pmpEntry& entry : entries)
+            entry = { false, false, false, false, pmpAddressMode::OFF, 0 };
+        Recompile();
+    }
+
+    // configNumber is n in pmpcfgn. On RV64 only the even registers exist;
+    // writes to odd ones are ignored.
+    void WriteConfig(unsigned int configNumber, XLEN_t value) {
+        if (entriesPerConfig == 8 && (configNumber & 1))
+            return;
+        for (unsigned int i = 0; i < entriesPerConfig; i++)
+            WriteConfigByte(configNumber * 4 + i, (value >> (8 * i)) & 0xff);
+        Recompile();
+    }
+
+    XLEN_t ReadConfig(unsigned int configNumber) const {
+        if (entriesPerConfig == 8 && (configNumber & 1))
+            return 0;
+        XLEN_t value = 0;
+        for (unsigned int i = 0; i < entriesPerConfig; i++)
+            value |= (XLEN_t)ReadConfigByte(configNumber * 4 + i) << (8 * i);
+        return value;
+    }
+
+    void WriteAddress(unsigned int entryNumber, XLEN_t value) {
+        if (entries[entryNumber].locked)
+            return;
+        // A locked TOR entry also locks the address register below it
+        if (entryNumber + 1 < NumPMPEntries &&
+            entries[entryNumber + 1].locked &&
+            entries[entryNumber + 1].aMode == pmpAddressMode::TOR)
+            return;
+        entries[entryNumber].address = (__uint64_t)value & addressRegisterMask;
+        Recompile();
+    }
+
+    XLEN_t ReadAddress(unsigned int entryNumber) const {
+        return (XLEN_t)entries[entryNumber].address;
+    }
+
+    // privilege is the effective privilege of the access, i.e. after MPRV
+    bool Check(__uint64_t address, unsigned int size, AccessType type, PrivilegeMode privilege) {
+        const pmpRegion* region = &regions[lastHit];
+        if (address < region->first || address > region->last) {
+            unsigned int lo = 0;
+            unsigned int hi = numRegions;
+            while (hi - lo > 1) {
+                unsigned int mid = (lo + hi) / 2;
+                if (regions[mid].first <= address)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            lastHit = lo;
+            region = &regions[lo];
+        }
+        __uint64_t last = address + size - 1;
+        if (last > region->last || last < address)
+            return false;
+        __uint8_t allowed = privilege == PrivilegeMode::Machine ? region->machineAllowed : region->otherAllowed;
+        return (allowed >> type) & 1;
+    }
+
+private:
+
+    void WriteConfigByte(unsigned int entryNumber, __uint8_t value) {
+        pmpEntry& entry = entries[entryNumber];
+        if (entry.locked)
+            return;
+        entry.r = value & pmpReadMask;
+        // R=0, W=1 is reserved; keep W clear unless R is set
+        entry.w = (value & pmpWriteMask) && entry.r;
+        entry.x = value & pmpExecuteMask;
+        entry.aMode = (pmpAddressMode)((value & pmpAddressModeMask) >> pmpAddressModeShift);
+        entry.locked = value & pmpLockedMask;
+    }
+
+    __uint8_t ReadConfigByte(unsigned int entryNumber) const {
+        const pmpEntry& entry = entries[entryNumber];
+        return (entry.r ? pmpReadMask : 0) |
+               (entry.w ? pmpWriteMask : 0) |
+               (entry.x ? pmpExecuteMask : 0) |
+               (entry.aMode << pmpAddressModeShift) |
+               (entry.locked ? pmpLockedMask : 0);
+    }
+
+    // Computes the inclusive byte range an entry matches; false if it matches nothing
+    bool EntryRange(unsigned int entryNumber, __uint64_t& first, __uint64_t& last) const {
+        const pmpEntry& entry = entries[entryNumber];
+        switch (entry.aMode) {
+        case pmpAddressMode::TOR: {
+            __uint64_t bottom = entryNumber == 0 ? 0 : entries[entryNumber - 1].address << 2;
+            __uint64_t top = entry.address << 2;
+            if (bottom >= top)
+                return false;
+            first = bottom;
+            last = top - 1;
+            return true;
+        }
+        case pmpAddressMode::NA4:
+            first = entry.address << 2;
+            last = first + 3;
+            return true;
+        case pmpAddressMode::NAPOT: {
+            unsigned int trailingOnes = __builtin_ctzll(~entry.address);
+            __uint64_t size = (__uint64_t)8 << trailingOnes;
+            first = (entry.address << 2) & ~(size - 1);
+            last = first + size - 1;
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    void Recompile() {
+
+        std::array<__uint64_t, NumPMPEntries> firsts = {};
+        std::array<__uint64_t, NumPMPEntries> lasts = {};
+        std::array<bool, NumPMPEntries> active = {};
+        std::array<__uint64_t, 2 * NumPMPEntries + 1> starts = {};
+        unsigned int numStarts = 0;
+
+        starts[numStarts++] = 0;
+        for (unsigned int i = 0; i < NumPMPEntries; i++) {
+            active[i] = EntryRange(i, firsts[i], lasts[i]);
+            if (!active[i])
+                continue;
+            starts[numStarts++] = firsts[i];
+            if (lasts[i] != ~(__uint64_t)0)
+                starts[numStarts++] = lasts[i] + 1;
+        }
+
+        // Insertion sort, dropping duplicates
+        unsigned int unique = 0;
+        for (unsigned int i = 0; i < numStarts; i++) {
+            __uint64_t start = starts[i];
+            unsigned int j = unique;
+            while (j > 0 && starts[j - 1] > start)
+                j--;
+            if (j > 0 && starts[j - 1] == start)
+                continue;
+            for (unsigned int k = unique; k > j; k--)
+                starts[k] = starts[k - 1];
+            starts[j] = start;
+            unique++;
+        }
+
+        numRegions = 0;
+        for (unsigned int i = 0; i < unique; i++) {
+            __uint64_t first = starts[i];
+            __uint64_t last = i + 1 < unique ? starts[i + 1] - 1 : ~(__uint64_t)0;
+            unsigned int winner = 0;
+            while (winner < NumPMPEntries && !(active[winner] && firsts[winner] <= first && first <= lasts[winner]))
+                winner++;
+            if (numRegions > 0 && regions[numRegions - 1].entry == winner) {
+                regions[numRegions - 1].last = last;
+                continue;
+            }
+            pmpRegion& region = regions[numRegions++];
+            region.first = first;
+            region.last = last;
+            region.entry = winner;
+            if (winner == NumPMPEntries) {
+                region.machineAllowed = allAccesses;
+                region.otherAllowed = 0;
+            } else {
+                const pmpEntry& entry = entries[winner];
+                __uint8_t permitted = (entry.x << Fetch) | (entry.r << Load) | (entry.w << Store);
+                region.machineAllowed = entry.locked ? permitted : allAccesses;
+                region.otherAllowed = permitted;
+            }
+        }
+        lastHit = 0;
+    }
+
+};
+
+} // namespace RISCV
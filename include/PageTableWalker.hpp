@@ -0,0 +1,199 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+namespace RISCV {
+
+// -- Virtual memory translation --
+
+// The walker is a template over XLEN and paging mode, so the level count, VPN
+// width and PTE size are compile-time constants and the walk loop unrolls.
+// Memory is reached through an accessor type supplied by the caller, which
+// needs to provide
+//
+//     bool Read(__uint64_t physicalAddress, pte_t& value);
+//     bool Write(__uint64_t physicalAddress, pte_t value);
+//
+// for the PTE type of the modes it is used with (__uint32_t for Sv32,
+// __uint64_t otherwise). Returning false reports an access fault, e.g. for a
+// PMP or PMA violation on the page table itself. The walker calls these
+// directly, so a host-backed accessor can be inlined.
+
+constexpr unsigned int PageShift = 12;
+constexpr __uint64_t PageSize = (__uint64_t)1 << PageShift;
+
+template<PagingMode mode>
+struct pagingTraits;
+
+template<>
+struct pagingTraits<PagingMode::Sv32> {
+    using pte_t = __uint32_t;
+    constexpr static unsigned int levels = 2;
+    constexpr static unsigned int vpnBits = 10;
+    constexpr static unsigned int vaBits = 32;
+    constexpr static __uint64_t ppnMask = 0x3fffff;
+};
+
+template<>
+struct pagingTraits<PagingMode::Sv39> {
+    using pte_t = __uint64_t;
+    constexpr static unsigned int levels = 3;
+    constexpr static unsigned int vpnBits = 9;
+    constexpr static unsigned int vaBits = 39;
+    constexpr static __uint64_t ppnMask = 0xfffffffffff;
+};
+
+template<>
+struct pagingTraits<PagingMode::Sv48> {
+    using pte_t = __uint64_t;
+    constexpr static unsigned int levels = 4;
+    constexpr static unsigned int vpnBits = 9;
+    constexpr static unsigned int vaBits = 48;
+    constexpr static __uint64_t ppnMask = 0xfffffffffff;
+};
+
+template<>
+struct pagingTraits<PagingMode::Sv57> {
+    using pte_t = __uint64_t;
+    constexpr static unsigned int levels = 5;
+    constexpr static unsigned int vpnBits = 9;
+    constexpr static unsigned int vaBits = 57;
+    constexpr static __uint64_t ppnMask = 0xfffffffffff;
+};
+
+struct translationResult {
+    __uint64_t physicalAddress;
+    TrapCause cause;            // NONE on success
+    unsigned int pageShift;     // log2 of the size of the page that was hit
+    __uint8_t pteBits;          // the leaf's PTEBits, after any A/D update
+};
+
+// Whether a valid leaf PTE allows an access. privilege is the effective
+// privilege of the access, and is never Machine here since M-mode accesses are
+// not translated.
+constexpr bool ptePermits(__uint64_t pte, AccessType type, PrivilegeMode privilege, bool sum, bool mxr) {
+    if (pte & PTEBit::U) {
+        // S-mode may touch user pages only with SUM set, and may never execute them
+        if (privilege == PrivilegeMode::Supervisor && (type == Fetch || !sum))
+            return false;
+    } else if (privilege == PrivilegeMode::User) {
+        return false;
+    }
+    switch (type) {
+    case Fetch:
+        return pte & PTEBit::X;
+    case Load:
+        return (pte & PTEBit::R) || (mxr && (pte & PTEBit::X));
+    default:
+        return pte & PTEBit::W;
+    }
+}
+
+// With updateAccessedDirty set, the walker sets A (and D on stores) in the
+// leaf PTE itself. Otherwise a clear A, or a clear D on a store, is a page
+// fault and software has to set the bits. The spec allows either behaviour.
+template<typename XLEN_t, PagingMode mode, bool updateAccessedDirty = true>
+struct pageTableWalker {
+
+    using traits = pagingTraits<mode>;
+    using pte_t = typename traits::pte_t;
+
+    static_assert(sizeof(XLEN_t) * 8 >= traits::vaBits, "Paging mode needs a wider XLEN");
+
+    template<typename Memory>
+    static translationResult Walk(Memory& memory, __uint64_t rootPpn, XLEN_t virtualAddress,
+                                  AccessType type, PrivilegeMode privilege, bool sum, bool mxr) {
+
+        const translationResult pageFault = { 0, pageFaultCause(type), PageShift, 0 };
+        const translationResult accessFault = { 0, accessFaultCause(type), PageShift, 0 };
+
+        // Bits above the VA width must all equal the top VA bit
+        if constexpr (sizeof(XLEN_t) * 8 > traits::vaBits) {
+            constexpr unsigned int unused = 64 - traits::vaBits;
+            __int64_t extended = (__int64_t)((__uint64_t)virtualAddress << unused) >> unused;
+            if ((__uint64_t)extended != (__uint64_t)virtualAddress)
+                return pageFault;
+        }
+
+        __uint64_t table = rootPpn << PageShift;
+        for (int level = traits::levels - 1; level >= 0; level--) {
+
+            const unsigned int shift = PageShift + level * traits::vpnBits;
+            const __uint64_t vpn = ((__uint64_t)virtualAddress >> shift) & ((1u << traits::vpnBits) - 1);
+            const __uint64_t pteAddress = table + vpn * sizeof(pte_t);
+
+            pte_t pte;
+            if (!memory.Read(pteAddress, pte))
+                return accessFault;
+            if (!(pte & PTEBit::V) || (!(pte & PTEBit::R) && (pte & PTEBit::W)))
+                return pageFault;
+
+            const __uint64_t ppn = ((__uint64_t)pte >> 10) & traits::ppnMask;
+            if (!(pte & (PTEBit::R | PTEBit::X))) {
+                table = ppn << PageShift;
+                continue;
+            }
+
+            if (!ptePermits(pte, type, privilege, sum, mxr))
+                return pageFault;
+
+            // Superpages must be aligned to their own size
+            const __uint64_t offsetMask = ((__uint64_t)1 << shift) - 1;
+            if ((ppn << PageShift) & offsetMask)
+                return pageFault;
+
+            if (!(pte & PTEBit::A) || (type == Store && !(pte & PTEBit::D))) {
+                if constexpr (!updateAccessedDirty)
+                    return pageFault;
+                pte |= PTEBit::A | (type == Store ? PTEBit::D : 0);
+                if (!memory.Write(pteAddress, pte))
+                    return accessFault;
+            }
+
+            return { (ppn << PageShift) | ((__uint64_t)virtualAddress & offsetMask), TrapCause::NONE, shift, (__uint8_t)pte };
+        }
+
+        // Ran out of levels on a pointer PTE
+        return pageFault;
+    }
+};
+
+// Privilege that loads and stores are checked with: MPRV makes M-mode data
+// accesses use the privilege in MPP. Instruction fetch ignores MPRV.
+inline PrivilegeMode effectiveAccessPrivilege(PrivilegeMode privilege, const mstatusReg& mstatus, AccessType type) {
+    if (type != Fetch && privilege == PrivilegeMode::Machine && mstatus.MPRV())
+        return mstatus.MPP();
+    return privilege;
+}
+
+// Full translation of one access under the current satp and mstatus.
+// M-mode accesses and Bare mode map identically.
+template<typename XLEN_t, bool updateAccessedDirty = true, typename Memory>
+translationResult translate(Memory& memory, const satpReg<XLEN_t>& satp, const mstatusReg& mstatus,
+                            PrivilegeMode privilege, XLEN_t virtualAddress, AccessType type) {
+
+    PrivilegeMode effective = effectiveAccessPrivilege(privilege, mstatus, type);
+    if (effective == PrivilegeMode::Machine || satp.pagingMode == PagingMode::Bare)
+        return { (__uint64_t)virtualAddress, TrapCause::NONE, PageShift, 0xff };
+
+    bool sum = mstatus.SUM();
+    bool mxr = mstatus.MXR();
+    if constexpr (std::is_same<XLEN_t, __uint32_t>()) {
+        if (satp.pagingMode == PagingMode::Sv32)
+            return pageTableWalker<XLEN_t, PagingMode::Sv32, updateAccessedDirty>::Walk(memory, satp.ppn, virtualAddress, type, effective, sum, mxr);
+    } else {
+        switch (satp.pagingMode) {
+        case PagingMode::Sv39:
+            return pageTableWalker<XLEN_t, PagingMode::Sv39, updateAccessedDirty>::Walk(memory, satp.ppn, virtualAddress, type, effective, sum, mxr);
+        case PagingMode::Sv48:
+            return pageTableWalker<XLEN_t, PagingMode::Sv48, updateAccessedDirty>::Walk(memory, satp.ppn, virtualAddress, type, effective, sum, mxr);
+        case PagingMode::Sv57:
+            return pageTableWalker<XLEN_t, PagingMode::Sv57, updateAccessedDirty>::Walk(memory, satp.ppn, virtualAddress, type, effective, sum, mxr);
+        default:
+            break;
+        }
+    }
+    return { 0, pageFaultCause(type), PageShift, 0 };
+}
+
+} // namespace RISCV
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+#include <chrono>
+
+namespace RISCV {
+
+// -- Hardware performance monitor --
+
+// Execution reports events through Count<event>(), which is a single add to
+// a per-event tally with no test of whether anything is listening. The
+// mhpmcounters are not stored as running values. Each one is a base plus
+// the tally of the event it selects, so reads add the two. Any write to a
+// counter, event selector or mcountinhibit rebases the affected counters.
+// That is the only time the set of active events is looked at.
+//
+// Counting some events takes work beyond the add, e.g. telling taken
+// branches from untaken ones. Call sites for those can test Active(event),
+// which is also only recomputed when the configuration changes.
+//
+// cycle, time and instret work the same way. Nothing is stored per
+// instruction. instret is a base plus the InstructionsRetired tally, which
+// the interpreter bumps once per executed block by the block's length.
+// cycle and time are a base plus the host monotonic clock, scaled to
+// cycleFrequency and timeFrequency. Writes to mcycle and minstret, and
+// inhibiting or resuming them, just move the base.
+
+enum class PerformanceEvent : __uint8_t {
+    None,
+    InstructionsRetired,
+    BranchesRetired,
+    BranchesTaken,
+    JumpsRetired,
+    LoadsRetired,
+    StoresRetired,
+    AtomicsRetired,
+    FloatingPointRetired,
+    CSRAccesses,
+    Exceptions,
+    Interrupts,
+    TLBMisses,
+    TLBFences,
+    NUM_PERFORMANCE_EVENTS
+};
+
+constexpr unsigned int NumPerformanceEvents = (unsigned int)PerformanceEvent::NUM_PERFORMANCE_EVENTS;
+
+constexpr std::array<std::string_view, NumPerformanceEvents> performanceEventNames = {
+    "none", "instructions-retired", "branches-retired", "branches-taken", "jumps-retired",
+    "loads-retired", "stores-retired", "atomics-retired", "fp-retired", "csr-accesses",
+    "exceptions", "interrupts", "tlb-misses", "tlb-fences"
+};
+
+// Maps mhpmevent selector values to events. Selectors outside the catalog,
+// or mapped to None, are not supported and read back as zero.
+struct performanceEventCatalog {
+
+    constexpr static unsigned int NumSelectors = 64;
+
+    std::array<PerformanceEvent, NumSelectors> events;
+
+    constexpr void Define(unsigned int selector, PerformanceEvent event) {
+        events[selector] = event;
+    }
+
+    template<typename XLEN_t>
+    constexpr PerformanceEvent Lookup(XLEN_t selector) const {
+        return selector < NumSelectors ? events[selector] : PerformanceEvent::None;
+    }
+};
+
+// Selector n counts PerformanceEvent n
+constexpr performanceEventCatalog getDefaultPerformanceEventCatalog() {
+    performanceEventCatalog catalog = {};
+    for (unsigned int event = 0; event < NumPerformanceEvents; event++)
+        catalog.Define(event, (PerformanceEvent)event);
+    return catalog;
+}
+
+constexpr performanceEventCatalog defaultPerformanceEventCatalog = getDefaultPerformanceEventCatalog();
+
+constexpr unsigned int CycleCounter = 0;
+constexpr unsigned int TimeCounter = 1;
+constexpr unsigned int InstretCounter = 2;
+constexpr unsigned int FirstHPMCounter = 3;
+constexpr unsigned int NumCounters = 32;
+
+struct performanceCounters {
+
+    // mcountinhibit bit 1 is hardwired to zero, since time cannot be inhibited
+    constexpr static __uint32_t inhibitWriteMask = ~((__uint32_t)1 << TimeCounter);
+
+    const performanceEventCatalog* catalog;
+    __uint64_t cycleFrequency;  // Hz
+    __uint64_t timeFrequency;   // Hz, the platform's mtime rate
+    std::chrono::steady_clock::time_point origin;
+    std::array<__uint64_t, NumPerformanceEvents> tallies;
+    std::array<__uint64_t, NumCounters> bases;
+    std::array<__uint64_t, NumCounters> selectors;
+    std::array<PerformanceEvent, NumCounters> events;
+    __uint32_t inhibit;
+    __uint32_t counting;        // counters whose value currently follows their source
+    __uint32_t activeEvents;    // one bit per PerformanceEvent
+
+    performanceCounters(const performanceEventCatalog* catalog = &defaultPerformanceEventCatalog,
+                        __uint64_t cycleFrequency = 1000000000, __uint64_t timeFrequency = 10000000) :
+        catalog(catalog), cycleFrequency(cycleFrequency), timeFrequency(timeFrequency) { }
+
+    void Reset() {
+        origin = std::chrono::steady_clock::now();
+        tallies = {};
+        bases = {};
+        selectors = {};
+        events.fill(PerformanceEvent::None);
+        events[InstretCounter] = PerformanceEvent::InstructionsRetired;
+        inhibit = 0;
+        counting = 0;
+        activeEvents = 0;
+        for (unsigned int counter = 0; counter < NumCounters; counter++)
+            Reconfigure(counter, 0);
+    }
+
+    template<PerformanceEvent event>
+    void Count(__uint64_t amount = 1) {
+        tallies[(unsigned int)event] += amount;
+    }
+
+    bool Active(PerformanceEvent event) const {
+        return (activeEvents >> (unsigned int)event) & 1;
+    }
+
+    // Full 64-bit value of counter n, i.e. mcycle, time, minstret or mhpmcounter<n>
+    __uint64_t Value(unsigned int counter) const {
+        return bases[counter] + Source(counter);
+    }
+
+    void SetValue(unsigned int counter, __uint64_t value) {
+        bases[counter] = value - Source(counter);
+    }
+
+    // For platform writes to mtime
+    void SetTime(__uint64_t value) {
+        SetValue(TimeCounter, value);
+    }
+
+    template<typename XLEN_t>
+    void WriteEvent(unsigned int counter, XLEN_t value) {
+        __uint64_t current = Value(counter);
+        PerformanceEvent event = catalog->Lookup(value);
+        selectors[counter] = event == PerformanceEvent::None ? 0 : (__uint64_t)value;
+        events[counter] = event;
+        Reconfigure(counter, current);
+    }
+
+    template<typename XLEN_t>
+    XLEN_t ReadEvent(unsigned int counter) const {
+        return (XLEN_t)selectors[counter];
+    }
+
+    void WriteInhibit(__uint32_t value) {
+        std::array<__uint64_t, NumCounters> current;
+        for (unsigned int counter = 0; counter < NumCounters; counter++)
+            current[counter] = Value(counter);
+        inhibit = value & inhibitWriteMask;
+        for (unsigned int counter = 0; counter < NumCounters; counter++)
+            Reconfigure(counter, current[counter]);
+    }
+
+    __uint32_t ReadInhibit() const {
+        return inhibit;
+    }
+
+    // Reads any of the counter, event selector or inhibit CSRs. Access
+    // checks are up to the caller, see ReadGated(). On RV32 each half is read
+    // live; software gets a consistent pair with the usual high, low, high
+    // retry loop.
+    template<typename XLEN_t>
+    XLEN_t Read(unsigned int address) const {
+        unsigned int counter = address & (NumCounters - 1);
+        if (address == CSRAddress::MCOUNTINHIBIT)
+            return ReadInhibit();
+        if (address >= CSRAddress::MHPMEVENT3 && address <= CSRAddress::MHPMEVENT31)
+            return ReadEvent<XLEN_t>(counter);
+        switch (address & ~(NumCounters - 1)) {
+        case CSRAddress::MCYCLE:
+        case CSRAddress::CYCLE:
+            return (XLEN_t)Value(counter);
+        case CSRAddress::MCYCLEH:
+        case CSRAddress::CYCLEH:
+            return (XLEN_t)(Value(counter) >> 32);
+        default:
+            return 0;
+        }
+    }
+
+    // Writes to time are ignored here; the platform owns mtime, see SetTime()
+    template<typename XLEN_t>
+    void Write(unsigned int address, XLEN_t value) {
+        unsigned int counter = address & (NumCounters - 1);
+        if (address == CSRAddress::MCOUNTINHIBIT) {
+            WriteInhibit((__uint32_t)value);
+        } else if (address >= CSRAddress::MHPMEVENT3 && address <= CSRAddress::MHPMEVENT31) {
+            WriteEvent<XLEN_t>(counter, value);
+        } else if (counter == TimeCounter) {
+            return;
+        } else if (address >= CSRAddress::MCYCLE && address <= CSRAddress::MHPMCOUNTER31) {
+            if constexpr (std::is_same<XLEN_t, __uint32_t>())
+                SetValue(counter, (Value(counter) & ~(__uint64_t)0xffffffff) | value);
+            else
+                SetValue(counter, value);
+        } else if (address >= CSRAddress::MCYCLEH && address <= CSRAddress::MHPMCOUNTER31H) {
+            SetValue(counter, (Value(counter) & 0xffffffff) | ((__uint64_t)value << 32));
+        }
+    }
+
+    // Read through the mcounteren/scounteren gating of the user-level
+    // counter aliases. Returns false if the access should trap.
+    template<typename XLEN_t>
+    bool ReadGated(unsigned int address, PrivilegeMode privilege, __uint32_t extensions,
+                   __uint32_t mcounteren, __uint32_t scounteren, XLEN_t& value) const {
+        __uint32_t counterEnable = effectiveCounterEnable(privilege, mcounteren, scounteren, extensions);
+        if (!csrAccessLegal<XLEN_t>(address, privilege, false, extensions, counterEnable))
+            return false;
+        value = Read<XLEN_t>(address);
+        return true;
+    }
+
+private:
+
+    // Host clock ticks since Reset(), scaled to frequency
+    __uint64_t HostTicks(__uint64_t frequency) const {
+        __uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - origin).count();
+        return (__uint64_t)(((__uint128_t)nanoseconds * frequency) / 1000000000);
+    }
+
+    // What a counter adds to its base while it is counting
+    __uint64_t Source(unsigned int counter) const {
+        if (!((counting >> counter) & 1))
+            return 0;
+        if (counter == CycleCounter)
+            return HostTicks(cycleFrequency);
+        if (counter == TimeCounter)
+            return HostTicks(timeFrequency);
+        return tallies[(unsigned int)events[counter]];
+    }
+
+    // Changes whether a counter follows its source, keeping its value
+    void Reconfigure(unsigned int counter, __uint64_t value) {
+        bool hasSource = counter == CycleCounter || counter == TimeCounter || events[counter] != PerformanceEvent::None;
+        bool follows = hasSource && !((inhibit >> counter) & 1);
+        counting = follows ? (counting | (1u << counter)) : (counting & ~(1u << counter));
+        SetValue(counter, value);
+        activeEvents = 0;
+        for (unsigned int other = InstretCounter; other < NumCounters; other++)
+            if ((counting >> other) & 1)
+                activeEvents |= 1u << (unsigned int)events[other];
+    }
+};
+
+} // namespace RISCV
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <cstdint>
+#include <cfenv>
 #include <type_traits>
 #include <array>
 #include <string>
+#include <string_view>
+#include <charconv>
+#include <system_error>
 
 namespace RISCV {
 
@@ -72,6 +76,12 @@ enum pmpAddressMode {
     NAPOT = 3
 };
 
+enum AccessType {
+    Fetch = 0,
+    Load = 1,
+    Store = 2
+};
+
 enum fpRoundingMode {
     RNE = 0,
     RTZ = 1,
@@ -81,7 +91,7 @@ enum fpRoundingMode {
     DYN = 7
 };
 
-enum TrapCause {
+enum TrapCause : int {
 
     NONE = -1,
 
@@ -204,7 +214,20 @@ enum CSRAddress {
 
 // -- String names from enum values --
 
-inline std::string floatingPointStateName(FloatingPointState fpState) {
+// The ...NameView functions return views of static storage, so they never
+// allocate; the std::string versions are wrappers for convenience. The
+// ...ToChars writers follow std::to_chars: they return one past the last
+// character written, or errc::value_too_large if the buffer is too small.
+
+inline std::to_chars_result nameToChars(char* first, char* last, std::string_view name) {
+    if ((std::size_t)(last - first) < name.size())
+        return { last, std::errc::value_too_large };
+    for (char c : name)
+        *first++ = c;
+    return { first, std::errc() };
+}
+
+constexpr std::string_view floatingPointStateNameView(FloatingPointState fpState) {
     switch (fpState) {
     case Off:
         return "Off";
@@ -224,7 +247,7 @@ inline std::string floatingPointStateName(FloatingPointState fpState) {
     }
 }
 
-inline std::string extensionStateName(ExtensionState extState) {
+constexpr std::string_view extensionStateNameView(ExtensionState extState) {
     switch (extState) {
     case AllOff:
         return "All off";
@@ -244,7 +267,7 @@ inline std::string extensionStateName(ExtensionState extState) {
     }
 }
 
-inline std::string pagingModeName(PagingMode pagingMode) {
+constexpr std::string_view pagingModeNameView(PagingMode pagingMode) {
     switch (pagingMode) {
     case Bare:
         return "Bare";
@@ -270,94 +293,55 @@ inline std::string pagingModeName(PagingMode pagingMode) {
     }
 }
 
-inline std::string tvecModeName(tvecMode mode) {
+constexpr std::string_view tvecModeNameView(tvecMode mode) {
     return mode == Direct ? "Direct" : "Vectored";
+}
+
+constexpr unsigned int NumStandardCauses = 16;
+
+constexpr std::array<const char*, NumStandardCauses> interruptNames = {
+    "User software interrupt",
+    "Supervisor software interrupt",
+    nullptr,
+    "Machine software interrupt",
+    "User timer interrupt",
+    "Supervisor timer interrupt",
+    nullptr,
+    "Machine timer interrupt",
+    "User external interrupt",
+    "Supervisor external interrupt",
+    nullptr,
+    "Machine external interrupt",
+    nullptr, nullptr, nullptr, nullptr
 };
 
-inline std::string trapName(bool interrupt, TrapCause trapCause) {
-    if (interrupt) {
-        switch (trapCause) {
-        case USER_SOFTWARE_INTERRUPT:
-            return "User software interrupt";
-            break;
-        case SUPERVISOR_SOFTWARE_INTERRUPT:
-            return "User software interrupt";
-            break;
-        case MACHINE_SOFTWARE_INTERRUPT:
-            return "User software interrupt";
-            break;
-        case USER_TIMER_INTERRUPT:
-            return "User software interrupt";
-            break;
-        case SUPERVISOR_TIMER_INTERRUPT:
-            return "User software interrupt";
-            break;
-        case MACHINE_TIMER_INTERRUPT:
-            return "User software interrupt";
-            break;
-        case USER_EXTERNAL_INTERRUPT:
-            return "User software interrupt";
-            break;
-        case SUPERVISOR_EXTERNAL_INTERRUPT:
-            return "User software interrupt";
-            break;
-        case MACHINE_EXTERNAL_INTERRUPT:
-            return "User software interrupt";
-            break;
-        default:
-            return "Unknown interrupt";
-        }
-    }
-    switch (trapCause) {
-    case INSTRUCTION_ADDRESS_MISALIGNED:
-        return "Instruction address misaligned";
-        break;
-    case INSTRUCTION_ACCESS_FAULT:
-        return "Instruction access fault";
-        break;
-    case ILLEGAL_INSTRUCTION:
-        return "Illegal instruction";
-        break;
-    case BREAKPOINT:
-        return "Breakpoint";
-        break;
-    case LOAD_ADDRESS_MISALIGNED:
-        return "Load address misaligned";
-        break;
-    case LOAD_ACCESS_FAULT:
-        return "Load access fault";
-        break;
-    case STORE_AMO_ADDRESS_MISALIGNED:
-        return "Store/AMO address misaligned";
-        break;
-    case STORE_AMO_ACCESS_FAULT:
-        return "Store/AMO access fault";
-        break;
-    case ECALL_FROM_U_MODE:
-        return "ECall from user mode";
-        break;
-    case ECALL_FROM_S_MODE:
-        return "ECall from supervisor mode";
-        break;
-    case ECALL_FROM_M_MODE:
-        return "ECall from machine mode";
-        break;
-    case INSTRUCTION_PAGE_FAULT:
-        return "Instruction page fault";
-        break;
-    case LOAD_PAGE_FAULT:
-        return "Load page fault";
-        break;
-    case STORE_AMO_PAGE_FAULT:
-        return "Store/AMO page fault";
-        break;
-    default:
-        return "Unknown exception";
-    }
+constexpr std::array<const char*, NumStandardCauses> exceptionNames = {
+    "Instruction address misaligned",
+    "Instruction access fault",
+    "Illegal instruction",
+    "Breakpoint",
+    "Load address misaligned",
+    "Load access fault",
+    "Store/AMO address misaligned",
+    "Store/AMO access fault",
+    "ECall from user mode",
+    "ECall from supervisor mode",
+    nullptr,
+    "ECall from machine mode",
+    "Instruction page fault",
+    "Load page fault",
+    nullptr,
+    "Store/AMO page fault"
+};
 
+constexpr std::string_view trapNameView(bool interrupt, TrapCause trapCause) {
+    const std::array<const char*, NumStandardCauses>& names = interrupt ? interruptNames : exceptionNames;
+    if (trapCause < 0 || (unsigned int)trapCause >= NumStandardCauses || names[trapCause] == nullptr)
+        return interrupt ? "Unknown interrupt" : "Unknown exception";
+    return names[trapCause];
 }
 
-inline std::string privilegeModeName(PrivilegeMode privilegeMode) {
+constexpr std::string_view privilegeModeNameView(PrivilegeMode privilegeMode) {
     if (privilegeMode == PrivilegeMode::Machine)
         return "Machine";
     if (privilegeMode == PrivilegeMode::Supervisor)
@@ -365,6 +349,30 @@ inline std::string privilegeModeName(PrivilegeMode privilegeMode) {
     return "User";
 }
 
+inline std::string floatingPointStateName(FloatingPointState fpState) {
+    return std::string(floatingPointStateNameView(fpState));
+}
+
+inline std::string extensionStateName(ExtensionState extState) {
+    return std::string(extensionStateNameView(extState));
+}
+
+inline std::string pagingModeName(PagingMode pagingMode) {
+    return std::string(pagingModeNameView(pagingMode));
+}
+
+inline std::string tvecModeName(tvecMode mode) {
+    return std::string(tvecModeNameView(mode));
+}
+
+inline std::string trapName(bool interrupt, TrapCause trapCause) {
+    return std::string(trapNameView(interrupt, trapCause));
+}
+
+inline std::string privilegeModeName(PrivilegeMode privilegeMode) {
+    return std::string(privilegeModeNameView(privilegeMode));
+}
+
 constexpr std::array<const char*, NumRegs> registerAbiNames = {
     "zero", "ra", "sp", "gp", "tp",
     "t0", "t1", "t2",
@@ -380,37 +388,285 @@ constexpr std::array<const char*, NumRegs> registerFlatNames = {
     "x23", "x24", "x25", "x26", "x27", "x28", "x29", "x30", "x31"
 };
 
-inline std::string regName(unsigned int regNum, bool flat=false) {
+// Returns an empty view for an out-of-range register number
+constexpr std::string_view regNameView(unsigned int regNum, bool flat=false) {
     if (regNum >= NumRegs)
-        return "(invalid register #" + std::to_string(regNum) + ")";
+        return std::string_view();
     if (flat)
         return registerFlatNames[regNum];
     return registerAbiNames[regNum];
 }
 
+inline std::to_chars_result regNameToChars(char* first, char* last, unsigned int regNum, bool flat=false) {
+    if (regNum >= NumRegs)
+        return { first, std::errc::invalid_argument };
+    return nameToChars(first, last, regNameView(regNum, flat));
+}
+
+inline std::string regName(unsigned int regNum, bool flat=false) {
+    if (regNum >= NumRegs)
+        return "(invalid register #" + std::to_string(regNum) + ")";
+    return std::string(regNameView(regNum, flat));
+}
+
+// -- ISA strings --
+
+// Multi-letter extensions understood by the ISA string parser. A feature set
+// gives each one a bit above the single-letter extensions.
+enum class MultiLetterExtension : __uint8_t {
+    Zicsr, Zifencei, Zicntr, Zihpm, Zihintpause, Zmmul, Zawrs,
+    Zba, Zbb, Zbc, Zbs, Zfh, Zfhmin, Zicbom, Zicbop, Zicboz,
+    Sstc, Sscofpmf, Svinval, Svnapot, Svpbmt, Smepmp,
+    NUM_MULTI_LETTER_EXTENSIONS
+};
+
+constexpr unsigned int NumMultiLetterExtensions = (unsigned int)MultiLetterExtension::NUM_MULTI_LETTER_EXTENSIONS;
+
+constexpr std::array<std::string_view, NumMultiLetterExtensions> multiLetterExtensionNames = {
+    "zicsr", "zifencei", "zicntr", "zihpm", "zihintpause", "zmmul", "zawrs",
+    "zba", "zbb", "zbc", "zbs", "zfh", "zfhmin", "zicbom", "zicbop", "zicboz",
+    "sstc", "sscofpmf", "svinval", "svnapot", "svpbmt", "smepmp"
+};
+
+// Bits 0-25 are the single-letter extensions, laid out as in misa, so the low
+// word of a feature set is a regular extension vector. Bit 32 + n is
+// MultiLetterExtension n. Being a plain integer, a feature set can be a
+// template argument, which lets decoders and executors built for a fixed
+// configuration drop everything it lacks at compile time.
+using isaFeatureSet = __uint64_t;
+
+constexpr unsigned int multiLetterFeatureShift = 32;
+constexpr isaFeatureSet allFeatures = ~(isaFeatureSet)0;
+
+// The privilege modes a hart implements, one bit per PrivilegeMode. Kept apart
+// from isaFeatureSet because the usual ISA strings ("rv64gc") do not list S
+// or U even for harts that have them.
+using privilegeModeSet = __uint8_t;
+
+constexpr privilegeModeSet privilegeModeBit(PrivilegeMode mode) {
+    return (privilegeModeSet)(1u << mode);
+}
+
+constexpr bool privilegeModeSetHas(privilegeModeSet modes, PrivilegeMode mode) {
+    return modes & privilegeModeBit(mode);
+}
+
+constexpr privilegeModeSet allPrivilegeModes =
+    privilegeModeBit(PrivilegeMode::Machine) | privilegeModeBit(PrivilegeMode::Supervisor) | privilegeModeBit(PrivilegeMode::User);
+
+static_assert(NumMultiLetterExtensions <= 64 - multiLetterFeatureShift, "Too many multi-letter extensions for isaFeatureSet");
+
+namespace detail {
+
+constexpr char asciiLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+constexpr bool asciiLetter(char c) {
+    return asciiLower(c) >= 'a' && asciiLower(c) <= 'z';
+}
+
+constexpr bool asciiDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Skips an optional version suffix, <major>[p<minor>], returning the index after it
+constexpr std::size_t skipISAVersion(std::string_view isa, std::size_t i) {
+    if (i >= isa.size() || !asciiDigit(isa[i]))
+        return i;
+    while (i < isa.size() && asciiDigit(isa[i]))
+        i++;
+    if (i + 1 < isa.size() && asciiLower(isa[i]) == 'p' && asciiDigit(isa[i + 1])) {
+        i++;
+        while (i < isa.size() && asciiDigit(isa[i]))
+            i++;
+    }
+    return i;
+}
+
+// The longest known multi-letter extension that a name segment (the text up
+// to the next underscore) starts with, followed only by a version, or
+// NumMultiLetterExtensions if there is none
+constexpr unsigned int matchMultiLetterExtension(std::string_view segment) {
+    unsigned int match = NumMultiLetterExtensions;
+    for (unsigned int e = 0; e < NumMultiLetterExtensions; e++) {
+        std::string_view name = multiLetterExtensionNames[e];
+        if (name.size() > segment.size())
+            continue;
+        bool prefix = true;
+        for (std::size_t k = 0; k < name.size(); k++)
+            prefix = prefix && asciiLower(segment[k]) == name[k];
+        if (!prefix || skipISAVersion(segment, name.size()) != segment.size())
+            continue;
+        if (match == NumMultiLetterExtensions || name.size() > multiLetterExtensionNames[match].size())
+            match = e;
+    }
+    return match;
+}
+
+} // namespace detail
+
+constexpr isaFeatureSet featureBit(char extension) {
+    return (isaFeatureSet)1 << (detail::asciiLower(extension) - 'a');
+}
+
+constexpr isaFeatureSet featureBit(MultiLetterExtension extension) {
+    return (isaFeatureSet)1 << (multiLetterFeatureShift + (unsigned int)extension);
+}
+
+template<typename Extension>
+constexpr bool featureSetHas(isaFeatureSet features, Extension extension) {
+    return features & featureBit(extension);
+}
+
+// Adds the extensions other extensions depend on or contain
+constexpr isaFeatureSet impliedFeatures(isaFeatureSet features) {
+    using MLE = MultiLetterExtension;
+    if (features & featureBit('g'))
+        features = (features & ~featureBit('g')) |
+            featureBit('i') | featureBit('m') | featureBit('a') | featureBit('f') | featureBit('d') |
+            featureBit(MLE::Zicsr) | featureBit(MLE::Zifencei);
+    if (features & featureBit('q'))
+        features |= featureBit('d');
+    if (features & featureBit('d'))
+        features |= featureBit('f');
+    if (features & featureBit('f'))
+        features |= featureBit(MLE::Zicsr);
+    if (features & featureBit('m'))
+        features |= featureBit(MLE::Zmmul);
+    if (features & featureBit(MLE::Zfh))
+        features |= featureBit(MLE::Zfhmin);
+    return features;
+}
+
+struct isaDescription {
+    XlenMode xlen;
+    isaFeatureSet features;
+    bool valid;                 // false on malformed strings
+    bool unknownExtensions;     // some well-formed extension names were not recognized and left out
+};
+
+// Parses a full ISA string such as "rv64imafdc_zicsr_zifencei", case
+// insensitively, with optional version suffixes on every extension
+// ("rv64i2p1m2p0"). Unrecognized multi-letter extensions are skipped and
+// reported through unknownExtensions.
+constexpr isaDescription parseISAString(std::string_view isa) {
+
+    using detail::asciiLower;
+    isaDescription result = { XlenMode::None, 0, false, false };
+
+    if (isa.size() < 5 || asciiLower(isa[0]) != 'r' || asciiLower(isa[1]) != 'v')
+        return result;
+    std::size_t i = 2;
+    if (isa.substr(i, 3) == "128") {
+        result.xlen = XlenMode::XL128;
+        i += 3;
+    } else if (isa.substr(i, 2) == "64") {
+        result.xlen = XlenMode::XL64;
+        i += 2;
+    } else if (isa.substr(i, 2) == "32") {
+        result.xlen = XlenMode::XL32;
+        i += 2;
+    } else {
+        return result;
+    }
+
+    // The base ISA comes first
+    if (i >= isa.size())
+        return result;
+    char base = asciiLower(isa[i]);
+    if (base != 'i' && base != 'e' && base != 'g')
+        return result;
+    result.features |= featureBit(base);
+    i = detail::skipISAVersion(isa, i + 1);
+
+    // Before the first underscore, s is the single-letter S (supervisor mode)
+    // unless a known S-prefixed extension name follows, as in "rv64imacsu"
+    bool singleLetterRun = true;
+    while (i < isa.size()) {
+        char c = asciiLower(isa[i]);
+        if (c == '_') {
+            singleLetterRun = false;
+            i++;
+            continue;
+        }
+        if (!detail::asciiLetter(c))
+            return result;
+
+        // Multi-letter names run to the next underscore
+        std::size_t end = isa.find('_', i);
+        if (end == std::string_view::npos)
+            end = isa.size();
+        std::string_view segment = isa.substr(i, end - i);
+        unsigned int match = NumMultiLetterExtensions;
+        bool multiLetter = c == 'z' || c == 'x';
+        if (c == 's') {
+            match = detail::matchMultiLetterExtension(segment);
+            multiLetter = !singleLetterRun || match != NumMultiLetterExtensions;
+        }
+
+        if (!multiLetter) {
+            result.features |= featureBit(c);
+            i = detail::skipISAVersion(isa, i + 1);
+            continue;
+        }
+
+        if (c != 's')
+            match = detail::matchMultiLetterExtension(segment);
+        if (match == NumMultiLetterExtensions)
+            result.unknownExtensions = true;
+        else
+            result.features |= featureBit((MultiLetterExtension)match);
+        i = end;
+    }
+
+    result.features = impliedFeatures(result.features);
+    result.valid = true;
+    return result;
+}
+
+// The feature set of an ISA string, or none at all if it is malformed
+constexpr isaFeatureSet isaFeatures(std::string_view isa) {
+    isaDescription description = parseISAString(isa);
+    return description.valid ? description.features : 0;
+}
+
+constexpr isaFeatureSet RV32GC = isaFeatures("rv32gc");
+constexpr isaFeatureSet RV64GC = isaFeatures("rv64gc");
+
 // -- Facts about RISC-V extension vectors --
 
+// Accepts either a bare list of extension letters ("imafdc") or a full ISA
+// string, of which only the single-letter extensions are kept
 constexpr inline __uint32_t stringToExtensions(const char *isa) {
+    std::string_view view(isa);
+    if (view.size() >= 2 && detail::asciiLower(view[0]) == 'r' && detail::asciiLower(view[1]) == 'v')
+        return (__uint32_t)isaFeatures(view);
     __uint32_t vec = 0;
-    for (; *isa; isa++)
-        vec |= (1 << (*isa - (((*isa >= 'a') && (*isa <= 'z')) ? 'a' : 'A')));
+    for (char c : view)
+        if (detail::asciiLetter(c))
+            vec |= (__uint32_t)featureBit(c);
     return vec;
 }
 
+inline std::to_chars_result extensionsToChars(char* first, char* last, __uint32_t extensions) {
+    for (unsigned int i = 0; i < 32; i++) {
+        if (!(extensions & (1u << i)))
+            continue;
+        if (first == last)
+            return { last, std::errc::value_too_large };
+        *first++ = 'a' + i;
+    }
+    return { first, std::errc() };
+}
+
 inline std::string extensionsToString(__uint32_t extensions) {
-    // TODO this is stupid but I'm tired... make it less stupid
-    char buf[33];
-    int bufIdx = 0;
-    for (unsigned int i = 0; i < 32; i++)
-        if (extensions & (1<<i))
-            buf[bufIdx++] = 'a'+i;
-    buf[bufIdx] = 0;
-    return std::string(buf);
+    char buf[32];
+    return std::string(buf, extensionsToChars(buf, buf + sizeof(buf), extensions).ptr);
 }
 
-// TODO case-insensitive please
 constexpr inline bool vectorHasExtension(__uint32_t vector, char extension) {
-    return vector & (1 <<  (extension - 'A'));
+    return vector & featureBit(extension);
 }
 
 constexpr inline const char * xlenModeName(XlenMode xlenMode) {
@@ -539,8 +795,27 @@ constexpr bool isCompressed(__uint32_t encodedInstruction) {
     return (encodedInstruction & 0x00000003) != 0x00000003;
 }
 
+// Longest encoding with a defined length: 80 + 16*6 bits
+constexpr unsigned int MaxInstructionLength = 22;
+
+// Length in bytes, decided entirely by the first 16-bit parcel. Returns 0 for
+// the encodings reserved for 192 bits and longer.
 constexpr unsigned int instructionLength(__uint32_t encodedInstruction) {
-    return isCompressed(encodedInstruction) ? 2 : 4; // TODO extended lengths
+    if (isCompressed(encodedInstruction))
+        return 2;
+    switch ((encodedInstruction >> 2) & 0x1f) {
+    case MajorOpcode::LONG_48B_1:
+    case MajorOpcode::LONG_48B_2:
+        return 6;
+    case MajorOpcode::LONG_64B:
+        return 8;
+    case MajorOpcode::LONG_80B: {
+        unsigned int nnn = (encodedInstruction >> 12) & 0x7;
+        return nnn == 0x7 ? 0 : 10 + (2 * nnn);
+    }
+    default:
+        return 4;
+    }
 }
 
 // -- Facts about Configuration & Status Registers --
@@ -676,6 +951,32 @@ constexpr std::array<const char*, NumCSRs> getCSRNameTable() {
     table[CSRAddress::MINSTRET] = "minstret";
     table[CSRAddress::MHPMCOUNTER3] = "mhpmcounter3";
     table[CSRAddress::MHPMCOUNTER4] = "mhpmcounter4";
+    table[CSRAddress::MHPMCOUNTER5] = "mhpmcounter5";
+    table[CSRAddress::MHPMCOUNTER6] = "mhpmcounter6";
+    table[CSRAddress::MHPMCOUNTER7] = "mhpmcounter7";
+    table[CSRAddress::MHPMCOUNTER8] = "mhpmcounter8";
+    table[CSRAddress::MHPMCOUNTER9] = "mhpmcounter9";
+    table[CSRAddress::MHPMCOUNTER10] = "mhpmcounter10";
+    table[CSRAddress::MHPMCOUNTER11] = "mhpmcounter11";
+    table[CSRAddress::MHPMCOUNTER12] = "mhpmcounter12";
+    table[CSRAddress::MHPMCOUNTER13] = "mhpmcounter13";
+    table[CSRAddress::MHPMCOUNTER14] = "mhpmcounter14";
+    table[CSRAddress::MHPMCOUNTER15] = "mhpmcounter15";
+    table[CSRAddress::MHPMCOUNTER16] = "mhpmcounter16";
+    table[CSRAddress::MHPMCOUNTER17] = "mhpmcounter17";
+    table[CSRAddress::MHPMCOUNTER18] = "mhpmcounter18";
+    table[CSRAddress::MHPMCOUNTER19] = "mhpmcounter19";
+    table[CSRAddress::MHPMCOUNTER20] = "mhpmcounter20";
+    table[CSRAddress::MHPMCOUNTER21] = "mhpmcounter21";
+    table[CSRAddress::MHPMCOUNTER22] = "mhpmcounter22";
+    table[CSRAddress::MHPMCOUNTER23] = "mhpmcounter23";
+    table[CSRAddress::MHPMCOUNTER24] = "mhpmcounter24";
+    table[CSRAddress::MHPMCOUNTER25] = "mhpmcounter25";
+    table[CSRAddress::MHPMCOUNTER26] = "mhpmcounter26";
+    table[CSRAddress::MHPMCOUNTER27] = "mhpmcounter27";
+    table[CSRAddress::MHPMCOUNTER28] = "mhpmcounter28";
+    table[CSRAddress::MHPMCOUNTER29] = "mhpmcounter29";
+    table[CSRAddress::MHPMCOUNTER30] = "mhpmcounter30";
     table[CSRAddress::MHPMCOUNTER31] = "mhpmcounter31";
     table[CSRAddress::MCYCLEH] = "mcycleh";
     table[CSRAddress::MINSTRETH] = "minstreth";
@@ -751,20 +1052,205 @@ constexpr std::array<const char*, NumCSRs> getCSRNameTable() {
 
 constexpr std::array<const char*, NumCSRs> csrNames = getCSRNameTable();
 
+// Returns an empty view for an address with no named CSR
+constexpr std::string_view csrNameView(unsigned int address) {
+    if (address >= NumCSRs || csrNames[address] == nullptr)
+        return std::string_view();
+    return csrNames[address];
+}
+
 inline std::string csrName(unsigned int address) {
-    if (address >= NumCSRs)
+    if (address >= NumCSRs || csrNames[address] == nullptr)
         return "(invalid CSR #" + std::to_string(address) + ")";
-    return csrNames[address];
+    return std::string(csrNameView(address));
+}
+
+// Unnamed addresses are written as a hex number, which assemblers accept
+inline std::to_chars_result csrNameToChars(char* first, char* last, unsigned int address) {
+    std::string_view name = csrNameView(address);
+    if (!name.empty())
+        return nameToChars(first, last, name);
+    if (last - first < 2)
+        return { last, std::errc::value_too_large };
+    first[0] = '0';
+    first[1] = 'x';
+    return std::to_chars(first + 2, last, address, 16);
 }
 
 inline constexpr PrivilegeMode csrRequiredPrivilege(CSRAddress addr) {
     return (PrivilegeMode) ((addr & 0b001100000000) >> 8);
 }
 
-inline bool csrIsReadOnly(CSRAddress addr) {
+inline constexpr bool csrIsReadOnly(CSRAddress addr) {
     return (addr & 0b110000000000) == 0b110000000000;
 }
 
+// What kind of state a CSR reads and writes, for dispatching CSR instructions
+enum class CSRHandlerClass : __uint8_t {
+    None, Status, ISA, Delegation, InterruptEnable, InterruptPending,
+    TrapVector, CounterEnable, Scratch, ExceptionPC, Cause, TrapValue,
+    AddressTranslation, FloatingPoint, Counter, CounterHigh, EventSelector,
+    CounterInhibit, PMPConfig, PMPAddress, MachineInformation, Trigger, Debug
+};
+
+struct csrMetadata {
+
+    constexpr static __uint8_t existsMask       = 0b00001;
+    constexpr static __uint8_t readOnlyMask     = 0b00010;
+    constexpr static __uint8_t rv32OnlyMask     = 0b00100;
+    constexpr static __uint8_t counterGatedMask = 0b01000;
+    constexpr static __uint8_t debugOnlyMask    = 0b10000;
+
+    __uint32_t requiredExtensions;  // misa bits that must all be present
+    __uint32_t anyExtensions;       // misa bits of which one must be present, if any
+    __uint8_t flags;
+    __uint8_t privilege;            // lowest PrivilegeMode allowed access
+    __uint8_t counterIndex;         // mcounteren/scounteren bit, if counter gated
+    CSRHandlerClass handler;
+};
+
+namespace detail {
+
+constexpr __uint32_t extensionBit(char extension) {
+    return 1u << (extension - 'A');
+}
+
+struct CSRMetadataBuilder {
+
+    std::array<csrMetadata, NumCSRs> table;
+
+    constexpr void Define(unsigned int address, CSRHandlerClass handler,
+                          __uint32_t requiredExtensions = 0, __uint32_t anyExtensions = 0, __uint8_t flags = 0) {
+        flags |= csrMetadata::existsMask;
+        if (csrIsReadOnly((CSRAddress)address))
+            flags |= csrMetadata::readOnlyMask;
+        table[address] = {
+            requiredExtensions, anyExtensions, flags,
+            (__uint8_t)csrRequiredPrivilege((CSRAddress)address), 0, handler };
+    }
+
+    constexpr void DefineRange(unsigned int first, unsigned int last, CSRHandlerClass handler,
+                               __uint32_t requiredExtensions = 0, __uint8_t flags = 0) {
+        for (unsigned int address = first; address <= last; address++)
+            Define(address, handler, requiredExtensions, 0, flags);
+    }
+
+    constexpr void DefineCounters(unsigned int first, unsigned int last, CSRHandlerClass handler, __uint8_t flags) {
+        for (unsigned int address = first; address <= last; address++) {
+            Define(address, handler, 0, 0, flags);
+            table[address].counterIndex = address & 0x1f;
+        }
+    }
+};
+
+} // namespace detail
+
+constexpr std::array<csrMetadata, NumCSRs> getCSRMetadataTable() {
+
+    using H = CSRHandlerClass;
+    using detail::extensionBit;
+    constexpr __uint32_t F = extensionBit('F');
+    constexpr __uint32_t N = extensionBit('N');
+    constexpr __uint32_t S = extensionBit('S');
+    constexpr __uint32_t U = extensionBit('U');
+    constexpr __uint8_t rv32Only = csrMetadata::rv32OnlyMask;
+    constexpr __uint8_t gated = csrMetadata::counterGatedMask;
+
+    detail::CSRMetadataBuilder b = {};
+
+    b.Define(CSRAddress::USTATUS, H::Status, N);
+    b.Define(CSRAddress::UIE, H::InterruptEnable, N);
+    b.Define(CSRAddress::UTVEC, H::TrapVector, N);
+    b.Define(CSRAddress::USCRATCH, H::Scratch, N);
+    b.Define(CSRAddress::UEPC, H::ExceptionPC, N);
+    b.Define(CSRAddress::UCAUSE, H::Cause, N);
+    b.Define(CSRAddress::UTVAL, H::TrapValue, N);
+    b.Define(CSRAddress::UIP, H::InterruptPending, N);
+
+    b.DefineRange(CSRAddress::FFLAGS, CSRAddress::FCSR, H::FloatingPoint, F);
+
+    b.DefineCounters(CSRAddress::CYCLE, CSRAddress::HPMCOUNTER31, H::Counter, gated);
+    b.DefineCounters(CSRAddress::CYCLEH, CSRAddress::HPMCOUNTER31H, H::CounterHigh, gated | rv32Only);
+
+    b.Define(CSRAddress::SSTATUS, H::Status, S);
+    b.Define(CSRAddress::SEDELEG, H::Delegation, S | N);
+    b.Define(CSRAddress::SIDELEG, H::Delegation, S | N);
+    b.Define(CSRAddress::SIE, H::InterruptEnable, S);
+    b.Define(CSRAddress::STVEC, H::TrapVector, S);
+    b.Define(CSRAddress::SCOUNTEREN, H::CounterEnable, S);
+    b.Define(CSRAddress::SSCRATCH, H::Scratch, S);
+    b.Define(CSRAddress::SEPC, H::ExceptionPC, S);
+    b.Define(CSRAddress::SCAUSE, H::Cause, S);
+    b.Define(CSRAddress::STVAL, H::TrapValue, S);
+    b.Define(CSRAddress::SIP, H::InterruptPending, S);
+    b.Define(CSRAddress::SATP, H::AddressTranslation, S);
+
+    b.DefineRange(CSRAddress::MVENDORID, CSRAddress::MHARTID, H::MachineInformation);
+
+    b.Define(CSRAddress::MSTATUS, H::Status);
+    b.Define(CSRAddress::MISA, H::ISA);
+    // Delegation registers exist whenever there is a less privileged trap handler
+    b.Define(CSRAddress::MEDELEG, H::Delegation, 0, S | N);
+    b.Define(CSRAddress::MIDELEG, H::Delegation, 0, S | N);
+    b.Define(CSRAddress::MIE, H::InterruptEnable);
+    b.Define(CSRAddress::MTVEC, H::TrapVector);
+    b.Define(CSRAddress::MCOUNTEREN, H::CounterEnable, U);
+    b.Define(CSRAddress::MSCRATCH, H::Scratch);
+    b.Define(CSRAddress::MEPC, H::ExceptionPC);
+    b.Define(CSRAddress::MCAUSE, H::Cause);
+    b.Define(CSRAddress::MTVAL, H::TrapValue);
+    b.Define(CSRAddress::MIP, H::InterruptPending);
+
+    b.Define(CSRAddress::PMPCFG0, H::PMPConfig);
+    b.Define(CSRAddress::PMPCFG1, H::PMPConfig, 0, 0, rv32Only);
+    b.Define(CSRAddress::PMPCFG2, H::PMPConfig);
+    b.Define(CSRAddress::PMPCFG3, H::PMPConfig, 0, 0, rv32Only);
+    b.DefineRange(CSRAddress::PMPADDR0, CSRAddress::PMPADDR15, H::PMPAddress);
+
+    b.DefineCounters(CSRAddress::MCYCLE, CSRAddress::MCYCLE, H::Counter, 0);
+    b.DefineCounters(CSRAddress::MINSTRET, CSRAddress::MHPMCOUNTER31, H::Counter, 0);
+    b.DefineCounters(CSRAddress::MCYCLEH, CSRAddress::MCYCLEH, H::CounterHigh, rv32Only);
+    b.DefineCounters(CSRAddress::MINSTRETH, CSRAddress::MHPMCOUNTER31H, H::CounterHigh, rv32Only);
+
+    b.Define(CSRAddress::MCOUNTINHIBIT, H::CounterInhibit);
+    b.DefineCounters(CSRAddress::MHPMEVENT3, CSRAddress::MHPMEVENT31, H::EventSelector, 0);
+
+    b.DefineRange(CSRAddress::TSELECT, CSRAddress::TDATA3, H::Trigger);
+    b.DefineRange(CSRAddress::DCSR, CSRAddress::DSCRATCH1, H::Debug, 0, csrMetadata::debugOnlyMask);
+
+    return b.table;
+}
+
+constexpr std::array<csrMetadata, NumCSRs> csrMetadataTable = getCSRMetadataTable();
+
+// The mcounteren/scounteren bits that apply at a privilege level
+constexpr __uint32_t effectiveCounterEnable(PrivilegeMode privilege, __uint32_t mcounteren, __uint32_t scounteren, __uint32_t extensions) {
+    if (privilege == PrivilegeMode::Machine)
+        return ~(__uint32_t)0;
+    if (privilege == PrivilegeMode::User && (extensions & detail::extensionBit('S')))
+        return mcounteren & scounteren;
+    return mcounteren;
+}
+
+// Whether a CSR instruction may touch this CSR at all: one table load and a
+// handful of mask tests, combined without short-circuiting.
+template<typename XLEN_t>
+constexpr bool csrAccessLegal(unsigned int address, PrivilegeMode privilege, bool write,
+                              __uint32_t extensions, __uint32_t counterEnable, bool debugMode = false) {
+    const csrMetadata& meta = csrMetadataTable[address & (NumCSRs - 1)];
+    bool exists = ((meta.flags & csrMetadata::existsMask) != 0) &
+                  ((extensions & meta.requiredExtensions) == meta.requiredExtensions) &
+                  ((meta.anyExtensions == 0) | ((extensions & meta.anyExtensions) != 0));
+    if constexpr (!std::is_same<XLEN_t, __uint32_t>()) {
+        exists = exists & ((meta.flags & csrMetadata::rv32OnlyMask) == 0);
+    }
+    bool privileged = privilege >= meta.privilege;
+    bool writable = !write | ((meta.flags & csrMetadata::readOnlyMask) == 0);
+    bool enabled = ((meta.flags & csrMetadata::counterGatedMask) == 0) | ((counterEnable >> meta.counterIndex) & 1);
+    bool debug = debugMode | ((meta.flags & csrMetadata::debugOnlyMask) == 0);
+    return (address < NumCSRs) & exists & privileged & writable & enabled & debug;
+}
+
 // -- Facts about interrupts, exceptions, and traps --
 
 // TODO move to tvec
@@ -783,10 +1269,22 @@ constexpr static __uint32_t ueiMask = 0b0000100000000;
 constexpr static __uint32_t seiMask = 0b0001000000000;
 constexpr static __uint32_t meiMask = 0b0100000000000;
 
+constexpr TrapCause accessFaultCause(AccessType type) {
+    return type == Fetch ? INSTRUCTION_ACCESS_FAULT : type == Load ? LOAD_ACCESS_FAULT : STORE_AMO_ACCESS_FAULT;
+}
+
+constexpr TrapCause pageFaultCause(AccessType type) {
+    return type == Fetch ? INSTRUCTION_PAGE_FAULT : type == Load ? LOAD_PAGE_FAULT : STORE_AMO_PAGE_FAULT;
+}
+
+constexpr TrapCause misalignedCause(AccessType type) {
+    return type == Fetch ? INSTRUCTION_ADDRESS_MISALIGNED : type == Load ? LOAD_ADDRESS_MISALIGNED : STORE_AMO_ADDRESS_MISALIGNED;
+}
+
 template<typename XLEN_t>
 PrivilegeMode DestinedPrivilegeForCause(TrapCause cause, XLEN_t mdeleg, XLEN_t sdeleg, __uint32_t extensions) {
 
-    XLEN_t causeMask = 1 << cause;
+    XLEN_t causeMask = (XLEN_t)1 << cause;
 
     // Without U mode, there is no S mode either, so M mode takes it.
     if (!vectorHasExtension(extensions, 'U')) {
@@ -813,31 +1311,77 @@ PrivilegeMode DestinedPrivilegeForCause(TrapCause cause, XLEN_t mdeleg, XLEN_t s
     return PrivilegeMode::User;
 }
 
+// Caches DestinedPrivilegeForCause() for every cause. Update() whenever
+// medeleg, mideleg, sedeleg, sideleg or misa changes; trap entry is then a
+// single indexed load.
 template<typename XLEN_t>
-TrapCause highestPriorityInterrupt(XLEN_t interruptsToService) {
-    // The order in the spec is: MEI MSI MTI SEI SSI STI UEI USI UTI
-    if (interruptsToService & (1 << TrapCause::MACHINE_EXTERNAL_INTERRUPT)) {
-        return TrapCause::MACHINE_EXTERNAL_INTERRUPT;
-    } else if (interruptsToService & (1 << TrapCause::MACHINE_SOFTWARE_INTERRUPT)) {
-        return TrapCause::MACHINE_SOFTWARE_INTERRUPT;
-    } else if (interruptsToService & (1 << TrapCause::MACHINE_TIMER_INTERRUPT)) {
-        return TrapCause::MACHINE_TIMER_INTERRUPT;
-    } else if (interruptsToService & (1 << TrapCause::SUPERVISOR_EXTERNAL_INTERRUPT)) {
-        return TrapCause::SUPERVISOR_EXTERNAL_INTERRUPT;
-    } else if (interruptsToService & (1 << TrapCause::SUPERVISOR_SOFTWARE_INTERRUPT)) {
-        return TrapCause::SUPERVISOR_SOFTWARE_INTERRUPT;
-    } else if (interruptsToService & (1 << TrapCause::SUPERVISOR_TIMER_INTERRUPT)) {
-        return TrapCause::SUPERVISOR_TIMER_INTERRUPT;
-    } else if (interruptsToService & (1 << TrapCause::USER_EXTERNAL_INTERRUPT)) {
-        return TrapCause::USER_EXTERNAL_INTERRUPT;
-    } else if (interruptsToService & (1 << TrapCause::USER_SOFTWARE_INTERRUPT)) {
-        return TrapCause::USER_SOFTWARE_INTERRUPT;
-    } else if (interruptsToService & (1 << TrapCause::USER_TIMER_INTERRUPT)) {
-        return TrapCause::USER_TIMER_INTERRUPT;
-    } else {
-        // This indicates custom interrupts... TODO ?
-        return TrapCause::NONE;
+struct trapDelegationResolver {
+
+    constexpr static unsigned int NumCauses = sizeof(XLEN_t) * 8;
+
+    PrivilegeMode destinations[2][NumCauses];
+
+    void Update(XLEN_t medeleg, XLEN_t mideleg, XLEN_t sedeleg, XLEN_t sideleg, __uint32_t extensions) {
+        for (unsigned int cause = 0; cause < NumCauses; cause++) {
+            destinations[0][cause] = DestinedPrivilegeForCause<XLEN_t>((TrapCause)cause, medeleg, sedeleg, extensions);
+            destinations[1][cause] = DestinedPrivilegeForCause<XLEN_t>((TrapCause)cause, mideleg, sideleg, extensions);
+        }
     }
+
+    // The cause must be below XLEN, as only those can be delegated
+    inline PrivilegeMode Resolve(bool interrupt, TrapCause cause) const {
+        return destinations[interrupt][cause];
+    }
+};
+
+// Interrupt causes from lowest to highest priority. The spec order, highest
+// first, is: MEI MSI MTI SEI SSI STI UEI USI UTI
+constexpr std::array<TrapCause, 10> interruptPriorityOrder = {
+    TrapCause::NONE,
+    TrapCause::USER_TIMER_INTERRUPT,
+    TrapCause::USER_SOFTWARE_INTERRUPT,
+    TrapCause::USER_EXTERNAL_INTERRUPT,
+    TrapCause::SUPERVISOR_TIMER_INTERRUPT,
+    TrapCause::SUPERVISOR_SOFTWARE_INTERRUPT,
+    TrapCause::SUPERVISOR_EXTERNAL_INTERRUPT,
+    TrapCause::MACHINE_TIMER_INTERRUPT,
+    TrapCause::MACHINE_SOFTWARE_INTERRUPT,
+    TrapCause::MACHINE_EXTERNAL_INTERRUPT
+};
+
+// Permutes each nibble of the 12 standard interrupt bits into a word where
+// bit n is set for pending interrupts of priority rank n.
+constexpr std::array<__uint16_t, 48> buildInterruptRankTable() {
+    std::array<__uint16_t, 48> table = {0};
+    for (unsigned int nibble = 0; nibble < 3; nibble++) {
+        for (unsigned int value = 0; value < 16; value++) {
+            for (unsigned int rank = 1; rank < interruptPriorityOrder.size(); rank++) {
+                unsigned int cause = interruptPriorityOrder[rank];
+                if ((cause >> 2) == nibble && (value & (1 << (cause & 3))))
+                    table[(nibble << 4) | value] |= 1 << rank;
+            }
+        }
+    }
+    return table;
+}
+
+constexpr std::array<__uint16_t, 48> interruptRankTable = buildInterruptRankTable();
+
+// Branch-free: three table loads and a count-leading-zeros pick the standard
+// interrupt. Platform interrupts (bits 16 and up) have platform-defined
+// priority; here they outrank the standard ones, highest number first, as
+// the spec suggests is typical.
+template<typename XLEN_t>
+TrapCause highestPriorityInterrupt(XLEN_t interruptsToService) {
+    unsigned int standard = (unsigned int)interruptsToService;
+    unsigned int ranked = 1 |
+        interruptRankTable[0x00 | (standard & 0xf)] |
+        interruptRankTable[0x10 | ((standard >> 4) & 0xf)] |
+        interruptRankTable[0x20 | ((standard >> 8) & 0xf)];
+    TrapCause standardCause = interruptPriorityOrder[31 - __builtin_clz(ranked)];
+    __uint64_t platform = (__uint64_t)(interruptsToService >> 16);
+    TrapCause platformCause = (TrapCause)(16 + 63 - __builtin_clzll(platform | 1));
+    return platform ? platformCause : standardCause;
 }
 
 // TODO comment for what this section of the spec-knowledge is. In general I need to sort this doc...
@@ -871,7 +1415,8 @@ struct misaReg {
     }
 };
 
-struct mstatusReg {
+// The canonical mstatus bit layout, shared by both storage modes below
+struct mstatusLayout {
 
     constexpr static __uint32_t uieMask  = 0b00000000000000000000001;
     constexpr static __uint32_t sieMask  = 0b00000000000000000000010;
@@ -900,8 +1445,10 @@ struct mstatusReg {
     constexpr static __uint32_t xsShift  = 15;
     constexpr static __uint32_t uxlShift = 32;
     constexpr static __uint32_t sxlShift = 34;
+};
+
+struct mstatusUnpackedReg : mstatusLayout {
 
-    // TODO accessor pattern and option to store as packed form instead?
     bool uie, sie, mie, upie, spie, mpie;
     PrivilegeMode spp, mpp;
     FloatingPointState fs;
@@ -910,6 +1457,46 @@ struct mstatusReg {
     XlenMode sxl, uxl;
     bool sd;
 
+    bool UIE() const { return uie; }
+    bool SIE() const { return sie; }
+    bool MIE() const { return mie; }
+    bool UPIE() const { return upie; }
+    bool SPIE() const { return spie; }
+    bool MPIE() const { return mpie; }
+    PrivilegeMode SPP() const { return spp; }
+    PrivilegeMode MPP() const { return mpp; }
+    FloatingPointState FS() const { return fs; }
+    ExtensionState XS() const { return xs; }
+    bool MPRV() const { return mprv; }
+    bool SUM() const { return sum; }
+    bool MXR() const { return mxr; }
+    bool TVM() const { return tvm; }
+    bool TW() const { return tw; }
+    bool TSR() const { return tsr; }
+    XlenMode SXL() const { return sxl; }
+    XlenMode UXL() const { return uxl; }
+    bool SD() const { return sd; }
+
+    void UIE(bool value) { uie = value; }
+    void SIE(bool value) { sie = value; }
+    void MIE(bool value) { mie = value; }
+    void UPIE(bool value) { upie = value; }
+    void SPIE(bool value) { spie = value; }
+    void MPIE(bool value) { mpie = value; }
+    void SPP(PrivilegeMode value) { spp = value; }
+    void MPP(PrivilegeMode value) { mpp = value; }
+    void FS(FloatingPointState value) { fs = value; }
+    void XS(ExtensionState value) { xs = value; }
+    void MPRV(bool value) { mprv = value; }
+    void SUM(bool value) { sum = value; }
+    void MXR(bool value) { mxr = value; }
+    void TVM(bool value) { tvm = value; }
+    void TW(bool value) { tw = value; }
+    void TSR(bool value) { tsr = value; }
+    void SXL(XlenMode value) { sxl = value; }
+    void UXL(XlenMode value) { uxl = value; }
+    void SD(bool value) { sd = value; }
+
     template <typename XLEN_t, PrivilegeMode viewPrivilege>
     inline void Write(XLEN_t value) {
         uie = uieMask & value;
@@ -991,7 +1578,8 @@ struct mstatusReg {
         upie = false;
         mprv = false;
         mpp = PrivilegeMode::Machine;
-        spp = PrivilegeMode::Machine;
+        // SPP is one bit wide and can only hold User or Supervisor
+        spp = PrivilegeMode::User;
         fs = FloatingPointState::Off;
         xs = ExtensionState::AllOff;
         mprv = false;
@@ -1006,59 +1594,198 @@ struct mstatusReg {
     }
 };
 
-struct interruptReg {
+// Stores mstatus as its canonical RV64 word, so every privilege view is a
+// constant mask. SD lives at bit 63 and is moved to bit 31 for RV32 views.
+struct mstatusPackedReg : mstatusLayout {
 
-    bool usi, ssi, msi, uti, sti, mti, uei, sei, mei;
+    __uint64_t bits;
 
-    template<typename XLEN_t, PrivilegeMode viewPrivilege>
-    void Write(XLEN_t value) {
-        usi = usiMask & value;
-        uti = utiMask & value;
-        uei = ueiMask & value;
+    template <typename XLEN_t, PrivilegeMode viewPrivilege>
+    constexpr static __uint64_t viewMask() {
+        static_assert(!std::is_same<XLEN_t, __uint128_t>(), "Packed mstatus has no RV128 layout");
+        __uint64_t mask = uieMask | upieMask;
         if constexpr (viewPrivilege != PrivilegeMode::User) {
-            ssi = ssiMask & value;
-            sti = stiMask & value;
-            sei = seiMask & value;
+            mask |= sieMask | spieMask | sppMask | fsMask | xsMask | sumMask | mxrMask | sdMask64;
         }
         if constexpr (viewPrivilege == PrivilegeMode::Machine) {
-            msi = msiMask & value;
-            mti = mtiMask & value;
-            mei = meiMask & value;
+            mask |= mieMask | mpieMask | mppMask | mprvMask | tvmMask | twMask | tsrMask | uxlMask | sxlMask;
         }
+        return mask;
     }
 
-    template<typename XLEN_t, PrivilegeMode viewPrivilege>
-    XLEN_t Read() {
-        XLEN_t value = 0;
-        value |= usi ? usiMask : 0;
-        value |= uti ? utiMask : 0;
-        value |= uei ? ueiMask : 0;
-        if constexpr (viewPrivilege != PrivilegeMode::User) {
-            value |= ssi ? ssiMask : 0;
-            value |= sti ? stiMask : 0;
-            value |= sei ? seiMask : 0;
+    template <typename XLEN_t, PrivilegeMode viewPrivilege>
+    inline void Write(XLEN_t value) {
+        constexpr __uint64_t mask = viewMask<XLEN_t, viewPrivilege>();
+        __uint64_t incoming = value;
+        if constexpr (std::is_same<XLEN_t, __uint32_t>()) {
+            // RV32 harts have UXL and SXL fixed at 32 bits
+            constexpr __uint64_t xl32 =
+                ((__uint64_t)XlenMode::XL32 << uxlShift) | ((__uint64_t)XlenMode::XL32 << sxlShift);
+            incoming |= ((incoming & sdMask32) << 32) | xl32;
         }
+        bits = (bits & ~mask) | (incoming & mask);
+    }
+
+    template <typename XLEN_t, PrivilegeMode viewPrivilege>
+    inline XLEN_t Read() {
+        constexpr __uint64_t mask = viewMask<XLEN_t, viewPrivilege>();
+        if constexpr (std::is_same<XLEN_t, __uint32_t>()) {
+            return (XLEN_t)((bits & mask) | ((bits & mask & sdMask64) >> 32));
+        } else {
+            return bits & mask;
+        }
+    }
+
+    template <typename MXLEN_t>
+    inline void Reset() {
+        bits = 0;
+        MPP(PrivilegeMode::Machine);
+        SXL(xlenTypeToMode<MXLEN_t>());
+        UXL(xlenTypeToMode<MXLEN_t>());
+    }
+
+    template <__uint64_t mask>
+    inline __uint64_t Field() const {
+        return (bits & mask) >> __builtin_ctzll(mask);
+    }
+
+    template <__uint64_t mask>
+    inline void Field(__uint64_t value) {
+        bits = (bits & ~mask) | ((value << __builtin_ctzll(mask)) & mask);
+    }
+
+    bool UIE() const { return Field<uieMask>(); }
+    bool SIE() const { return Field<sieMask>(); }
+    bool MIE() const { return Field<mieMask>(); }
+    bool UPIE() const { return Field<upieMask>(); }
+    bool SPIE() const { return Field<spieMask>(); }
+    bool MPIE() const { return Field<mpieMask>(); }
+    PrivilegeMode SPP() const { return (PrivilegeMode)Field<sppMask>(); }
+    PrivilegeMode MPP() const { return (PrivilegeMode)Field<mppMask>(); }
+    FloatingPointState FS() const { return (FloatingPointState)Field<fsMask>(); }
+    ExtensionState XS() const { return (ExtensionState)Field<xsMask>(); }
+    bool MPRV() const { return Field<mprvMask>(); }
+    bool SUM() const { return Field<sumMask>(); }
+    bool MXR() const { return Field<mxrMask>(); }
+    bool TVM() const { return Field<tvmMask>(); }
+    bool TW() const { return Field<twMask>(); }
+    bool TSR() const { return Field<tsrMask>(); }
+    XlenMode SXL() const { return (XlenMode)Field<sxlMask>(); }
+    XlenMode UXL() const { return (XlenMode)Field<uxlMask>(); }
+    bool SD() const { return Field<sdMask64>(); }
+
+    void UIE(bool value) { Field<uieMask>(value); }
+    void SIE(bool value) { Field<sieMask>(value); }
+    void MIE(bool value) { Field<mieMask>(value); }
+    void UPIE(bool value) { Field<upieMask>(value); }
+    void SPIE(bool value) { Field<spieMask>(value); }
+    void MPIE(bool value) { Field<mpieMask>(value); }
+    void SPP(PrivilegeMode value) { Field<sppMask>(value); }
+    void MPP(PrivilegeMode value) { Field<mppMask>(value); }
+    void FS(FloatingPointState value) { Field<fsMask>(value); }
+    void XS(ExtensionState value) { Field<xsMask>(value); }
+    void MPRV(bool value) { Field<mprvMask>(value); }
+    void SUM(bool value) { Field<sumMask>(value); }
+    void MXR(bool value) { Field<mxrMask>(value); }
+    void TVM(bool value) { Field<tvmMask>(value); }
+    void TW(bool value) { Field<twMask>(value); }
+    void TSR(bool value) { Field<tsrMask>(value); }
+    void SXL(XlenMode value) { Field<sxlMask>(value); }
+    void UXL(XlenMode value) { Field<uxlMask>(value); }
+    void SD(bool value) { Field<sdMask64>(value); }
+};
+
+// Define RISCV_PACKED_MSTATUS to store mstatus as a single packed word. Code
+// that goes through the accessors works with either layout.
+#if defined(RISCV_PACKED_MSTATUS)
+using mstatusReg = mstatusPackedReg;
+#else
+using mstatusReg = mstatusUnpackedReg;
+#endif
+
+// Backs both mip and mie. Bits 16 and up belong to platform interrupt
+// sources and are visible only in the machine view. In mip the platform sets
+// and clears them directly, so they are not CSR-writable there. In mie they
+// are, so that M-mode software can enable platform interrupts.
+template<bool platformWritable>
+struct interruptReg {
+
+    constexpr static __uint64_t userMask = usiMask | utiMask | ueiMask;
+    constexpr static __uint64_t supervisorMask = userMask | ssiMask | stiMask | seiMask;
+    constexpr static __uint64_t machineMask = supervisorMask | msiMask | mtiMask | meiMask;
+    constexpr static __uint64_t platformMask = ~(__uint64_t)0xffff;
+
+    __uint64_t bits;
+
+    template<PrivilegeMode viewPrivilege>
+    constexpr static __uint64_t writeMask() {
         if constexpr (viewPrivilege == PrivilegeMode::Machine) {
-            value |= msi ? msiMask : 0;
-            value |= mti ? mtiMask : 0;
-            value |= mei ? meiMask : 0;
+            return platformWritable ? (machineMask | platformMask) : machineMask;
+        } else if constexpr (viewPrivilege == PrivilegeMode::Supervisor) {
+            return supervisorMask;
+        } else {
+            return userMask;
         }
-        return value;
+    }
+
+    template<PrivilegeMode viewPrivilege>
+    constexpr static __uint64_t readMask() {
+        if constexpr (viewPrivilege == PrivilegeMode::Machine) {
+            return machineMask | platformMask;
+        } else {
+            return writeMask<viewPrivilege>();
+        }
+    }
+
+    template<typename XLEN_t, PrivilegeMode viewPrivilege>
+    void Write(XLEN_t value) {
+        constexpr __uint64_t mask = writeMask<viewPrivilege>();
+        bits = (bits & ~mask) | ((__uint64_t)value & mask);
+    }
+
+    template<typename XLEN_t, PrivilegeMode viewPrivilege>
+    XLEN_t Read() {
+        return (XLEN_t)(bits & readMask<viewPrivilege>());
     }
 
     void Reset() {
-        usi = false;
-        ssi = false;
-        msi = false;
-        uti = false;
-        sti = false;
-        mti = false;
-        uei = false;
-        sei = false;
-        mei = false;
+        bits = 0;
     }
+
+    template<__uint64_t mask>
+    bool Bit() const {
+        return bits & mask;
+    }
+
+    template<__uint64_t mask>
+    void Bit(bool value) {
+        bits = value ? (bits | mask) : (bits & ~mask);
+    }
+
+    bool USI() const { return Bit<usiMask>(); }
+    bool SSI() const { return Bit<ssiMask>(); }
+    bool MSI() const { return Bit<msiMask>(); }
+    bool UTI() const { return Bit<utiMask>(); }
+    bool STI() const { return Bit<stiMask>(); }
+    bool MTI() const { return Bit<mtiMask>(); }
+    bool UEI() const { return Bit<ueiMask>(); }
+    bool SEI() const { return Bit<seiMask>(); }
+    bool MEI() const { return Bit<meiMask>(); }
+
+    void USI(bool value) { Bit<usiMask>(value); }
+    void SSI(bool value) { Bit<ssiMask>(value); }
+    void MSI(bool value) { Bit<msiMask>(value); }
+    void UTI(bool value) { Bit<utiMask>(value); }
+    void STI(bool value) { Bit<stiMask>(value); }
+    void MTI(bool value) { Bit<mtiMask>(value); }
+    void UEI(bool value) { Bit<ueiMask>(value); }
+    void SEI(bool value) { Bit<seiMask>(value); }
+    void MEI(bool value) { Bit<meiMask>(value); }
 };
 
+using interruptPendingReg = interruptReg<false>;
+using interruptEnableReg = interruptReg<true>;
+
 template<typename XLEN_t>
 struct tvecReg {
     XLEN_t base;
@@ -1069,7 +1796,8 @@ struct tvecReg {
     }
 
     void Write(XLEN_t value) {
-        base = value & RISCV::tvecBaseMask;
+        // tvecBaseMask is only 32 bits wide; build the mask at XLEN
+        base = value & ~(XLEN_t)RISCV::tvecModeMask;
         mode = (RISCV::tvecMode)(value & RISCV::tvecModeMask);
     }
 
@@ -1147,26 +1875,116 @@ struct satpReg {
     }
 };
 
+// fflags are kept packed in their CSR layout. With accumulateHostFlags set,
+// FP instructions may leave exception reporting to the host FPU: its sticky
+// flags collect across any run of FP instructions and are folded into fflags
+// only when software reads fflags or fcsr, or when the emulator calls
+// SyncHostFlags() on trap entry. This is only sound if nothing else on the
+// emulating thread uses host floating point in between.
 struct fcsrReg {
+
+    constexpr static __uint8_t nxMask = 0b00001;
+    constexpr static __uint8_t ufMask = 0b00010;
+    constexpr static __uint8_t ofMask = 0b00100;
+    constexpr static __uint8_t dzMask = 0b01000;
+    constexpr static __uint8_t nvMask = 0b10000;
+    constexpr static __uint8_t fflagsMask = 0b11111;
+    constexpr static __uint8_t frmMask = 0b111;
+    constexpr static unsigned int frmShift = 5;
+
     fpRoundingMode frm;
-    struct {
-        bool nx, uf, of, dz, nv;
-    } fflags;
+    __uint8_t fflags;
+    bool accumulateHostFlags = false;
+
     void Reset() {
         frm = fpRoundingMode::RNE;
-        fflags.nx = false;
-        fflags.uf = false;
-        fflags.of = false;
-        fflags.dz = false;
-        fflags.nv = false;
+        fflags = 0;
+        if (accumulateHostFlags)
+            std::feclearexcept(FE_ALL_EXCEPT);
     }
-    // TODO R/W
+
+    static __uint8_t FromHostFlags(int hostFlags) {
+        return ((hostFlags & FE_INEXACT) ? nxMask : 0) |
+               ((hostFlags & FE_UNDERFLOW) ? ufMask : 0) |
+               ((hostFlags & FE_OVERFLOW) ? ofMask : 0) |
+               ((hostFlags & FE_DIVBYZERO) ? dzMask : 0) |
+               ((hostFlags & FE_INVALID) ? nvMask : 0);
+    }
+
+    void SyncHostFlags() {
+        if (!accumulateHostFlags)
+            return;
+        int hostFlags = std::fetestexcept(FE_ALL_EXCEPT);
+        if (hostFlags) {
+            fflags |= FromHostFlags(hostFlags);
+            std::feclearexcept(FE_ALL_EXCEPT);
+        }
+    }
+
+    // For instructions that compute their own exception flags
+    void Raise(__uint8_t flags) {
+        fflags |= flags & fflagsMask;
+    }
+
+    template<typename XLEN_t, CSRAddress view>
+    void Write(XLEN_t value) {
+        static_assert(view == CSRAddress::FFLAGS || view == CSRAddress::FRM || view == CSRAddress::FCSR);
+        // Flags the host collected before this write are overwritten with the rest
+        if constexpr (view != CSRAddress::FRM) {
+            if (accumulateHostFlags)
+                std::feclearexcept(FE_ALL_EXCEPT);
+        }
+        if constexpr (view == CSRAddress::FFLAGS) {
+            fflags = value & fflagsMask;
+        } else if constexpr (view == CSRAddress::FRM) {
+            frm = (fpRoundingMode)(value & frmMask);
+        } else {
+            fflags = value & fflagsMask;
+            frm = (fpRoundingMode)((value >> frmShift) & frmMask);
+        }
+    }
+
+    template<typename XLEN_t, CSRAddress view>
+    XLEN_t Read() {
+        static_assert(view == CSRAddress::FFLAGS || view == CSRAddress::FRM || view == CSRAddress::FCSR);
+        if constexpr (view != CSRAddress::FRM)
+            SyncHostFlags();
+        if constexpr (view == CSRAddress::FFLAGS) {
+            return fflags;
+        } else if constexpr (view == CSRAddress::FRM) {
+            return frm;
+        } else {
+            return ((XLEN_t)frm << frmShift) | fflags;
+        }
+    }
+
+    template<__uint8_t mask>
+    bool Flag() const {
+        return fflags & mask;
+    }
+
+    template<__uint8_t mask>
+    void Flag(bool value) {
+        fflags = value ? (fflags | mask) : (fflags & ~mask);
+    }
+
+    bool NX() const { return Flag<nxMask>(); }
+    bool UF() const { return Flag<ufMask>(); }
+    bool OF() const { return Flag<ofMask>(); }
+    bool DZ() const { return Flag<dzMask>(); }
+    bool NV() const { return Flag<nvMask>(); }
+
+    void NX(bool value) { Flag<nxMask>(value); }
+    void UF(bool value) { Flag<ufMask>(value); }
+    void OF(bool value) { Flag<ofMask>(value); }
+    void DZ(bool value) { Flag<dzMask>(value); }
+    void NV(bool value) { Flag<nvMask>(value); }
 };
 
 struct pmpEntry {
     bool r, w, x, locked;
     pmpAddressMode aMode;
     __uint64_t address;
-} pmpentry[16];
+};
 
 } // namespace RISCV
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "RiscV.hpp"
+#include "PageTableWalker.hpp"
+#include "PerformanceCounters.hpp"
+
+namespace RISCV {
+
+// -- Translation lookaside buffer --
+
+// A set-associative software TLB. Entries are tagged with the ASID they were
+// walked under, or marked global, so translations for several address spaces
+// stay resident across satp writes and nothing needs flushing on a context
+// switch. A superpage entry is indexed by the VPN at its own page size, so a
+// lookup probes one set per page size currently held. A 4K-only workload
+// probes exactly one set. Entries cache the leaf PTE bits, and permissions
+// are rechecked against them on every hit, so changes to privilege, SUM or
+// MXR need no flush either.
+
+struct tlbEntry {
+    __uint64_t tag;         // virtual address >> pageShift
+    __uint64_t base;        // physical address of the start of the page
+    __uint16_t asid;
+    __uint8_t pageShift;
+    __uint8_t pteBits;
+    bool valid;
+};
+
+struct tlbStats {
+    __uint64_t hits;
+    __uint64_t misses;
+    __uint64_t fences;
+    __uint64_t entriesFlushed;
+};
+
+template<typename XLEN_t, unsigned int Sets = 64, unsigned int Ways = 4>
+struct tlb {
+
+    static_assert((Sets & (Sets - 1)) == 0, "TLB set count must be a power of two");
+
+    std::array<std::array<tlbEntry, Ways>, Sets> sets;
+    std::array<__uint8_t, Sets> nextVictim;
+    __uint64_t pageShiftsHeld;  // bit n set if some entry may have pageShift n
+    tlbStats stats;
+    performanceCounters* counters = nullptr;    // for TLBMisses and TLBFences, if set
+
+    void Reset() {
+        for (auto& set : sets)
+            for (tlbEntry& entry : set)
+                entry.valid = false;
+        nextVictim = {};
+        pageShiftsHeld = 0;
+        stats = {};
+    }
+
+    static unsigned int SetIndex(__uint64_t tag, unsigned int pageShift) {
+        return (tag + pageShift) & (Sets - 1);
+    }
+
+    static bool Matches(const tlbEntry& entry, __uint64_t tag, unsigned int pageShift, __uint16_t asid) {
+        return entry.valid && entry.tag == tag && entry.pageShift == pageShift &&
+               ((entry.pteBits & PTEBit::G) || entry.asid == asid);
+    }
+
+    tlbEntry* Lookup(XLEN_t virtualAddress, __uint16_t asid) {
+        for (__uint64_t shifts = pageShiftsHeld; shifts; shifts &= shifts - 1) {
+            unsigned int pageShift = __builtin_ctzll(shifts);
+            __uint64_t tag = (__uint64_t)virtualAddress >> pageShift;
+            for (tlbEntry& entry : sets[SetIndex(tag, pageShift)])
+                if (Matches(entry, tag, pageShift, asid))
+                    return &entry;
+        }
+        return nullptr;
+    }
+
+    void Insert(XLEN_t virtualAddress, __uint16_t asid, const translationResult& result) {
+        __uint64_t tag = (__uint64_t)virtualAddress >> result.pageShift;
+        unsigned int index = SetIndex(tag, result.pageShift);
+        std::array<tlbEntry, Ways>& set = sets[index];
+        tlbEntry* slot = nullptr;
+        for (tlbEntry& entry : set) {
+            if (Matches(entry, tag, result.pageShift, asid) || !entry.valid) {
+                slot = &entry;
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            slot = &set[nextVictim[index]];
+            nextVictim[index] = (nextVictim[index] + 1) % Ways;
+        }
+        __uint64_t offsetMask = ((__uint64_t)1 << result.pageShift) - 1;
+        *slot = { tag, result.physicalAddress & ~offsetMask, asid, (__uint8_t)result.pageShift, result.pteBits, true };
+        pageShiftsHeld |= (__uint64_t)1 << result.pageShift;
+    }
+
+    // SFENCE.VMA. hasAddress and hasAsid say whether rs1 and rs2 were other
+    // than x0. A fence naming an ASID leaves global entries alone.
+    void Fence(bool hasAddress, XLEN_t virtualAddress, bool hasAsid, __uint16_t asid) {
+        stats.fences++;
+        if (counters != nullptr)
+            counters->Count<PerformanceEvent::TLBFences>();
+        if (!hasAddress) {
+            for (auto& set : sets)
+                for (tlbEntry& entry : set)
+                    FenceEntry(entry, hasAsid, asid);
+            if (!hasAsid)
+                pageShiftsHeld = 0;
+            return;
+        }
+        for (__uint64_t shifts = pageShiftsHeld; shifts; shifts &= shifts - 1) {
+            unsigned int pageShift = __builtin_ctzll(shifts);
+            __uint64_t tag = (__uint64_t)virtualAddress >> pageShift;
+            for (tlbEntry& entry : sets[SetIndex(tag, pageShift)])
+                if (entry.tag == tag && entry.pageShift == pageShift)
+                    FenceEntry(entry, hasAsid, asid);
+        }
+    }
+
+    // Translates through the TLB, walking and filling on a miss. A hit on a
+    // page whose D bit is clear is treated as a miss for stores, so the walker
+    // gets to set D or fault.
+    template<bool updateAccessedDirty = true, typename Memory>
+    translationResult Translate(Memory& memory, const satpReg<XLEN_t>& satp, const mstatusReg& mstatus,
+                                PrivilegeMode privilege, XLEN_t virtualAddress, AccessType type) {
+
+        PrivilegeMode effective = effectiveAccessPrivilege(privilege, mstatus, type);
+        if (effective == PrivilegeMode::Machine || satp.pagingMode == PagingMode::Bare)
+            return { (__uint64_t)virtualAddress, TrapCause::NONE, PageShift, 0xff };
+
+        __uint16_t asid = satp.asid;
+        tlbEntry* entry = Lookup(virtualAddress, asid);
+        if (entry != nullptr && (type != Store || (entry->pteBits & PTEBit::D))) {
+            stats.hits++;
+            if (!ptePermits(entry->pteBits, type, effective, mstatus.SUM(), mstatus.MXR()))
+                return { 0, pageFaultCause(type), PageShift, 0 };
+            __uint64_t offsetMask = ((__uint64_t)1 << entry->pageShift) - 1;
+            return { entry->base | ((__uint64_t)virtualAddress & offsetMask), TrapCause::NONE, entry->pageShift, entry->pteBits };
+        }
+
+        stats.misses++;
+        if (counters != nullptr)
+            counters->Count<PerformanceEvent::TLBMisses>();
+        translationResult result = translate<XLEN_t, updateAccessedDirty>(memory, satp, mstatus, privilege, virtualAddress, type);
+        if (result.cause == TrapCause::NONE)
+            Insert(virtualAddress, asid, result);
+        return result;
+    }
+
+private:
+
+    void FenceEntry(tlbEntry& entry, bool hasAsid, __uint16_t asid) {
+        if (!entry.valid)
+            return;
+        if (hasAsid && ((entry.pteBits & PTEBit::G) || entry.asid != asid))
+            return;
+        entry.valid = false;
+        stats.entriesFlushed++;
+    }
+
+};
+
+} // namespace RISCV
@@ -0,0 +1,518 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace RISCV {
+
+// -- Binary instruction traces --
+
+// A trace file is a header, a sequence of independently decodable blocks, a
+// block index and a footer:
+//
+//     header   "RVTRACE2", u32 XLEN in bytes, u32 block payload capacity
+//     block    u32 payload bytes, u32 record count, u64 first instruction number, payload
+//     index    per block: u64 file offset, u64 first instruction number
+//     footer   u64 index offset, u64 block count, u64 instruction count, "RVTRIDX1"
+//
+// Integers are little-endian. Varints put their length first: one of n <= 8
+// bytes has n - 1 zero bits and a one at the bottom of its first byte and
+// 7n bits of value above them. A zero first byte means the value follows in
+// eight bytes. Unlike LEB128, varints encode and decode without a loop. A
+// record starts with a tag byte whose low two bits give its kind:
+//
+//     Instruction  bit 2: pc follows on from the previous instruction
+//                  bit 3: 16-bit instruction word
+//                  then, unless bit 2 is set, the zigzag varint pc delta
+//                  from where the previous instruction would have fallen
+//                  through to, then the raw 2- or 4-byte instruction word
+//     Writeback    bits 3-7: register number, then the varint value
+//     Trap         bit 2: interrupt, bits 3-4: privilege before, bits 5-6:
+//                  privilege after, then the varint cause
+//
+// The fall-through pc comes from instructionLength(), so straight-line code
+// costs one tag byte plus the instruction word. Longer instructions keep
+// only their low 32 bits. Each block starts as if the previous pc were 0,
+// which lets a reader seek to any block through the index. Readers load
+// eight bytes at a time; the index and footer keep that inside the file.
+
+constexpr char traceFileMagic[8] = { 'R', 'V', 'T', 'R', 'A', 'C', 'E', '2' };
+constexpr char traceIndexMagic[8] = { 'R', 'V', 'T', 'R', 'I', 'D', 'X', '1' };
+constexpr unsigned int TraceBlockCapacity = 1 << 20;
+// Bytes a record may write from its start, including scratch past its end
+constexpr unsigned int TraceMaxRecordBytes = 16;
+
+enum class TraceRecordKind : __uint8_t {
+    Instruction = 0,
+    Writeback = 1,
+    Trap = 2
+};
+
+constexpr __uint8_t traceKindMask = 0b11;
+constexpr __uint8_t traceSequentialMask = 0b100;
+constexpr __uint8_t traceCompressedMask = 0b1000;
+constexpr __uint8_t traceInterruptMask = 0b100;
+constexpr unsigned int traceRegisterShift = 3;
+constexpr unsigned int traceFromShift = 3;
+constexpr unsigned int traceToShift = 5;
+
+struct traceBlockHeader {
+    __uint32_t payloadBytes;
+    __uint32_t recordCount;
+    __uint64_t firstInstruction;
+};
+
+struct traceIndexEntry {
+    __uint64_t offset;
+    __uint64_t firstInstruction;
+};
+
+struct traceFooter {
+    __uint64_t indexOffset;
+    __uint64_t blockCount;
+    __uint64_t instructionCount;
+    char magic[8];
+};
+
+template<typename XLEN_t>
+struct traceRecord {
+    TraceRecordKind kind;
+    XLEN_t pc;                  // Instruction
+    __uint32_t word;            // Instruction
+    unsigned int reg;           // Writeback
+    XLEN_t value;               // Writeback
+    bool interrupt;             // Trap
+    TrapCause cause;            // Trap
+    PrivilegeMode from, to;     // Trap
+};
+
+namespace detail {
+
+// How to lay out a tag byte and the varint after it, by the index of the
+// value's highest set bit. The value is multiplied rather than shifted into
+// place: one 128-bit multiply gives both eight-byte words, where variable
+// shifts are several micro-ops each on common x86 cores.
+struct varintShape {
+    __uint64_t multiplier;
+    __uint64_t marker;          // already past the tag byte
+    __uint64_t length;          // of the varint alone
+};
+
+constexpr std::array<varintShape, 64> makeVarintShapes() {
+    std::array<varintShape, 64> shapes = {};
+    for (unsigned int top = 0; top < 64; top++) {
+        unsigned int length = (top + 7) / 7;
+        if (length > 8)
+            shapes[top] = { 1ull << 16, 0, 9 };
+        else
+            shapes[top] = { 1ull << (8 + length), 1ull << (8 + length - 1), length };
+    }
+    return shapes;
+}
+
+constexpr std::array<varintShape, 64> varintShapes = makeVarintShapes();
+
+// Writes a tag byte and a varint as two eight-byte stores, so out needs
+// sixteen bytes of room, and returns the length of the varint. There are no
+// branches, since the lengths of traced values are close to random.
+inline __uint64_t putTaggedVarint(__uint8_t* out, __uint8_t tag, __uint64_t value) {
+    const varintShape& shape = varintShapes[63 - __builtin_clzll(value | 1)];
+    __uint128_t product = (__uint128_t)value * shape.multiplier;
+    __uint64_t first = (__uint64_t)product | shape.marker | tag;
+    __uint64_t second = (__uint64_t)(product >> 64);
+    std::memcpy(out, &first, sizeof(first));
+    std::memcpy(out + sizeof(first), &second, sizeof(second));
+    return shape.length;
+}
+
+// Loads eight bytes at in whatever the length
+inline const __uint8_t* getVarint(const __uint8_t* in, __uint64_t& value) {
+    __uint64_t low;
+    std::memcpy(&low, in, sizeof(low));
+    unsigned int length = __builtin_ctz((unsigned int)(low & 0xff) | 0x100) + 1;
+    if (__builtin_expect(length > 8, 0)) {
+        std::memcpy(&value, in + 1, sizeof(value));
+        return in + 9;
+    }
+    value = (low >> length) & (~0ull >> (64 - 7 * length));
+    return in + length;
+}
+
+constexpr __uint64_t zigzag(__int64_t value) {
+    return ((__uint64_t)value << 1) ^ (__uint64_t)(value >> 63);
+}
+
+constexpr __int64_t unzigzag(__uint64_t value) {
+    return (__int64_t)(value >> 1) ^ -(__int64_t)(value & 1);
+}
+
+inline bool writeAll(int fd, const void* data, std::size_t size) {
+    const char* bytes = (const char*)data;
+    while (size > 0) {
+        ssize_t written = ::write(fd, bytes, size);
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+} // namespace detail
+
+// Encodes records into one half of a double buffer while a background thread
+// writes the other half out, so the encoding thread only blocks if the disk
+// falls a whole block behind. Not thread safe; one writer per hart.
+template<typename XLEN_t>
+struct traceWriter {
+
+    struct buffer {
+        std::vector<__uint8_t> bytes;
+        std::size_t size;
+        bool pending;
+    };
+
+    int fd = -1;
+    bool failed = false;
+    buffer buffers[2];
+    unsigned int current = 0;
+    __uint8_t* out = nullptr;           // encode position in buffers[current]
+    __uint8_t* blockStart = nullptr;
+    __uint8_t* blockLimit = nullptr;    // last position a whole record still fits at
+    __uint64_t blockCounts = 0;         // instructions in the block << 32 | records in the block
+    __uint64_t blockFirstInstruction = 0;
+    __uint64_t instructions = 0;
+    __uint64_t fileOffset = 0;
+    XLEN_t nextPc = 0;
+    std::vector<traceIndexEntry> index;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool closing = false;
+
+    ~traceWriter() {
+        Close();
+    }
+
+    bool Open(const char* path) {
+        fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        for (buffer& b : buffers) {
+            b.bytes.resize(sizeof(traceBlockHeader) + TraceBlockCapacity);
+            b.size = 0;
+            b.pending = false;
+        }
+        __uint32_t header[2] = { sizeof(XLEN_t), TraceBlockCapacity };
+        failed = !detail::writeAll(fd, traceFileMagic, sizeof(traceFileMagic)) ||
+                 !detail::writeAll(fd, header, sizeof(header));
+        fileOffset = sizeof(traceFileMagic) + sizeof(header);
+        closing = false;
+        current = 0;
+        StartBlock();
+        thread = std::thread([this] { WriterLoop(); });
+        return !failed;
+    }
+
+    // The record functions work on a local copy of out and store it back
+    // at the end: the buffer is bytes, so the compiler must assume every
+    // store into it may change the members. Stores are what limits them, so
+    // the tag goes out with the start of the varint. The instruction encoding
+    // has no branches besides Reserve(), since whether an instruction is
+    // compressed or follows on from the last one is hard to predict.
+    void Instruction(XLEN_t pc, __uint32_t word) {
+        __uint8_t* position = Reserve();
+        XLEN_t fallThrough = nextPc;
+        __uint64_t counts = blockCounts;
+        bool compressed = isCompressed(word);
+        __int64_t delta = (__int64_t)(std::make_signed_t<XLEN_t>)(pc - fallThrough);
+        bool sequential = delta == 0;
+        __uint8_t tag = (__uint8_t)TraceRecordKind::Instruction | (compressed ? traceCompressedMask : 0) |
+                        (sequential ? traceSequentialMask : 0);
+        __uint64_t deltaBytes = detail::putTaggedVarint(position, tag, detail::zigzag(delta));
+        // A mask rather than a select, which the compiler turns back into a branch
+        position += 1 + (deltaBytes & -(__uint64_t)!sequential);
+        std::memcpy(position, &word, 4);
+        unsigned int length = 4 - 2 * compressed;
+        out = position + length;
+        // Only opcodes with bits [4:0] all set can be longer than 32 bits
+        if (__builtin_expect((word & 0x1f) == 0x1f, 0))
+            length = instructionLength(word);
+        nextPc = pc + length;
+        blockCounts = counts + ((__uint64_t)1 << 32) + 1;
+    }
+
+    void Writeback(unsigned int reg, XLEN_t value) {
+        __uint8_t* position = Reserve();
+        __uint64_t counts = blockCounts;
+        __uint8_t tag = (__uint8_t)TraceRecordKind::Writeback | (reg << traceRegisterShift);
+        out = position + 1 + detail::putTaggedVarint(position, tag, (__uint64_t)value);
+        blockCounts = counts + 1;
+    }
+
+    void Trap(bool interrupt, TrapCause cause, PrivilegeMode from, PrivilegeMode to) {
+        __uint8_t* position = Reserve();
+        __uint64_t counts = blockCounts;
+        __uint8_t tag = (__uint8_t)TraceRecordKind::Trap | (interrupt ? traceInterruptMask : 0) |
+                        (from << traceFromShift) | (to << traceToShift);
+        out = position + 1 + detail::putTaggedVarint(position, tag, (__uint64_t)cause);
+        blockCounts = counts + 1;
+    }
+
+    // Flushes everything, writes the index and footer and closes the file.
+    // Returns false if any write failed along the way.
+    bool Close() {
+        if (fd < 0)
+            return !failed;
+        SealBlock();
+        Submit();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            closing = true;
+            changed.notify_all();
+        }
+        thread.join();
+        traceFooter footer = { fileOffset, index.size(), instructions, {} };
+        std::memcpy(footer.magic, traceIndexMagic, sizeof(footer.magic));
+        failed = failed ||
+                 !detail::writeAll(fd, index.data(), index.size() * sizeof(traceIndexEntry)) ||
+                 !detail::writeAll(fd, &footer, sizeof(footer));
+        failed = (::close(fd) != 0) || failed;
+        fd = -1;
+        return !failed;
+    }
+
+private:
+
+    void StartBlock() {
+        buffer& b = buffers[current];
+        blockStart = b.bytes.data() + b.size;
+        out = blockStart + sizeof(traceBlockHeader);
+        blockLimit = out + TraceBlockCapacity - TraceMaxRecordBytes;
+        blockCounts = 0;
+        blockFirstInstruction = instructions;
+        nextPc = 0;
+    }
+
+    void SealBlock() {
+        if (blockCounts == 0)
+            return;
+        instructions = blockFirstInstruction + (blockCounts >> 32);
+        __uint32_t payload = (__uint32_t)(out - blockStart - sizeof(traceBlockHeader));
+        traceBlockHeader header = { payload, (__uint32_t)blockCounts, blockFirstInstruction };
+        std::memcpy(blockStart, &header, sizeof(header));
+        index.push_back({ fileOffset, blockFirstInstruction });
+        fileOffset += sizeof(header) + payload;
+        buffers[current].size = out - buffers[current].bytes.data();
+    }
+
+    // Where the next record goes, starting a new block if it might not fit
+    __uint8_t* Reserve() {
+        if (__builtin_expect(out <= blockLimit, 1))
+            return out;
+        SealBlock();
+        Submit();
+        StartBlock();
+        return out;
+    }
+
+    // Hands the current buffer to the writer thread and waits for the other
+    void Submit() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (buffers[current].size > 0) {
+            buffers[current].pending = true;
+            changed.notify_all();
+        }
+        current ^= 1;
+        changed.wait(lock, [this] { return !buffers[current].pending; });
+        buffers[current].size = 0;
+    }
+
+    void WriterLoop() {
+        unsigned int next = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [&] { return buffers[next].pending || closing; });
+            if (!buffers[next].pending) {
+                if (buffers[next ^ 1].pending) {
+                    next ^= 1;
+                    continue;
+                }
+                return;
+            }
+            buffer& b = buffers[next];
+            lock.unlock();
+            bool ok = detail::writeAll(fd, b.bytes.data(), b.size);
+            lock.lock();
+            failed = failed || !ok;
+            b.pending = false;
+            changed.notify_all();
+            next ^= 1;
+        }
+    }
+};
+
+// Reads a trace through a read-only memory mapping. Seek() finds the block
+// holding an instruction through the index and decodes forward from there.
+template<typename XLEN_t>
+struct traceReader {
+
+    const __uint8_t* base = nullptr;
+    std::size_t size = 0;
+    const __uint8_t* index = nullptr;       // entries, not necessarily aligned
+    traceFooter footer = {};
+
+    const __uint8_t* in = nullptr;          // next record
+    const __uint8_t* blockEnd = nullptr;
+    __uint64_t block = 0;                   // index of the block after the current one
+    __uint64_t nextInstruction = 0;
+    XLEN_t nextPc = 0;
+
+    ~traceReader() {
+        Close();
+    }
+
+    bool Open(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || (std::size_t)info.st_size < sizeof(traceFileMagic) + 8 + sizeof(traceFooter)) {
+            ::close(fd);
+            return false;
+        }
+        size = info.st_size;
+        void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            return false;
+        base = (const __uint8_t*)mapping;
+
+        __uint32_t header[2];
+        std::memcpy(header, base + sizeof(traceFileMagic), sizeof(header));
+        std::memcpy(&footer, base + size - sizeof(traceFooter), sizeof(traceFooter));
+        bool valid = std::memcmp(base, traceFileMagic, sizeof(traceFileMagic)) == 0 &&
+                     std::memcmp(footer.magic, traceIndexMagic, sizeof(traceIndexMagic)) == 0 &&
+                     header[0] == sizeof(XLEN_t) &&
+                     footer.indexOffset + footer.blockCount * sizeof(traceIndexEntry) + sizeof(traceFooter) == size;
+        if (!valid) {
+            Close();
+            return false;
+        }
+        index = base + footer.indexOffset;
+        Rewind();
+        return true;
+    }
+
+    void Close() {
+        if (base != nullptr)
+            ::munmap((void*)base, size);
+        base = nullptr;
+    }
+
+    __uint64_t InstructionCount() const {
+        return footer.instructionCount;
+    }
+
+    void Rewind() {
+        block = 0;
+        in = blockEnd = nullptr;
+        nextInstruction = 0;
+    }
+
+    // Positions the reader so the next instruction record returned is
+    // instruction number instruction (counting from zero). Writeback and
+    // trap records before it in the same block are skipped.
+    bool Seek(__uint64_t instruction) {
+        if (instruction >= footer.instructionCount)
+            return false;
+        __uint64_t lo = 0;
+        __uint64_t hi = footer.blockCount;
+        while (hi - lo > 1) {
+            __uint64_t mid = (lo + hi) / 2;
+            if (IndexEntry(mid).firstInstruction <= instruction)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        block = lo;
+        EnterBlock();
+        traceRecord<XLEN_t> record;
+        while (in >= blockEnd || (TraceRecordKind)(*in & traceKindMask) != TraceRecordKind::Instruction ||
+               nextInstruction != instruction)
+            Next(record);
+        return true;
+    }
+
+    // Decodes the next record; false at the end of the trace
+    bool Next(traceRecord<XLEN_t>& record) {
+        if (__builtin_expect(in >= blockEnd, 0)) {
+            if (block >= footer.blockCount)
+                return false;
+            EnterBlock();
+        }
+        __uint8_t tag = *in++;
+        record.kind = (TraceRecordKind)(tag & traceKindMask);
+        __uint64_t value;
+        switch (record.kind) {
+        case TraceRecordKind::Instruction:
+            if (!(tag & traceSequentialMask)) {
+                in = detail::getVarint(in, value);
+                nextPc += (XLEN_t)detail::unzigzag(value);
+            }
+            record.pc = nextPc;
+            record.word = 0;
+            std::memcpy(&record.word, in, (tag & traceCompressedMask) ? 2 : 4);
+            in += (tag & traceCompressedMask) ? 2 : 4;
+            nextPc += instructionLength(record.word);
+            nextInstruction++;
+            break;
+        case TraceRecordKind::Writeback:
+            record.reg = tag >> traceRegisterShift;
+            in = detail::getVarint(in, value);
+            record.value = (XLEN_t)value;
+            break;
+        default:
+            record.interrupt = tag & traceInterruptMask;
+            record.from = (PrivilegeMode)((tag >> traceFromShift) & 0b11);
+            record.to = (PrivilegeMode)((tag >> traceToShift) & 0b11);
+            in = detail::getVarint(in, value);
+            record.cause = (TrapCause)value;
+            break;
+        }
+        return true;
+    }
+
+private:
+
+    // Block payloads have any length, so the index may sit at any offset
+    traceIndexEntry IndexEntry(__uint64_t i) const {
+        traceIndexEntry entry;
+        std::memcpy(&entry, index + i * sizeof(traceIndexEntry), sizeof(entry));
+        return entry;
+    }
+
+    void EnterBlock() {
+        traceBlockHeader header;
+        const __uint8_t* start = base + IndexEntry(block).offset;
+        std::memcpy(&header, start, sizeof(header));
+        in = start + sizeof(header);
+        blockEnd = in + header.payloadBytes;
+        nextInstruction = header.firstInstruction;
+        nextPc = 0;
+        block++;
+    }
+};
+
+} // namespace RISCV
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "RiscV.hpp"
+
+namespace RISCV {
+
+// -- Trap entry and return --
+
+// Taking a trap touches xtvec, xcause, xepc, xtval and a handful of mstatus
+// fields, all for the one privilege the trap is destined for. The routines
+// here are templated on XLEN and that destination, so each specialization is
+// a straight-line sequence of stores with no XLEN or privilege branches left.
+// TakeTrap() resolves the destination once, through a trapDelegationResolver,
+// and jumps into the right specialization.
+
+template<typename XLEN_t>
+struct trapContext {
+    tvecReg<XLEN_t> tvec;
+    causeReg<XLEN_t> cause;
+    XLEN_t epc;
+    XLEN_t tval;
+
+    void Reset() {
+        tvec.Reset();
+        cause.Reset();
+        epc = 0;
+        tval = 0;
+    }
+};
+
+// One trapContext per privilege, indexed by PrivilegeMode. Index 2 is the
+// reserved hypervisor encoding and is never used.
+template<typename XLEN_t>
+struct trapState {
+    std::array<trapContext<XLEN_t>, 4> contexts;
+
+    void Reset() {
+        for (trapContext<XLEN_t>& context : contexts)
+            context.Reset();
+    }
+
+    template<PrivilegeMode privilege>
+    trapContext<XLEN_t>& Context() {
+        static_assert(privilege != (PrivilegeMode)2, "No trap context for the reserved privilege");
+        return contexts[privilege];
+    }
+};
+
+// Vectored mode sends interrupts to base + 4 * cause; exceptions, and every
+// trap in direct mode, go to base.
+template<typename XLEN_t>
+inline XLEN_t trapTarget(const tvecReg<XLEN_t>& tvec, bool interrupt, TrapCause cause) {
+    XLEN_t offset = (tvec.mode == tvecMode::Vectored && interrupt) ? (XLEN_t)cause << 2 : 0;
+    return tvec.base + offset;
+}
+
+// Performs the whole state transition for a trap taken into destination and
+// returns the new pc. privilege is updated in place.
+template<typename XLEN_t, PrivilegeMode destination>
+inline XLEN_t EnterTrap(trapState<XLEN_t>& state, mstatusReg& mstatus, PrivilegeMode& privilege,
+                        bool interrupt, TrapCause cause, XLEN_t pc, XLEN_t tval) {
+
+    trapContext<XLEN_t>& context = state.template Context<destination>();
+    context.cause.interrupt = interrupt;
+    context.cause.exceptionCode = cause;
+    context.epc = pc;
+    context.tval = tval;
+
+    if constexpr (destination == PrivilegeMode::Machine) {
+        mstatus.MPIE(mstatus.MIE());
+        mstatus.MIE(false);
+        mstatus.MPP(privilege);
+    } else if constexpr (destination == PrivilegeMode::Supervisor) {
+        mstatus.SPIE(mstatus.SIE());
+        mstatus.SIE(false);
+        // SPP is one bit wide, and a trap into S never comes from M
+        mstatus.SPP(privilege);
+    } else {
+        mstatus.UPIE(mstatus.UIE());
+        mstatus.UIE(false);
+    }
+
+    privilege = destination;
+    return trapTarget(context.tvec, interrupt, cause);
+}
+
+// Resolves where the trap goes and enters it there. Returns the new pc.
+// Harts using fcsrReg::accumulateHostFlags call SyncHostFlags() first.
+template<typename XLEN_t>
+inline XLEN_t TakeTrap(trapState<XLEN_t>& state, const trapDelegationResolver<XLEN_t>& resolver,
+                       mstatusReg& mstatus, PrivilegeMode& privilege,
+                       bool interrupt, TrapCause cause, XLEN_t pc, XLEN_t tval) {
+
+    PrivilegeMode destination = resolver.Resolve(interrupt, cause);
+
+    // Traps never move to a less privileged mode
+    if (destination < privilege)
+        destination = privilege;
+
+    switch (destination) {
+    case PrivilegeMode::User:
+        return EnterTrap<XLEN_t, PrivilegeMode::User>(state, mstatus, privilege, interrupt, cause, pc, tval);
+    case PrivilegeMode::Supervisor:
+        return EnterTrap<XLEN_t, PrivilegeMode::Supervisor>(state, mstatus, privilege, interrupt, cause, pc, tval);
+    default:
+        return EnterTrap<XLEN_t, PrivilegeMode::Machine>(state, mstatus, privilege, interrupt, cause, pc, tval);
+    }
+}
+
+// xRET. Each returns the new pc and updates privilege in place. The caller
+// checks that the return is legal from the current privilege (and TSR for
+// SRET) before calling. leastPrivilege is the lowest mode the hart
+// implements, which xPP is left holding afterwards.
+
+template<typename XLEN_t>
+inline XLEN_t MRet(const trapState<XLEN_t>& state, mstatusReg& mstatus, PrivilegeMode& privilege,
+                   PrivilegeMode leastPrivilege = PrivilegeMode::User) {
+    privilege = mstatus.MPP();
+    mstatus.MIE(mstatus.MPIE());
+    mstatus.MPIE(true);
+    mstatus.MPP(leastPrivilege);
+    if (privilege != PrivilegeMode::Machine)
+        mstatus.MPRV(false);
+    return state.contexts[PrivilegeMode::Machine].epc;
+}
+
+template<typename XLEN_t>
+inline XLEN_t SRet(const trapState<XLEN_t>& state, mstatusReg& mstatus, PrivilegeMode& privilege) {
+    privilege = mstatus.SPP();
+    mstatus.SIE(mstatus.SPIE());
+    mstatus.SPIE(true);
+    mstatus.SPP(PrivilegeMode::User);
+    mstatus.MPRV(false);
+    return state.contexts[PrivilegeMode::Supervisor].epc;
+}
+
+template<typename XLEN_t>
+inline XLEN_t URet(const trapState<XLEN_t>& state, mstatusReg& mstatus, PrivilegeMode& privilege) {
+    privilege = PrivilegeMode::User;
+    mstatus.UIE(mstatus.UPIE());
+    mstatus.UPIE(true);
+    return state.contexts[PrivilegeMode::User].epc;
+}
+
+} // namespace RISCV
@@ -0,0 +1,143 @@
+#include "Atomics.hpp"
+
+#include "Check.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace RISCV;
+
+constexpr __uint64_t DataBase = 0x80000000;
+
+using table_t = reservationTable<4>;
+
+std::unique_ptr<table_t> makeTable() {
+    auto table = std::make_unique<table_t>();
+    table->Reset();
+    return table;
+}
+
+// An LR/SC pair with nothing in between stores, and the reservation is gone
+// afterwards
+void TestStoreConditional() {
+    auto table = makeTable();
+    __uint32_t word = 5;
+    CHECK_EQ(table->LoadReserved<__uint32_t>(0, DataBase, &word, false, false), 5);
+    CHECK(table->StoreConditional<__uint32_t>(0, DataBase, &word, 6, false, false));
+    CHECK_EQ(word, 6);
+    CHECK(!table->StoreConditional<__uint32_t>(0, DataBase, &word, 7, false, false));
+    CHECK_EQ(word, 6);
+}
+
+// Stores to the line, by this hart or another, and AMOs break the reservation
+void TestInterveningStores() {
+    auto table = makeTable();
+    __uint64_t words[8] = {};
+
+    table->LoadReserved<__uint64_t>(0, DataBase, &words[0], false, false);
+    table->OnStore(DataBase + 8, 8);                // same line, other word
+    CHECK(!table->StoreConditional<__uint64_t>(0, DataBase, &words[0], 1, false, false));
+
+    table->LoadReserved<__uint64_t>(0, DataBase, &words[0], false, false);
+    table->AMO<MinorOpcode::AMOADD, __uint64_t>(DataBase, &words[0], 0, false, false);
+    CHECK(!table->StoreConditional<__uint64_t>(0, DataBase, &words[0], 1, false, false));
+
+    // A store to another line leaves it alone
+    table->LoadReserved<__uint64_t>(0, DataBase, &words[0], false, false);
+    table->OnStore(DataBase + (1 << ReservationLineShift), 8);
+    CHECK(table->StoreConditional<__uint64_t>(0, DataBase, &words[0], 1, false, false));
+    CHECK_EQ(words[0], 1);
+
+    // Another hart's SC claims the line first
+    table->LoadReserved<__uint64_t>(0, DataBase, &words[0], false, false);
+    table->LoadReserved<__uint64_t>(1, DataBase, &words[0], false, false);
+    CHECK(table->StoreConditional<__uint64_t>(1, DataBase, &words[0], 2, false, false));
+    CHECK(!table->StoreConditional<__uint64_t>(0, DataBase, &words[0], 3, false, false));
+    CHECK_EQ(words[0], 2);
+
+    // Clear() drops the reservation as trap entry would
+    table->LoadReserved<__uint64_t>(0, DataBase, &words[0], false, false);
+    table->Clear(0);
+    CHECK(!table->StoreConditional<__uint64_t>(0, DataBase, &words[0], 4, false, false));
+    CHECK_EQ(words[0], 2);
+}
+
+// SC has to match the address and width of the LR
+void TestMismatches() {
+    auto table = makeTable();
+    __uint64_t words[2] = {};
+
+    table->LoadReserved<__uint64_t>(0, DataBase, &words[0], false, false);
+    CHECK(!table->StoreConditional<__uint64_t>(0, DataBase + 8, &words[1], 1, false, false));
+    CHECK_EQ(words[1], 0);
+
+    table->LoadReserved<__uint64_t>(0, DataBase, &words[0], false, false);
+    CHECK(!table->StoreConditional<__uint32_t>(0, DataBase, (__uint32_t*)&words[0], 1, false, false));
+    CHECK_EQ(words[0], 0);
+
+    // The failed SCs used up the reservation
+    CHECK(!table->StoreConditional<__uint64_t>(0, DataBase, &words[0], 1, false, false));
+}
+
+// MIN and MAX compare signed, MINU and MAXU unsigned, and all return the old value
+template<typename T>
+void TestMinMax() {
+    const T negative = (T)-2;
+    T value = 3;
+    CHECK_EQ(atomicMemoryOperation<MinorOpcode::AMOMIN>(&value, negative, __ATOMIC_SEQ_CST), 3);
+    CHECK_EQ(value, negative);
+    value = 3;
+    CHECK_EQ(atomicMemoryOperation<MinorOpcode::AMOMAX>(&value, negative, __ATOMIC_SEQ_CST), 3);
+    CHECK_EQ(value, 3);
+    CHECK_EQ(atomicMemoryOperation<MinorOpcode::AMOMINU>(&value, negative, __ATOMIC_SEQ_CST), 3);
+    CHECK_EQ(value, 3);
+    CHECK_EQ(atomicMemoryOperation<MinorOpcode::AMOMAXU>(&value, negative, __ATOMIC_SEQ_CST), 3);
+    CHECK_EQ(value, negative);
+    CHECK_EQ(atomicMemoryOperation<MinorOpcode::AMOMIN>(&value, (T)7, __ATOMIC_RELEASE), negative);
+    CHECK_EQ(value, negative);
+    CHECK_EQ(atomicMemoryOperation<MinorOpcode::AMOMINU>(&value, (T)7, __ATOMIC_ACQUIRE), negative);
+    CHECK_EQ(value, 7);
+
+    // The run-time form agrees, and rejects LR and SC
+    T old;
+    CHECK(atomicMemoryOperation<T>(MinorOpcode::AMOMAXU, &value, (T)9, __ATOMIC_RELAXED, old));
+    CHECK_EQ(old, 7);
+    CHECK_EQ(value, 9);
+    CHECK(!atomicMemoryOperation<T>(MinorOpcode::LR, &value, (T)1, __ATOMIC_RELAXED, old));
+    CHECK(!atomicMemoryOperation<T>(MinorOpcode::SC, &value, (T)1, __ATOMIC_RELAXED, old));
+    CHECK_EQ(value, 9);
+}
+
+// Harts on their own threads each add through LR/SC retry loops; none of
+// the increments may be lost
+void TestContendedIncrements() {
+    constexpr unsigned int harts = 4;
+    constexpr unsigned int increments = 20000;
+    auto table = makeTable();
+    __uint32_t counter = 0;
+    std::vector<std::thread> threads;
+    for (unsigned int hart = 0; hart < harts; hart++) {
+        threads.emplace_back([&table, &counter, hart]() {
+            for (unsigned int i = 0; i < increments; i++) {
+                __uint32_t value;
+                do {
+                    value = table->LoadReserved<__uint32_t>(hart, DataBase, &counter, true, false);
+                } while (!table->StoreConditional<__uint32_t>(hart, DataBase, &counter, value + 1, false, true));
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    CHECK_EQ(counter, harts * increments);
+}
+
+int main() {
+    TestStoreConditional();
+    TestInterveningStores();
+    TestMismatches();
+    TestMinMax<__uint32_t>();
+    TestMinMax<__uint64_t>();
+    TestContendedIncrements();
+    return CHECK_RESULT();
+}
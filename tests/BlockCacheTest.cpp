@@ -0,0 +1,183 @@
+#include "BlockCache.hpp"
+
+#include "Check.hpp"
+#include "GuestProgram.hpp"
+
+#include <memory>
+
+using namespace RISCV;
+
+// Code everywhere: three ADDIs then a JAL in every 16 bytes, so each block
+// is four instructions long and any page can hold code
+struct patternMemory {
+    bool Read(__uint64_t physicalAddress, __uint16_t& value) {
+        __uint32_t word = (physicalAddress & 0xc) == 0xc ? encode::jal(0, 0) : encode::addi(1, 1, 1);
+        value = (physicalAddress & 2) ? word >> 16 : word & 0xffff;
+        return true;
+    }
+};
+
+// Nothing but the low half of a 32-bit ADDI
+struct halfwordMemory {
+    bool Read(__uint64_t, __uint16_t& value) {
+        value = encode::addi(1, 1, 1) & 0xffff;
+        return true;
+    }
+};
+
+using cache_t = blockCache<__uint64_t>;
+
+constexpr __uint8_t Mode = blockMode(PrivilegeMode::Machine, XlenMode::XL64);
+constexpr __uint64_t CodePage = 0x80000000;
+
+struct fixture {
+    patternMemory memory;
+    std::unique_ptr<cache_t> cache = std::make_unique<cache_t>();
+
+    fixture() {
+        cache->Reset();
+    }
+
+    const cache_t::block* Build(__uint64_t pc, bool virtuallyTagged = false) {
+        return cache->Build(memory, pc, pc, Mode, virtuallyTagged);
+    }
+
+    bool Cached(__uint64_t pc) {
+        return cache->Lookup(pc, Mode) != nullptr;
+    }
+};
+
+// Blocks end after a control transfer or at the end of their page, and a
+// block whose first instruction straddles the page is not built
+void TestBuild() {
+    fixture f;
+    const cache_t::block* b = f.Build(CodePage);
+    CHECK(b != nullptr);
+    CHECK_EQ(b->count, 4);
+    CHECK_EQ(b->bytes, 16);
+    CHECK_EQ(b->page, CodePage >> PageShift);
+    CHECK_EQ(b->ops[0].id, InstructionID::ADDI);
+    CHECK_EQ(b->ops[3].id, InstructionID::JAL);
+
+    b = f.Build(CodePage + PageSize - 8);
+    CHECK_EQ(b->count, 2);
+    b = f.Build(CodePage + PageSize - 4);
+    CHECK_EQ(b->count, 1);
+    CHECK_EQ(b->bytes, 4);
+    CHECK_EQ(b->ops[0].id, InstructionID::JAL);
+    halfwordMemory straddling;
+    CHECK(f.cache->Build(straddling, CodePage + PageSize - 2, CodePage + PageSize - 2, Mode, false) == nullptr);
+    b = f.cache->Build(straddling, CodePage + PageSize - 6, CodePage + PageSize - 6, Mode, false);
+    CHECK_EQ(b->count, 1);
+
+    CHECK(f.Cached(CodePage));
+    CHECK(f.cache->Lookup(CodePage, blockMode(PrivilegeMode::User, XlenMode::XL64)) == nullptr);
+    CHECK(!f.Cached(CodePage + 4));
+    CHECK_EQ(f.cache->stats.hits, 1);
+    CHECK_EQ(f.cache->stats.misses, 2);
+}
+
+// FENCE.I drops everything, and the lists start over
+void TestFenceI() {
+    fixture f;
+    f.Build(CodePage);
+    f.Build(CodePage + 0x100);
+    f.cache->OnFenceI();
+    CHECK(!f.Cached(CodePage));
+    CHECK(!f.Cached(CodePage + 0x100));
+    CHECK_EQ(f.cache->stats.fences, 1);
+
+    f.Build(CodePage);
+    f.cache->OnStore(CodePage + 0x800, 8);
+    CHECK(!f.Cached(CodePage));
+    CHECK_EQ(f.cache->stats.invalidations, 1);
+}
+
+// A store drops the blocks on the pages it touches, and only those, even
+// when another code page hashes to the same list. The block offsets keep
+// clear of each other's cache slots.
+void TestStoreInvalidation() {
+    fixture f;
+    const __uint64_t neighbour = CodePage + PageSize;
+    __uint64_t alias = CodePage + PageSize;
+    while (cache_t::FilterSlot(alias >> PageShift) != cache_t::FilterSlot(CodePage >> PageShift))
+        alias += PageSize;
+
+    f.Build(CodePage);
+    f.Build(CodePage + 0x40);
+    f.Build(CodePage + 0x200);
+    f.Build(neighbour + 0x10);
+    f.Build(alias + 0x80);
+
+    f.cache->OnStore(neighbour + 2 * PageSize, 8);       // not code
+    CHECK_EQ(f.cache->stats.invalidations, 0);
+
+    f.cache->OnStore(CodePage + 0x300, 4);
+    CHECK_EQ(f.cache->stats.invalidations, 3);
+    CHECK(!f.Cached(CodePage));
+    CHECK(!f.Cached(CodePage + 0x40));
+    CHECK(!f.Cached(CodePage + 0x200));
+    CHECK(f.Cached(neighbour + 0x10));
+    CHECK(f.Cached(alias + 0x80));
+
+    // A store across the page boundary reaches the page it ends on
+    f.Build(CodePage);
+    f.cache->OnStore(neighbour - 2, 4);
+    CHECK(!f.Cached(CodePage));
+    CHECK(!f.Cached(neighbour + 0x10));
+    CHECK_EQ(f.cache->stats.invalidations, 5);
+
+    f.cache->OnStore(alias, 1);
+    CHECK(!f.Cached(alias + 0x80));
+    CHECK_EQ(f.cache->stats.invalidations, 6);
+    f.cache->OnStore(alias, 1);
+    CHECK_EQ(f.cache->stats.invalidations, 6);
+}
+
+// A block built into an occupied slot evicts the old one, which leaves its
+// page's list
+void TestEviction() {
+    fixture f;
+    const __uint64_t other = CodePage + 3 * PageSize;
+    CHECK_EQ(cache_t::Index(CodePage), cache_t::Index(other));
+    f.Build(CodePage);
+    f.Build(CodePage + 0x10);
+    f.Build(other);
+    CHECK_EQ(f.cache->stats.evictions, 1);
+    CHECK(!f.Cached(CodePage));
+    CHECK(f.Cached(other));
+
+    f.cache->OnStore(CodePage, 4);
+    CHECK_EQ(f.cache->stats.invalidations, 1);
+    CHECK(f.Cached(other));
+
+    // Rebuilding after an invalidation is not an eviction
+    f.Build(CodePage + 0x10);
+    CHECK_EQ(f.cache->stats.evictions, 1);
+}
+
+// A satp write drops virtually tagged blocks only
+void TestSatpWrite() {
+    fixture f;
+    f.Build(CodePage);
+    f.Build(0x1010, true);
+    f.cache->OnSatpWrite();
+    CHECK(f.Cached(CodePage));
+    CHECK(!f.Cached(0x1010));
+    CHECK_EQ(f.cache->stats.satpFlushes, 1);
+
+    // and their stale links do no harm
+    f.Build(0x1010, true);
+    f.cache->OnStore(0x1010, 4);
+    CHECK(!f.Cached(0x1010));
+    CHECK(f.Cached(CodePage));
+}
+
+int main() {
+    TestBuild();
+    TestFenceI();
+    TestStoreInvalidation();
+    TestEviction();
+    TestSatpWrite();
+    return CHECK_RESULT();
+}
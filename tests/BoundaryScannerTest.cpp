@@ -0,0 +1,139 @@
+#include "BoundaryScanner.hpp"
+
+#include "Check.hpp"
+
+#include <iterator>
+#include <random>
+#include <vector>
+
+using namespace RISCV;
+
+// CMake builds this test a second time with -mavx2 where the host can run it,
+// so both classifyChunk paths are checked against the same reference
+
+// Walks one instruction at a time, the way findInstructionStarts has to agree with
+std::vector<std::size_t> ReferenceStarts(const std::vector<__uint8_t>& code) {
+    std::vector<std::size_t> starts;
+    std::size_t parcel = 0;
+    while (parcel < code.size() / 2) {
+        starts.push_back(2 * parcel);
+        unsigned int length = instructionLength(detail::loadParcel(&code[2 * parcel]));
+        parcel += length ? length / 2 : 1;
+    }
+    return starts;
+}
+
+bool Agrees(const std::vector<__uint8_t>& code) {
+    std::vector<std::size_t> offsets(code.size() / 2 + 1, ~(std::size_t)0);
+    std::size_t count = findInstructionStarts(code.data(), code.size(), offsets.data());
+    offsets.resize(count);
+    return offsets == ReferenceStarts(code);
+}
+
+// First parcels of each length
+constexpr __uint16_t Compressed = 0x4501;      // c.li a0, 0
+constexpr __uint16_t Standard = 0x0513;        // addi a0, ...
+constexpr __uint16_t Long48 = 0x001f;
+constexpr __uint16_t Long64 = 0x003f;
+constexpr __uint16_t Long80 = 0x007f;          // nnn in bits 14:12 adds 16 bits each
+constexpr __uint16_t Reserved = 0x707f;        // nnn = 7
+
+struct codeBuilder {
+    std::vector<__uint8_t> bytes;
+
+    void Parcel(__uint16_t parcel) {
+        bytes.push_back(parcel & 0xff);
+        bytes.push_back(parcel >> 8);
+    }
+
+    // An instruction of first parcel `first`, padded with parcels that would
+    // each look like a 64-bit instruction start if misread
+    codeBuilder& Instruction(__uint16_t first) {
+        Parcel(first);
+        unsigned int length = instructionLength(first);
+        for (unsigned int i = 2; i < length; i += 2)
+            Parcel(Long64);
+        return *this;
+    }
+
+    codeBuilder& Repeat(__uint16_t first, unsigned int times) {
+        for (unsigned int i = 0; i < times; i++)
+            Instruction(first);
+        return *this;
+    }
+};
+
+void TestFixedStreams() {
+    CHECK(Agrees({}));
+    CHECK(Agrees({ 0x01 }));
+    CHECK(Agrees(codeBuilder().Repeat(Compressed, 100).bytes));
+    CHECK(Agrees(codeBuilder().Repeat(Standard, 100).bytes));
+    CHECK(Agrees(codeBuilder().Repeat(Long48, 50).bytes));
+    CHECK(Agrees(codeBuilder().Repeat(Long64, 50).bytes));
+    for (__uint16_t nnn = 0; nnn < 7; nnn++)
+        CHECK(Agrees(codeBuilder().Repeat(Long80 | (nnn << 12), 20).Repeat(Compressed, 3).bytes));
+    CHECK(Agrees(codeBuilder().Repeat(Reserved, 70).bytes));
+
+    // A reserved parcel is stepped over by itself
+    std::vector<__uint8_t> code = codeBuilder().Instruction(Reserved).Instruction(Standard).Instruction(Compressed).bytes;
+    std::size_t offsets[8];
+    CHECK_EQ(findInstructionStarts(code.data(), code.size(), offsets), 3);
+    CHECK_EQ(offsets[1], 2);
+    CHECK_EQ(offsets[2], 6);
+
+    // A truncated last instruction still starts where it starts
+    code = codeBuilder().Repeat(Compressed, 3).Instruction(Long64).bytes;
+    code.resize(code.size() - 4);
+    CHECK_EQ(findInstructionStarts(code.data(), code.size(), offsets), 4);
+    CHECK_EQ(offsets[3], 6);
+}
+
+// Instructions that spill 1 to 10 parcels past a 32-parcel chunk boundary,
+// entering the next chunk on both the table walk and the fallback
+void TestChunkSpills() {
+    const __uint16_t firsts[] = { Standard, Long48, Long64, Long80, Long80 | (6 << 12) };
+    for (__uint16_t first : firsts) {
+        for (unsigned int lead = 0; lead < 2 * detail::ParcelsPerChunk; lead++) {
+            codeBuilder builder;
+            builder.Repeat(Compressed, lead).Instruction(first).Repeat(Standard, 20).Repeat(Compressed, 9);
+            CHECK(Agrees(builder.bytes));
+            CHECK(Agrees(codeBuilder().Repeat(Standard, lead / 2).Repeat(Compressed, lead & 1).Instruction(first)
+                         .Repeat(Compressed, 40).bytes));
+        }
+    }
+}
+
+// Random mixes of every length, and plain random bytes, at many sizes
+void TestRandomStreams() {
+    const __uint16_t firsts[] = { Compressed, Compressed, Standard, Standard, Long48, Long64, Long80,
+                                  Long80 | (3 << 12), Reserved };
+    std::mt19937 random(2);
+    for (unsigned int trial = 0; trial < 2000; trial++) {
+        codeBuilder builder;
+        unsigned int instructions = random() % 120;
+        for (unsigned int i = 0; i < instructions; i++) {
+            __uint16_t first = firsts[random() % std::size(firsts)];
+            // Keep the length bits, randomise the rest
+            if (first == Compressed) {
+                first = (random() & ~0x0003) | (random() % 3);
+            } else {
+                __uint16_t lengthBits = (first & 0x7000) || first == Long80 ? 0x707f : 0x007f;
+                first = (random() & ~lengthBits) | first;
+            }
+            builder.Instruction(first);
+        }
+        CHECK(Agrees(builder.bytes));
+
+        std::vector<__uint8_t> noise(random() % 400);
+        for (__uint8_t& byte : noise)
+            byte = random();
+        CHECK(Agrees(noise));
+    }
+}
+
+int main() {
+    TestFixedStreams();
+    TestChunkSpills();
+    TestRandomStreams();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,148 @@
+#include "RiscV.hpp"
+
+#include "Check.hpp"
+
+using namespace RISCV;
+
+constexpr __uint32_t Extensions(const char* letters) {
+    __uint32_t bits = 0;
+    for (; *letters; letters++)
+        bits |= detail::extensionBit(*letters);
+    return bits;
+}
+
+constexpr __uint32_t Full = Extensions("IMAFDNSU");
+constexpr __uint32_t NoSupervisor = Extensions("IMAFDNU");
+constexpr __uint32_t MachineOnly = Extensions("IMA");
+constexpr __uint32_t AllCounters = ~(__uint32_t)0;
+
+template<typename XLEN_t>
+bool Readable(unsigned int address, PrivilegeMode privilege = PrivilegeMode::Machine,
+              __uint32_t extensions = Full, __uint32_t counterEnable = AllCounters) {
+    return csrAccessLegal<XLEN_t>(address, privilege, false, extensions, counterEnable);
+}
+
+template<typename XLEN_t>
+bool Writable(unsigned int address, PrivilegeMode privilege = PrivilegeMode::Machine,
+              __uint32_t extensions = Full, __uint32_t counterEnable = AllCounters) {
+    return csrAccessLegal<XLEN_t>(address, privilege, true, extensions, counterEnable);
+}
+
+// Table entries carry the privilege and read-only bits of their address
+// and the counter index of their number
+void TestMetadataTable() {
+    const csrMetadata& mhartid = csrMetadataTable[CSRAddress::MHARTID];
+    CHECK(mhartid.flags & csrMetadata::readOnlyMask);
+    CHECK_EQ(mhartid.privilege, PrivilegeMode::Machine);
+    CHECK(mhartid.handler == CSRHandlerClass::MachineInformation);
+
+    const csrMetadata& sstatus = csrMetadataTable[CSRAddress::SSTATUS];
+    CHECK_EQ(sstatus.privilege, PrivilegeMode::Supervisor);
+    CHECK_EQ(sstatus.flags & csrMetadata::readOnlyMask, 0);
+    CHECK(sstatus.handler == CSRHandlerClass::Status);
+
+    CHECK_EQ(csrMetadataTable[CSRAddress::HPMCOUNTER7].counterIndex, 7);
+    CHECK_EQ(csrMetadataTable[CSRAddress::HPMCOUNTER7H].counterIndex, 7);
+    CHECK_EQ(csrMetadataTable[CSRAddress::MHPMCOUNTER7].counterIndex, 7);
+    CHECK_EQ(csrMetadataTable[CSRAddress::MHPMCOUNTER7].flags & csrMetadata::counterGatedMask, 0);
+    CHECK(csrMetadataTable[CSRAddress::INSTRET].flags & csrMetadata::counterGatedMask);
+    CHECK(csrMetadataTable[CSRAddress::CYCLEH].flags & csrMetadata::rv32OnlyMask);
+
+    // Every defined address agrees with the address encoding
+    for (unsigned int address = 0; address < NumCSRs; address++) {
+        const csrMetadata& meta = csrMetadataTable[address];
+        if (!(meta.flags & csrMetadata::existsMask)) {
+            CHECK(meta.handler == CSRHandlerClass::None);
+            continue;
+        }
+        CHECK_EQ(meta.privilege, csrRequiredPrivilege((CSRAddress)address));
+        CHECK_EQ((meta.flags & csrMetadata::readOnlyMask) != 0, csrIsReadOnly((CSRAddress)address));
+    }
+}
+
+// A CSR exists when its extensions do, and some only on RV32
+void TestExistence() {
+    CHECK(Readable<__uint64_t>(CSRAddress::MSTATUS, PrivilegeMode::Machine, MachineOnly));
+    CHECK(!Readable<__uint64_t>(0x7ff));
+    CHECK(!Readable<__uint64_t>(CSRAddress::SATP, PrivilegeMode::Machine, NoSupervisor));
+    CHECK(Readable<__uint64_t>(CSRAddress::SATP));
+    CHECK(!Readable<__uint64_t>(CSRAddress::FCSR, PrivilegeMode::Machine, MachineOnly));
+    CHECK(!Readable<__uint64_t>(CSRAddress::USTATUS, PrivilegeMode::Machine, Extensions("IMASU")));
+    CHECK(!Readable<__uint64_t>(CSRAddress::MCOUNTEREN, PrivilegeMode::Machine, MachineOnly));
+
+    // SEDELEG needs both, MEDELEG either
+    CHECK(!Readable<__uint64_t>(CSRAddress::SEDELEG, PrivilegeMode::Machine, Extensions("IMASU")));
+    CHECK(Readable<__uint64_t>(CSRAddress::SEDELEG, PrivilegeMode::Machine, Extensions("IMANSU")));
+    CHECK(!Readable<__uint64_t>(CSRAddress::MEDELEG, PrivilegeMode::Machine, Extensions("IMAU")));
+    CHECK(Readable<__uint64_t>(CSRAddress::MEDELEG, PrivilegeMode::Machine, Extensions("IMANU")));
+    CHECK(Readable<__uint64_t>(CSRAddress::MEDELEG, PrivilegeMode::Machine, Extensions("IMASU")));
+
+    CHECK(!Readable<__uint64_t>(CSRAddress::CYCLEH));
+    CHECK(Readable<__uint32_t>(CSRAddress::CYCLEH));
+    CHECK(!Readable<__uint64_t>(CSRAddress::MCYCLEH));
+    CHECK(Readable<__uint32_t>(CSRAddress::MCYCLEH));
+    CHECK(!Readable<__uint64_t>(CSRAddress::PMPCFG3));
+    CHECK(Readable<__uint32_t>(CSRAddress::PMPCFG3));
+    CHECK(Readable<__uint64_t>(CSRAddress::PMPCFG2));
+
+    // Addresses past the 12-bit space do not alias into the table
+    CHECK(!Readable<__uint64_t>(NumCSRs + CSRAddress::MSTATUS));
+
+    // Debug CSRs only in debug mode
+    CHECK(!Readable<__uint64_t>(CSRAddress::DCSR));
+    CHECK(csrAccessLegal<__uint64_t>(CSRAddress::DCSR, PrivilegeMode::Machine, false, Full, AllCounters, true));
+    CHECK(Readable<__uint64_t>(CSRAddress::TSELECT));
+}
+
+// Lower privileges are refused, and read-only CSRs refuse writes at any
+void TestPrivilegeAndWrites() {
+    CHECK(Readable<__uint64_t>(CSRAddress::SSTATUS, PrivilegeMode::Supervisor));
+    CHECK(!Readable<__uint64_t>(CSRAddress::SSTATUS, PrivilegeMode::User));
+    CHECK(!Readable<__uint64_t>(CSRAddress::MSTATUS, PrivilegeMode::Supervisor));
+    CHECK(Readable<__uint64_t>(CSRAddress::FFLAGS, PrivilegeMode::User));
+    CHECK(Writable<__uint64_t>(CSRAddress::FFLAGS, PrivilegeMode::User));
+
+    CHECK(Readable<__uint64_t>(CSRAddress::MHARTID));
+    CHECK(!Writable<__uint64_t>(CSRAddress::MHARTID));
+    CHECK(!Writable<__uint64_t>(CSRAddress::CYCLE));
+    CHECK(Writable<__uint64_t>(CSRAddress::MCYCLE));
+    CHECK(!Writable<__uint64_t>(CSRAddress::MCYCLE, PrivilegeMode::Supervisor));
+}
+
+// Machine mode sees every counter; supervisor mode what mcounteren allows;
+// user mode what both allow, or mcounteren alone without supervisor mode
+void TestCounterEnable() {
+    const __uint32_t mcounteren = 0b10000101;      // CY, IR, HPM7
+    const __uint32_t scounteren = 0b00000100;      // IR
+    CHECK_EQ(effectiveCounterEnable(PrivilegeMode::Machine, 0, 0, Full), AllCounters);
+    CHECK_EQ(effectiveCounterEnable(PrivilegeMode::Supervisor, mcounteren, scounteren, Full), mcounteren);
+    CHECK_EQ(effectiveCounterEnable(PrivilegeMode::User, mcounteren, scounteren, Full), scounteren);
+    CHECK_EQ(effectiveCounterEnable(PrivilegeMode::User, mcounteren, scounteren, NoSupervisor), mcounteren);
+
+    auto readable = [&](unsigned int address, PrivilegeMode privilege, __uint32_t extensions = Full) {
+        __uint32_t enable = effectiveCounterEnable(privilege, mcounteren, scounteren, extensions);
+        return Readable<__uint32_t>(address, privilege, extensions, enable);
+    };
+    CHECK(readable(CSRAddress::CYCLE, PrivilegeMode::Supervisor));
+    CHECK(!readable(CSRAddress::CYCLE, PrivilegeMode::User));
+    CHECK(readable(CSRAddress::CYCLE, PrivilegeMode::User, NoSupervisor));
+    CHECK(readable(CSRAddress::INSTRET, PrivilegeMode::User));
+    CHECK(readable(CSRAddress::INSTRETH, PrivilegeMode::User));
+    CHECK(!readable(CSRAddress::TIME, PrivilegeMode::Supervisor));
+    CHECK(readable(CSRAddress::TIME, PrivilegeMode::Machine));
+    CHECK(readable(CSRAddress::HPMCOUNTER7, PrivilegeMode::Supervisor));
+    CHECK(readable(CSRAddress::HPMCOUNTER7H, PrivilegeMode::Supervisor));
+    CHECK(!readable(CSRAddress::HPMCOUNTER7, PrivilegeMode::User));
+    CHECK(!readable(CSRAddress::HPMCOUNTER8, PrivilegeMode::Supervisor));
+
+    // The machine counters are not gated, only privileged
+    CHECK(Readable<__uint64_t>(CSRAddress::MHPMCOUNTER8, PrivilegeMode::Machine, Full, 0));
+}
+
+int main() {
+    TestMetadataTable();
+    TestExistence();
+    TestPrivilegeAndWrites();
+    TestCounterEnable();
+    return CHECK_RESULT();
+}
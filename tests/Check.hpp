@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal checks for the standalone test mains. Each main returns
+// CHECK_RESULT(), which is nonzero if any check failed.
+
+namespace check {
+inline int failures = 0;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            check::failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        unsigned long long actualValue = (unsigned long long)(actual); \
+        unsigned long long expectedValue = (unsigned long long)(expected); \
+        if (actualValue != expectedValue) { \
+            std::printf("%s:%d: CHECK_EQ(%s, %s) failed: 0x%llx != 0x%llx\n", __FILE__, __LINE__, \
+                        #actual, #expected, actualValue, expectedValue); \
+            check::failures++; \
+        } \
+    } while (0)
+
+#define CHECK_RESULT() (check::failures ? (std::printf("%d check(s) failed\n", check::failures), 1) : 0)
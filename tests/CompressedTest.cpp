@@ -0,0 +1,96 @@
+#include "Compressed.hpp"
+#include "Decoder.hpp"
+
+#include "Check.hpp"
+
+using namespace RISCV;
+
+// Expansions checked against encodings from the specification's tables,
+// assembled independently of Compressed.hpp
+struct knownExpansion {
+    __uint16_t compressed;
+    __uint32_t rv32;        // IllegalExpansion where reserved
+    __uint32_t rv64;
+};
+
+constexpr knownExpansion knownExpansions[] = {
+    // C.ADDI4SPN, with nzuimm = 0 reserved
+    { 0x0048, 0x00410513, 0x00410513 },     // addi a0, sp, 4
+    { 0x1fe0, 0x3fc10413, 0x3fc10413 },     // addi s0, sp, 1020
+    { 0x0008, IllegalExpansion, IllegalExpansion },
+    { 0x0000, IllegalExpansion, IllegalExpansion },
+
+    // C.LWSP, with rd = x0 reserved
+    { 0x4532, 0x00c12503, 0x00c12503 },     // lw a0, 12(sp)
+    { 0x557e, 0x0fc12503, 0x0fc12503 },     // lw a0, 252(sp)
+    { 0x4002, IllegalExpansion, IllegalExpansion },
+
+    // C.LDSP on RV64, C.FLWSP on RV32
+    { 0x6522, 0x00812507, 0x00813503 },     // flw fa0, 8(sp) / ld a0, 8(sp)
+    { 0x757e, 0x0fc12507, 0x1f813503 },     // flw fa0, 252(sp) / ld a0, 504(sp)
+    { 0x6002, 0x00012007, IllegalExpansion },
+
+    // C.SDSP on RV64, C.FSWSP on RV32
+    { 0xe82a, 0x00a12827, 0x00a13823 },     // fsw fa0, 16(sp) / sd a0, 16(sp)
+    { 0xffaa, 0x0ea12e27, 0x1ea13c23 },     // fsw fa0, 252(sp) / sd a0, 504(sp)
+
+    // C.J, and C.JAL on RV32 where RV64 has C.ADDIW
+    { 0xa009, 0x0020006f, 0x0020006f },     // j .+2
+    { 0xbffd, 0xfffff06f, 0xfffff06f },     // j .-2
+    { 0xaffd, 0x7fe0006f, 0x7fe0006f },     // j .+2046
+    { 0xb001, 0x801ff06f, 0x801ff06f },     // j .-2048
+    { 0xa46d, 0x2aa0006f, 0x2aa0006f },     // j .+682
+    { 0xb46d, 0xaabff06f, 0xaabff06f },     // j .-1366
+    { 0x2ffd, 0x7fe000ef, 0x01ff8f9b },     // jal .+2046 / addiw t6, t6, 31
+    { 0x3001, 0x801ff0ef, IllegalExpansion },
+
+    // C.BEQZ and C.BNEZ
+    { 0xc089, 0x00048163, 0x00048163 },     // beqz s1, .+2
+    { 0xdcfd, 0xfe048fe3, 0xfe048fe3 },     // beqz s1, .-2
+    { 0xccfd, 0x0e048f63, 0x0e048f63 },     // beqz s1, .+254
+    { 0xd081, 0xf00480e3, 0xf00480e3 },     // beqz s1, .-256
+    { 0xc8b9, 0x04048b63, 0x04048b63 },     // beqz s1, .+86
+    { 0xfbb9, 0xf4079be3, 0xf4079be3 },     // bnez a5, .-170
+    { 0xe389, 0x00079163, 0x00079163 },     // bnez a5, .+2
+
+    // Shift amounts of 32 and up are RV64 only
+    { 0x0506, 0x00151513, 0x00151513 },     // slli a0, a0, 1
+    { 0x1502, IllegalExpansion, 0x02051513 },   // slli a0, a0, 32
+    { 0x9005, IllegalExpansion, 0x02145413 },   // srli s0, s0, 33
+    { 0x9405, IllegalExpansion, 0x42145413 },   // srai s0, s0, 33
+    { 0x807d, 0x01f45413, 0x01f45413 },     // srli s0, s0, 31
+};
+
+void TestKnownExpansions() {
+    for (const knownExpansion& known : knownExpansions) {
+        CHECK_EQ(expandCompressed<__uint32_t>(known.compressed), known.rv32);
+        CHECK_EQ(expandCompressed<__uint64_t>(known.compressed), known.rv64);
+    }
+}
+
+// Uncompressed parcels have no expansion, and every expansion is a 32-bit
+// instruction the decoder accepts. The decoder has no FP loads and stores,
+// so C.FLD, C.FSW and friends are only checked against known encodings.
+template<typename XLEN_t>
+void TestWholeTable() {
+    for (unsigned int halfword = 0; halfword < NumHalfwords; halfword++) {
+        __uint32_t expanded = expandCompressed<XLEN_t>(halfword);
+        if (!isCompressed(halfword)) {
+            CHECK_EQ(expanded, IllegalExpansion);
+            continue;
+        }
+        if (expanded == IllegalExpansion)
+            continue;
+        CHECK_EQ(expanded & 0b11, 0b11);
+        unsigned int major = (expanded >> 2) & 0x1f;
+        if (major != MajorOpcode::LOAD_FP && major != MajorOpcode::STORE_FP)
+            CHECK(decode<XLEN_t>(expanded).id != InstructionID::INVALID);
+    }
+}
+
+int main() {
+    TestKnownExpansions();
+    TestWholeTable<__uint32_t>();
+    TestWholeTable<__uint64_t>();
+    return CHECK_RESULT();
+}
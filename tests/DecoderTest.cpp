@@ -0,0 +1,63 @@
+#include "Decoder.hpp"
+
+#include "Check.hpp"
+
+using namespace RISCV;
+
+constexpr __uint32_t sretWord = 0x10200073;
+constexpr __uint32_t mretWord = 0x30200073;
+constexpr __uint32_t uretWord = 0x00200073;
+constexpr __uint32_t sfenceVmaWord = 0x12000073;
+constexpr __uint32_t addWord = 0x00b50533;     // add a0, a0, a1
+
+void TestISAStrings() {
+    isaDescription su = parseISAString("rv64imacsu");
+    CHECK(su.valid);
+    CHECK(!su.unknownExtensions);
+    CHECK(featureSetHas(su.features, 'S'));
+    CHECK(featureSetHas(su.features, 'U'));
+    CHECK(featureSetHas(su.features, 'C'));
+
+    isaDescription n = parseISAString("rv64imacsun_zicsr");
+    CHECK(n.valid);
+    CHECK(featureSetHas(n.features, 'N'));
+    CHECK(featureSetHas(n.features, MultiLetterExtension::Zicsr));
+
+    // S-prefixed names are still multi-letter extensions, not S
+    isaDescription svinval = parseISAString("rv64gc_svinval");
+    CHECK(featureSetHas(svinval.features, MultiLetterExtension::Svinval));
+    CHECK(!featureSetHas(svinval.features, 'S'));
+    isaDescription attached = parseISAString("rv64gcsvinval");
+    CHECK(featureSetHas(attached.features, MultiLetterExtension::Svinval));
+    CHECK(!featureSetHas(attached.features, 'S'));
+    CHECK(!attached.unknownExtensions);
+
+    isaDescription unknown = parseISAString("rv64gc_sfoo");
+    CHECK(unknown.valid);
+    CHECK(unknown.unknownExtensions);
+    CHECK(!featureSetHas(unknown.features, 'S'));
+}
+
+template<typename XLEN_t>
+void TestPrivilegedDecode() {
+    CHECK_EQ((decode<XLEN_t, RV64GC>(sretWord).id), InstructionID::SRET);
+    CHECK_EQ((decode<XLEN_t, RV64GC>(mretWord).id), InstructionID::MRET);
+    CHECK_EQ((decode<XLEN_t, RV64GC>(sfenceVmaWord).id), InstructionID::SFENCE_VMA);
+    CHECK_EQ((decode<XLEN_t, RV64GC>(addWord).id), InstructionID::ADD);
+    // URET needs N, which GC does not include
+    CHECK_EQ((decode<XLEN_t, RV64GC>(uretWord).id), InstructionID::INVALID);
+    CHECK_EQ((decode<XLEN_t, isaFeatures("rv64gcn")>(uretWord).id), InstructionID::URET);
+
+    // A machine-only hart has no SRET or SFENCE.VMA
+    constexpr privilegeModeSet machineOnly = privilegeModeBit(PrivilegeMode::Machine);
+    CHECK_EQ((decode<XLEN_t, RV64GC, machineOnly>(sretWord).id), InstructionID::INVALID);
+    CHECK_EQ((decode<XLEN_t, RV64GC, machineOnly>(sfenceVmaWord).id), InstructionID::INVALID);
+    CHECK_EQ((decode<XLEN_t, RV64GC, machineOnly>(mretWord).id), InstructionID::MRET);
+}
+
+int main() {
+    TestISAStrings();
+    TestPrivilegedDecode<__uint32_t>();
+    TestPrivilegedDecode<__uint64_t>();
+    return CHECK_RESULT();
+}
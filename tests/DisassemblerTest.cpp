@@ -0,0 +1,86 @@
+#include "Disassembler.hpp"
+
+#include "Check.hpp"
+#include "GuestProgram.hpp"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace RISCV;
+
+template<typename XLEN_t>
+std::string disassembleOne(XLEN_t pc, __uint32_t word) {
+    char line[MaxDisassemblyLength];
+    std::to_chars_result result = disassembleToChars<XLEN_t>(line, line + sizeof(line), pc, word);
+    return std::string(line, result.ptr);
+}
+
+// Every operand format, and numbers either side of each digit count
+void TestLines() {
+    CHECK(disassembleOne<__uint64_t>(0, encode::addi(10, 11, -2048)) == "addi a0, a1, -2048");
+    CHECK(disassembleOne<__uint64_t>(0, encode::addi(10, 0, 7)) == "addi a0, zero, 7");
+    CHECK(disassembleOne<__uint64_t>(0, encode::addi(10, 0, 10)) == "addi a0, zero, 10");
+    CHECK(disassembleOne<__uint64_t>(0, encode::addi(10, 0, -999)) == "addi a0, zero, -999");
+    CHECK(disassembleOne<__uint64_t>(0, encode::addi(10, 0, 1000)) == "addi a0, zero, 1000");
+    CHECK(disassembleOne<__uint64_t>(0, 0x4035d513) == "srai a0, a1, 3");
+    CHECK(disassembleOne<__uint64_t>(0, encode::load(3, 1, 2, 1234)) == "ld ra, 1234(sp)");
+    CHECK(disassembleOne<__uint64_t>(0, encode::store(2, 2, 8, -16)) == "sw s0, -16(sp)");
+    CHECK(disassembleOne<__uint64_t>(0, encode::add(1, 2, 3)) == "add ra, sp, gp");
+    CHECK(disassembleOne<__uint64_t>(0, encode::lui(5, 0xabcde000)) == "lui t0, 0xabcde");
+    CHECK(disassembleOne<__uint64_t>(0, encode::lui(5, 0)) == "lui t0, 0x0");
+    CHECK(disassembleOne<__uint64_t>(0x80000010, encode::branch(0, 10, 11, -16)) == "beq a0, a1, 0x80000000");
+    CHECK(disassembleOne<__uint64_t>(0xfffffffffffffff0ull, encode::jal(1, 0x20)) == "jal ra, 0x10");
+    CHECK(disassembleOne<__uint64_t>(0x123456789abcdef0ull, encode::jal(0, -4)) == "jal zero, 0x123456789abcdeec");
+    CHECK(disassembleOne<__uint32_t>(0x80000000, encode::jal(1, -8)) == "jal ra, 0x7ffffff8");
+    CHECK(disassembleOne<__uint64_t>(0, encode::csr(2, 10, 0, 0x300)) == "csrrs a0, mstatus, zero");
+    CHECK(disassembleOne<__uint64_t>(0, encode::csr(6, 10, 31, 0x7ff)) == "csrrsi a0, 0x7ff, 31");
+    CHECK(disassembleOne<__uint64_t>(0, 0x0ff0000f) == "fence iorw, iorw");
+    CHECK(disassembleOne<__uint64_t>(0, 0x06c5a52f) == "amoadd.w.aqrl a0, a2, (a1)");
+    CHECK(disassembleOne<__uint64_t>(0, 0x1005252f) == "lr.w a0, (a0)");
+    CHECK(disassembleOne<__uint64_t>(0, 0x12000073) == "sfence.vma zero, zero");
+    CHECK(disassembleOne<__uint64_t>(0, encode::mret) == "mret");
+    CHECK(disassembleOne<__uint64_t>(0, 0x4501) == "addi a0, zero, 0");
+    CHECK(disassembleOne<__uint64_t>(0, 0x0000) == "(invalid) 0x0");
+    CHECK(disassembleOne<__uint64_t>(0, 0xffffffff) == "(invalid) 0xffffffff");
+}
+
+// Batches print each format in a group of its own. Their lines still come
+// out in order, and match the single-instruction form, however the buffer
+// cuts the batch short. Nothing past the end of the output is touched.
+template<typename XLEN_t>
+void TestBatch() {
+    constexpr std::size_t count = 1000;
+    std::mt19937 random(1);
+    std::vector<XLEN_t> pcs(count);
+    std::vector<__uint32_t> words(count);
+    std::string expected;
+    for (std::size_t i = 0; i < count; i++) {
+        pcs[i] = (XLEN_t)(0x80000000 + 2 * i);
+        words[i] = random() % 3 == 0 ? random() & 0xffff : random();
+        expected += disassembleOne<XLEN_t>(pcs[i], words[i]) + "\n";
+    }
+
+    for (std::size_t size : { (std::size_t)MaxDisassemblyLength, (std::size_t)1000, (std::size_t)1 << 16 }) {
+        std::vector<char> buffer(size);
+        std::string printed;
+        for (std::size_t done = 0; done < count;) {
+            std::fill(buffer.begin(), buffer.end(), '#');
+            disassemblyResult result = disassemble<XLEN_t>(pcs.data() + done, words.data() + done, count - done,
+                                                           buffer.data(), buffer.data() + size);
+            CHECK(result.count > 0);
+            CHECK(std::all_of(result.end, buffer.data() + size, [](char c) { return c == '#'; }));
+            done += result.count;
+            printed.append(buffer.data(), result.end);
+        }
+        CHECK(printed == expected);
+    }
+}
+
+int main() {
+    TestLines();
+    TestBatch<__uint32_t>();
+    TestBatch<__uint64_t>();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,103 @@
+#include "FloatingPoint.hpp"
+
+#include "Check.hpp"
+
+#include <random>
+
+using namespace RISCV;
+
+template<typename T>
+T denorms(double count) {
+    return (T)(count * std::numeric_limits<T>::denorm_min());
+}
+
+#define CHECK_FP(actual, expected) CHECK_EQ(detail::toBits(actual), detail::toBits(expected))
+
+// RMM rounds an exact tie between subnormals away from zero
+template<typename T>
+void TestSubnormalTies() {
+    constexpr fpRoundingMode RMM = fpRoundingMode::RMM;
+    constexpr fpRoundingMode RNE = fpRoundingMode::RNE;
+    T half = (T)0.5;
+
+    CHECK_FP((fpMul<RMM, T>(denorms<T>(5), half)), denorms<T>(3));
+    CHECK_FP((fpMul<RMM, T>(denorms<T>(-5), half)), denorms<T>(-3));
+    CHECK_FP((fpMul<RMM, T>(denorms<T>(1), half)), denorms<T>(1));
+    CHECK_FP((fpMul<RMM, T>(denorms<T>(5), (T)0.25)), denorms<T>(1));
+    CHECK_FP((fpMul<RNE, T>(denorms<T>(5), half)), denorms<T>(2));
+
+    CHECK_FP((fpDiv<RMM, T>(denorms<T>(5), (T)2)), denorms<T>(3));
+    CHECK_FP((fpDiv<RMM, T>(denorms<T>(5), (T)-2)), denorms<T>(-3));
+    CHECK_FP((fpDiv<RMM, T>(denorms<T>(5), (T)4)), denorms<T>(1));
+
+    CHECK_FP((fpMulAdd<RMM, T>(denorms<T>(5), half, (T)0)), denorms<T>(3));
+    CHECK_FP((fpMulAdd<RMM, T>(denorms<T>(5), half, denorms<T>(2))), denorms<T>(5));
+    CHECK_FP((fpMulAdd<RMM, T>(denorms<T>(5), half, denorms<T>(-2))), denorms<T>(1));
+    CHECK_FP((fpMulAdd<RNE, T>(denorms<T>(5), half, denorms<T>(2))), denorms<T>(4));
+
+    // A tiny product breaking a tie in the smallest normal binade
+    T minimum = std::numeric_limits<T>::min();
+    CHECK_FP((fpMulAdd<RMM, T>(denorms<T>(1), half, minimum)), minimum + denorms<T>(1));
+    CHECK_FP((fpMulAdd<RNE, T>(denorms<T>(1), half, minimum)), minimum);
+}
+
+void TestNarrowTies() {
+    constexpr fpRoundingMode RMM = fpRoundingMode::RMM;
+    double tiny = 2.5 * std::numeric_limits<float>::denorm_min();
+    CHECK_FP(fpNarrow<RMM>(tiny), denorms<float>(3));
+    CHECK_FP(fpNarrow<RMM>(-tiny), denorms<float>(-3));
+    CHECK_FP(fpNarrow<fpRoundingMode::RNE>(tiny), denorms<float>(2));
+    CHECK_FP(fpNarrow<RMM>(1 + std::ldexp(1.0, -24)), 1 + std::ldexp(1.0f, -23));
+}
+
+// RMM of an exact double, as a float
+float referenceRMM(double exact) {
+    float r = (float)exact;
+    if (std::fabs(exact) > std::fabs(r)) {
+        float away = std::nextafter(r, std::copysign(INFINITY, (float)exact));
+        if ((double)r + (double)away == 2 * exact)
+            return away;
+    }
+    return r;
+}
+
+// Float products and sums near the subnormal range are exact in double,
+// so random ones can be checked against referenceRMM
+void TestRandomFloat() {
+    constexpr fpRoundingMode RMM = fpRoundingMode::RMM;
+    std::mt19937 random(1);
+    for (int i = 0; i < 200000; i++) {
+        int target = -(int)(random() % 40) - 120;
+        int ea = -(int)(random() % 40) - 50;
+        float a, b;
+        if (i & 1) {
+            // An odd multiple of a power of two times a power of two: often a tie
+            a = std::ldexp((float)(random() % (1 << 20) | 1), ea);
+            b = std::ldexp(1.0f, target - ea - 20);
+        } else {
+            a = std::ldexp((float)(random() % (1 << 24)), ea - 24);
+            b = std::ldexp((float)(random() % (1 << 24)), target - ea - 24);
+        }
+        if (random() & 1)
+            a = -a;
+        double product = (double)a * b;
+        CHECK_FP((fpMul<RMM, float>(a, b)), referenceRMM(product));
+        if ((i & 1) && std::isfinite(1 / b))
+            CHECK_FP((fpDiv<RMM, float>(a, 1 / b)), referenceRMM(product));
+
+        float c = std::ldexp((float)(random() % (1 << 24)), -(int)(random() % 30) - 149 + 6);
+        if (random() & 1)
+            c = -c;
+        double sum = product + c;
+        if (detail::twoSumError(product, (double)c, sum) == 0)
+            CHECK_FP((fpMulAdd<RMM, float>(a, b, c)), referenceRMM(sum));
+    }
+}
+
+int main() {
+    TestSubnormalTies<float>();
+    TestSubnormalTies<double>();
+    TestNarrowTies();
+    TestRandomFloat();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Compressed.hpp"
+#include "HartState.hpp"
+
+#include <cstring>
+#include <vector>
+
+// Flat guest RAM and a tiny program builder, shared by the tests and
+// benchmarks that execute code
+
+constexpr __uint64_t GuestBase = 0x80000000;
+
+struct flatMemory {
+
+    std::vector<__uint8_t> bytes = std::vector<__uint8_t>(1 << 20);
+
+    template<typename T>
+    bool Read(__uint64_t physicalAddress, T& value) {
+        if (physicalAddress < GuestBase || physicalAddress + sizeof(T) > GuestBase + bytes.size())
+            return false;
+        std::memcpy(&value, &bytes[physicalAddress - GuestBase], sizeof(T));
+        return true;
+    }
+
+    template<typename T>
+    bool Write(__uint64_t physicalAddress, T value) {
+        if (physicalAddress < GuestBase || physicalAddress + sizeof(T) > GuestBase + bytes.size())
+            return false;
+        std::memcpy(&bytes[physicalAddress - GuestBase], &value, sizeof(T));
+        return true;
+    }
+};
+
+// 32-bit instructions laid out from GuestBase
+struct guestProgram {
+
+    std::vector<__uint32_t> words;
+
+    // Byte offset of the next instruction
+    __int32_t Here() const {
+        return (__int32_t)(words.size() * 4);
+    }
+
+    guestProgram& operator<<(__uint32_t word) {
+        words.push_back(word);
+        return *this;
+    }
+
+    void Load(flatMemory& memory) const {
+        std::memcpy(memory.bytes.data(), words.data(), words.size() * 4);
+    }
+};
+
+// Encodings the tests use that Compressed.hpp's helpers do not cover by name
+namespace encode {
+
+using namespace RISCV;
+using namespace RISCV::detail;
+
+constexpr __uint32_t addi(unsigned int rd, unsigned int rs1, __int32_t imm) { return encodeI(MajorOpcode::OP_IMM, rd, 0, rs1, imm); }
+constexpr __uint32_t add(unsigned int rd, unsigned int rs1, unsigned int rs2) { return encodeR(MajorOpcode::OP, rd, 0, rs1, rs2, 0); }
+constexpr __uint32_t lui(unsigned int rd, __int32_t imm) { return encodeU(MajorOpcode::LUI, rd, imm); }
+constexpr __uint32_t auipc(unsigned int rd, __int32_t imm) { return encodeU(MajorOpcode::AUIPC, rd, imm); }
+constexpr __uint32_t load(unsigned int funct3, unsigned int rd, unsigned int rs1, __int32_t imm) { return encodeI(MajorOpcode::LOAD, rd, funct3, rs1, imm); }
+constexpr __uint32_t store(unsigned int funct3, unsigned int rs1, unsigned int rs2, __int32_t imm) { return encodeS(MajorOpcode::STORE, funct3, rs1, rs2, imm); }
+constexpr __uint32_t branch(unsigned int funct3, unsigned int rs1, unsigned int rs2, __int32_t offset) { return encodeB(funct3, rs1, rs2, offset); }
+constexpr __uint32_t jal(unsigned int rd, __int32_t offset) { return encodeJ(rd, offset); }
+constexpr __uint32_t csr(unsigned int funct3, unsigned int rd, unsigned int rs1, unsigned int address) { return encodeI(MajorOpcode::SYSTEM, rd, funct3, rs1, (__int32_t)address); }
+constexpr __uint32_t ecall = 0x00000073;
+constexpr __uint32_t mret = 0x30200073;
+constexpr __uint32_t sret = 0x10200073;
+
+} // namespace encode
@@ -0,0 +1,101 @@
+#include "HartState.hpp"
+
+#include "Check.hpp"
+
+#include <memory>
+
+using namespace RISCV;
+
+// Harts in an array never share a cache line, and the CSRs never share one
+// with the hot fields
+template<typename XLEN_t>
+constexpr bool CacheLineLayout() {
+    return alignof(HartState<XLEN_t>) % HartStateAlignment == 0 &&
+           sizeof(HartState<XLEN_t>) % HartStateAlignment == 0 &&
+           alignof(hartControlState<XLEN_t>) % HartStateAlignment == 0 &&
+           sizeof(hartControlState<XLEN_t>) % HartStateAlignment == 0;
+}
+static_assert(CacheLineLayout<__uint32_t>());
+static_assert(CacheLineLayout<__uint64_t>());
+
+constexpr __uint32_t Extensions = isaFeatures("rv64imacsu") & 0x3ffffff;
+
+std::size_t Offset(const void* base, const void* field) {
+    return (const char*)field - (const char*)base;
+}
+
+// control starts on the first line boundary after the registers
+template<typename XLEN_t>
+void TestControlPlacement() {
+    auto state = std::make_unique<HartState<XLEN_t>>(Extensions);
+    std::size_t control = Offset(state.get(), &state->control);
+    std::size_t hotEnd = Offset(state.get(), &state->regs) + sizeof(state->regs);
+    CHECK_EQ(control % HartStateAlignment, 0);
+    CHECK(control >= hotEnd);
+    CHECK(control - hotEnd < HartStateAlignment);
+    CHECK_EQ((std::size_t)state.get() % HartStateAlignment, 0);
+}
+
+// Each hot array of HartArray starts on its own line, and a hart's fields
+// survive a Load and Store without disturbing its neighbours
+template<typename XLEN_t>
+void TestHartArray() {
+    constexpr unsigned int Harts = 5;
+    auto harts = std::make_unique<HartArray<XLEN_t, Harts>>(Extensions);
+    harts->Reset(0x1000);
+    CHECK_EQ(Offset(harts.get(), &harts->interruptsPending) % HartStateAlignment, 0);
+    CHECK_EQ(Offset(harts.get(), &harts->privilege) % HartStateAlignment, 0);
+    CHECK_EQ(Offset(harts.get(), &harts->regs) % HartStateAlignment, 0);
+    CHECK_EQ(Offset(harts.get(), &harts->control) % HartStateAlignment, 0);
+
+    for (unsigned int hart = 0; hart < Harts; hart++) {
+        harts->pc[hart] = 0x2000 + 4 * hart;
+        for (unsigned int reg = 1; reg < NumRegs; reg++)
+            harts->regs[reg][hart] = 100 * hart + reg;
+    }
+
+    auto state = std::make_unique<HartState<XLEN_t>>(Extensions);
+    state->Reset(0);
+    harts->Load(3, *state);
+    CHECK_EQ(state->pc, 0x200c);
+    CHECK_EQ(state->privilege, PrivilegeMode::Machine);
+    CHECK_EQ(state->interruptsPending, 0);
+    CHECK_EQ(state->regs[0], 0);
+    CHECK_EQ(state->regs[31], 331);
+
+    state->pc = 0x3000;
+    state->privilege = PrivilegeMode::User;
+    state->interruptsPending = 1 << TrapCause::MACHINE_TIMER_INTERRUPT;
+    state->regs[7] = 0x77;
+    harts->Store(1, *state);
+    CHECK_EQ(harts->pc[1], 0x3000);
+    CHECK_EQ(harts->privilege[1], PrivilegeMode::User);
+    CHECK_EQ(harts->regs[7][1], 0x77);
+    CHECK_EQ(harts->regs[8][1], 308);
+    CHECK(harts->AnyInterruptsPending());
+
+    // The neighbours are untouched
+    CHECK_EQ(harts->pc[0], 0x2000);
+    CHECK_EQ(harts->pc[2], 0x2008);
+    CHECK_EQ(harts->privilege[2], PrivilegeMode::Machine);
+    CHECK_EQ(harts->regs[7][0], 7);
+    CHECK_EQ(harts->regs[7][2], 207);
+
+    auto copy = std::make_unique<HartState<XLEN_t>>(Extensions);
+    harts->Load(1, *copy);
+    CHECK_EQ(copy->pc, state->pc);
+    CHECK_EQ(copy->privilege, state->privilege);
+    CHECK_EQ(copy->interruptsPending, state->interruptsPending);
+    CHECK(copy->regs == state->regs);
+
+    harts->UpdateInterruptsPending(1);
+    CHECK(!harts->AnyInterruptsPending());
+}
+
+int main() {
+    TestControlPlacement<__uint32_t>();
+    TestControlPlacement<__uint64_t>();
+    TestHartArray<__uint32_t>();
+    TestHartArray<__uint64_t>();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,144 @@
+#include "HostTranslationCache.hpp"
+
+#include "Check.hpp"
+
+#include <memory>
+#include <vector>
+
+using namespace RISCV;
+
+constexpr __uint8_t Writable = PTEBit::V | PTEBit::R | PTEBit::W | PTEBit::A | PTEBit::D;
+
+using cache_t = hostTranslationCache<__uint64_t>;
+
+struct fixture {
+    std::vector<__uint8_t> host = std::vector<__uint8_t>(4 * PageSize);
+    std::unique_ptr<cache_t> cache = std::make_unique<cache_t>();
+    satpReg<__uint64_t> satp;
+
+    fixture() {
+        cache->Reset();
+        satp.Reset();
+        SetSatp(PagingMode::Sv39, 1, 0x100);
+    }
+
+    void SetSatp(PagingMode mode, __uint16_t asid, __uint64_t ppn) {
+        satp.pagingMode = mode;
+        satp.asid = asid;
+        satp.ppn = ppn;
+        cache->OnSatpWrite(satp);
+    }
+
+    // Maps the guest page at virtualAddress to host page n for loads
+    void Fill(__uint64_t virtualAddress, unsigned int n) {
+        cache->Insert(virtualAddress, Load, PrivilegeMode::Supervisor, Writable, &host[n * PageSize]);
+    }
+
+    bool Hits(__uint64_t virtualAddress, PrivilegeMode privilege = PrivilegeMode::Supervisor) {
+        return cache->Lookup<Load>(virtualAddress, 4, privilege) != nullptr;
+    }
+};
+
+// A hit is the host address at the same page offset; an access crossing
+// out of the page, or under another privilege or access type, misses
+void TestHits() {
+    fixture f;
+    f.Fill(0x5000, 2);
+    CHECK(f.cache->Lookup<Load>(0x5010, 4, PrivilegeMode::Supervisor) == &f.host[2 * PageSize + 0x10]);
+    CHECK(f.Hits(0x5ffc));
+    CHECK(f.cache->Lookup<Load>(0x5ffe, 4, PrivilegeMode::Supervisor) == nullptr);
+    CHECK(!f.Hits(0x5000, PrivilegeMode::User));
+    CHECK(f.cache->Lookup<Store>(0x5000, 4, PrivilegeMode::Supervisor) == nullptr);
+    CHECK(!f.Hits(0x5000 + 256 * PageSize));           // same index, other page
+
+    f.host[2 * PageSize + 8] = 0x5a;
+    __uint8_t value = 0;
+    CHECK(f.cache->Load(0x5008, PrivilegeMode::Supervisor, value));
+    CHECK_EQ(value, 0x5a);
+
+    // Store entries need D set in the leaf
+    f.cache->Insert(0x6000, Store, PrivilegeMode::Supervisor, Writable & ~PTEBit::D, &f.host[3 * PageSize]);
+    CHECK(!f.cache->Store(0x6000, PrivilegeMode::Supervisor, (__uint32_t)1));
+    f.cache->Insert(0x6000, Store, PrivilegeMode::Supervisor, Writable, &f.host[3 * PageSize]);
+    CHECK(f.cache->Store(0x6004, PrivilegeMode::Supervisor, (__uint16_t)0xbeef));
+    CHECK_EQ(f.host[3 * PageSize + 4], 0xef);
+    CHECK_EQ(f.host[3 * PageSize + 5], 0xbe);
+}
+
+// Switching ASID keeps the entries of the one switched away from; moving
+// the root or mode under the same ASID drops them
+void TestSatpWrites() {
+    fixture f;
+    f.Fill(0x5000, 1);
+    const __uint64_t epoch = f.cache->epoch;
+
+    f.SetSatp(PagingMode::Sv39, 2, 0x200);
+    CHECK(!f.Hits(0x5000));
+    f.Fill(0x7000, 2);
+    f.SetSatp(PagingMode::Sv39, 1, 0x100);
+    CHECK(f.Hits(0x5000));
+    CHECK(!f.Hits(0x7000));
+    f.SetSatp(PagingMode::Sv39, 2, 0x200);
+    CHECK(f.Hits(0x7000));
+    CHECK_EQ(f.cache->epoch, epoch);
+
+    // Same ASID, same tables: nothing to do
+    f.SetSatp(PagingMode::Sv39, 2, 0x200);
+    CHECK(f.Hits(0x7000));
+    CHECK_EQ(f.cache->epoch, epoch);
+
+    f.SetSatp(PagingMode::Sv39, 2, 0x300);
+    CHECK(!f.Hits(0x7000));
+    f.SetSatp(PagingMode::Sv39, 1, 0x100);
+    CHECK(!f.Hits(0x5000));
+    CHECK_EQ(f.cache->epoch, epoch + 1);
+
+    f.Fill(0x5000, 1);
+    f.SetSatp(PagingMode::Sv48, 1, 0x100);
+    CHECK(!f.Hits(0x5000));
+    CHECK_EQ(f.cache->epoch, epoch + 2);
+
+    // Bare under a reused ASID is told apart by the mode
+    f.Fill(0x5000, 1);
+    f.SetSatp(PagingMode::Sv48, 3, 0x100);
+    f.SetSatp(PagingMode::Bare, 1, 0);
+    CHECK(!f.Hits(0x5000));
+}
+
+// SFENCE.VMA with an address drops that page in every table; any other
+// fence, mstatus translation bits and PMP writes drop everything
+void TestInvalidationHooks() {
+    fixture f;
+    f.Fill(0x5000, 1);
+    f.Fill(0x6000, 2);
+    f.cache->Insert(0x5000, Store, PrivilegeMode::Supervisor, Writable, &f.host[PageSize]);
+    f.cache->OnFence(true, 0x5123);
+    CHECK(!f.Hits(0x5000));
+    CHECK(f.cache->Lookup<Store>(0x5000, 4, PrivilegeMode::Supervisor) == nullptr);
+    CHECK(f.Hits(0x6000));
+    f.cache->OnFence(false, 0);
+    CHECK(!f.Hits(0x6000));
+
+    mstatusReg before;
+    before.Reset<__uint64_t>();
+    mstatusReg after = before;
+    after.MIE(true);
+    after.FS(FloatingPointState::Dirty);
+    f.Fill(0x6000, 2);
+    f.cache->OnMstatusWrite(before, after);
+    CHECK(f.Hits(0x6000));
+    after.SUM(true);
+    f.cache->OnMstatusWrite(before, after);
+    CHECK(!f.Hits(0x6000));
+
+    f.Fill(0x6000, 2);
+    f.cache->OnPmpWrite();
+    CHECK(!f.Hits(0x6000));
+}
+
+int main() {
+    TestHits();
+    TestSatpWrites();
+    TestInvalidationHooks();
+    return CHECK_RESULT();
+}
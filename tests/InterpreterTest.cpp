@@ -0,0 +1,242 @@
+#include "Interpreter.hpp"
+
+#include "Check.hpp"
+#include "GuestProgram.hpp"
+
+#include <cfenv>
+#include <memory>
+
+using namespace RISCV;
+
+template<typename XLEN_t>
+struct machine {
+
+    flatMemory memory;
+    std::unique_ptr<HartState<XLEN_t>> hart;
+    std::unique_ptr<interpreter<XLEN_t, flatMemory>> cpu;
+
+    explicit machine(const guestProgram& program) {
+        program.Load(memory);
+        hart = std::make_unique<HartState<XLEN_t>>(isaFeatures("rv64imacsu") & 0x3ffffff);
+        hart->Reset((XLEN_t)GuestBase);
+        cpu = std::make_unique<interpreter<XLEN_t, flatMemory>>(*hart, memory);
+        cpu->Reset();
+    }
+};
+
+// Stores -1 at each width and loads it back signed and unsigned
+template<typename XLEN_t>
+void TestSignedLoads() {
+    using namespace encode;
+    guestProgram program;
+    program << auipc(10, 0x1000)        // x10 = data
+            << addi(5, 0, -1)
+            << store(0, 10, 5, 0)       // sb
+            << store(1, 10, 5, 8)       // sh
+            << store(2, 10, 5, 16)      // sw
+            << addi(6, 0, 0x7f)
+            << store(0, 10, 6, 24)      // sb 0x7f
+            << load(0, 11, 10, 0)       // lb
+            << load(1, 12, 10, 8)       // lh
+            << load(2, 13, 10, 16)      // lw
+            << load(4, 14, 10, 0)       // lbu
+            << load(5, 15, 10, 8)       // lhu
+            << load(0, 16, 10, 24);     // lb of a positive byte
+    if constexpr (!std::is_same<XLEN_t, __uint32_t>())
+        program << load(6, 17, 10, 16); // lwu
+    program << jal(0, 0);
+
+    machine<XLEN_t> m(program);
+    m.cpu->Run(program.words.size());
+    const auto& x = m.hart->regs;
+    CHECK_EQ(x[11], (XLEN_t)-1);
+    CHECK_EQ(x[12], (XLEN_t)-1);
+    CHECK_EQ(x[13], (XLEN_t)-1);
+    CHECK_EQ(x[14], 0xff);
+    CHECK_EQ(x[15], 0xffff);
+    CHECK_EQ(x[16], 0x7f);
+    if constexpr (!std::is_same<XLEN_t, __uint32_t>())
+        CHECK_EQ(x[17], 0xffffffff);
+}
+
+// MRET from M with MIE clear down to U, with a machine timer interrupt
+// pending and enabled. It has to be taken as soon as U code runs.
+template<typename XLEN_t>
+void TestInterruptAfterMRet() {
+    using namespace encode;
+    guestProgram program;
+    program << auipc(5, 0)
+            << addi(6, 5, 64)
+            << csr(1, 0, 6, CSRAddress::MTVEC)     // handler at +64
+            << addi(6, 5, 96)
+            << csr(1, 0, 6, CSRAddress::MEPC)      // user code at +96
+            << lui(7, 0x2000)
+            << addi(7, 7, -0x800)
+            << csr(3, 0, 7, CSRAddress::MSTATUS)   // MPP = U
+            << addi(7, 0, 0x80)
+            << csr(1, 0, 7, CSRAddress::MIE)       // MTIE
+            << mret;
+    while (program.Here() < 96)
+        program << jal(0, 0);                       // +64: handler spins
+    program << addi(8, 8, 1) << jal(0, -4);         // +96: user code counts forever
+
+    machine<XLEN_t> m(program);
+    m.hart->control.mip.template Bit<mtiMask>(true);
+    m.hart->UpdateInterruptsPending();
+    CHECK_EQ(m.hart->interruptsPending, 0);         // MIE is clear in M
+    m.cpu->Run(100);
+    CHECK_EQ(m.hart->privilege, PrivilegeMode::Machine);
+    CHECK_EQ(m.hart->pc, GuestBase + 64);
+    CHECK_EQ(m.hart->control.traps.contexts[PrivilegeMode::Machine].cause.Read(),
+             ((XLEN_t)1 << (sizeof(XLEN_t) * 8 - 1)) | TrapCause::MACHINE_TIMER_INTERRUPT);
+}
+
+// M-mode software enables platform interrupt 20 through mie, which the
+// platform then raises in mip
+template<typename XLEN_t>
+void TestPlatformInterrupt() {
+    using namespace encode;
+    guestProgram program;
+    program << auipc(5, 0)
+            << addi(6, 5, 32)
+            << csr(1, 0, 6, CSRAddress::MTVEC)     // handler at +32
+            << lui(7, 0x100000)
+            << csr(2, 0, 7, CSRAddress::MIE)       // enable platform interrupt 20
+            << csr(6, 0, 8, CSRAddress::MSTATUS);  // csrsi mstatus, MIE
+    while (program.Here() < 32)
+        program << jal(0, 0);
+    program << jal(0, 0);                           // +32: handler spins
+
+    machine<XLEN_t> m(program);
+    m.hart->control.mip.bits |= (__uint64_t)1 << 20;
+    m.cpu->Run(20);
+    CHECK_EQ((m.hart->control.mie.template Read<XLEN_t, PrivilegeMode::Machine>()), (XLEN_t)1 << 20);
+    CHECK_EQ(m.hart->pc, GuestBase + 32);
+    CHECK_EQ(m.hart->control.traps.contexts[PrivilegeMode::Machine].cause.Read(),
+             ((XLEN_t)1 << (sizeof(XLEN_t) * 8 - 1)) | 20);
+
+    // Platform bits of mip stay out of reach of CSR writes
+    m.hart->control.mip.template Write<XLEN_t, PrivilegeMode::Machine>(0);
+    CHECK_EQ((m.hart->control.mip.template Read<XLEN_t, PrivilegeMode::Machine>()), (XLEN_t)1 << 20);
+}
+
+template<typename XLEN_t>
+void TestEcallFromMachine() {
+    using namespace encode;
+    guestProgram program;
+    program << auipc(5, 0)
+            << addi(6, 5, 16)
+            << csr(1, 0, 6, CSRAddress::MTVEC)
+            << ecall
+            << jal(0, 0);                           // +16: handler spins
+
+    machine<XLEN_t> m(program);
+    m.cpu->Run(10);
+    CHECK_EQ(m.hart->pc, GuestBase + 16);
+    CHECK_EQ(m.hart->control.traps.contexts[PrivilegeMode::Machine].cause.Read(), TrapCause::ECALL_FROM_M_MODE);
+    CHECK_EQ(m.hart->control.traps.contexts[PrivilegeMode::Machine].epc, GuestBase + 12);
+}
+
+// With host flag accumulation on, flags the host FPU raised before a trap
+// are in fflags by the time the handler runs
+template<typename XLEN_t>
+void TestTrapSyncsHostFlags() {
+    using namespace encode;
+    guestProgram program;
+    program << auipc(5, 0)
+            << addi(6, 5, 16)
+            << csr(1, 0, 6, CSRAddress::MTVEC)
+            << ecall
+            << jal(0, 0);                           // +16: handler spins
+
+    machine<XLEN_t> m(program);
+    m.hart->control.fcsr.accumulateHostFlags = true;
+    std::feclearexcept(FE_ALL_EXCEPT);
+    std::feraiseexcept(FE_DIVBYZERO);
+    m.cpu->Run(10);
+    CHECK_EQ(m.hart->pc, GuestBase + 16);
+    CHECK_EQ(m.hart->control.fcsr.fflags, fcsrReg::dzMask);
+    CHECK_EQ(std::fetestexcept(FE_ALL_EXCEPT), 0);
+}
+
+// A 32-bit instruction whose upper half would sit past the end of memory.
+// The fetch fault reports the address of that half in mtval, with mepc
+// still at the instruction.
+template<typename XLEN_t>
+void TestStraddlerFaultAddress() {
+    using namespace encode;
+    guestProgram program;
+    program << auipc(5, 0)
+            << addi(6, 5, 16)
+            << csr(1, 0, 6, CSRAddress::MTVEC)
+            << jal(0, 0);                           // patched below
+    program << jal(0, 0);                           // +16: handler spins
+
+    machine<XLEN_t> m(program);
+    const __uint64_t last = GuestBase + m.memory.bytes.size() - 2;
+    m.memory.Write(GuestBase + 12, jal(0, (__int32_t)(last - (GuestBase + 12))));
+    m.memory.Write(last, (__uint16_t)0x0013);       // low half of addi x0, x0, 0
+    m.cpu->Run(10);
+    auto& context = m.hart->control.traps.contexts[PrivilegeMode::Machine];
+    CHECK_EQ(m.hart->pc, GuestBase + 16);
+    CHECK_EQ(context.cause.Read(), TrapCause::INSTRUCTION_ACCESS_FAULT);
+    CHECK_EQ(context.epc, (XLEN_t)last);
+    CHECK_EQ(context.tval, (XLEN_t)(last + 2));
+}
+
+// mhpmcounter3 and 4 count loads and taken branches, selected from M-mode
+template<typename XLEN_t>
+void TestEventCounters() {
+    using namespace encode;
+    guestProgram program;
+    program << auipc(10, 0x1000)
+            << addi(5, 0, (__int32_t)PerformanceEvent::LoadsRetired)
+            << csr(1, 0, 5, CSRAddress::MHPMEVENT3)
+            << addi(5, 0, (__int32_t)PerformanceEvent::BranchesTaken)
+            << csr(1, 0, 5, CSRAddress::MHPMEVENT4)
+            << load(2, 6, 10, 0)
+            << load(2, 6, 10, 4)
+            << addi(8, 0, 3)
+            << addi(8, 8, -1)                       // +32: three loads, two taken branches
+            << load(0, 6, 10, 8)
+            << branch(1, 8, 0, -8)
+            << csr(2, 11, 0, CSRAddress::MHPMCOUNTER3)
+            << csr(2, 12, 0, CSRAddress::MHPMCOUNTER4)
+            << jal(0, 0);
+
+    machine<XLEN_t> m(program);
+    m.cpu->Run(100);
+    CHECK_EQ(m.hart->regs[11], 5);
+    CHECK_EQ(m.hart->regs[12], 2);
+    CHECK_EQ(m.cpu->counters.tallies[(unsigned int)PerformanceEvent::BranchesRetired], 3);
+}
+
+// Zeroed memory is all illegal instructions, and mtvec resets to an
+// unmapped address, so every step is a trap. Run still has to return.
+template<typename XLEN_t>
+void TestTrapLoopTerminates() {
+    machine<XLEN_t> m(guestProgram{});
+    CHECK_EQ(m.cpu->Run(1), 0);
+    CHECK_EQ(m.cpu->Run(1000), 0);
+    CHECK_EQ(m.cpu->trapsTaken, 1001);
+}
+
+int main() {
+    TestSignedLoads<__uint32_t>();
+    TestSignedLoads<__uint64_t>();
+    TestInterruptAfterMRet<__uint32_t>();
+    TestInterruptAfterMRet<__uint64_t>();
+    TestPlatformInterrupt<__uint32_t>();
+    TestPlatformInterrupt<__uint64_t>();
+    TestEcallFromMachine<__uint32_t>();
+    TestEcallFromMachine<__uint64_t>();
+    TestTrapSyncsHostFlags<__uint32_t>();
+    TestTrapSyncsHostFlags<__uint64_t>();
+    TestStraddlerFaultAddress<__uint32_t>();
+    TestStraddlerFaultAddress<__uint64_t>();
+    TestEventCounters<__uint32_t>();
+    TestEventCounters<__uint64_t>();
+    TestTrapLoopTerminates<__uint32_t>();
+    TestTrapLoopTerminates<__uint64_t>();
+    return CHECK_RESULT();
+}
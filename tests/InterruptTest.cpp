@@ -0,0 +1,121 @@
+#include "RiscV.hpp"
+
+#include "Check.hpp"
+
+#include <random>
+
+using namespace RISCV;
+
+// The spec's priority order, highest first, written out independently of
+// interruptPriorityOrder
+constexpr TrapCause specOrder[] = {
+    TrapCause::MACHINE_EXTERNAL_INTERRUPT,
+    TrapCause::MACHINE_SOFTWARE_INTERRUPT,
+    TrapCause::MACHINE_TIMER_INTERRUPT,
+    TrapCause::SUPERVISOR_EXTERNAL_INTERRUPT,
+    TrapCause::SUPERVISOR_SOFTWARE_INTERRUPT,
+    TrapCause::SUPERVISOR_TIMER_INTERRUPT,
+    TrapCause::USER_EXTERNAL_INTERRUPT,
+    TrapCause::USER_SOFTWARE_INTERRUPT,
+    TrapCause::USER_TIMER_INTERRUPT,
+};
+
+TrapCause ReferencePick(unsigned int pending) {
+    for (TrapCause cause : specOrder) {
+        if (pending & (1u << cause))
+            return cause;
+    }
+    return TrapCause::NONE;
+}
+
+// Every combination of the standard bits, with the reserved bits 2, 6 and
+// 10 set or not, picks what a walk down the spec order picks
+template<typename XLEN_t>
+void TestStandardPriority() {
+    CHECK_EQ(highestPriorityInterrupt<XLEN_t>(0), TrapCause::NONE);
+    for (unsigned int pending = 0; pending < (1u << 12); pending++)
+        CHECK_EQ(highestPriorityInterrupt<XLEN_t>(pending), ReferencePick(pending));
+}
+
+// The rank table sets, for each nibble value, exactly the ranks of the
+// causes whose bits it holds
+void TestRankTable() {
+    CHECK_EQ(interruptPriorityOrder[0], TrapCause::NONE);
+    for (unsigned int rank = 1; rank < interruptPriorityOrder.size(); rank++)
+        CHECK_EQ(interruptPriorityOrder[rank], specOrder[interruptPriorityOrder.size() - 1 - rank]);
+    for (unsigned int index = 0; index < interruptRankTable.size(); index++) {
+        unsigned int pending = (index & 0xf) << ((index >> 4) * 4);
+        __uint16_t expected = 0;
+        for (unsigned int rank = 1; rank < interruptPriorityOrder.size(); rank++) {
+            if (pending & (1u << interruptPriorityOrder[rank]))
+                expected |= 1 << rank;
+        }
+        CHECK_EQ(interruptRankTable[index], expected);
+    }
+}
+
+// Platform interrupts outrank MEI, the highest numbered first
+void TestPlatformInterrupts() {
+    CHECK_EQ(highestPriorityInterrupt<__uint64_t>(meiMask | (1ull << 16)), 16);
+    CHECK_EQ(highestPriorityInterrupt<__uint64_t>((1ull << 16) | (1ull << 40)), 40);
+    CHECK_EQ(highestPriorityInterrupt<__uint64_t>(1ull << 63), 63);
+    CHECK_EQ(highestPriorityInterrupt<__uint32_t>(meiMask | (1u << 31) | (1u << 17)), 31);
+
+    std::mt19937_64 random(5);
+    for (unsigned int i = 0; i < 1000; i++) {
+        __uint64_t pending = random() & random();
+        __uint64_t platform = pending >> 16;
+        if (platform)
+            CHECK_EQ(highestPriorityInterrupt<__uint64_t>(pending), 16 + 63 - __builtin_clzll(platform));
+        else
+            CHECK_EQ(highestPriorityInterrupt<__uint64_t>(pending), ReferencePick(pending));
+    }
+}
+
+// Each view reads and writes its own level's bits and those below; the
+// platform bits are machine-only, and CSR-writable in mie but not in mip
+template<typename reg_t>
+void TestViews(bool platformWritable) {
+    reg_t reg;
+    reg.Reset();
+    reg.template Write<__uint64_t, PrivilegeMode::User>(~(__uint64_t)0);
+    CHECK_EQ(reg.bits, usiMask | utiMask | ueiMask);
+    reg.template Write<__uint64_t, PrivilegeMode::Supervisor>(~(__uint64_t)0);
+    CHECK_EQ(reg.bits, reg_t::supervisorMask);
+    CHECK(reg.SEI());
+    CHECK(!reg.MEI());
+
+    reg.template Write<__uint64_t, PrivilegeMode::Machine>(~(__uint64_t)0);
+    CHECK_EQ(reg.bits, platformWritable ? (reg_t::machineMask | reg_t::platformMask) : reg_t::machineMask);
+    CHECK(reg.MEI());
+    CHECK(reg.MTI());
+
+    // The platform sets its bits directly; only the machine view sees them
+    reg.bits |= 1ull << 20;
+    CHECK_EQ((reg.template Read<__uint64_t, PrivilegeMode::Machine>() & (1ull << 20)), 1ull << 20);
+    CHECK_EQ((reg.template Read<__uint64_t, PrivilegeMode::Supervisor>()), reg_t::supervisorMask);
+    CHECK_EQ((reg.template Read<__uint32_t, PrivilegeMode::User>()), usiMask | utiMask | ueiMask);
+
+    // Lower views leave higher bits alone
+    reg.template Write<__uint64_t, PrivilegeMode::Supervisor>(0);
+    CHECK_EQ(reg.bits & reg_t::supervisorMask, 0);
+    CHECK(reg.MSI());
+    CHECK_EQ(reg.bits & (1ull << 20), 1ull << 20);
+    reg.template Write<__uint64_t, PrivilegeMode::Machine>(0);
+    CHECK_EQ(reg.bits, platformWritable ? 0 : (1ull << 20));
+
+    reg.STI(true);
+    CHECK_EQ(reg.bits & ~reg_t::platformMask, stiMask);
+    reg.STI(false);
+    CHECK(!reg.STI());
+}
+
+int main() {
+    TestStandardPriority<__uint32_t>();
+    TestStandardPriority<__uint64_t>();
+    TestRankTable();
+    TestPlatformInterrupts();
+    TestViews<interruptPendingReg>(false);
+    TestViews<interruptEnableReg>(true);
+    return CHECK_RESULT();
+}
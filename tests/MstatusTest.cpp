@@ -0,0 +1,138 @@
+#include "RiscV.hpp"
+
+#include "Check.hpp"
+
+#include <array>
+#include <random>
+#include <type_traits>
+
+using namespace RISCV;
+
+// CMake builds this test a second time with RISCV_PACKED_MSTATUS, along with
+// the interpreter test, so both choices of mstatusReg are exercised
+#if defined(RISCV_PACKED_MSTATUS)
+static_assert(std::is_same<mstatusReg, mstatusPackedReg>());
+#else
+static_assert(std::is_same<mstatusReg, mstatusUnpackedReg>());
+#endif
+
+template<typename reg_t>
+std::array<__uint64_t, 19> Fields(const reg_t& reg) {
+    return {
+        reg.UIE(), reg.SIE(), reg.MIE(), reg.UPIE(), reg.SPIE(), reg.MPIE(),
+        (__uint64_t)reg.SPP(), (__uint64_t)reg.MPP(), (__uint64_t)reg.FS(), (__uint64_t)reg.XS(),
+        reg.MPRV(), reg.SUM(), reg.MXR(), reg.TVM(), reg.TW(), reg.TSR(),
+        (__uint64_t)reg.SXL(), (__uint64_t)reg.UXL(), reg.SD() };
+}
+
+struct mstatusPair {
+    mstatusUnpackedReg unpacked;
+    mstatusPackedReg packed;
+
+    template<typename XLEN_t>
+    void Reset() {
+        unpacked.Reset<XLEN_t>();
+        packed.Reset<XLEN_t>();
+    }
+
+    template<typename XLEN_t, PrivilegeMode view>
+    void Write(XLEN_t value) {
+        unpacked.Write<XLEN_t, view>(value);
+        packed.Write<XLEN_t, view>(value);
+    }
+
+    // Every view reads the same, and so does every accessor
+    template<typename XLEN_t>
+    bool Agree() {
+        return unpacked.Read<XLEN_t, PrivilegeMode::User>() == packed.Read<XLEN_t, PrivilegeMode::User>() &&
+               unpacked.Read<XLEN_t, PrivilegeMode::Supervisor>() == packed.Read<XLEN_t, PrivilegeMode::Supervisor>() &&
+               unpacked.Read<XLEN_t, PrivilegeMode::Machine>() == packed.Read<XLEN_t, PrivilegeMode::Machine>() &&
+               Fields(unpacked) == Fields(packed);
+    }
+};
+
+// Random writes through random views, with the field widths the spec
+// gives; MPP and SPP are WARL and hold whatever was written
+template<typename XLEN_t>
+void TestRandomWrites() {
+    std::mt19937_64 random(4);
+    mstatusPair pair;
+    pair.Reset<XLEN_t>();
+    CHECK(pair.Agree<XLEN_t>());
+    CHECK_EQ(pair.packed.SPP(), PrivilegeMode::User);
+    for (unsigned int i = 0; i < 10000; i++) {
+        XLEN_t value = random();
+        if constexpr (!std::is_same<XLEN_t, __uint32_t>()) {
+            // UXL and SXL are WARL; keep them legal
+            value &= ~(mstatusLayout::uxlMask | mstatusLayout::sxlMask);
+            value |= (__uint64_t)XlenMode::XL64 << mstatusLayout::uxlShift;
+            value |= (__uint64_t)XlenMode::XL32 << mstatusLayout::sxlShift;
+        }
+        switch (random() % 3) {
+        case 0: pair.Write<XLEN_t, PrivilegeMode::User>(value); break;
+        case 1: pair.Write<XLEN_t, PrivilegeMode::Supervisor>(value); break;
+        default: pair.Write<XLEN_t, PrivilegeMode::Machine>(value); break;
+        }
+        CHECK(pair.Agree<XLEN_t>());
+    }
+}
+
+// Views hide the fields above them, and RV32 moves SD to bit 31
+template<typename XLEN_t>
+void TestViews() {
+    constexpr XLEN_t sd = std::is_same<XLEN_t, __uint32_t>() ? (XLEN_t)mstatusLayout::sdMask32
+                                                                : (XLEN_t)mstatusLayout::sdMask64;
+    mstatusPair pair;
+    pair.Reset<XLEN_t>();
+    pair.Write<XLEN_t, PrivilegeMode::Machine>(sd | mstatusLayout::mieMask | mstatusLayout::sieMask | mstatusLayout::uieMask);
+    CHECK(pair.Agree<XLEN_t>());
+    CHECK(pair.packed.SD());
+    CHECK(pair.unpacked.SD());
+    CHECK_EQ((pair.packed.Read<XLEN_t, PrivilegeMode::Supervisor>()), sd | mstatusLayout::sieMask | mstatusLayout::uieMask);
+    CHECK_EQ((pair.packed.Read<XLEN_t, PrivilegeMode::User>()), mstatusLayout::uieMask);
+    if constexpr (std::is_same<XLEN_t, __uint32_t>()) {
+        CHECK_EQ(pair.packed.bits & 0xffffffff, mstatusLayout::mieMask | mstatusLayout::sieMask | mstatusLayout::uieMask);
+        CHECK_EQ(pair.packed.SXL(), XlenMode::XL32);
+        CHECK_EQ(pair.packed.UXL(), XlenMode::XL32);
+    }
+
+    // A supervisor write leaves the machine fields alone
+    pair.Write<XLEN_t, PrivilegeMode::Supervisor>(mstatusLayout::mieMask | mstatusLayout::sumMask);
+    CHECK(pair.Agree<XLEN_t>());
+    CHECK(pair.packed.MIE());
+    CHECK(!pair.packed.SD());
+    CHECK(!pair.packed.SIE());
+    CHECK(pair.packed.SUM());
+
+    // and a user write leaves everything but UIE and UPIE
+    pair.Write<XLEN_t, PrivilegeMode::User>(~(XLEN_t)0);
+    CHECK(pair.Agree<XLEN_t>());
+    CHECK(pair.packed.UPIE());
+    CHECK(!pair.packed.SPIE());
+}
+
+// The field setters land where the views read them
+void TestSetters() {
+    mstatusPair pair;
+    pair.Reset<__uint64_t>();
+    pair.unpacked.MPP(PrivilegeMode::Supervisor);
+    pair.packed.MPP(PrivilegeMode::Supervisor);
+    pair.unpacked.FS(FloatingPointState::Dirty);
+    pair.packed.FS(FloatingPointState::Dirty);
+    pair.unpacked.SD(true);
+    pair.packed.SD(true);
+    pair.unpacked.TSR(true);
+    pair.packed.TSR(true);
+    CHECK(pair.Agree<__uint64_t>());
+    CHECK(pair.Agree<__uint32_t>());
+    CHECK_EQ((pair.packed.Read<__uint32_t, PrivilegeMode::Supervisor>() & mstatusLayout::sdMask32), mstatusLayout::sdMask32);
+}
+
+int main() {
+    TestRandomWrites<__uint32_t>();
+    TestRandomWrites<__uint64_t>();
+    TestViews<__uint32_t>();
+    TestViews<__uint64_t>();
+    TestSetters();
+    return CHECK_RESULT();
+}
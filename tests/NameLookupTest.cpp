@@ -0,0 +1,45 @@
+#include "NameLookup.hpp"
+
+#include "Check.hpp"
+
+#include <string>
+
+using namespace RISCV;
+
+// Every name in each set finds its own value
+void TestFullSets() {
+    for (const auto& entry : detail::getCSRNameEntries())
+        CHECK_EQ(csrAddressFromName(entry.name), entry.value);
+    for (const auto& entry : detail::getRegisterNameEntries())
+        CHECK_EQ(regNumFromName(entry.name), entry.value);
+    for (const auto& entry : detail::getTrapNameEntries()) {
+        trapIdentity trap = trapFromName(entry.name);
+        CHECK_EQ(trap.cause, entry.value.cause);
+        CHECK_EQ(trap.interrupt, entry.value.interrupt);
+    }
+}
+
+// Prefixes, extensions, case changes and the empty name all miss
+void TestMisses() {
+    CHECK_EQ(csrAddressFromName(""), CSRAddress::INVALID_CSR);
+    CHECK_EQ(csrAddressFromName("mstatu"), CSRAddress::INVALID_CSR);
+    CHECK_EQ(csrAddressFromName("mstatuss"), CSRAddress::INVALID_CSR);
+    CHECK_EQ(csrAddressFromName("MSTATUS"), CSRAddress::INVALID_CSR);
+    CHECK_EQ(csrAddressFromName(std::string("mstatus\0", 8)), CSRAddress::INVALID_CSR);
+    CHECK_EQ(regNumFromName(""), NumRegs);
+    CHECK_EQ(regNumFromName("x32"), NumRegs);
+    CHECK_EQ(regNumFromName("a"), NumRegs);
+    CHECK(trapFromName("Supervisor software interrupt ").cause == TrapCause::NONE);
+    CHECK(trapFromName("Illegal instructio").cause == TrapCause::NONE);
+}
+
+// Lookups work at compile time too
+static_assert(csrAddressFromName("satp") == CSRAddress::SATP);
+static_assert(regNumFromName("fp") == 8);
+static_assert(regNumFromName("x31") == 31);
+
+int main() {
+    TestFullSets();
+    TestMisses();
+    return CHECK_RESULT();
+}
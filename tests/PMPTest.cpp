@@ -0,0 +1,233 @@
+#include "PMP.hpp"
+
+#include "Check.hpp"
+
+using namespace RISCV;
+
+constexpr __uint8_t Rd = pmpReadMask;
+constexpr __uint8_t Wr = pmpWriteMask;
+constexpr __uint8_t Ex = pmpExecuteMask;
+constexpr __uint8_t Lk = pmpLockedMask;
+
+constexpr __uint8_t Config(pmpAddressMode mode, __uint8_t bits) {
+    return (mode << pmpAddressModeShift) | bits;
+}
+
+// pmpaddr for a naturally aligned power-of-two region of at least 8 bytes
+constexpr __uint64_t Napot(__uint64_t base, __uint64_t size) {
+    return (base | (size / 2 - 1)) >> 2;
+}
+
+// Sets one entry's config byte through its pmpcfg register
+template<typename XLEN_t>
+void SetConfig(pmpUnit<XLEN_t>& pmp, unsigned int entryNumber, __uint8_t value) {
+    constexpr unsigned int perRegister = sizeof(XLEN_t);
+    const unsigned int configNumber = entryNumber / perRegister * (perRegister / 4);
+    const unsigned int shift = 8 * (entryNumber % perRegister);
+    XLEN_t config = pmp.ReadConfig(configNumber);
+    config = (config & ~((XLEN_t)0xff << shift)) | ((XLEN_t)value << shift);
+    pmp.WriteConfig(configNumber, config);
+}
+
+template<typename XLEN_t>
+bool Allowed(pmpUnit<XLEN_t>& pmp, __uint64_t address, unsigned int size, AccessType type,
+             PrivilegeMode privilege = PrivilegeMode::User) {
+    return pmp.Check(address, size, type, privilege);
+}
+
+// With nothing configured M-mode may do anything and lower modes nothing
+template<typename XLEN_t>
+void TestDefaults() {
+    pmpUnit<XLEN_t> pmp;
+    pmp.Reset();
+    for (AccessType type : { Fetch, Load, Store }) {
+        CHECK(Allowed(pmp, 0x80000000, 4, type, PrivilegeMode::Machine));
+        CHECK(!Allowed(pmp, 0x80000000, 4, type, PrivilegeMode::Supervisor));
+        CHECK(!Allowed(pmp, 0x80000000, 4, type));
+    }
+    CHECK(Allowed(pmp, ~(__uint64_t)7, 8, Load, PrivilegeMode::Machine));
+    CHECK(!Allowed(pmp, ~(__uint64_t)3, 8, Load, PrivilegeMode::Machine));    // wraps
+}
+
+// TOR entries take the previous pmpaddr as their base, entry 0 from zero,
+// and lower-numbered entries win where regions overlap
+template<typename XLEN_t>
+void TestTorAndNapot() {
+    pmpUnit<XLEN_t> pmp;
+    pmp.Reset();
+    pmp.WriteAddress(0, 0x1000 >> 2);
+    SetConfig(pmp, 0, Config(pmpAddressMode::TOR, Rd));
+    pmp.WriteAddress(1, 0x3000 >> 2);
+    SetConfig(pmp, 1, Config(pmpAddressMode::TOR, Rd | Wr | Ex));
+    pmp.WriteAddress(2, Napot(0x80000000, 0x10000));
+    SetConfig(pmp, 2, Config(pmpAddressMode::NAPOT, Rd | Ex));
+    pmp.WriteAddress(3, Napot(0x80008000, 0x8));
+    SetConfig(pmp, 3, Config(pmpAddressMode::NAPOT, Rd | Wr));
+    pmp.WriteAddress(4, 0x90000000 >> 2);
+    SetConfig(pmp, 4, Config(pmpAddressMode::NA4, Wr | Rd));
+
+    CHECK(Allowed(pmp, 0, 8, Load));
+    CHECK(!Allowed(pmp, 0, 8, Store));
+    CHECK(Allowed(pmp, 0xff8, 8, Load));
+    CHECK(Allowed(pmp, 0x1000, 8, Store));
+    CHECK(Allowed(pmp, 0x2ffc, 4, Fetch));
+    CHECK(!Allowed(pmp, 0x3000, 4, Load));
+
+    CHECK(Allowed(pmp, 0x80000000, 4, Fetch));
+    CHECK(Allowed(pmp, 0x8000fffc, 4, Load));
+    CHECK(!Allowed(pmp, 0x80000000, 4, Store));
+    CHECK(!Allowed(pmp, 0x80010000, 4, Load));
+    CHECK(!Allowed(pmp, 0x7ffffffc, 4, Load));
+    // Entry 3 sits inside entry 2, which outranks it
+    CHECK(!Allowed(pmp, 0x80008000, 4, Store));
+
+    CHECK(Allowed(pmp, 0x90000000, 4, Store));
+    CHECK(!Allowed(pmp, 0x90000004, 4, Store));
+
+    // Unlocked entries do not bind M-mode
+    CHECK(Allowed(pmp, 0, 8, Store, PrivilegeMode::Machine));
+    CHECK(Allowed(pmp, 0x80000000, 4, Store, PrivilegeMode::Machine));
+
+    // A TOR entry whose top is not above its base matches nothing
+    pmp.WriteAddress(5, 0x88000000 >> 2);
+    SetConfig(pmp, 5, Config(pmpAddressMode::TOR, Rd));
+    CHECK(!Allowed(pmp, 0x8c000000, 4, Load));
+}
+
+// An access that only partly matches an entry fails, in any mode
+template<typename XLEN_t>
+void TestStraddle() {
+    pmpUnit<XLEN_t> pmp;
+    pmp.Reset();
+    pmp.WriteAddress(0, 0x1000 >> 2);
+    SetConfig(pmp, 0, Config(pmpAddressMode::TOR, Rd | Wr));
+    pmp.WriteAddress(1, 0x2000 >> 2);
+    SetConfig(pmp, 1, Config(pmpAddressMode::TOR, Rd | Wr));
+    CHECK(Allowed(pmp, 0xffc, 4, Load));
+    CHECK(!Allowed(pmp, 0xffc, 8, Load));
+    CHECK(!Allowed(pmp, 0xffc, 8, Load, PrivilegeMode::Machine));
+    CHECK(!Allowed(pmp, 0x1ffc, 8, Load, PrivilegeMode::Machine));
+    CHECK(Allowed(pmp, 0x1ff8, 8, Store));
+    // Checks in either order give the same answers
+    CHECK(!Allowed(pmp, 0xffc, 8, Load));
+    CHECK(Allowed(pmp, 0xff8, 8, Load));
+}
+
+// Locked entries bind M-mode and ignore writes to their config and address.
+// A locked TOR entry also locks the address register below it.
+template<typename XLEN_t>
+void TestLocking() {
+    pmpUnit<XLEN_t> pmp;
+    pmp.Reset();
+    pmp.WriteAddress(0, 0x1000 >> 2);
+    SetConfig(pmp, 0, Config(pmpAddressMode::TOR, Rd));
+    pmp.WriteAddress(1, 0x2000 >> 2);
+    SetConfig(pmp, 1, Config(pmpAddressMode::TOR, Rd | Ex | Lk));
+    pmp.WriteAddress(2, Napot(0x4000, 0x1000));
+    SetConfig(pmp, 2, Config(pmpAddressMode::NAPOT, Rd | Lk));
+
+    CHECK(Allowed(pmp, 0x1000, 4, Load, PrivilegeMode::Machine));
+    CHECK(Allowed(pmp, 0x1000, 4, Fetch, PrivilegeMode::Machine));
+    CHECK(!Allowed(pmp, 0x1000, 4, Store, PrivilegeMode::Machine));
+    CHECK(!Allowed(pmp, 0x4000, 4, Fetch, PrivilegeMode::Machine));
+    CHECK(Allowed(pmp, 0, 4, Store, PrivilegeMode::Machine));
+
+    const XLEN_t config = pmp.ReadConfig(0);
+    SetConfig(pmp, 1, Config(pmpAddressMode::TOR, Rd | Wr | Ex));
+    SetConfig(pmp, 2, Config(pmpAddressMode::OFF, 0));
+    CHECK_EQ(pmp.ReadConfig(0), config);
+    pmp.WriteAddress(1, 0x3000 >> 2);
+    pmp.WriteAddress(2, Napot(0x8000, 0x1000));
+    CHECK_EQ(pmp.ReadAddress(1), 0x2000 >> 2);
+    CHECK_EQ(pmp.ReadAddress(2), Napot(0x4000, 0x1000));
+
+    // Entry 0's address is entry 1's base, so it is locked too, while its
+    // config is not
+    pmp.WriteAddress(0, 0x800 >> 2);
+    CHECK_EQ(pmp.ReadAddress(0), 0x1000 >> 2);
+    SetConfig(pmp, 0, Config(pmpAddressMode::TOR, Rd | Wr));
+    CHECK(Allowed(pmp, 0, 4, Store));
+
+    // Below a locked NA4 entry, addresses stay writable
+    pmp.WriteAddress(4, 0x5000 >> 2);
+    SetConfig(pmp, 4, Config(pmpAddressMode::NA4, Rd | Lk));
+    pmp.WriteAddress(3, 0x6000 >> 2);
+    CHECK_EQ(pmp.ReadAddress(3), 0x6000 >> 2);
+
+    // Reset clears locks
+    pmp.Reset();
+    pmp.WriteAddress(1, 0x3000 >> 2);
+    CHECK_EQ(pmp.ReadAddress(1), 0x3000 >> 2);
+}
+
+// W without R is reserved; it reads back, and behaves, with W clear
+template<typename XLEN_t>
+void TestWriteWithoutRead() {
+    pmpUnit<XLEN_t> pmp;
+    pmp.Reset();
+    pmp.WriteAddress(0, Napot(0x2000, 0x1000));
+    SetConfig(pmp, 0, Config(pmpAddressMode::NAPOT, Wr | Ex));
+    CHECK_EQ(pmp.ReadConfig(0) & 0xff, Config(pmpAddressMode::NAPOT, Ex));
+    CHECK(!Allowed(pmp, 0x2000, 4, Store));
+    CHECK(!Allowed(pmp, 0x2000, 4, Load));
+    CHECK(Allowed(pmp, 0x2000, 4, Fetch));
+    SetConfig(pmp, 0, Config(pmpAddressMode::NAPOT, Rd | Wr));
+    CHECK_EQ(pmp.ReadConfig(0) & 0xff, Config(pmpAddressMode::NAPOT, Rd | Wr));
+    CHECK(Allowed(pmp, 0x2000, 4, Store));
+}
+
+// RV32 packs four entries into each of pmpcfg0..3. RV64 packs eight into
+// pmpcfg0 and pmpcfg2; the odd registers do not exist.
+void TestConfigNumbering() {
+    pmpUnit<__uint32_t> pmp32;
+    pmp32.Reset();
+    pmp32.WriteConfig(1, 0x19181b1d);
+    CHECK_EQ(pmp32.ReadConfig(0), 0);
+    CHECK_EQ(pmp32.ReadConfig(1), 0x19181b1d);
+    pmp32.WriteConfig(3, 0x0f000000);
+    CHECK_EQ(pmp32.ReadConfig(3), 0x0f000000);
+    CHECK_EQ(pmp32.entries[4].aMode, pmpAddressMode::NAPOT);
+    CHECK_EQ(pmp32.entries[5].aMode, pmpAddressMode::NAPOT);
+    CHECK(pmp32.entries[5].w && pmp32.entries[5].r && !pmp32.entries[5].x);
+    CHECK_EQ(pmp32.entries[7].aMode, pmpAddressMode::NAPOT);
+    CHECK(pmp32.entries[15].x && pmp32.entries[15].aMode == pmpAddressMode::TOR);
+
+    // pmpaddr holds address bits 33:2 on RV32, so it reaches above 4 GiB
+    pmp32.WriteAddress(0, 0xffffffff);
+    CHECK_EQ(pmp32.ReadAddress(0), 0xffffffff);
+    pmp32.WriteAddress(7, Napot(0x100000000, 0x1000));
+    CHECK(Allowed(pmp32, 0x100000000, 4, Load));
+    CHECK(!Allowed(pmp32, 0x100001000, 4, Load));
+
+    pmpUnit<__uint64_t> pmp64;
+    pmp64.Reset();
+    pmp64.WriteConfig(1, 0x1f);
+    pmp64.WriteConfig(3, 0x1f);
+    CHECK_EQ(pmp64.ReadConfig(0), 0);
+    CHECK_EQ(pmp64.ReadConfig(1), 0);
+    CHECK_EQ(pmp64.ReadConfig(2), 0);
+    pmp64.WriteConfig(2, 0x0f00000000000019ull);
+    CHECK_EQ(pmp64.ReadConfig(2), 0x0f00000000000019ull);
+    CHECK_EQ(pmp64.ReadConfig(3), 0);
+    CHECK_EQ(pmp64.entries[8].aMode, pmpAddressMode::NAPOT);
+    CHECK(pmp64.entries[15].x && pmp64.entries[15].aMode == pmpAddressMode::TOR);
+
+    // and bits 55:2 on RV64
+    pmp64.WriteAddress(0, ~(__uint64_t)0);
+    CHECK_EQ(pmp64.ReadAddress(0), 0x003fffffffffffffull);
+}
+
+int main() {
+    TestDefaults<__uint32_t>();
+    TestDefaults<__uint64_t>();
+    TestTorAndNapot<__uint32_t>();
+    TestTorAndNapot<__uint64_t>();
+    TestStraddle<__uint32_t>();
+    TestStraddle<__uint64_t>();
+    TestLocking<__uint32_t>();
+    TestLocking<__uint64_t>();
+    TestWriteWithoutRead<__uint32_t>();
+    TestWriteWithoutRead<__uint64_t>();
+    TestConfigNumbering();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,241 @@
+#include "PageTableWalker.hpp"
+
+#include "Check.hpp"
+
+#include <cstring>
+#include <vector>
+
+using namespace RISCV;
+
+// Page tables live in the first few pages of physical memory. Leaves point
+// wherever they like; the walker never reads the data pages.
+struct tableMemory {
+
+    std::vector<__uint8_t> bytes = std::vector<__uint8_t>(8 * PageSize);
+    unsigned int writes = 0;
+
+    template<typename T>
+    bool Read(__uint64_t physicalAddress, T& value) {
+        value = 0;
+        if (physicalAddress + sizeof(T) > bytes.size())
+            return false;
+        std::memcpy(&value, &bytes[physicalAddress], sizeof(T));
+        return true;
+    }
+
+    template<typename T>
+    bool Write(__uint64_t physicalAddress, T value) {
+        if (physicalAddress + sizeof(T) > bytes.size())
+            return false;
+        std::memcpy(&bytes[physicalAddress], &value, sizeof(T));
+        writes++;
+        return true;
+    }
+};
+
+constexpr __uint64_t RootPpn = 1;
+constexpr __uint8_t Leaf = PTEBit::V | PTEBit::R | PTEBit::W | PTEBit::X | PTEBit::A | PTEBit::D;
+
+// Builds the path to virtualAddress with its leaf at the given level. The
+// table for level l sits in page RootPpn + (levels - 1 - l). Returns the
+// address of the leaf PTE.
+template<PagingMode mode>
+__uint64_t Map(tableMemory& memory, __uint64_t virtualAddress, unsigned int level, __uint64_t ppn, __uint8_t bits) {
+    using traits = pagingTraits<mode>;
+    using pte_t = typename traits::pte_t;
+    std::fill(memory.bytes.begin(), memory.bytes.end(), 0);
+    __uint64_t table = RootPpn;
+    for (int l = traits::levels - 1; ; l--) {
+        __uint64_t vpn = (virtualAddress >> (PageShift + l * traits::vpnBits)) & ((1u << traits::vpnBits) - 1);
+        __uint64_t pteAddress = (table << PageShift) + vpn * sizeof(pte_t);
+        if ((unsigned int)l == level) {
+            memory.Write(pteAddress, (pte_t)((ppn << 10) | bits));
+            memory.writes = 0;
+            return pteAddress;
+        }
+        table++;
+        memory.Write(pteAddress, (pte_t)((table << 10) | PTEBit::V));
+    }
+}
+
+template<typename XLEN_t, PagingMode mode, bool updateAccessedDirty = true>
+translationResult Walk(tableMemory& memory, __uint64_t virtualAddress, AccessType type,
+                       PrivilegeMode privilege = PrivilegeMode::Supervisor, bool sum = false, bool mxr = false) {
+    return pageTableWalker<XLEN_t, mode, updateAccessedDirty>::Walk(memory, RootPpn, (XLEN_t)virtualAddress,
+                                                                    type, privilege, sum, mxr);
+}
+
+// A leaf at each level maps a page of that level's size, aligned to it
+template<typename XLEN_t, PagingMode mode>
+void TestLeafAtEveryLevel() {
+    using traits = pagingTraits<mode>;
+    tableMemory memory;
+    for (unsigned int level = 0; level < traits::levels; level++) {
+        const unsigned int shift = PageShift + level * traits::vpnBits;
+        __uint64_t virtualAddress = 0x123;
+        for (unsigned int l = 0; l < traits::levels; l++)
+            virtualAddress |= (__uint64_t)(l + 1) << (PageShift + l * traits::vpnBits);
+        const __uint64_t physicalBase = (__uint64_t)5 << shift;
+        Map<mode>(memory, virtualAddress, level, physicalBase >> PageShift, Leaf);
+
+        translationResult result = Walk<XLEN_t, mode>(memory, virtualAddress, Load);
+        CHECK_EQ(result.cause, TrapCause::NONE);
+        CHECK_EQ(result.pageShift, shift);
+        CHECK_EQ(result.physicalAddress, physicalBase | (virtualAddress & (((__uint64_t)1 << shift) - 1)));
+        CHECK_EQ(result.pteBits, Leaf);
+        CHECK_EQ(memory.writes, 0);
+    }
+}
+
+// A superpage whose PPN is not aligned to its size faults, and a leaf with
+// W set and R clear faults at any level
+template<typename XLEN_t, PagingMode mode>
+void TestMalformedLeaves() {
+    using traits = pagingTraits<mode>;
+    tableMemory memory;
+    for (unsigned int level = 1; level < traits::levels; level++) {
+        Map<mode>(memory, 0, level, ((__uint64_t)5 << (level * traits::vpnBits)) | 1, Leaf);
+        CHECK_EQ((Walk<XLEN_t, mode>(memory, 0, Load).cause), TrapCause::LOAD_PAGE_FAULT);
+        CHECK_EQ((Walk<XLEN_t, mode>(memory, 0, Fetch).cause), TrapCause::INSTRUCTION_PAGE_FAULT);
+    }
+    for (unsigned int level = 0; level < traits::levels; level++) {
+        Map<mode>(memory, 0, level, 0, PTEBit::V | PTEBit::W | PTEBit::A | PTEBit::D);
+        CHECK_EQ((Walk<XLEN_t, mode>(memory, 0, Store).cause), TrapCause::STORE_AMO_PAGE_FAULT);
+        Map<mode>(memory, 0, level, 0, PTEBit::V | PTEBit::W | PTEBit::X | PTEBit::A | PTEBit::D);
+        CHECK_EQ((Walk<XLEN_t, mode>(memory, 0, Fetch).cause), TrapCause::INSTRUCTION_PAGE_FAULT);
+    }
+    // An invalid PTE, a pointer at the last level, and a table outside memory
+    Map<mode>(memory, 0, 0, 7, Leaf & ~PTEBit::V);
+    CHECK_EQ((Walk<XLEN_t, mode>(memory, 0, Load).cause), TrapCause::LOAD_PAGE_FAULT);
+    Map<mode>(memory, 0, 0, 7, PTEBit::V);
+    CHECK_EQ((Walk<XLEN_t, mode>(memory, 0, Load).cause), TrapCause::LOAD_PAGE_FAULT);
+    Map<mode>(memory, 0, 1, 0x1000, PTEBit::V);
+    CHECK_EQ((Walk<XLEN_t, mode>(memory, 0, Store).cause), TrapCause::STORE_AMO_ACCESS_FAULT);
+}
+
+// Bits above the VA width must copy the top VA bit
+template<PagingMode mode>
+void TestNonCanonical() {
+    using traits = pagingTraits<mode>;
+    tableMemory memory;
+    const __uint64_t top = (__uint64_t)1 << (traits::vaBits - 1);
+    const __uint64_t high = ~(top - 1);                     // top bit and everything above it
+    Map<mode>(memory, high, traits::levels - 1, 0, Leaf);
+    CHECK_EQ((Walk<__uint64_t, mode>(memory, high, Load).cause), TrapCause::NONE);
+    CHECK_EQ((Walk<__uint64_t, mode>(memory, high ^ ((__uint64_t)1 << 63), Load).cause), TrapCause::LOAD_PAGE_FAULT);
+    CHECK_EQ((Walk<__uint64_t, mode>(memory, top, Fetch).cause), TrapCause::INSTRUCTION_PAGE_FAULT);
+    CHECK_EQ((Walk<__uint64_t, mode>(memory, (__uint64_t)1 << traits::vaBits, Store).cause),
+             TrapCause::STORE_AMO_PAGE_FAULT);
+}
+
+// U pages need SUM for S-mode data access and are never executable from S;
+// U-mode cannot reach S pages. MXR makes execute-only pages loadable.
+void TestPrivilegeAndMXR() {
+    tableMemory memory;
+    Map<PagingMode::Sv39>(memory, 0, 0, 9, Leaf | PTEBit::U);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Load).cause), TrapCause::LOAD_PAGE_FAULT);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Load, PrivilegeMode::Supervisor, true).cause), TrapCause::NONE);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Store, PrivilegeMode::Supervisor, true).cause), TrapCause::NONE);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Fetch, PrivilegeMode::Supervisor, true).cause),
+             TrapCause::INSTRUCTION_PAGE_FAULT);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Fetch, PrivilegeMode::User).cause), TrapCause::NONE);
+
+    Map<PagingMode::Sv39>(memory, 0, 0, 9, Leaf);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Load, PrivilegeMode::User).cause), TrapCause::LOAD_PAGE_FAULT);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Fetch).cause), TrapCause::NONE);
+
+    const __uint8_t executeOnly = PTEBit::V | PTEBit::X | PTEBit::A;
+    Map<PagingMode::Sv39>(memory, 0, 0, 9, executeOnly);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Load).cause), TrapCause::LOAD_PAGE_FAULT);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Load, PrivilegeMode::Supervisor, false, true).cause),
+             TrapCause::NONE);
+    CHECK_EQ((Walk<__uint64_t, PagingMode::Sv39>(memory, 0, Store, PrivilegeMode::Supervisor, false, true).cause),
+             TrapCause::STORE_AMO_PAGE_FAULT);
+}
+
+// translate() maps M-mode identically unless MPRV puts its data accesses
+// under the MPP privilege. Fetches ignore MPRV.
+template<typename XLEN_t, PagingMode mode>
+void TestMPRV() {
+    tableMemory memory;
+    const XLEN_t virtualAddress = 0x3456;
+    Map<mode>(memory, virtualAddress, 0, 9, Leaf);
+    satpReg<XLEN_t> satp;
+    satp.Reset();
+    satp.pagingMode = mode;
+    satp.ppn = RootPpn;
+    mstatusReg mstatus;
+    mstatus.Reset<XLEN_t>();
+
+    auto translated = [&](PrivilegeMode privilege, AccessType type) {
+        return translate<XLEN_t>(memory, satp, mstatus, privilege, virtualAddress, type);
+    };
+    const __uint64_t mapped = (9 << PageShift) | 0x456;
+    CHECK_EQ(translated(PrivilegeMode::Machine, Load).physicalAddress, virtualAddress);
+    CHECK_EQ(translated(PrivilegeMode::Supervisor, Load).physicalAddress, mapped);
+
+    mstatus.MPRV(true);
+    mstatus.MPP(PrivilegeMode::Supervisor);
+    CHECK_EQ(translated(PrivilegeMode::Machine, Load).physicalAddress, mapped);
+    CHECK_EQ(translated(PrivilegeMode::Machine, Store).physicalAddress, mapped);
+    CHECK_EQ(translated(PrivilegeMode::Machine, Fetch).physicalAddress, virtualAddress);
+
+    // MPP = U checks the page as a user access
+    mstatus.MPP(PrivilegeMode::User);
+    CHECK_EQ(translated(PrivilegeMode::Machine, Load).cause, TrapCause::LOAD_PAGE_FAULT);
+    mstatus.MPP(PrivilegeMode::Machine);
+    CHECK_EQ(translated(PrivilegeMode::Machine, Load).physicalAddress, virtualAddress);
+}
+
+// With updateAccessedDirty the walker sets A, and D on stores, in the leaf.
+// Without it a clear A, or a clear D on a store, is a page fault and the PTE
+// is left alone.
+template<typename XLEN_t, PagingMode mode>
+void TestAccessedDirty() {
+    using pte_t = typename pagingTraits<mode>::pte_t;
+    const __uint8_t clean = PTEBit::V | PTEBit::R | PTEBit::W;
+    tableMemory memory;
+    pte_t pte;
+
+    __uint64_t pteAddress = Map<mode>(memory, 0, 0, 9, clean);
+    translationResult result = Walk<XLEN_t, mode>(memory, 0, Load);
+    CHECK_EQ(result.cause, TrapCause::NONE);
+    CHECK_EQ(result.pteBits, clean | PTEBit::A);
+    memory.Read(pteAddress, pte);
+    CHECK_EQ(pte & 0xff, clean | PTEBit::A);
+    result = Walk<XLEN_t, mode>(memory, 0, Store);
+    CHECK_EQ(result.pteBits, clean | PTEBit::A | PTEBit::D);
+    memory.Read(pteAddress, pte);
+    CHECK_EQ(pte & 0xff, clean | PTEBit::A | PTEBit::D);
+    CHECK_EQ(pte >> 10, 9);
+    CHECK_EQ(memory.writes, 2);
+    Walk<XLEN_t, mode>(memory, 0, Store);
+    CHECK_EQ(memory.writes, 2);
+
+    pteAddress = Map<mode>(memory, 0, 0, 9, clean);
+    CHECK_EQ((Walk<XLEN_t, mode, false>(memory, 0, Load).cause), TrapCause::LOAD_PAGE_FAULT);
+    CHECK_EQ((Walk<XLEN_t, mode, false>(memory, 0, Fetch).cause), TrapCause::INSTRUCTION_PAGE_FAULT);
+    Map<mode>(memory, 0, 0, 9, clean | PTEBit::A);
+    CHECK_EQ((Walk<XLEN_t, mode, false>(memory, 0, Load).cause), TrapCause::NONE);
+    CHECK_EQ((Walk<XLEN_t, mode, false>(memory, 0, Store).cause), TrapCause::STORE_AMO_PAGE_FAULT);
+    Map<mode>(memory, 0, 0, 9, clean | PTEBit::A | PTEBit::D);
+    CHECK_EQ((Walk<XLEN_t, mode, false>(memory, 0, Store).cause), TrapCause::NONE);
+    CHECK_EQ(memory.writes, 0);
+}
+
+int main() {
+    TestLeafAtEveryLevel<__uint32_t, PagingMode::Sv32>();
+    TestLeafAtEveryLevel<__uint64_t, PagingMode::Sv39>();
+    TestLeafAtEveryLevel<__uint64_t, PagingMode::Sv48>();
+    TestMalformedLeaves<__uint32_t, PagingMode::Sv32>();
+    TestMalformedLeaves<__uint64_t, PagingMode::Sv39>();
+    TestMalformedLeaves<__uint64_t, PagingMode::Sv48>();
+    TestNonCanonical<PagingMode::Sv39>();
+    TestNonCanonical<PagingMode::Sv48>();
+    TestPrivilegeAndMXR();
+    TestMPRV<__uint32_t, PagingMode::Sv32>();
+    TestMPRV<__uint64_t, PagingMode::Sv39>();
+    TestAccessedDirty<__uint32_t, PagingMode::Sv32>();
+    TestAccessedDirty<__uint64_t, PagingMode::Sv48>();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,42 @@
+#include "PerformanceCounters.hpp"
+
+#include "Check.hpp"
+
+using namespace RISCV;
+
+// RV32 halves of instret are each read live; a lone high-half read long
+// after a low-half read sees the current value
+void TestRV32Halves() {
+    performanceCounters counters;
+    counters.Reset();
+    counters.SetValue(InstretCounter, 0xffffffff);
+    CHECK_EQ(counters.Read<__uint32_t>(CSRAddress::INSTRET), 0xffffffff);
+    CHECK_EQ(counters.Read<__uint32_t>(CSRAddress::INSTRETH), 0);
+    CHECK_EQ(counters.Read<__uint32_t>(CSRAddress::MINSTRET), 0xffffffff);
+    counters.Count<PerformanceEvent::InstructionsRetired>(1);
+    CHECK_EQ(counters.Read<__uint32_t>(CSRAddress::MINSTRETH), 1);
+    CHECK_EQ(counters.Read<__uint32_t>(CSRAddress::MINSTRET), 0);
+
+    counters.Write<__uint32_t>(CSRAddress::MINSTRETH, 5);
+    CHECK_EQ(counters.Value(InstretCounter), 0x500000000ull);
+}
+
+// An hpmcounter follows its selected event and stops while inhibited
+void TestEventCounting() {
+    performanceCounters counters;
+    counters.Reset();
+    counters.Write<__uint64_t>(CSRAddress::MHPMEVENT3, (unsigned int)PerformanceEvent::LoadsRetired);
+    CHECK(counters.Active(PerformanceEvent::LoadsRetired));
+    counters.Count<PerformanceEvent::LoadsRetired>(3);
+    CHECK_EQ(counters.Read<__uint64_t>(CSRAddress::MHPMCOUNTER3), 3);
+    counters.WriteInhibit(1u << 3);
+    counters.Count<PerformanceEvent::LoadsRetired>(4);
+    CHECK_EQ(counters.Read<__uint64_t>(CSRAddress::MHPMCOUNTER3), 3);
+    CHECK(!counters.Active(PerformanceEvent::LoadsRetired));
+}
+
+int main() {
+    TestRV32Halves();
+    TestEventCounting();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,214 @@
+#include "TLB.hpp"
+
+#include "Check.hpp"
+
+#include <cstring>
+#include <vector>
+
+using namespace RISCV;
+
+// An Sv39 table with the root in page 1, a level 1 table in page 2 and a
+// level 0 table in page 3, so the first 2 MiB of virtual space is mapped
+// with 4K pages and the next 2 MiB by one superpage.
+struct sv39Memory {
+
+    std::vector<__uint8_t> bytes = std::vector<__uint8_t>(4 * PageSize);
+
+    sv39Memory() {
+        Write(1 * PageSize, (__uint64_t)(2 << 10) | PTEBit::V);
+        Write(2 * PageSize, (__uint64_t)(3 << 10) | PTEBit::V);
+    }
+
+    template<typename T>
+    bool Read(__uint64_t physicalAddress, T& value) {
+        value = 0;
+        if (physicalAddress + sizeof(T) > bytes.size())
+            return false;
+        std::memcpy(&value, &bytes[physicalAddress], sizeof(T));
+        return true;
+    }
+
+    template<typename T>
+    bool Write(__uint64_t physicalAddress, T value) {
+        if (physicalAddress + sizeof(T) > bytes.size())
+            return false;
+        std::memcpy(&bytes[physicalAddress], &value, sizeof(T));
+        return true;
+    }
+
+    // Maps the 4K page at vpn to ppn
+    void Page(unsigned int vpn, __uint64_t ppn, __uint8_t bits) {
+        Write(3 * PageSize + vpn * 8, (ppn << 10) | bits);
+    }
+
+    __uint64_t PageBits(unsigned int vpn) {
+        __uint64_t pte;
+        Read(3 * PageSize + vpn * 8, pte);
+        return pte & 0xff;
+    }
+
+    // Maps the 2 MiB superpage at 0x200000 to ppn
+    void Superpage(__uint64_t ppn, __uint8_t bits) {
+        Write(2 * PageSize + 8, (ppn << 10) | bits);
+    }
+};
+
+constexpr __uint8_t Mapped = PTEBit::V | PTEBit::R | PTEBit::W | PTEBit::A | PTEBit::D;
+
+using tlb_t = tlb<__uint64_t>;
+
+struct fixture {
+    sv39Memory memory;
+    tlb_t buffer;
+    satpReg<__uint64_t> satp;
+    mstatusReg mstatus;
+
+    fixture() {
+        buffer.Reset();
+        satp.Reset();
+        satp.pagingMode = PagingMode::Sv39;
+        satp.ppn = 1;
+        mstatus.Reset<__uint64_t>();
+    }
+
+    translationResult Translate(__uint64_t virtualAddress, AccessType type = Load) {
+        return buffer.Translate(memory, satp, mstatus, PrivilegeMode::Supervisor, virtualAddress, type);
+    }
+
+    // The address the TLB hands back. After a fill, remapping the page in
+    // memory shows whether a later translation came from the TLB.
+    __uint64_t Address(__uint64_t virtualAddress) {
+        return Translate(virtualAddress).physicalAddress;
+    }
+};
+
+// The second translation of a page is a hit, and it does not look at the
+// page tables again. Superpages hit anywhere within them.
+void TestHitAfterFill() {
+    fixture f;
+    f.memory.Page(4, 0x40, Mapped);
+    CHECK_EQ(f.Address(0x4123), 0x40123);
+    CHECK_EQ(f.buffer.stats.misses, 1);
+    f.memory.Page(4, 0x50, Mapped);
+    CHECK_EQ(f.Address(0x4abc), 0x40abc);
+    CHECK_EQ(f.buffer.stats.hits, 1);
+    CHECK_EQ(f.buffer.stats.misses, 1);
+
+    f.memory.Superpage(0x400, Mapped);
+    translationResult result = f.Translate(0x200010);
+    CHECK_EQ(result.physicalAddress, 0x400010);
+    CHECK_EQ(result.pageShift, 21);
+    f.memory.Superpage(0x600, Mapped);
+    CHECK_EQ(f.Address(0x3ffff8), 0x5ffff8);
+    CHECK_EQ(f.buffer.stats.hits, 2);
+
+    // Permissions are checked on hits too
+    f.memory.Page(5, 0x41, PTEBit::V | PTEBit::R | PTEBit::A | PTEBit::U);
+    f.mstatus.SUM(true);
+    CHECK_EQ(f.Translate(0x5000).cause, TrapCause::NONE);
+    f.mstatus.SUM(false);
+    CHECK_EQ(f.Translate(0x5000).cause, TrapCause::LOAD_PAGE_FAULT);
+    CHECK_EQ(f.Translate(0x5000, Store).cause, TrapCause::STORE_AMO_PAGE_FAULT);
+}
+
+// An entry filled by a load with D clear does not satisfy a store: the
+// store walks again and the walker sets D
+void TestStoreToCleanPage() {
+    fixture f;
+    const __uint8_t clean = PTEBit::V | PTEBit::R | PTEBit::W | PTEBit::A;
+    f.memory.Page(6, 0x60, clean);
+    CHECK_EQ(f.Translate(0x6000).cause, TrapCause::NONE);
+    CHECK_EQ(f.Translate(0x6008).cause, TrapCause::NONE);
+    CHECK_EQ(f.buffer.stats.misses, 1);
+    CHECK_EQ(f.memory.PageBits(6), clean);
+
+    translationResult result = f.Translate(0x6010, Store);
+    CHECK_EQ(result.cause, TrapCause::NONE);
+    CHECK_EQ(result.pteBits & PTEBit::D, PTEBit::D);
+    CHECK_EQ(f.buffer.stats.misses, 2);
+    CHECK_EQ(f.memory.PageBits(6), clean | PTEBit::D);
+    CHECK_EQ(f.Translate(0x6018, Store).cause, TrapCause::NONE);
+    CHECK_EQ(f.buffer.stats.misses, 2);
+}
+
+// SFENCE.VMA with an address drops that page only; with an ASID it drops
+// that ASID's entries but keeps global ones; with neither it drops all
+void TestFence() {
+    fixture f;
+    f.memory.Page(1, 0x11, Mapped);
+    f.memory.Page(2, 0x12, Mapped);
+    f.memory.Page(3, 0x13, Mapped | PTEBit::G);
+    f.satp.asid = 1;
+    f.Address(0x1000);
+    f.Address(0x2000);
+    f.Address(0x3000);
+    f.satp.asid = 2;
+    f.Address(0x2000);
+    f.memory.Page(1, 0x21, Mapped);
+    f.memory.Page(2, 0x22, Mapped);
+    f.memory.Page(3, 0x23, Mapped | PTEBit::G);
+
+    // By address, every ASID
+    f.buffer.Fence(true, 0x2000, false, 0);
+    CHECK_EQ(f.Address(0x2000), 0x22000);
+    f.satp.asid = 1;
+    CHECK_EQ(f.Address(0x1000), 0x11000);
+    CHECK_EQ(f.Address(0x2000), 0x22000);
+    CHECK_EQ(f.Address(0x3000), 0x13000);
+
+    // By ASID
+    f.memory.Page(1, 0x31, Mapped);
+    f.memory.Page(2, 0x32, Mapped);
+    f.buffer.Fence(false, 0, true, 2);
+    CHECK_EQ(f.Address(0x1000), 0x11000);
+    f.buffer.Fence(false, 0, true, 1);
+    CHECK_EQ(f.Address(0x1000), 0x31000);
+    CHECK_EQ(f.Address(0x3000), 0x13000);
+    f.satp.asid = 2;
+    CHECK_EQ(f.Address(0x2000), 0x32000);
+
+    // By address and ASID leaves globals and other ASIDs
+    f.memory.Page(2, 0x42, Mapped);
+    f.buffer.Fence(true, 0x3000, true, 2);
+    f.buffer.Fence(true, 0x2000, true, 1);
+    CHECK_EQ(f.Address(0x3000), 0x13000);
+    CHECK_EQ(f.Address(0x2000), 0x32000);
+
+    // Everything
+    const __uint64_t flushed = f.buffer.stats.entriesFlushed;
+    f.buffer.Fence(false, 0, false, 0);
+    CHECK(f.buffer.stats.entriesFlushed > flushed);
+    CHECK_EQ(f.buffer.pageShiftsHeld, 0);
+    CHECK_EQ(f.Address(0x3000), 0x23000);
+    CHECK_EQ(f.Address(0x2000), 0x42000);
+    CHECK_EQ(f.buffer.stats.fences, 6);
+}
+
+// An entry filled under one ASID never answers for another, unless global
+void TestAsidIsolation() {
+    fixture f;
+    f.memory.Page(7, 0x70, Mapped);
+    f.memory.Page(8, 0x80, Mapped | PTEBit::G);
+    f.satp.asid = 3;
+    f.Address(0x7000);
+    f.Address(0x8000);
+    CHECK(f.buffer.Lookup(0x7000, 3) != nullptr);
+    CHECK(f.buffer.Lookup(0x7000, 4) == nullptr);
+    CHECK(f.buffer.Lookup(0x8000, 4) != nullptr);
+
+    f.memory.Page(7, 0x71, Mapped);
+    f.satp.asid = 4;
+    CHECK_EQ(f.Address(0x7000), 0x71000);
+    f.satp.asid = 3;
+    CHECK_EQ(f.Address(0x7000), 0x70000);
+    f.satp.asid = 4;
+    CHECK_EQ(f.Address(0x7000), 0x71000);
+}
+
+int main() {
+    TestHitAfterFill();
+    TestStoreToCleanPage();
+    TestFence();
+    TestAsidIsolation();
+    return CHECK_RESULT();
+}
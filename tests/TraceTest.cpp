@@ -0,0 +1,102 @@
+#include "Trace.hpp"
+
+#include "Check.hpp"
+
+using namespace RISCV;
+
+constexpr char tracePath[] = "TraceTest.rvtrace";
+constexpr __uint32_t nopWord = 0x00000013;
+
+// Payload bytes of the first block
+template<typename XLEN_t>
+__uint32_t firstBlockPayload(const traceReader<XLEN_t>& reader) {
+    traceBlockHeader header;
+    std::memcpy(&header, reader.base + sizeof(traceFileMagic) + 8, sizeof(header));
+    return header.payloadBytes;
+}
+
+// A backward jump on RV32 is a small negative delta, not a 32-bit one
+void TestRV32BackwardDelta() {
+    traceWriter<__uint32_t> writer;
+    CHECK(writer.Open(tracePath));
+    writer.Instruction(0x80000000, nopWord);
+    writer.Instruction(0x80000004, nopWord);
+    writer.Instruction(0x80000000, nopWord);
+    CHECK(writer.Close());
+
+    traceReader<__uint32_t> reader;
+    CHECK(reader.Open(tracePath));
+    // 0x80000000 from 0 is -2^31: tag, 5 varint bytes, word. Sequential:
+    // tag, word. Back by 8: tag, 1 varint byte, word.
+    CHECK_EQ(firstBlockPayload(reader), 10 + 5 + 6);
+    traceRecord<__uint32_t> record;
+    __uint32_t expected[] = { 0x80000000, 0x80000004, 0x80000000 };
+    for (__uint32_t pc : expected) {
+        CHECK(reader.Next(record));
+        CHECK(record.kind == TraceRecordKind::Instruction);
+        CHECK_EQ(record.pc, pc);
+        CHECK_EQ(record.word, nopWord);
+    }
+    CHECK(!reader.Next(record));
+    reader.Close();
+    ::unlink(tracePath);
+}
+
+// Every varint length, either side of each boundary
+void TestVarints() {
+    __uint8_t bytes[32] = {};
+    for (unsigned int bits = 0; bits <= 64; bits++) {
+        __uint64_t top = bits == 64 ? ~0ull : (1ull << bits) - 1;
+        for (__uint64_t value : std::initializer_list<__uint64_t>{ top, top + 1, top >> 1 }) {
+            __uint64_t length = detail::putTaggedVarint(bytes, 0x5a, value);
+            CHECK_EQ(bytes[0], 0x5a);
+            __uint64_t decoded;
+            CHECK(detail::getVarint(bytes + 1, decoded) == bytes + 1 + length);
+            CHECK_EQ(decoded, value);
+            CHECK_EQ(length, value < (1ull << 56) ? (64 - __builtin_clzll(value | 1) + 6) / 7 : 9);
+        }
+    }
+}
+
+// Enough records for several blocks, read back through Seek()
+void TestSeek() {
+    constexpr __uint64_t count = 600000;
+    traceWriter<__uint64_t> writer;
+    CHECK(writer.Open(tracePath));
+    for (__uint64_t i = 0; i < count; i++) {
+        writer.Instruction(0x80000000 + (i % 1000) * 4, nopWord);
+        writer.Writeback(1 + i % 31, i * 0x9e3779b97f4a7c15ull);
+    }
+    writer.Trap(false, TrapCause::ECALL_FROM_U_MODE, PrivilegeMode::User, PrivilegeMode::Machine);
+    CHECK(writer.Close());
+
+    traceReader<__uint64_t> reader;
+    CHECK(reader.Open(tracePath));
+    CHECK_EQ(reader.InstructionCount(), count);
+    CHECK(reader.footer.blockCount > 1);
+    traceRecord<__uint64_t> record;
+    for (__uint64_t i : std::initializer_list<__uint64_t>{ 0, 1, 299999, 500000, count - 1 }) {
+        CHECK(reader.Seek(i));
+        CHECK(reader.Next(record));
+        CHECK_EQ(record.pc, 0x80000000 + (i % 1000) * 4);
+        CHECK(reader.Next(record));
+        CHECK(record.kind == TraceRecordKind::Writeback);
+        CHECK_EQ(record.reg, 1 + i % 31);
+        CHECK_EQ(record.value, i * 0x9e3779b97f4a7c15ull);
+    }
+    CHECK(reader.Next(record));
+    CHECK(record.kind == TraceRecordKind::Trap);
+    CHECK(record.cause == TrapCause::ECALL_FROM_U_MODE);
+    CHECK(record.to == PrivilegeMode::Machine);
+    CHECK(!reader.Next(record));
+    CHECK(!reader.Seek(count));
+    reader.Close();
+    ::unlink(tracePath);
+}
+
+int main() {
+    TestVarints();
+    TestRV32BackwardDelta();
+    TestSeek();
+    return CHECK_RESULT();
+}